@@ -277,3 +277,16 @@ public extension Array where Element == UInt8 {
         return result
     }
 }
+
+public extension Sequence where Element == UInt8 {
+    /// - Returns: the 64 bit FNV-1a hash of the bytes. Unlike `Hasher`,
+    /// which is seeded differently in each process, the hash is stable,
+    /// so it can identify values that are stored on disk.
+    @inlinable func fnv1a() -> UInt64 {
+        var hash: UInt64 = 0xcbf29ce484222325
+        for byte in self {
+            hash = (hash ^ UInt64(byte)) &* 0x100000001b3
+        }
+        return hash
+    }
+}
@@ -59,7 +59,7 @@ public protocol _Logging {
   ///   mainly for creating message partitions i.e. "---------"
   func diagnostic(
     _ category: LogCategory,
-    _ message: String,
+    _ message: @autoclosure () -> String,
     categories: LogCategories,
     indent: Int,
     trailing: String,
@@ -97,12 +97,13 @@ extension _Logging {
   #if DEBUG
     @inlinable public func diagnostic(
       _ category: LogCategory,
-      _ message: String,
+      _ message: @autoclosure () -> String,
       categories: LogCategories,
       indent: Int = 0,
       trailing: String = "",
       minCount: Int = 80
     ) {
+      traceLabel(category, message)
       guard willLog(level: .diagnostic) else { return }
       // if subcategories have been selected on the logWriter object
       // then make sure the caller's category is desired
@@ -114,33 +115,49 @@ extension _Logging {
 
       logWriter.write(
         level: .diagnostic,
-        message: "\(category)\(message)",
+        message: "\(category)\(message())",
         nestingLevel: indent + logNestingLevel,
         trailing: trailing, minCount: minCount)
     }
   #else
     @inlinable public func diagnostic(
       _ category: LogCategory,
-      _ message: String,
+      _ message: @autoclosure () -> String,
       categories: LogCategories,
       indent: Int = 0,
       trailing: String = "",
       minCount: Int = 80
-    ) {}
+    ) {
+      traceLabel(category, message)
+    }
   #endif
+
+  //--------------------------------------------------------------------------
+  // the diagnostic issued when an op is queued names it in the trace,
+  // so the message is only formatted when tracing is enabled
+  @inlinable func traceLabel(
+    _ category: LogCategory,
+    _ message: () -> String
+  ) {
+    if Tracer.shared.isEnabled
+      && (category == .queueCpu || category == .queueGpu)
+    {
+      Tracer.shared.label(message())
+    }
+  }
 }
 
 // convenience helper for top level output
 @inlinable public func diagnostic(
   _ category: LogCategory,
-  _ message: String,
+  _ message: @autoclosure () -> String,
   categories: LogCategories,
   indent: Int = 0,
   trailing: String = "",
   minCount: Int = 80
 ) {
   currentQueue.diagnostic(
-    category, message, categories: categories,
+    category, message(), categories: categories,
     indent: indent, trailing: trailing, minCount: minCount)
 }
 
@@ -0,0 +1,383 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Dispatch
+import Foundation
+
+//==============================================================================
+/// TraceCategory
+/// the kind of work a trace event measures
+public enum TraceCategory: String {
+  /// an op executed by a queue
+  case op
+  /// a copy between device buffers
+  case copy
+  /// a storage migration to the replica used by a queue. The copies are
+  /// asynchronous, so the event measures the time to enqueue them.
+  case migrate
+  /// a queue waiting for an event
+  case sync
+}
+
+//==============================================================================
+/// TraceEvent
+/// the span of one unit of work on a queue
+public struct TraceEvent {
+  /// the op or copy name, such as `add`
+  public let name: String
+  /// the kind of work
+  public let category: TraceCategory
+  /// the full diagnostic description of the work
+  public let detail: String
+  /// the id of the queue that executed the work
+  public let queueId: Int
+  /// the name of the queue that executed the work
+  public let queueName: String
+  /// the id the tracer assigned to the executing thread
+  public let threadId: Int
+  /// the time the work started in nanoseconds since the tracer origin
+  public let begin: UInt64
+  /// the time the work finished in nanoseconds since the tracer origin
+  public let end: UInt64
+  /// the tensors accessed by the work, such as `a[2, 3]`
+  public let operands: [String]
+  /// the number of bytes read and written
+  public let bytes: Int
+
+  /// the duration of the work in nanoseconds
+  @inlinable public var duration: UInt64 { end - begin }
+}
+
+//==============================================================================
+/// TracedOp
+/// the description of an op collected on the calling thread between the
+/// op's diagnostic label and its dispatch to a queue
+public struct TracedOp {
+  public var name: String
+  public var detail: String
+  public var operands: [String]
+  public var bytes: Int
+
+  @inlinable public init(
+    name: String = "",
+    detail: String = "",
+    bytes: Int = 0
+  ) {
+    self.name = name
+    self.detail = detail
+    self.operands = []
+    self.bytes = bytes
+  }
+}
+
+//==============================================================================
+/// Tracer
+/// Records the begin and end time of the ops and copies executed by the
+/// device queues, and exports them in the Chrome trace event format, which
+/// can be viewed with `chrome://tracing` or Perfetto.
+///
+/// Each thread records into its own fixed size ring buffer, so recording
+/// doesn't contend with other threads and a long run keeps the most
+/// recent events. When tracing is disabled the only cost is testing
+/// `isEnabled`.
+///
+/// Ops are named by the queue diagnostic issued when an op is queued, and
+/// the tensors the op reads and writes before it is dispatched are
+/// recorded as its operands. Tensors accessed outside of a labeled op,
+/// such as by the application, aren't recorded.
+public final class Tracer {
+  /// the tracer used by the device queues
+  public static let shared = Tracer()
+
+  /// `true` to record events. This can be changed at any time.
+  public var isEnabled = false
+  /// the number of events kept by each thread. Changes apply to buffers
+  /// created after the next `clear`.
+  public var bufferCapacity = 16 * 1024
+  /// the time events are measured from
+  public let origin: UInt64
+
+  let mutex = Mutex()
+  var buffers: [TraceBuffer] = []
+  var generation = 0
+  var nextThreadId = 0
+  let bufferKey = "SwiftRT.Tracer.\(Platform.objectId.next)"
+
+  //--------------------------------------------------------------------------
+  public init() {
+    origin = DispatchTime.now().uptimeNanoseconds
+  }
+
+  /// the current time in nanoseconds since `origin`
+  @inlinable public var now: UInt64 {
+    DispatchTime.now().uptimeNanoseconds - origin
+  }
+
+  //--------------------------------------------------------------------------
+  /// label(_:
+  /// starts describing the next op dispatched by the calling thread
+  /// - Parameter message: the queue diagnostic of the op, such as
+  ///   `add(a, b) on cpu:0`. The text before the first parenthesis or
+  ///   space is the op name.
+  public func label(_ message: String) {
+    let name = message.prefix { $0 != "(" && $0 != " " }
+    let buffer = threadBuffer
+    buffer.pending = TracedOp(name: String(name), detail: message)
+    buffer.isLabeled = true
+  }
+
+  //--------------------------------------------------------------------------
+  /// operand(_:bytes:
+  /// adds a tensor accessed by the op being described on this thread.
+  /// It is ignored when no op is being described.
+  public func operand(_ description: String, bytes: Int) {
+    let buffer = threadBuffer
+    guard buffer.isLabeled else { return }
+    buffer.pending.operands.append(description)
+    buffer.pending.bytes += bytes
+  }
+
+  //--------------------------------------------------------------------------
+  /// takeOp(_:
+  /// - Parameter function: the name used when the op wasn't labeled
+  /// - Returns: the op described on this thread, which is reset
+  public func takeOp(_ function: StaticString) -> TracedOp {
+    let buffer = threadBuffer
+    var op = buffer.pending
+    buffer.pending = TracedOp()
+    buffer.isLabeled = false
+    if op.name.isEmpty {
+      op.name = "\(function)"
+      op.detail = op.name
+    }
+    return op
+  }
+
+  //--------------------------------------------------------------------------
+  /// record
+  /// adds an event to the calling thread's buffer
+  public func record(
+    _ op: TracedOp,
+    _ category: TraceCategory,
+    queueId: Int,
+    queueName: String,
+    begin: UInt64,
+    end: UInt64
+  ) {
+    let buffer = threadBuffer
+    buffer.append(
+      TraceEvent(
+        name: op.name, category: category, detail: op.detail,
+        queueId: queueId, queueName: queueName, threadId: buffer.threadId,
+        begin: begin, end: end, operands: op.operands, bytes: op.bytes))
+  }
+
+  //--------------------------------------------------------------------------
+  /// trace(_:_:queueId:queueName:body:
+  /// runs `body` and records it as an event
+  @inlinable public func trace<R>(
+    _ op: TracedOp,
+    _ category: TraceCategory,
+    queueId: Int,
+    queueName: String,
+    _ body: () throws -> R
+  ) rethrows -> R {
+    let begin = now
+    defer {
+      record(
+        op, category, queueId: queueId, queueName: queueName,
+        begin: begin, end: now)
+    }
+    return try body()
+  }
+
+  //--------------------------------------------------------------------------
+  /// events
+  /// the events recorded by all threads ordered by begin time
+  public var events: [TraceEvent] {
+    let all = mutex.access { buffers }
+    return all.flatMap { $0.snapshot() }.sorted { $0.begin < $1.begin }
+  }
+
+  //--------------------------------------------------------------------------
+  /// clear
+  /// discards the recorded events. Buffers of threads that have exited
+  /// are released, and the others are replaced on their next event.
+  public func clear() {
+    mutex.access {
+      buffers = []
+      generation += 1
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// chromeTrace
+  /// - Returns: the recorded events in the Chrome trace event format.
+  ///   Each queue is shown as a thread of the process of its device.
+  public func chromeTrace() throws -> Data {
+    let events = self.events
+    var queues: [Int: String] = [:]
+    var traceEvents: [[String: Any]] = []
+    traceEvents.reserveCapacity(events.count + 8)
+
+    for event in events {
+      queues[event.queueId] = event.queueName
+      var args: [String: Any] = [
+        "detail": event.detail,
+        "thread": event.threadId,
+      ]
+      if !event.operands.isEmpty { args["operands"] = event.operands }
+      if event.bytes > 0 { args["bytes"] = event.bytes }
+
+      traceEvents.append([
+        "name": event.name,
+        "cat": event.category.rawValue,
+        "ph": "X",
+        "ts": Double(event.begin) / 1000,
+        "dur": Double(event.duration) / 1000,
+        "pid": 0,
+        "tid": event.queueId,
+        "args": args,
+      ])
+    }
+
+    // name the timeline rows after the queues
+    for (id, name) in queues {
+      traceEvents.append([
+        "name": "thread_name", "ph": "M", "pid": 0, "tid": id,
+        "args": ["name": name],
+      ])
+    }
+
+    return try JSONSerialization.data(
+      withJSONObject: ["traceEvents": traceEvents, "displayTimeUnit": "ns"])
+  }
+
+  //--------------------------------------------------------------------------
+  /// exportChromeTrace(to:
+  /// writes the recorded events to a Chrome trace json file
+  public func exportChromeTrace(to path: String) throws {
+    try chromeTrace().write(to: URL(fileURLWithPath: path), options: .atomic)
+  }
+
+  //--------------------------------------------------------------------------
+  /// the buffer of the calling thread, which is created on first use
+  var threadBuffer: TraceBuffer {
+    let dictionary = Thread.current.threadDictionary
+    if let buffer = dictionary[bufferKey] as? TraceBuffer,
+      buffer.generation == generation
+    {
+      return buffer
+    }
+    let buffer = mutex.access { () -> TraceBuffer in
+      nextThreadId += 1
+      let buffer = TraceBuffer(
+        threadId: nextThreadId, generation: generation,
+        capacity: bufferCapacity)
+      buffers.append(buffer)
+      return buffer
+    }
+    dictionary[bufferKey] = buffer
+    return buffer
+  }
+}
+
+//==============================================================================
+/// TraceBuffer
+/// The ring buffer of events recorded by one thread. Only the owning
+/// thread appends, so its lock is only contended while events are read.
+final class TraceBuffer {
+  let threadId: Int
+  let generation: Int
+  let capacity: Int
+  let mutex = Mutex()
+  var events: [TraceEvent] = []
+  var next = 0
+  /// the op being described on the owning thread
+  var pending = TracedOp()
+  /// `true` from when an op is labeled until it is dispatched
+  var isLabeled = false
+
+  init(threadId: Int, generation: Int, capacity: Int) {
+    self.threadId = threadId
+    self.generation = generation
+    self.capacity = Swift.max(1, capacity)
+  }
+
+  func append(_ event: TraceEvent) {
+    mutex.access {
+      if events.count < capacity {
+        events.append(event)
+      } else {
+        // overwrite the oldest event
+        events[next] = event
+        next = (next + 1) % capacity
+      }
+    }
+  }
+
+  /// the events in the order they were recorded
+  func snapshot() -> [TraceEvent] {
+    mutex.access { Array(events[next...] + events[..<next]) }
+  }
+}
+
+//==============================================================================
+// DeviceQueue tracing
+extension DeviceQueue {
+  //--------------------------------------------------------------------------
+  /// cpu_execute(_:bytes:function:_:
+  /// runs `body` on this queue, synchronously or in stream order
+  /// depending on the queue `mode`, and records it when tracing is enabled
+  /// - Parameters:
+  ///  - category: the kind of work. Ops take the description collected
+  ///    on the dispatching thread, and other work is named by category.
+  ///  - bytes: the number of bytes moved, if not known from the operands
+  ///  - function: the op name used when the op wasn't labeled by a
+  ///    queue diagnostic
+  ///  - body: the work to run
+  @inlinable public func cpu_execute(
+    _ category: TraceCategory = .op,
+    bytes: Int = 0,
+    function: StaticString = #function,
+    _ body: @escaping () -> Void
+  ) {
+    guard Tracer.shared.isEnabled else {
+      if mode == .sync {
+        body()
+      } else {
+        queue.async(group: group) { body() }
+      }
+      return
+    }
+
+    // the op is described by the dispatching thread
+    var op = category == .op
+      ? Tracer.shared.takeOp(function)
+      : TracedOp(name: category.rawValue, detail: "\(function)")
+    op.bytes += bytes
+    let (id, name) = (self.id, self.name)
+    func traced() {
+      Tracer.shared.trace(op, category, queueId: id, queueName: name, body)
+    }
+
+    if mode == .sync {
+      traced()
+    } else {
+      queue.async(group: group) { traced() }
+    }
+  }
+}
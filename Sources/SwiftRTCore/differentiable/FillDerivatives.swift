@@ -74,23 +74,12 @@ import _Differentiation
 where E.Value: DifferentiableNumeric {
   let axis = axis < 0 ? axis + S.rank : axis
   let value = gather(from: tensor, indices: indices, axis: axis)
-  let shape = tensor.shape
+  let (shape, order) = (tensor.shape, tensor.order)
   return (
     value,
     {
-      var result = Tensor<S, E>(zeros: shape, order: tensor.order)
-      var rlower = S.zero
-      var tlower = S.zero
-      var rupper = shape
-      var tupper = shape
-      for (ti, ri) in indices.enumerated() {
-        rlower[axis] = Int(ri)
-        rupper[axis] = rlower[axis] + 1
-        tlower[axis] = Int(ti)
-        tupper[axis] = tlower[axis] + 1
-        result[rlower, rupper] = $0[tlower, tupper]
-      }
-      return result
+      // repeated indices accumulate their gradients
+      scatterAdd($0, indices: indices, axis: axis, shape: shape, order: order)
     }
   )
 }
@@ -436,6 +436,22 @@ where E.Value: DifferentiableNumeric & Real {
   )
 }
 
+@derivative(of:gelu)
+@usableFromInline func _derivativeGelu<S, E>(
+  _ x: Tensor<S, E>
+) -> (value: Tensor<S, E>, pullback: (Tensor<S, E>) -> Tensor<S, E>)
+where E.Value: DifferentiableNumeric & Real {
+  (
+    gelu(x),
+    { v in
+      // Φ(x) + x * φ(x)
+      let cdf = (1 + erf(x / E.Value.sqrt(2))) / 2
+      let pdf = exp(-(x * x) / 2) / E.Value.sqrt(2 * E.Value.pi)
+      return v * (cdf + x * pdf)
+    }
+  )
+}
+
 @derivative(of:tan)
 @usableFromInline func _derivativeTan<S, E>(
   _ x: Tensor<S, E>
@@ -17,6 +17,11 @@
 //==============================================================================
 /// gather(from:indices:axis:
 /// consolidates the specified slices
+/// - Parameters:
+///  - tensor: the tensor to gather slices from
+///  - indices: the indices of the slices along `axis`, which can repeat
+///  - axis: the axis to gather along. Negative values count from the end.
+/// - Returns: a tensor with `indices.count` slices along `axis`
 @inlinable public func gather<S, E>(
   from tensor: Tensor<S, E>,
   indices: TensorR1<DeviceIndex>,
@@ -26,18 +31,7 @@
   var shape = tensor.shape
   shape[axis] = indices.count
   var result = Tensor<S, E>(shape: shape, order: tensor.order)
-  var rlower = S.zero
-  var tlower = S.zero
-  var rupper = tensor.shape
-  var tupper = tensor.shape
-
-  for (ri, ti) in indices.enumerated() {
-    rlower[axis] = Int(ri)
-    rupper[axis] = rlower[axis] + 1
-    tlower[axis] = Int(ti)
-    tupper[axis] = tlower[axis] + 1
-    result[rlower, rupper] = tensor[tlower, tupper]
-  }
+  currentQueue.gather(from: tensor, indices: indices, axis: axis, into: &result)
   return result
 }
 
@@ -49,3 +43,116 @@ extension Tensor {
     gather(from: self, indices: indices, axis: axis)
   }
 }
+
+//==============================================================================
+/// scatterAdd(_:indices:axis:into:
+/// adds the slices of `updates` along `axis` to the slices of `tensor`
+/// selected by `indices`. Slices with the same index are summed before
+/// they are added, so each slice of `tensor` is written once.
+/// - Parameters:
+///  - updates: the slices to add, with `indices.count` slices along `axis`
+///  - indices: the index in `tensor` of each slice, which can repeat
+///  - axis: the axis to scatter along. Negative values count from the end.
+///  - tensor: the tensor the slices are added to
+@inlinable public func scatterAdd<S, E>(
+  _ updates: Tensor<S, E>,
+  indices: TensorR1<DeviceIndex>,
+  axis: Int = 0,
+  into tensor: inout Tensor<S, E>
+) where E.Value: Numeric {
+  let axis = axis < 0 ? axis + S.rank : axis
+  currentQueue.scatterAdd(updates, indices: indices, axis: axis, into: &tensor)
+}
+
+/// scatterAdd(_:indices:axis:shape:order:
+/// - Returns: a tensor of zeros with the slices of `updates` added at
+///   `indices`, which is the pullback of `gather`
+@inlinable public func scatterAdd<S, E>(
+  _ updates: Tensor<S, E>,
+  indices: TensorR1<DeviceIndex>,
+  axis: Int = 0,
+  shape: S,
+  order: Order = .defaultOrder
+) -> Tensor<S, E> where E.Value: Numeric {
+  var result = Tensor<S, E>(zeros: shape, order: order)
+  scatterAdd(updates, indices: indices, axis: axis, into: &result)
+  return result
+}
+
+//==============================================================================
+/// SparseRows
+/// A tensor that is zero except for the rows at `indices` along axis 0,
+/// stored as just those rows. The gradient of an embedding table only has
+/// rows for the indices that were looked up, which are usually a small
+/// fraction of the table.
+public struct SparseRows<S: TensorShape, E: StorageElement> {
+  /// the distinct row indices in ascending order
+  public let indices: TensorR1<DeviceIndex>
+  /// the rows, where row `i` is the row at `indices[i]`
+  public var rows: Tensor<S, E>
+  /// the shape of the dense tensor
+  public let shape: S
+
+  @inlinable public init(
+    indices: TensorR1<DeviceIndex>,
+    rows: Tensor<S, E>,
+    shape: S
+  ) {
+    assert(rows.shape[0] == indices.count, "there must be a row per index")
+    self.indices = indices
+    self.rows = rows
+    self.shape = shape
+  }
+}
+
+extension SparseRows where E.Value: Numeric {
+  /// the dense tensor
+  @inlinable public var dense: Tensor<S, E> {
+    scatterAdd(rows, indices: indices, shape: shape, order: rows.order)
+  }
+
+  /// add(to:scale:
+  /// adds the rows scaled by `scale` to the same rows of `tensor`, such
+  /// as a sparse gradient step on an embedding table. Only the rows at
+  /// `indices` are written.
+  /// - Parameters:
+  ///  - tensor: the dense tensor to update
+  ///  - scale: the factor applied to the rows
+  @inlinable public func add(to tensor: inout Tensor<S, E>, scale: E.Value) {
+    assert(tensor.shape == shape, "tensor shape must equal the dense shape")
+    scatterAdd(rows * scale, indices: indices, into: &tensor)
+  }
+}
+
+//==============================================================================
+/// segmentSum(_:indices:rows:
+/// sums the rows of `updates` with the same index, which is a scatter add
+/// into a tensor of zeros that only stores the rows that were added to
+/// - Parameters:
+///  - updates: the rows to sum along axis 0
+///  - indices: the destination row of each update row
+///  - rows: the number of rows in the dense tensor
+/// - Returns: the sum of the updates for each distinct index
+@inlinable public func segmentSum<S, E>(
+  _ updates: Tensor<S, E>,
+  indices: TensorR1<DeviceIndex>,
+  rows: Int
+) -> SparseRows<S, E> where E.Value: Numeric {
+  // the number of distinct indices is the result shape, so the indices
+  // are grouped before the sum is queued
+  let segments = usingSyncQueue { ScatterSegments(indices.elements) }
+  if let first = segments.rows.first, let last = segments.rows.last {
+    precondition(first >= 0 && last < rows, "segment index out of range")
+  }
+  let count = segments.rows.count
+  var shape = updates.shape
+  shape[0] = count
+  var result = Tensor<S, E>(shape: shape, order: updates.order)
+  currentQueue.segmentSum(updates, segments: segments, into: &result)
+
+  var dense = updates.shape
+  dense[0] = rows
+  return SparseRows(
+    indices: TensorR1(segments.rows.map { DeviceIndex($0) }, shape: Shape1(count)),
+    rows: result, shape: dense)
+}
@@ -410,6 +410,15 @@ extension Tensor where TensorElement.Value: Comparable & SignedNumeric {
   return out
 }
 
+@inlinable public func cast<S, E, OE>(
+  _ tensor: Tensor<S, E>,
+  elementsTo type: OE.Type
+) -> Tensor<S, OE> where E.Value: BinaryFloatingPoint, OE.Value: BinaryFloatingPoint {
+  var out = Tensor<S, OE>(shape: tensor.shape, order: tensor.order)
+  currentQueue.cast(from: tensor, to: &out)
+  return out
+}
+
 @inlinable public func cast<S, E, OE>(
   _ tensor: Tensor<S, E>,
   elementsTo type: OE.Type
@@ -839,6 +848,28 @@ extension Tensor where TensorElement.Value: Real {
   @inlinable public func sigmoid() -> Self { sign(self) }
 }
 
+//==============================================================================
+/// gelu(x)
+/// computes the Gaussian error linear unit of `x`, which is
+/// `x / 2 * (1 + erf(x / sqrt(2)))`
+/// - Parameter x: value tensor
+/// - Returns: out
+@inlinable public func gelu<S, E>(
+  _ x: Tensor<S, E>
+) -> Tensor<S, E> where E.Value: Real {
+  var out = Tensor(like: x)
+  currentQueue.gelu(x, &out)
+  return out
+}
+
+// Tensor extension
+extension Tensor where TensorElement.Value: Real {
+  // make glboal function visible for extension implementations
+  @inlinable public func gelu(_ x: Self) -> Self { SwiftRTCore.gelu(x) }
+
+  @inlinable public func gelu() -> Self { gelu(self) }
+}
+
 //==============================================================================
 /// tan(x)
 /// computes the tangent of `x`
@@ -15,6 +15,7 @@
 //
 
 import Foundation
+import Numerics
 
 //==============================================================================
 /// matmul
@@ -67,7 +68,65 @@ import Foundation
     order: lhs.order)
   //    let op = currentQueue.matmul2(type: E.self)
   //    op.forward(lhs, transposeLhs, rhs, transposeRhs, &result)
-  currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs, &result)
+  // the bias is added in the gemm epilogue instead of another pass
+  let blocking = CpuGemmBlocking.plan(
+    for: E.self, m: lhsShape[0], k: lhsShape[1], n: rhsShape[1])
+  let packed = PackedMatrix(rhs, transposed: transposeRhs, blocking: blocking)
+  currentQueue.matmul(lhs, transposeLhs, packed, bias, &result)
+  return result
+}
+
+//==============================================================================
+/// matmul
+/// performs a matrix cross product with a right hand matrix that has
+/// already been packed. This avoids repacking `rhs` on every call when the
+/// same matrix is used repeatedly, for example a layer weight.
+/// - Parameters:
+///  - lhs: left hand tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: the packed right hand matrix
+/// - Returns: a new tensor containing the result
+@inlinable public func matmul<E>(
+  _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+  _ rhs: PackedMatrix<E>
+) -> TensorR2<E> where E: StorageElement, E.Value: StorageElement & Numeric {
+  let lhsShape = transposeLhs ? lhs.shape.t : lhs.shape
+  assert(lhsShape[1] == rhs.rows, "matmul inner dimensions must be equal")
+  var result = TensorR2<E>(
+    shape: Shape2(lhsShape[0], rhs.cols),
+    order: lhs.order)
+
+  currentQueue.matmul(lhs, transposeLhs, rhs, &result)
+  return result
+}
+
+//==============================================================================
+/// matmul
+/// performs a matrix cross product with a packed right hand matrix, adds
+/// `bias` to each row and applies `activation`. The bias and activation
+/// are fused into the gemm epilogue, so they are applied to each result
+/// block while it is still in cache instead of making separate passes
+/// over the result.
+/// - Parameters:
+///  - lhs: left hand tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: the packed right hand matrix
+///  - bias: the values added to each row of the product
+///  - activation: the activation applied to the biased product
+/// - Returns: a new tensor containing the result
+@inlinable public func matmul<E>(
+  _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+  _ rhs: PackedMatrix<E>,
+  bias: TensorR1<E>?,
+  activation: ActivationType = .identity
+) -> TensorR2<E> where E: StorageElement, E.Value: StorageElement & Real {
+  let lhsShape = transposeLhs ? lhs.shape.t : lhs.shape
+  assert(lhsShape[1] == rhs.rows, "matmul inner dimensions must be equal")
+  var result = TensorR2<E>(
+    shape: Shape2(lhsShape[0], rhs.cols),
+    order: lhs.order)
+
+  currentQueue.matmul(lhs, transposeLhs, rhs, bias, activation, &result)
   return result
 }
 
@@ -56,7 +56,7 @@ public enum PoolingOp: Int, Codable {
   strides: S = S.one,
   padding: S = S.zero,
   op: PoolingOp
-) -> Tensor<S, E> where E: Numeric {
+) -> Tensor<S, E> where E.Value: Comparable & AlgebraicField {
   let config = PoolingConfig(
     x: x, windowSize: windowSize,
     strides: strides, padding: padding, op: op)
@@ -72,7 +72,7 @@ public enum PoolingOp: Int, Codable {
   strides: S.Tuple = S.oneTuple,
   padding: S.Tuple = S.zeroTuple,
   op: PoolingOp
-) -> Tensor<S, E> where E: Numeric {
+) -> Tensor<S, E> where E.Value: Comparable & AlgebraicField {
   return pool(
     x: x, windowSize: S(windowSize), strides: S(strides),
     padding: S(padding), op: op)
@@ -14,8 +14,57 @@
 // limitations under the License.
 //
 
+import Foundation
 import Numerics
 
+//==============================================================================
+/// ReductionMode
+/// Selects how the partial results of sum, mean, abssum and prod are
+/// associated.
+public enum ReductionMode {
+  /// partial results follow the division of the work between the cores,
+  /// so the low order bits of a floating point result can vary with the
+  /// number of cores
+  case fast
+  /// the reduced elements are split into fixed size blocks, and the block
+  /// results are combined by a fixed pairwise tree, so the result is the
+  /// same for any number of workers
+  case reproducible
+  /// `reproducible` with Kahan compensated summation within each block
+  case compensated
+}
+
+/// the reduction mode used by the current thread when none is specified.
+/// Each thread has its own setting, so threads selecting different modes
+/// don't race. The mode is read when an operation is queued, so it also
+/// applies to operations that complete asynchronously.
+public var reductionMode: ReductionMode {
+  get {
+    Thread.current.threadDictionary[reductionModeKey] as? ReductionMode
+      ?? .fast
+  }
+  set { Thread.current.threadDictionary[reductionModeKey] = newValue }
+}
+
+/// the thread dictionary key of the current thread's reduction mode
+@usableFromInline let reductionModeKey = "SwiftRT.reductionMode"
+
+/// using(reductionMode:_:
+/// selects the reduction mode of the current thread for the operations
+/// within the scope of the body
+/// - Parameters:
+///  - mode: the reduction mode to use
+///  - body: a closure where the reduction mode will be used
+@inlinable public func using<R>(
+  reductionMode mode: ReductionMode,
+  _ body: () throws -> R
+) rethrows -> R {
+  let previous = reductionMode
+  reductionMode = mode
+  defer { reductionMode = previous }
+  return try body()
+}
+
 //==============================================================================
 /// all(x:axis:
 /// Returns `true` if all values are equal to `true` along the specified
@@ -99,10 +148,25 @@ extension Tensor where TensorElement == Bool {
 @inlinable public func sum<S, E>(
   _ x: Tensor<S, E>,
   axis: Int? = nil
+) -> Tensor<S, E> where E.Value: Numeric {
+  sum(x, axis: axis, mode: reductionMode)
+}
+
+/// sum(x:axis:mode:
+/// Sums `x` along the specified axis using the specified reduction mode
+/// - Parameters:
+///  - x: value tensor
+///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+///  - mode: how the partial results are associated
+/// - Returns: result
+@inlinable public func sum<S, E>(
+  _ x: Tensor<S, E>,
+  axis: Int? = nil,
+  mode: ReductionMode
 ) -> Tensor<S, E> where E.Value: Numeric {
   let shape = axis == nil ? S.one : x.reductionShape(axis!)
   var out = Tensor<S, E>(shape: shape)
-  currentQueue.sum(x, axis, &out)
+  currentQueue.sum(x, axis, &out, mode)
   return out
 }
 
@@ -120,6 +184,14 @@ extension Tensor where Element: Numeric {
   @inlinable public func sum(axis: Int? = nil) -> Self {
     SwiftRTCore.sum(self, axis: axis)
   }
+
+  /// - Parameters:
+  ///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+  ///  - mode: how the partial results are associated
+  /// - Returns: a new tensor containing the out
+  @inlinable public func sum(axis: Int? = nil, mode: ReductionMode) -> Self {
+    SwiftRTCore.sum(self, axis: axis, mode: mode)
+  }
 }
 
 //==============================================================================
@@ -134,10 +206,25 @@ extension Tensor where Element: Numeric {
 @inlinable public func mean<S, E>(
   _ x: Tensor<S, E>,
   axis: Int? = nil
+) -> Tensor<S, E> where E.Value: AlgebraicField {
+  mean(x, axis: axis, mode: reductionMode)
+}
+
+/// mean(x:axis:mode:
+/// mean of `x` along the specified axis using the specified reduction mode
+/// - Parameters:
+///  - x: value tensor
+///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+///  - mode: how the partial results are associated
+/// - Returns: result
+@inlinable public func mean<S, E>(
+  _ x: Tensor<S, E>,
+  axis: Int? = nil,
+  mode: ReductionMode
 ) -> Tensor<S, E> where E.Value: AlgebraicField {
   let shape = axis == nil ? S.one : x.reductionShape(axis!)
   var out = Tensor<S, E>(shape: shape)
-  currentQueue.mean(x, axis, &out)
+  currentQueue.mean(x, axis, &out, mode)
   return out
 }
 
@@ -155,6 +242,14 @@ extension Tensor where TensorElement.Value: AlgebraicField {
   @inlinable public func mean(axis: Int? = nil) -> Self {
     SwiftRTCore.mean(self, axis: axis)
   }
+
+  /// - Parameters:
+  ///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+  ///  - mode: how the partial results are associated
+  /// - Returns: a new tensor containing the out
+  @inlinable public func mean(axis: Int? = nil, mode: ReductionMode) -> Self {
+    SwiftRTCore.mean(self, axis: axis, mode: mode)
+  }
 }
 
 //==============================================================================
@@ -168,10 +263,25 @@ extension Tensor where TensorElement.Value: AlgebraicField {
 @inlinable public func prod<S, E>(
   _ x: Tensor<S, E>,
   axis: Int? = nil
+) -> Tensor<S, E> where E.Value: Numeric {
+  prod(x, axis: axis, mode: reductionMode)
+}
+
+/// prod(x:axis:mode:
+/// prod of `x` along the specified axis using the specified reduction mode
+/// - Parameters:
+///  - x: value tensor
+///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+///  - mode: how the partial results are associated
+/// - Returns: result
+@inlinable public func prod<S, E>(
+  _ x: Tensor<S, E>,
+  axis: Int? = nil,
+  mode: ReductionMode
 ) -> Tensor<S, E> where E.Value: Numeric {
   let shape = axis == nil ? S.one : x.reductionShape(axis!)
   var out = Tensor<S, E>(shape: shape)
-  currentQueue.prod(x, axis, &out)
+  currentQueue.prod(x, axis, &out, mode)
   return out
 }
 
@@ -189,6 +299,14 @@ extension Tensor where TensorElement.Value: Numeric {
   @inlinable public func prod(axis: Int? = nil) -> Self {
     SwiftRTCore.prod(self, axis: axis)
   }
+
+  /// - Parameters:
+  ///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+  ///  - mode: how the partial results are associated
+  /// - Returns: a new tensor containing the out
+  @inlinable public func prod(axis: Int? = nil, mode: ReductionMode) -> Self {
+    SwiftRTCore.prod(self, axis: axis, mode: mode)
+  }
 }
 
 //==============================================================================
@@ -404,10 +522,25 @@ extension Tensor where TensorElement.Value: Comparable & ComparableLimits {
 @inlinable public func abssum<S, E>(
   _ x: Tensor<S, E>,
   axis: Int? = nil
+) -> Tensor<S, E> where E.Value: SignedNumeric & Comparable {
+  abssum(x, axis: axis, mode: reductionMode)
+}
+
+/// abssum(x:axis:mode:
+/// Sums the absolute values of `x` along the specified axis using the specified reduction mode
+/// - Parameters:
+///  - x: value tensor
+///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+///  - mode: how the partial results are associated
+/// - Returns: result
+@inlinable public func abssum<S, E>(
+  _ x: Tensor<S, E>,
+  axis: Int? = nil,
+  mode: ReductionMode
 ) -> Tensor<S, E> where E.Value: SignedNumeric & Comparable {
   let shape = axis == nil ? S.one : x.reductionShape(axis!)
   var out = Tensor<S, E>(shape: shape)
-  currentQueue.abssum(x, axis, &out)
+  currentQueue.abssum(x, axis, &out, mode)
   return out
 }
 
@@ -425,4 +558,12 @@ extension Tensor where TensorElement.Value: SignedNumeric & Comparable {
   @inlinable public func abssum(axis: Int? = nil) -> Self {
     SwiftRTCore.abssum(self, axis: axis)
   }
+
+  /// - Parameters:
+  ///  - axis: the axis to operate on. `nil` reduces entire flattened tensor
+  ///  - mode: how the partial results are associated
+  /// - Returns: a new tensor containing the out
+  @inlinable public func abssum(axis: Int? = nil, mode: ReductionMode) -> Self {
+    SwiftRTCore.abssum(self, axis: axis, mode: mode)
+  }
 }
@@ -156,5 +156,40 @@ extension BFloat16: StorageElement {
   ) {
     buffer[index] = BFloat16(value)
   }
+
+  //-------------------------------------
+  // bulk conversion
+  // These are branch free loops over the bit patterns, so the compiler
+  // can vectorize them. Rounding is to nearest even and matches
+  // `float2bfloat16_rn`.
+  @inlinable public static func getValues(
+    from buffer: UnsafeBufferPointer<BFloat16>,
+    at index: Int,
+    into values: UnsafeMutableBufferPointer<Float>
+  ) {
+    guard values.count > 0 else { return }
+    let src = UnsafeRawPointer(buffer.baseAddress! + index)
+      .assumingMemoryBound(to: UInt16.self)
+    let dst = values.baseAddress!
+    for i in 0..<values.count {
+      dst[i] = Float(bitPattern: UInt32(src[i]) << 16)
+    }
+  }
+
+  @inlinable public static func set(
+    values: UnsafeBufferPointer<Float>,
+    in buffer: UnsafeMutableBufferPointer<BFloat16>,
+    at index: Int
+  ) {
+    guard values.count > 0 else { return }
+    let src = values.baseAddress!
+    let dst = UnsafeMutableRawPointer(buffer.baseAddress! + index)
+      .assumingMemoryBound(to: UInt16.self)
+    for i in 0..<values.count {
+      let x = src[i].bitPattern
+      let rounded = (x &+ 0x7fff &+ ((x >> 16) & 1)) >> 16
+      dst[i] = (x & 0x7fff_ffff) > 0x7f80_0000 ? 0x7fff : UInt16(truncatingIfNeeded: rounded)
+    }
+  }
 }
 
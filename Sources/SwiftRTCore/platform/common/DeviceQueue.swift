@@ -64,6 +64,17 @@ public protocol DeviceQueue: Logging {
   ///  - dst: the destination buffer
   func copyAsync(from src: DeviceMemory, to dst: DeviceMemory)
 
+  /// copyAsync(src:dst:range:
+  /// copies a byte range of device memory
+  /// - Parameters:
+  ///  - src: the source buffer
+  ///  - dst: the destination buffer
+  ///  - range: the range of bytes to copy
+  func copyAsync(
+    from src: DeviceMemory,
+    to dst: DeviceMemory,
+    range: Range<Int>)
+
   /// recordEvent
   /// adds an event to the queue and returns immediately
   /// - Returns: the event that was recorded on the queue
@@ -90,6 +101,15 @@ extension DeviceQueue {
     allocate(byteCount: byteCount, heapIndex: 0)
   }
 
+  //--------------------------------------------------------------------------
+  /// waitForScheduledWork
+  /// blocks the caller until the work already scheduled on an async queue
+  /// has completed. Unlike `waitForCompletion` it doesn't evaluate
+  /// deferred operations.
+  @inlinable public func waitForScheduledWork() {
+    if mode == .async { group.wait() }
+  }
+
   //--------------------------------------------------------------------------
   @inlinable func delay(_ interval: TimeInterval) { cpu_delay(interval) }
 
@@ -116,15 +136,30 @@ extension DeviceQueue {
     from src: DeviceMemory,
     to dst: DeviceMemory
   ) {
-    if mode == .async {
-      queue.async(group: group) {
-        dst.buffer.copyMemory(from: UnsafeRawBufferPointer(src.buffer))
-      }
-    } else {
+    cpu_execute(.copy, bytes: src.buffer.count) {
       dst.buffer.copyMemory(from: UnsafeRawBufferPointer(src.buffer))
     }
   }
 
+  @inlinable public func copyAsync(
+    from src: DeviceMemory,
+    to dst: DeviceMemory,
+    range: Range<Int>
+  ) {
+    cpu_copyAsync(from: src, to: dst, range: range)
+  }
+
+  @inlinable public func cpu_copyAsync(
+    from src: DeviceMemory,
+    to dst: DeviceMemory,
+    range: Range<Int>
+  ) {
+    cpu_execute(.copy, bytes: range.count) {
+      (dst.mutablePointer + range.lowerBound)
+        .copyMemory(from: src.pointer + range.lowerBound, byteCount: range.count)
+    }
+  }
+
   //--------------------------------------------------------------------------
   /// deviceName
   /// returns a diagnostic name for the device assoicated with this queue
@@ -26,6 +26,10 @@ public final class DiscreteStorage: StorageBuffer {
   public var isReadOnly: Bool
   public var isReference: Bool
   public var isZero: Bool
+  public var pendingWriter: LazyEvaluation?
+  public var pendingReader: LazyEvaluation?
+  /// the mapped file that holds the elements of a mapped buffer
+  public var mappedFile: MappedFile?
 
   @usableFromInline var _name: String = defaultTensorName
   @inlinable public var name: String {
@@ -35,6 +39,9 @@ public final class DiscreteStorage: StorageBuffer {
     set {
       _name = newValue
       replicas.forEach { $0?.name = newValue }
+      allocations.forEach {
+        MemoryAccounting.shared.rename($0, to: newValue)
+      }
     }
   }
 
@@ -42,6 +49,8 @@ public final class DiscreteStorage: StorageBuffer {
   // private properties
   /// replicated device memory buffers
   public var replicas: [DeviceMemory?]
+  /// the accounting records of the allocated replicas
+  public var allocations: [MemoryAccounting.Allocation] = []
 
   /// the last queue used to access storage
   public var lastQueue: Platform.Device.Queue?
@@ -56,6 +65,19 @@ public final class DiscreteStorage: StorageBuffer {
   /// this is incremented each time a write pointer is taken
   /// all replicated buffers will stay in sync with this version
   public var mainVersion: Int
+  @inlinable public var writeVersion: Int { mainVersion }
+
+  /// the number of bytes in each chunk of the buffer tracked for changes
+  public let chunkSize: Int
+  /// the `mainVersion` of the last write to each chunk. A replica is
+  /// brought up to date by copying only the chunks written after the
+  /// version it was last synchronized with.
+  public var chunkVersions: [Int]
+
+  /// the smallest number of bytes tracked as a chunk
+  public static var minChunkSize = 64 * 1024
+  /// the largest number of chunks tracked for a buffer
+  public static var maxChunkCount = 1024
 
   //------------------------------------
   // testing properties
@@ -65,6 +87,8 @@ public final class DiscreteStorage: StorageBuffer {
     _lastAccessCopiedMemory
   }
   public var _lastAccessCopiedMemory: Bool
+  /// testing: the number of bytes copied by the last access
+  public var _lastAccessCopiedBytes: Int
 
   //--------------------------------------------------------------------------
   // init(type:count:order:name:
@@ -82,6 +106,8 @@ public final class DiscreteStorage: StorageBuffer {
     isZero = false
     mainVersion = -1
     _lastAccessCopiedMemory = false
+    _lastAccessCopiedBytes = 0
+    (chunkSize, chunkVersions) = DiscreteStorage.chunks(for: byteCount)
 
     // setup replica managment
     let numDevices = platform.devices.count
@@ -125,17 +151,21 @@ public final class DiscreteStorage: StorageBuffer {
     id = Platform.objectId.next
     alignment = other.alignment
     byteCount = other.byteCount
-    isReadOnly = other.isReadOnly
+    // the copy is migrated to new memory, so it can always be written
+    isReadOnly = false
     isReference = other.isReference
     isZero = other.isZero
     _name = other._name
     _lastAccessCopiedMemory = false
+    _lastAccessCopiedBytes = 0
     mainVersion = -1
+    (chunkSize, chunkVersions) = DiscreteStorage.chunks(for: byteCount)
 
     // setup replica managment
     replicas = [DeviceMemory?](repeating: nil, count: other.replicas.count)
 
     // get the memory block to copy
+    other.evaluatePending(willMutate: false)
     let otherMemory = other.getDeviceMemory(Element.self, queue)
 
     // use migrate to create a new device memory instance
@@ -204,6 +234,7 @@ public final class DiscreteStorage: StorageBuffer {
   // ensure that all pending work is complete before releasing memory
   @inlinable deinit {
     waitForCompletion()
+    allocations.forEach { MemoryAccounting.shared.released($0) }
   }
 
   //--------------------------------------------------------------------------
@@ -228,7 +259,8 @@ public final class DiscreteStorage: StorageBuffer {
     count: Int,
     using queue: Platform.Device.Queue
   ) -> UnsafeMutableBufferPointer<Element> {
-    let buffer = migrate(type, willMutate: true, using: queue)
+    let buffer = migrate(
+      type, willMutate: true, range: index..<(index + count), using: queue)
     assert(index + count <= buffer.count, "range is out of bounds")
     let start = buffer.baseAddress!.advanced(by: index)
     return UnsafeMutableBufferPointer(start: start, count: count)
@@ -248,7 +280,16 @@ public final class DiscreteStorage: StorageBuffer {
       // allocate the buffer for the target device
       // and save in the replica list
       let memory = queue.allocate(byteCount)
+      // a buffer allocated while another device holds the elements
+      // is counted as a replica copy
+      let isReplica = replicas.contains { $0 != nil }
       replicas[queue.deviceIndex] = memory
+      if let allocation = MemoryAccounting.shared.allocated(
+        byteCount, name: _name, deviceIndex: queue.deviceIndex,
+        queueId: queue.id, isReplica: isReplica)
+      {
+        allocations.append(allocation)
+      }
 
       if willLog(level: .diagnostic) {
         let count = byteCount / MemoryLayout<Element>.size
@@ -304,39 +345,62 @@ public final class DiscreteStorage: StorageBuffer {
   /// - Parameters:
   ///  - type: the `Element` type
   ///  - willMutate: `true` if the returned buffer will be mutated
+  ///  - range: the range of elements that will be mutated. If `nil`
+  ///    the whole buffer is assumed to be mutated.
   ///  - queue: the queue that the returned buffer will be used
   ///
   /// - Returns: a buffer pointer to the data
   @inlinable public func migrate<Element>(
     _ type: Element.Type,
     willMutate: Bool,
+    range: Range<Int>? = nil,
     using queue: Platform.Device.Queue
   ) -> UnsafeMutableBufferPointer<Element> {
+    evaluatePending(willMutate: willMutate)
     assert(willMutate || main != nil, "attempting to read uninitialized memory")
 
     // For this tensor, get a buffer on the device associated
     // with `queue`. This is a synchronous operation. If the buffer
     // doesn't exist, then it will be created.
     let replica = getDeviceMemory(type, queue)
+    _lastAccessCopiedBytes = 0
 
     // If there is a `main` and the replica version doesn't match
     // then we need copy main --> replica
     if let main = main, let lastQueue = lastQueue {
 
-      func outputCopyMessage() {
+      func outputCopyMessage(_ bytes: Int) {
         diagnostic(
           .copy,
           "\(name) dev:\(main.deviceIndex)\(setText(" --> ", color: .blue))"
-            + "\(queue.name)  \(Element.self)[\(replica.count(of: Element.self))]",
+            + "\(queue.name)  \(Element.self)[\(replica.count(of: Element.self))]"
+            + (bytes < byteCount ? " changed \(bytes) bytes" : ""),
           categories: .dataCopy)
       }
 
+      // copies only the chunks written since the replica was synchronized
       func copyIfChanged(using q: Platform.Device.Queue) {
         if main.version != replica.version {
-          q.copyAsync(from: main, to: replica)
-          outputCopyMessage()
-          // set `true` for unit test purposes
+          let ranges = changedRanges(since: replica.version)
+          let bytes = ranges.reduce(0) { $0 + $1.count }
+          func copy() {
+            ranges.forEach { q.copyAsync(from: main, to: replica, range: $0) }
+          }
+          if Tracer.shared.isEnabled {
+            // the copies are asynchronous, so only enqueuing them is timed
+            let op = TracedOp(
+              name: "migrate enqueue",
+              detail: "\(name) dev:\(main.deviceIndex) --> \(queue.name)",
+              bytes: bytes)
+            Tracer.shared.trace(
+              op, .migrate, queueId: q.id, queueName: q.name, copy)
+          } else {
+            copy()
+          }
+          outputCopyMessage(bytes)
+          // set for unit test purposes
           _lastAccessCopiedMemory = true
+          _lastAccessCopiedBytes = bytes
         }
       }
 
@@ -363,10 +427,17 @@ public final class DiscreteStorage: StorageBuffer {
       }
     }
 
-    // increment version if mutating
+    // increment version and mark the written chunks if mutating
     if willMutate {
       mainVersion += 1
       main = replica
+      let size = MemoryLayout<Element>.size
+      let bytes = range.map { ($0.lowerBound * size)..<($0.upperBound * size) }
+        ?? 0..<byteCount
+      if !bytes.isEmpty {
+        let chunks = (bytes.lowerBound / chunkSize)...((bytes.upperBound - 1) / chunkSize)
+        for i in chunks { chunkVersions[i] = mainVersion }
+      }
     }
 
     // the replica version either matches the main by copying
@@ -379,4 +450,34 @@ public final class DiscreteStorage: StorageBuffer {
     // bind to the element type
     return replica.buffer.bindMemory(to: Element.self)
   }
+
+  //--------------------------------------------------------------------------
+  /// changedRanges(since:
+  /// - Parameter version: the version a replica was last synchronized with
+  /// - Returns: the byte ranges of the runs of chunks written after
+  ///   `version`
+  @inlinable public func changedRanges(since version: Int) -> [Range<Int>] {
+    var ranges: [Range<Int>] = []
+    var i = 0
+    while i < chunkVersions.count {
+      guard chunkVersions[i] > version else {
+        i += 1
+        continue
+      }
+      let first = i
+      while i < chunkVersions.count && chunkVersions[i] > version { i += 1 }
+      ranges.append((first * chunkSize)..<Swift.min(i * chunkSize, byteCount))
+    }
+    return ranges
+  }
+
+  //--------------------------------------------------------------------------
+  /// chunks(for:
+  /// - Returns: the chunk size and the initial chunk versions for a buffer
+  @inlinable public static func chunks(for byteCount: Int) -> (Int, [Int]) {
+    let size = Swift.max(
+      minChunkSize, (byteCount + maxChunkCount - 1) / maxChunkCount)
+    let count = (byteCount + size - 1) / size
+    return (size, [Int](repeating: -1, count: count))
+  }
 }
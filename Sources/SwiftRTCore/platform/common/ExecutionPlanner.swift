@@ -16,10 +16,34 @@
 
 import Foundation
 
+#if os(macOS) || os(iOS) || os(watchOS) || os(tvOS)
+  import Darwin
+#endif
+
 //==============================================================================
 public protocol ExecutionPlanCache {
   func query<Plan>(_ type: Plan.Type, key: Int) -> Plan?
   func add<Plan>(plan: Plan, _ type: Plan.Type, key: Int)
+  func query<Plan>(_ type: Plan.Type, key: ExecutionPlanKey) -> Plan?
+  func add<Plan>(plan: Plan, _ type: Plan.Type, key: ExecutionPlanKey)
+}
+
+// caches that don't keep the problem description use its hash
+extension ExecutionPlanCache {
+  @inlinable public func query<Plan>(
+    _ type: Plan.Type,
+    key: ExecutionPlanKey
+  ) -> Plan? {
+    query(type, key: key.value)
+  }
+
+  @inlinable public func add<Plan>(
+    plan: Plan,
+    _ type: Plan.Type,
+    key: ExecutionPlanKey
+  ) {
+    add(plan: plan, type, key: key.value)
+  }
 }
 
 //==============================================================================
@@ -27,3 +51,485 @@ public protocol ExecutionPlanner {
   associatedtype Plan
   func getPlan<S, E>(for tensor: Tensor<S, E>, workspaceLimit: Int?) -> Plan
 }
+
+//==============================================================================
+/// ExecutionPlanKey
+/// Identifies the problem an execution plan solves by the op, the operand
+/// shapes, element types and strides, and the number of threads. The key
+/// is a stable hash, so it is the same in every process and can be used
+/// to store plans on disk.
+public struct ExecutionPlanKey: Hashable, CustomStringConvertible {
+  /// the stable hash of the problem
+  public let value: Int
+  /// the problem description that was hashed
+  public let description: String
+
+  //--------------------------------------------------------------------------
+  /// - Parameters:
+  ///  - op: the op and any options that change its plan, such as
+  ///    `convolution.forward`
+  ///  - shapes: the operand shapes
+  ///  - types: the operand element types
+  ///  - strides: the operand strides, or op parameters such as the
+  ///    convolution strides
+  ///  - threads: the number of threads the plan runs on
+  @inlinable public init(
+    op: String,
+    shapes: [[Int]],
+    types: [Any.Type],
+    strides: [[Int]] = [],
+    threads: Int = CpuThreadPool.shared.workerCount
+  ) {
+    let typeNames = types.map { String(reflecting: $0) }
+    description =
+      "\(op) shapes: \(shapes) types: \(typeNames) "
+      + "strides: \(strides) threads: \(threads)"
+    value = Int(truncatingIfNeeded: Array(description.utf8).fnv1a())
+  }
+
+  //--------------------------------------------------------------------------
+  /// shapeClass(_:
+  /// - Returns: `extent` rounded up to a power of two, so problems that
+  ///   only differ in an extent that varies between calls, such as the
+  ///   batch size, share a plan
+  @inlinable public static func shapeClass(_ extent: Int) -> Int {
+    extent <= 1 ? 1 : 1 << (Int.bitWidth - (extent - 1).leadingZeroBitCount)
+  }
+
+  // the description is compared, so problems whose hashes collide
+  // are still distinct keys in `ExecutionPlans` and its database
+  @inlinable public static func == (lhs: Self, rhs: Self) -> Bool {
+    lhs.value == rhs.value && lhs.description == rhs.description
+  }
+
+  @inlinable public func hash(into hasher: inout Hasher) {
+    hasher.combine(value)
+  }
+}
+
+//==============================================================================
+/// ExecutionPlans
+/// A thread safe `ExecutionPlanCache` that keeps the most recently used
+/// plans in memory. Plans are stored by plan type and key, so different
+/// kinds of plans can share a cache. An `ExecutionPlanKey` is stored with
+/// its description, so problems whose hashes collide don't share a plan.
+/// The entries form a list ordered by use, so a lookup, an insert and an
+/// eviction take constant time.
+///
+/// When the cache has a database, `Codable` plans are also written to it,
+/// and a plan that isn't in memory is loaded from it, so a plan chosen
+/// by one process, such as a tuned gemm blocking, is reused by every
+/// process on the same kind of machine.
+public final class ExecutionPlans: ExecutionPlanCache {
+  /// the cache of the plans chosen by the cpu functions, backed by the
+  /// default database. It can be replaced, for example with a cache
+  /// without a database to not use stored plans.
+  public static var shared = ExecutionPlans(
+    capacity: 4096, database: ExecutionPlanDatabase.default)
+
+  /// the maximum number of plans kept in memory
+  public let capacity: Int
+  /// the database plans are stored in and loaded from
+  public let database: ExecutionPlanDatabase?
+
+  @usableFromInline let mutex = Mutex()
+  /// the index of the entry of each plan
+  @usableFromInline var plans: [PlanKey: Int] = [:]
+  @usableFromInline var entries: [Entry] = []
+  /// the most and least recently used entries, or -1 when empty
+  @usableFromInline var head = -1
+  @usableFromInline var tail = -1
+
+  @usableFromInline struct PlanKey: Hashable {
+    @usableFromInline let type: ObjectIdentifier
+    @usableFromInline let key: Int
+    /// the problem description, or empty for an `Int` key
+    @usableFromInline let problem: String
+
+    @inlinable init<Plan>(_ type: Plan.Type, _ key: Int) {
+      self.type = ObjectIdentifier(type)
+      self.key = key
+      self.problem = ""
+    }
+
+    @inlinable init<Plan>(_ type: Plan.Type, _ key: ExecutionPlanKey) {
+      self.type = ObjectIdentifier(type)
+      self.key = key.value
+      self.problem = key.description
+    }
+
+    // the key is already a hash of the problem
+    @inlinable func hash(into hasher: inout Hasher) {
+      hasher.combine(type)
+      hasher.combine(key)
+    }
+  }
+
+  /// the plan of a key that was looked up and not found
+  @usableFromInline struct Missing {
+    @inlinable init() {}
+  }
+
+  /// a node of the use ordered list
+  @usableFromInline struct Entry {
+    @usableFromInline var key: PlanKey
+    @usableFromInline var plan: Any
+    /// the next more recently used entry
+    @usableFromInline var previous = -1
+    /// the next less recently used entry
+    @usableFromInline var next = -1
+    @inlinable init(_ key: PlanKey, _ plan: Any) {
+      self.key = key
+      self.plan = plan
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// - Parameters:
+  ///  - capacity: the maximum number of plans kept in memory
+  ///  - database: the database `Codable` plans are stored in
+  @inlinable public init(
+    capacity: Int = 1024,
+    database: ExecutionPlanDatabase? = nil
+  ) {
+    self.capacity = Swift.max(1, capacity)
+    self.database = database
+  }
+
+  /// the number of plans in memory
+  @inlinable public var count: Int { mutex.access { plans.count } }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func query<Plan>(_ type: Plan.Type, key: Int) -> Plan? {
+    query(type, PlanKey(type, key))
+  }
+
+  @inlinable public func query<Plan>(
+    _ type: Plan.Type,
+    key: ExecutionPlanKey
+  ) -> Plan? {
+    query(type, PlanKey(type, key))
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func add<Plan>(plan: Plan, _ type: Plan.Type, key: Int) {
+    add(plan, PlanKey(type, key))
+  }
+
+  @inlinable public func add<Plan>(
+    plan: Plan,
+    _ type: Plan.Type,
+    key: ExecutionPlanKey
+  ) {
+    add(plan, PlanKey(type, key))
+  }
+
+  //--------------------------------------------------------------------------
+  /// addMissing(_:key:
+  /// records that there is no plan for `key`, so later queries return
+  /// `nil` without searching the database. It is replaced by the next
+  /// plan added for `key`, and isn't stored.
+  @inlinable public func addMissing<Plan>(
+    _ type: Plan.Type,
+    key: ExecutionPlanKey
+  ) {
+    mutex.access { insert(Missing(), PlanKey(type, key)) }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable func query<Plan>(_ type: Plan.Type, _ planKey: PlanKey) -> Plan? {
+    let (isCached, cached) = mutex.access { () -> (Bool, Plan?) in
+      guard let index = plans[planKey] else { return (false, nil) }
+      moveToHead(index)
+      return (true, entries[index].plan as? Plan)
+    }
+    if isCached { return cached }
+
+    // load a stored plan into memory
+    guard let database = database,
+      let decodable = type as? Decodable.Type,
+      let json = database.plan(for: Self.databaseKey(type, planKey)),
+      let plan = try? decodable.decoded(from: json) as? Plan
+    else { return nil }
+    mutex.access { insert(plan, planKey) }
+    return plan
+  }
+
+  @inlinable func add<Plan>(_ plan: Plan, _ planKey: PlanKey) {
+    mutex.access { insert(plan, planKey) }
+    if let database = database, let encodable = plan as? Encodable,
+      let json = try? encodable.encoded()
+    {
+      database.store(json, for: Self.databaseKey(Plan.self, planKey))
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// removeAll
+  /// removes the plans in memory. Stored plans are kept.
+  @inlinable public func removeAll() {
+    mutex.access {
+      plans.removeAll()
+      entries.removeAll()
+      (head, tail) = (-1, -1)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // inserts a plan, and replaces the least recently used plan when full.
+  // The caller holds the mutex.
+  @usableFromInline func insert(_ plan: Any, _ key: PlanKey) {
+    if let index = plans[key] {
+      entries[index].plan = plan
+      moveToHead(index)
+      return
+    }
+
+    let index: Int
+    if entries.count < capacity {
+      index = entries.count
+      entries.append(Entry(key, plan))
+    } else {
+      index = tail
+      unlink(index)
+      plans[entries[index].key] = nil
+      entries[index] = Entry(key, plan)
+    }
+    plans[key] = index
+    pushHead(index)
+  }
+
+  // moves a used entry to the head of the list
+  @usableFromInline func moveToHead(_ index: Int) {
+    guard index != head else { return }
+    unlink(index)
+    pushHead(index)
+  }
+
+  @usableFromInline func unlink(_ index: Int) {
+    let (previous, next) = (entries[index].previous, entries[index].next)
+    if previous >= 0 { entries[previous].next = next } else { head = next }
+    if next >= 0 { entries[next].previous = previous } else { tail = previous }
+    entries[index].previous = -1
+    entries[index].next = -1
+  }
+
+  @usableFromInline func pushHead(_ index: Int) {
+    entries[index].next = head
+    if head >= 0 { entries[head].previous = index }
+    head = index
+    if tail < 0 { tail = index }
+  }
+
+  // plans of different types can share a key, so the type is part
+  // of the stored key
+  @usableFromInline static func databaseKey<Plan>(
+    _ type: Plan.Type,
+    _ key: PlanKey
+  ) -> String {
+    let problem = key.problem.isEmpty ? String(key.key) : key.problem
+    return "\(String(reflecting: type)) \(problem)"
+  }
+}
+
+//==============================================================================
+/// ExecutionPlanDatabase
+/// A json file of `Codable` execution plans. The file records the format
+/// version, the library version and the cpu model it was written for, and
+/// it is ignored and replaced when any of them differ, because a plan
+/// tuned for other kernels or another machine can be slower than the
+/// default choice.
+///
+/// Plans are only stored on disk when a database is chosen. The default
+/// database is at the path in the `SWIFTRT_PLAN_DATABASE` environment
+/// variable, which can point to storage shared by a fleet of identical
+/// machines, and there is none when it isn't set.
+public final class ExecutionPlanDatabase {
+  /// the version of the file format
+  public static let formatVersion = 2
+  /// the version of the kernels plans are chosen for. This is changed
+  /// when kernels change in a way that invalidates stored plans.
+  public static let libraryVersion = "0.1.0"
+
+  /// the database used by `ExecutionPlans.shared`, or `nil` if the
+  /// `SWIFTRT_PLAN_DATABASE` environment variable isn't set
+  public static let `default`: ExecutionPlanDatabase? =
+    ProcessInfo.processInfo.environment["SWIFTRT_PLAN_DATABASE"].map {
+      ExecutionPlanDatabase(path: $0)
+    }
+
+  /// the path of the database file
+  public let path: String
+  /// the library version stored plans must match
+  public let libraryVersion: String
+  /// the cpu model stored plans must match
+  public let cpuModel: String
+  /// `true` to write the file each time a plan is stored. A database is
+  /// only used when one is chosen, and plans are chosen rarely, so this
+  /// is the default, and a process that exits early doesn't lose them.
+  public var savesOnStore = true
+  /// `true` if an existing file was ignored because it was written for
+  /// another format, library version or cpu model
+  public private(set) var wasInvalidated = false
+
+  let mutex = Mutex()
+  var plans: [String: String] = [:]
+
+  struct Contents: Codable {
+    var formatVersion: Int
+    var libraryVersion: String
+    var cpuModel: String
+    var plans: [String: String]
+  }
+
+  //--------------------------------------------------------------------------
+  /// init(path:libraryVersion:cpuModel:
+  /// loads the plans stored at `path` if they were written for the same
+  /// format, library version and cpu model
+  public init(
+    path: String,
+    libraryVersion: String = ExecutionPlanDatabase.libraryVersion,
+    cpuModel: String = ExecutionPlanDatabase.cpuModel
+  ) {
+    self.path = path
+    self.libraryVersion = libraryVersion
+    self.cpuModel = cpuModel
+
+    guard let data = FileManager.default.contents(atPath: path) else { return }
+    if let contents = load(data) {
+      plans = contents.plans
+      diagnostic(
+        .setup, "loaded \(plans.count) execution plans from \(path)",
+        categories: .setup)
+    } else {
+      wasInvalidated = true
+      diagnostic(
+        .setup, "ignored execution plans for another cpu or version "
+          + "in \(path)", categories: .setup)
+    }
+  }
+
+  /// the number of stored plans
+  public var count: Int { mutex.access { plans.count } }
+
+  //--------------------------------------------------------------------------
+  /// plan(for:
+  /// - Returns: the json encoded plan stored for `key`
+  public func plan(for key: String) -> String? {
+    mutex.access { plans[key] }
+  }
+
+  //--------------------------------------------------------------------------
+  /// store(_:for:
+  /// stores a json encoded plan, and writes the file if `savesOnStore`
+  public func store(_ plan: String, for key: String) {
+    let changed = mutex.access { () -> Bool in
+      guard plans[key] != plan else { return false }
+      plans[key] = plan
+      return true
+    }
+    guard changed && savesOnStore else { return }
+    do {
+      try save()
+    } catch {
+      log.write(
+        level: .warning,
+        message: "failed to save execution plans to \(path): \(error)")
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// save
+  /// writes the plans to the file. Plans stored in the file by other
+  /// processes since it was loaded are kept, so processes sharing a
+  /// database add to it instead of replacing it.
+  public func save() throws {
+    let url = URL(fileURLWithPath: path)
+    try FileManager.default.createDirectory(
+      at: url.deletingLastPathComponent(), withIntermediateDirectories: true)
+
+    let stored = FileManager.default.contents(atPath: path).flatMap { load($0) }
+    let contents = mutex.access { () -> Contents in
+      if let stored = stored {
+        plans.merge(stored.plans) { mine, _ in mine }
+      }
+      return Contents(
+        formatVersion: Self.formatVersion, libraryVersion: libraryVersion,
+        cpuModel: cpuModel, plans: plans)
+    }
+    let encoder = JSONEncoder()
+    encoder.outputFormatting = .sortedKeys
+    try encoder.encode(contents).write(to: url, options: .atomic)
+  }
+
+  //--------------------------------------------------------------------------
+  /// removeAll
+  /// removes the stored plans and the database file
+  public func removeAll() {
+    mutex.access { plans.removeAll() }
+    try? FileManager.default.removeItem(atPath: path)
+  }
+
+  //--------------------------------------------------------------------------
+  // decodes the contents if they match this database
+  func load(_ data: Data) -> Contents? {
+    guard let contents = try? JSONDecoder().decode(Contents.self, from: data),
+      contents.formatVersion == Self.formatVersion,
+      contents.libraryVersion == libraryVersion,
+      contents.cpuModel == cpuModel
+    else { return nil }
+    return contents
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpuModel
+  /// the processor brand, architecture and core count, which identify
+  /// machines that run the cpu kernels at the same speed
+  public static let cpuModel: String = {
+    var brand = "unknown"
+    #if os(Linux)
+      if let info = try? String(contentsOfFile: "/proc/cpuinfo"),
+        let line = info.split(separator: "\n").first(where: {
+          $0.hasPrefix("model name")
+        }),
+        let value = line.split(separator: ":", maxSplits: 1).last
+      {
+        brand = value.trimmingCharacters(in: .whitespaces)
+      }
+    #elseif os(macOS) || os(iOS) || os(watchOS) || os(tvOS)
+      var size = 0
+      if sysctlbyname("machdep.cpu.brand_string", nil, &size, nil, 0) == 0 {
+        var chars = [CChar](repeating: 0, count: size)
+        if sysctlbyname("machdep.cpu.brand_string", &chars, &size, nil, 0) == 0 {
+          brand = String(cString: chars)
+        }
+      }
+    #endif
+
+    #if arch(x86_64)
+      let arch = "x86_64"
+    #elseif arch(arm64)
+      let arch = "arm64"
+    #else
+      let arch = "other"
+    #endif
+    return "\(brand) \(arch) x\(ProcessInfo.processInfo.activeProcessorCount)"
+  }()
+}
+
+//==============================================================================
+// json coding of plans whose type is only known at runtime. Keys are
+// sorted so the same plan is always stored as the same text.
+extension Encodable {
+  @inlinable func encoded() throws -> String {
+    let encoder = JSONEncoder()
+    encoder.outputFormatting = .sortedKeys
+    return String(decoding: try encoder.encode(self), as: UTF8.self)
+  }
+}
+
+extension Decodable {
+  @inlinable static func decoded(from json: String) throws -> Self {
+    try JSONDecoder().decode(Self.self, from: Data(json.utf8))
+  }
+}
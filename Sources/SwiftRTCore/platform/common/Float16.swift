@@ -208,5 +208,65 @@ extension Float16: StorageElement {
   ) {
     buffer[index] = Float16(value)
   }
+
+  //-------------------------------------
+  // bulk conversion
+  // These work on the bit patterns with selects instead of the branches
+  // in `float162float` and `float2float16_rn`, so the compiler can
+  // vectorize the loops. Rounding is to nearest even.
+  @inlinable public static func getValues(
+    from buffer: UnsafeBufferPointer<Float16>,
+    at index: Int,
+    into values: UnsafeMutableBufferPointer<Float>
+  ) {
+    guard values.count > 0 else { return }
+    let src = UnsafeRawPointer(buffer.baseAddress! + index)
+      .assumingMemoryBound(to: UInt16.self)
+    let dst = values.baseAddress!
+    let shiftedExponent: UInt32 = 0x7c00 << 13
+    let magic = Float(bitPattern: 113 << 23)
+
+    for i in 0..<values.count {
+      let h = UInt32(src[i])
+      let bits = (h & 0x7fff) << 13
+      let exponent = bits & shiftedExponent
+      let normal = bits &+ ((127 - 15) << 23)
+      // Inf and NaN keep the maximum exponent
+      let special = normal &+ ((128 - 16) << 23)
+      // subnormals are renormalized by the fpu
+      let subnormal = (Float(bitPattern: normal &+ (1 << 23)) - magic).bitPattern
+      let magnitude = exponent == shiftedExponent ? special
+        : exponent == 0 ? subnormal : normal
+      dst[i] = Float(bitPattern: magnitude | ((h & 0x8000) << 16))
+    }
+  }
+
+  @inlinable public static func set(
+    values: UnsafeBufferPointer<Float>,
+    in buffer: UnsafeMutableBufferPointer<Float16>,
+    at index: Int
+  ) {
+    guard values.count > 0 else { return }
+    let src = values.baseAddress!
+    let dst = UnsafeMutableRawPointer(buffer.baseAddress! + index)
+      .assumingMemoryBound(to: UInt16.self)
+    let infinity: UInt32 = 255 << 23
+    let overflow: UInt32 = (127 + 16) << 23
+    let denormalMagic: UInt32 = ((127 - 15) + (23 - 10) + 1) << 23
+    let denormalMagicValue = Float(bitPattern: denormalMagic)
+
+    for i in 0..<values.count {
+      let x = src[i].bitPattern
+      let sign = x & 0x8000_0000
+      let f = x ^ sign
+      let large: UInt32 = f > infinity ? 0x7e00 : 0x7c00
+      let subnormal = (Float(bitPattern: f) + denormalMagicValue).bitPattern &- denormalMagic
+      // rebias the exponent and round the mantissa to nearest even
+      let normal = (f &+ 0xc800_0000 &+ 0xfff &+ ((f >> 13) & 1)) >> 13
+      let magnitude = f >= overflow ? large
+        : f < (113 << 23) ? subnormal : normal
+      dst[i] = UInt16(truncatingIfNeeded: magnitude | (sign >> 16))
+    }
+  }
 }
 #endif
@@ -0,0 +1,177 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+#if os(macOS) || os(iOS) || os(watchOS) || os(tvOS)
+  import Darwin
+#elseif os(Windows)
+  import ucrt
+#else
+  import Glibc
+#endif
+
+//==============================================================================
+/// MappedFile
+/// A region of a file mapped into the address space of the process.
+/// Tensors created over a mapped file read the elements directly from the
+/// mapped pages, so loading large weights doesn't allocate or copy, and
+/// pages are only read from disk when they are first touched.
+///
+/// A read only mapping is shared, so every process that maps the same
+/// file uses the same physical pages from the file system cache. A copy on
+/// write mapping shares pages until they are written, and writes are never
+/// stored to the file.
+public final class MappedFile {
+  //--------------------------------------------------------------------------
+  /// Access
+  public enum Access {
+    /// the mapped elements can't be written. Writing to a tensor over a
+    /// read only mapping copies it to new storage first.
+    case readOnly
+    /// writes go to private copies of the written pages
+    case copyOnWrite
+  }
+
+  //--------------------------------------------------------------------------
+  /// Advice
+  /// the expected access pattern, which directs read ahead
+  public enum Advice {
+    /// the default read ahead
+    case normal
+    /// pages are read in order, so read ahead aggressively
+    case sequential
+    /// pages are read in random order, so don't read ahead
+    case random
+    /// pages will be needed soon, so start reading them now
+    case willNeed
+  }
+
+  /// the path of the mapped file
+  public let path: String
+  /// the access mode of the mapping
+  public let access: Access
+  /// the address of the first mapped byte of the requested region
+  public let baseAddress: UnsafeMutableRawPointer
+  /// the number of bytes in the requested region
+  public let byteCount: Int
+
+  // the page aligned mapping that contains the requested region
+  @usableFromInline let mapping: UnsafeMutableRawPointer
+  @usableFromInline let mappingCount: Int
+
+  /// `true` if the mapped bytes can't be written
+  @inlinable public var isReadOnly: Bool { access == .readOnly }
+
+  /// the mapped bytes
+  @inlinable public var bytes: UnsafeRawBufferPointer {
+    UnsafeRawBufferPointer(start: baseAddress, count: byteCount)
+  }
+
+  //--------------------------------------------------------------------------
+  /// init(path:offset:byteCount:access:advice:
+  /// maps a region of a file
+  /// - Parameters:
+  ///  - path: the path of the file to map
+  ///  - offset: the file offset of the region, which doesn't need to be
+  ///    page aligned
+  ///  - byteCount: the number of bytes to map. If `nil` the region extends
+  ///    to the end of the file.
+  ///  - access: the access mode of the mapping
+  ///  - advice: the expected access pattern
+  public init(
+    path: String,
+    offset: Int = 0,
+    byteCount: Int? = nil,
+    access: Access = .readOnly,
+    advice: Advice = .normal
+  ) throws {
+    #if os(Windows)
+      throw PlatformError.functionFailure(
+        location: "MappedFile", message: "memory mapped files are not supported")
+    #else
+      func failure(_ operation: String) -> PlatformError {
+        PlatformError.functionFailure(
+          location: "MappedFile",
+          message: "\(operation) \(path): \(String(cString: strerror(errno)))")
+      }
+
+      // private writes don't reach the file, so it is always opened read only
+      let fd = open(path, O_RDONLY)
+      guard fd >= 0 else { throw failure("open") }
+      // the mapping keeps its own reference to the file
+      defer { close(fd) }
+
+      var info = stat()
+      guard fstat(fd, &info) == 0 else { throw failure("stat") }
+      let fileSize = Int(info.st_size)
+      let count = byteCount ?? (fileSize - offset)
+      guard offset >= 0 && count > 0 && offset + count <= fileSize else {
+        throw PlatformError.rangeError(
+          "region \(offset)..<\(offset + count) is outside \(path) "
+            + "of \(fileSize) bytes")
+      }
+
+      // mmap requires a page aligned file offset
+      let pageSize = Int(getpagesize())
+      let mapOffset = offset / pageSize * pageSize
+      let mapCount = count + offset - mapOffset
+      let protection = access == .readOnly ? PROT_READ : PROT_READ | PROT_WRITE
+      let flags = access == .readOnly ? MAP_SHARED : MAP_PRIVATE
+      guard
+        let mapping = mmap(
+          nil, mapCount, protection, flags, fd, off_t(mapOffset)),
+        mapping != UnsafeMutableRawPointer(bitPattern: -1)
+      else { throw failure("mmap") }
+
+      self.path = path
+      self.access = access
+      self.mapping = mapping
+      self.mappingCount = mapCount
+      self.baseAddress = mapping + (offset - mapOffset)
+      self.byteCount = count
+      advise(advice)
+
+      diagnostic(
+        .alloc, "mapped \(path) [\(count) bytes at \(offset)]",
+        categories: .dataAlloc)
+    #endif
+  }
+
+  deinit {
+    #if !os(Windows)
+      munmap(mapping, mappingCount)
+      diagnostic(.release, "unmapped \(path)", categories: .dataAlloc)
+    #endif
+  }
+
+  //--------------------------------------------------------------------------
+  /// advise(_:
+  /// sets the expected access pattern of the whole mapping
+  public func advise(_ advice: Advice) {
+    #if !os(Windows)
+      let value: Int32
+      switch advice {
+      case .normal: value = MADV_NORMAL
+      case .sequential: value = MADV_SEQUENTIAL
+      case .random: value = MADV_RANDOM
+      case .willNeed: value = MADV_WILLNEED
+      }
+      // advice is a hint, so a failure is ignored
+      _ = madvise(mapping, mappingCount, value)
+    #endif
+  }
+}
@@ -0,0 +1,317 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+//==============================================================================
+/// MemoryAccounting
+/// Counts the bytes of tensor storage that are live on each device and
+/// queue, and optionally attributes them to the name of the tensor that
+/// owns them. Accounting is always on in release builds. Each device has
+/// its own counters and lock, so allocations on different devices don't
+/// contend, and the name breakdown is only kept while `isTrackingNames`
+/// is `true`.
+///
+/// The storage buffers of tensors and the replicas made when a tensor is
+/// used on another device are counted. References to application buffers
+/// and memory mapped files are not, because they aren't allocated by
+/// the storage.
+///
+/// A snapshot taken each training step and compared with the previous one
+/// shows which tensors are growing.
+public final class MemoryAccounting {
+  /// the accounting of all storage
+  public static let shared = MemoryAccounting()
+
+  /// `true` to count allocations. Storage allocated while accounting is
+  /// disabled is never counted, including when it's released.
+  public var isEnabled = true
+  /// `true` to attribute live bytes to tensor names. The names of every
+  /// device share one lock and dictionary, so the breakdown is only kept
+  /// while it's needed. Storage allocated while this is `false` is never
+  /// attributed.
+  public var isTrackingNames = false
+
+  /// the number of device indexes that can be counted
+  public static let maxDevices = 16
+
+  /// the counters of one device
+  @usableFromInline final class DeviceCounters {
+    let mutex = Mutex()
+    var usage = Usage()
+    var queues: [Int: Usage] = [:]
+    var replicaBytes = 0
+    var allocatedBytes = 0
+    var allocations = 0
+  }
+
+  @usableFromInline let devices: [DeviceCounters]
+  let namesMutex = Mutex()
+  var names: [String: Int] = [:]
+
+  public init() {
+    devices = (0..<Self.maxDevices).map { _ in DeviceCounters() }
+  }
+
+  //--------------------------------------------------------------------------
+  /// Allocation
+  /// the record of one counted buffer, which the storage keeps and returns
+  /// when the buffer is released
+  public final class Allocation {
+    /// the name the bytes are attributed to
+    public internal(set) var name: String
+    /// `true` if the bytes are attributed to `name`
+    public let isNamed: Bool
+    /// the index of the device that holds the buffer
+    public let deviceIndex: Int
+    /// the id of the queue that allocated the buffer
+    public let queueId: Int
+    /// the size of the buffer
+    public let byteCount: Int
+    /// `true` if the buffer replicates storage on another device
+    public let isReplica: Bool
+
+    @usableFromInline init(
+      name: String, isNamed: Bool, deviceIndex: Int, queueId: Int,
+      byteCount: Int, isReplica: Bool
+    ) {
+      self.name = name
+      self.isNamed = isNamed
+      self.deviceIndex = deviceIndex
+      self.queueId = queueId
+      self.byteCount = byteCount
+      self.isReplica = isReplica
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// Usage
+  /// the live and peak bytes of a device, queue or process
+  public struct Usage: Equatable, CustomStringConvertible {
+    /// the number of live bytes
+    public var bytes = 0
+    /// the largest value of `bytes` since the peaks were last reset
+    public var peakBytes = 0
+    /// the number of live buffers
+    public var buffers = 0
+
+    public var description: String {
+      "bytes: \(bytes) peak: \(peakBytes) buffers: \(buffers)"
+    }
+
+    mutating func add(_ count: Int) {
+      bytes += count
+      buffers += 1
+      peakBytes = Swift.max(peakBytes, bytes)
+    }
+
+    mutating func remove(_ count: Int) {
+      bytes -= count
+      buffers -= 1
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// Snapshot
+  /// the accounting at one point in time. The counters of each device
+  /// are read together, but devices are read one after another.
+  public struct Snapshot {
+    /// the usage of all devices. Its peak is the sum of the device peaks,
+    /// which is exact for a single device and an upper bound otherwise.
+    public internal(set) var total = Usage()
+    /// the usage of each device by device index
+    public internal(set) var devices: [Int: Usage] = [:]
+    /// the usage of each queue by queue id
+    public internal(set) var queues: [Int: Usage] = [:]
+    /// the live bytes attributed to each tensor name while
+    /// `isTrackingNames` is `true`
+    public internal(set) var names: [String: Int] = [:]
+    /// the live bytes of replicas of storage on other devices
+    public internal(set) var replicaBytes = 0
+    /// the number of bytes allocated since the process started
+    public internal(set) var allocatedBytes = 0
+    /// the number of buffers allocated since the process started
+    public internal(set) var allocations = 0
+
+    /// top(_:
+    /// - Parameter count: the maximum number of names to return
+    /// - Returns: the names holding the most live bytes, largest first
+    public func top(_ count: Int) -> [(name: String, bytes: Int)] {
+      let sorted = names.sorted {
+        $0.value > $1.value || ($0.value == $1.value && $0.key < $1.key)
+      }
+      return sorted.prefix(count).map { (name: $0.key, bytes: $0.value) }
+    }
+
+    /// difference(from:
+    /// - Parameter earlier: a snapshot taken before this one
+    /// - Returns: the change in accounting from `earlier` to this snapshot
+    public func difference(from earlier: Snapshot) -> Difference {
+      func changes<K: Hashable>(_ now: [K: Int], _ then: [K: Int]) -> [K: Int] {
+        var result = now
+        for (key, bytes) in then { result[key, default: 0] -= bytes }
+        return result.filter { $0.value != 0 }
+      }
+      return Difference(
+        bytes: total.bytes - earlier.total.bytes,
+        devices: changes(
+          devices.mapValues { $0.bytes }, earlier.devices.mapValues { $0.bytes }),
+        queues: changes(
+          queues.mapValues { $0.bytes }, earlier.queues.mapValues { $0.bytes }),
+        names: changes(names, earlier.names),
+        allocatedBytes: allocatedBytes - earlier.allocatedBytes,
+        allocations: allocations - earlier.allocations)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// Difference
+  /// the change in live bytes between two snapshots. Entries that didn't
+  /// change are omitted.
+  public struct Difference: CustomStringConvertible {
+    /// the change in live bytes of all devices
+    public let bytes: Int
+    /// the change in live bytes of each device
+    public let devices: [Int: Int]
+    /// the change in live bytes of each queue
+    public let queues: [Int: Int]
+    /// the change in live bytes attributed to each tensor name
+    public let names: [String: Int]
+    /// the number of bytes allocated between the snapshots
+    public let allocatedBytes: Int
+    /// the number of buffers allocated between the snapshots
+    public let allocations: Int
+
+    public var description: String {
+      let growth = names.sorted { abs($0.value) > abs($1.value) }
+        .map { "\($0.key): \($0.value)" }.joined(separator: ", ")
+      return "bytes: \(bytes) allocated: \(allocatedBytes) "
+        + "in \(allocations) buffers [\(growth)]"
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// snapshot
+  /// the current accounting
+  public var snapshot: Snapshot {
+    var snapshot = Snapshot()
+    for (index, device) in devices.enumerated() {
+      device.mutex.access {
+        guard device.allocations > 0 else { return }
+        snapshot.devices[index] = device.usage
+        snapshot.queues.merge(device.queues) { $1 }
+        snapshot.total.bytes += device.usage.bytes
+        snapshot.total.peakBytes += device.usage.peakBytes
+        snapshot.total.buffers += device.usage.buffers
+        snapshot.replicaBytes += device.replicaBytes
+        snapshot.allocatedBytes += device.allocatedBytes
+        snapshot.allocations += device.allocations
+      }
+    }
+    snapshot.names = namesMutex.access { names }
+    return snapshot
+  }
+
+  /// the live bytes and peak of all devices
+  public var usage: Usage { snapshot.total }
+
+  //--------------------------------------------------------------------------
+  /// resetPeaks
+  /// sets the peak bytes to the live bytes, so the next snapshot reports
+  /// the peaks reached since now, such as those of one training step
+  public func resetPeaks() {
+    for device in devices {
+      device.mutex.access {
+        device.usage.peakBytes = device.usage.bytes
+        for key in device.queues.keys {
+          device.queues[key]!.peakBytes = device.queues[key]!.bytes
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// allocated(_:name:deviceIndex:queueId:isReplica:
+  /// counts a buffer allocated for storage
+  /// - Returns: the record to pass to `released` when the buffer is
+  ///   freed, or `nil` if accounting is disabled
+  @inlinable public func allocated(
+    _ byteCount: Int,
+    name: String,
+    deviceIndex: Int,
+    queueId: Int,
+    isReplica: Bool = false
+  ) -> Allocation? {
+    guard isEnabled else { return nil }
+    assert(deviceIndex < Self.maxDevices, "device index out of range")
+    let allocation = Allocation(
+      name: name, isNamed: isTrackingNames, deviceIndex: deviceIndex,
+      queueId: queueId, byteCount: byteCount, isReplica: isReplica)
+    add(allocation)
+    return allocation
+  }
+
+  @usableFromInline func add(_ allocation: Allocation) {
+    let count = allocation.byteCount
+    let device = devices[allocation.deviceIndex]
+    device.mutex.access {
+      device.usage.add(count)
+      device.queues[allocation.queueId, default: Usage()].add(count)
+      if allocation.isReplica { device.replicaBytes += count }
+      device.allocatedBytes += count
+      device.allocations += 1
+    }
+    if allocation.isNamed {
+      namesMutex.access { names[allocation.name, default: 0] += count }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// released(_:
+  /// removes a freed buffer from the accounting
+  public func released(_ allocation: Allocation) {
+    let count = allocation.byteCount
+    let device = devices[allocation.deviceIndex]
+    device.mutex.access {
+      device.usage.remove(count)
+      device.queues[allocation.queueId]?.remove(count)
+      if allocation.isReplica { device.replicaBytes -= count }
+    }
+    if allocation.isNamed {
+      namesMutex.access { removeName(allocation.name, count) }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// rename(_:to:
+  /// attributes the bytes of an allocation to a new tensor name
+  public func rename(_ allocation: Allocation, to name: String) {
+    namesMutex.access {
+      guard allocation.name != name else { return }
+      if allocation.isNamed {
+        removeName(allocation.name, allocation.byteCount)
+        names[name, default: 0] += allocation.byteCount
+      }
+      allocation.name = name
+    }
+  }
+
+  // names without live bytes are removed, so temporaries don't accumulate
+  func removeName(_ name: String, _ count: Int) {
+    let bytes = names[name, default: 0] - count
+    names[name] = bytes == 0 ? nil : bytes
+  }
+}
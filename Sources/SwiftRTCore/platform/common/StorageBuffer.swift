@@ -38,6 +38,18 @@ public protocol StorageBuffer: class, Logging {
   var isZero: Bool { get }
   /// the buffer name used in diagnostic messages
   var name: String { get set }
+  /// a counter that is incremented each time a write pointer is taken.
+  /// A value derived from the elements, such as a packed matrix, can keep
+  /// the version instead of the buffer to detect that it is stale.
+  var writeVersion: Int { get }
+  /// a deferred computation that will write the buffer. It is evaluated
+  /// before the buffer is next accessed.
+  var pendingWriter: LazyEvaluation? { get set }
+  /// a deferred computation that will read the buffer. It is evaluated
+  /// before the buffer is next mutated.
+  var pendingReader: LazyEvaluation? { get set }
+  /// the mapped file that holds the elements of a mapped buffer
+  var mappedFile: MappedFile? { get set }
 
   //--------------------------------------------------------------------------
   /// `init(type:count:
@@ -159,9 +171,74 @@ public protocol StorageBuffer: class, Logging {
   func waitForCompletion()
 }
 
+//==============================================================================
+/// LazyEvaluation
+/// A deferred computation recorded by a lazy queue
+public protocol LazyEvaluation: class {
+  /// evaluate
+  /// performs the deferred computation and detaches it from the
+  /// storage buffers it reads and writes
+  func evaluate()
+
+  /// release(_:
+  /// removes a released result buffer from the deferred computation,
+  /// so its result is never computed
+  func release(_ buffer: StorageBuffer)
+}
+
 //==============================================================================
 // convenience extensions
 extension StorageBuffer {
+  //--------------------------------------------------------------------------
+  /// evaluatePending(willMutate:
+  /// evaluates the deferred computations that must complete before
+  /// the buffer is accessed
+  /// - Parameter willMutate: `true` if the buffer will be mutated
+  @inlinable public func evaluatePending(willMutate: Bool) {
+    pendingWriter?.evaluate()
+    if willMutate { pendingReader?.evaluate() }
+  }
+
+  //--------------------------------------------------------------------------
+  /// `init(mapping:type:at:count:name:`
+  /// creates an element buffer over a region of a memory mapped file.
+  /// No memory is allocated and the buffer keeps the mapping alive.
+  /// - Parameters:
+  ///  - file: the mapped file
+  ///  - type: the stored `Element` type
+  ///  - byteOffset: the offset of the first element in the mapping
+  ///  - count: the number of stored elements
+  ///  - name: the name of the tensor
+  @inlinable public init<Element>(
+    mapping file: MappedFile,
+    type: Element.Type,
+    at byteOffset: Int,
+    count: Int,
+    name: String
+  ) {
+    precondition(
+      byteOffset >= 0
+        && byteOffset + count * MemoryLayout<Element>.stride <= file.byteCount,
+      "mapped range is outside the file region")
+    assert(
+      Int(bitPattern: file.baseAddress + byteOffset)
+        % MemoryLayout<Element>.alignment == 0,
+      "mapped elements are misaligned")
+    let start = (file.baseAddress + byteOffset)
+      .bindMemory(to: Element.self, capacity: count)
+    if file.isReadOnly {
+      self.init(
+        referenceTo: UnsafeBufferPointer(start: start, count: count),
+        name: name)
+    } else {
+      self.init(
+        referenceTo: UnsafeMutableBufferPointer(start: start, count: count),
+        name: name)
+    }
+    mappedFile = file
+  }
+
+  //--------------------------------------------------------------------------
   /// used for unit tests. `true` if a read/write operation caused
   /// memory to be copied between devices
   @inlinable public var testLastAccessCopiedDeviceMemory: Bool { false }
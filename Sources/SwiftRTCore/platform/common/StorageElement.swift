@@ -120,6 +120,32 @@ public protocol StorageElement {
     at index: Int
   )
 
+  //--------------------------------------------------------------------------
+  /// `getValues(from:at:into:`
+  /// converts a run of contiguous elements to values in bulk
+  /// - Parameters:
+  ///  - buffer: the storage buffer
+  ///  - index: the absolute logical storage index of the first element
+  ///  - values: receives `values.count` element values
+  static func getValues(
+    from buffer: UnsafeBufferPointer<Stored>,
+    at index: Int,
+    into values: UnsafeMutableBufferPointer<Value>
+  )
+
+  //--------------------------------------------------------------------------
+  /// `set(values:in:at:`
+  /// converts and stores a run of contiguous values in bulk
+  /// - Parameters:
+  ///  - values: the values to set
+  ///  - buffer: the storage buffer
+  ///  - index: the absolute logical storage index of the first element
+  static func set(
+    values: UnsafeBufferPointer<Value>,
+    in buffer: UnsafeMutableBufferPointer<Stored>,
+    at index: Int
+  )
+
   #if canImport(SwiftRTCuda)
     //--------------------------------------------------------------------------
     /// element data type identifier used for driver library dispatch
@@ -194,6 +220,37 @@ extension Complex: ComparableLimits where RealType: ComparableLimits {
   }
 }
 
+//==============================================================================
+// bulk conversion defaults, which convert one element at a time
+extension StorageElement {
+  /// `true` if whole elements are stored as a different type than
+  /// `Value`, such as `BFloat16` which is computed as `Float`. The cpu
+  /// converts these in chunks with `getValues` and `set(values:`
+  @inlinable public static var isConverted: Bool {
+    Stored.self != Value.self && storedCount(64) == 64
+  }
+
+  @inlinable public static func getValues(
+    from buffer: UnsafeBufferPointer<Stored>,
+    at index: Int,
+    into values: UnsafeMutableBufferPointer<Value>
+  ) {
+    for i in 0..<values.count {
+      values[i] = getValue(from: buffer, at: index + i)
+    }
+  }
+
+  @inlinable public static func set(
+    values: UnsafeBufferPointer<Value>,
+    in buffer: UnsafeMutableBufferPointer<Stored>,
+    at index: Int
+  ) {
+    for i in 0..<values.count {
+      set(value: values[i], in: buffer, at: index + i)
+    }
+  }
+}
+
 //==============================================================================
 // Note: The default behavior for whole native elements is simply pass through
 // which should be discarded by the compiler and impose no performance
@@ -234,6 +291,24 @@ extension StorageElement where Stored == Value {
   ) {
     buffer[index] = value
   }
+
+  @inlinable public static func getValues(
+    from buffer: UnsafeBufferPointer<Stored>,
+    at index: Int,
+    into values: UnsafeMutableBufferPointer<Value>
+  ) {
+    guard values.count > 0 else { return }
+    values.baseAddress!.assign(from: buffer.baseAddress! + index, count: values.count)
+  }
+
+  @inlinable public static func set(
+    values: UnsafeBufferPointer<Value>,
+    in buffer: UnsafeMutableBufferPointer<Stored>,
+    at index: Int
+  ) {
+    guard values.count > 0 else { return }
+    (buffer.baseAddress! + index).assign(from: values.baseAddress!, count: values.count)
+  }
 }
 
 //==============================================================================
@@ -22,7 +22,18 @@ public enum PmapBound {
 
 //==============================================================================
 /// pmap
+/// Partitions `t0` and `t1` along the specified axes and invokes `body`
+/// concurrently for each pair of partitions. The partitions are views
+/// of the original tensors, so results written to `t1` are stored in
+/// place without copying.
 ///
+/// Partitions run on the persistent `PmapWorkers` pool. For a given
+/// partition count, partition `i` is always processed by the workers of
+/// the same NUMA node, so repeated calls keep a partition's working set
+/// in that node's caches. Storage placement isn't controlled: tensor
+/// buffers come from the shared memory pool and may be resident on any
+/// node. A `pmap` called from `body` runs its partitions inline on the
+/// calling worker.
 @inlinable public func pmap<S0, E0, S1, E1>(
   _ t0: Tensor<S0, E0>, axis axis0: Int = 0,
   _ t1: inout Tensor<S1, E1>, axis axis1: Int = 0,
@@ -46,26 +57,135 @@ public enum PmapBound {
           : ProcessInfo.processInfo.activeProcessorCount / 2
       }(), t0.shape[axis0])
 
-  // execute partition
-  func execute(_ p0: inout Tensor<S0, E0>, _ p1: inout Tensor<S1, E1>) {
-    var tp0 = p0
-    var tp1 = p1
-    body(&tp0, &tp1)
-    Thread.sleep(forTimeInterval: 0.1)
-    p0.assign(tp0)
-    p1.assign(tp1)
-  }
-
-  if partitions == 0 {
+  if partitions <= 1 {
     var t0 = t0
-    execute(&t0, &t1)
+    body(&t0, &t1)
   } else {
     // distribute the work
-    let group = DispatchGroup()
-    for i in 0..<partitions {
+    PmapWorkers.shared.run(partitions) { i in
       var p0 = t0.partition(i, axis0, partitions)
-      var p1 = st1.partition(i, axis1, partitions)
-      DispatchQueue.global().async(group: group) { execute(&p0, &p1) }
+      var view = st1.partition(i, axis1, partitions)
+      var p1 = view
+      body(&p0, &p1)
+      // copies only if `body` replaced the view instead of writing to it
+      view.assign(p1)
+    }
+  }
+}
+
+//==============================================================================
+/// PmapWorkers
+/// A persistent pool of worker threads with one task list per NUMA node.
+/// Each worker is bound to the cpus of its node. The workers run until
+/// `shutdown` is called or the pool is released.
+public final class PmapWorkers {
+  public let topology: CpuTopology
+  @usableFromInline let nodes: [NodeTasks]
+  @usableFromInline let mutex = Mutex()
+  @usableFromInline var isShutdown = false
+
+  /// the pool shared by all `pmap` calls
+  public static let shared = PmapWorkers()
+
+  /// the thread dictionary key that marks pool worker threads
+  @usableFromInline static let workerKey = "SwiftRT.PmapWorkers.worker"
+
+  /// `true` if the current thread is a pool worker
+  @inlinable public static var isWorkerThread: Bool {
+    Thread.current.threadDictionary[workerKey] != nil
+  }
+
+  @usableFromInline final class NodeTasks {
+    @usableFromInline let mutex = Mutex()
+    /// the pending tasks. A `nil` task stops the worker that takes it.
+    @usableFromInline var tasks: [(() -> Void)?] = []
+    @usableFromInline let available = DispatchSemaphore(value: 0)
+    @usableFromInline let workerCount: Int
+
+    @inlinable init(workerCount: Int) {
+      self.workerCount = workerCount
+    }
+
+    @inlinable func add(_ task: (() -> Void)?) {
+      mutex.access { tasks.append(task) }
+      available.signal()
+    }
+
+    /// - Returns: the next task, or `nil` if the worker should exit
+    @inlinable func next() -> (() -> Void)? {
+      available.wait()
+      return mutex.access { tasks.removeFirst() }
+    }
+
+    /// queues one stop request for each worker after the pending tasks
+    @inlinable func stop() {
+      for _ in 0..<workerCount { add(nil) }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public init(topology: CpuTopology = .current) {
+    self.topology = topology
+    nodes = topology.nodes.map { NodeTasks(workerCount: $0.count) }
+    for (node, cpus) in topology.nodes.enumerated() {
+      let tasks = nodes[node]
+      for i in 0..<cpus.count {
+        // the thread holds only its task list, so releasing the pool
+        // stops the workers
+        let thread = Thread {
+          Thread.current.threadDictionary[PmapWorkers.workerKey] = true
+          CpuTopology.bindCurrentThread(to: cpus)
+          while let task = tasks.next() { task() }
+        }
+        thread.name = "pmap.node\(node).worker\(i)"
+        thread.start()
+      }
+    }
+  }
+
+  deinit {
+    shutdown()
+  }
+
+  //--------------------------------------------------------------------------
+  /// shutdown
+  /// stops the workers after they finish the tasks already queued.
+  /// Calling `run` after `shutdown` isn't supported.
+  @inlinable public func shutdown() {
+    mutex.access {
+      guard !isShutdown else { return }
+      isShutdown = true
+      for tasks in nodes { tasks.stop() }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// node(for:of:
+  /// - Returns: the node that processes `partition`. Contiguous blocks of
+  ///   partitions are assigned to each node.
+  @inlinable public func node(for partition: Int, of count: Int) -> Int {
+    partition * nodes.count / count
+  }
+
+  //--------------------------------------------------------------------------
+  /// run(_:_:
+  /// invokes `body` for each partition on the workers of its node and
+  /// returns when all partitions are complete
+  @inlinable public func run(_ count: Int, _ body: @escaping (Int) -> Void) {
+    // a nested call on a worker runs inline, because every worker of a
+    // node could otherwise be waiting for tasks queued behind itself
+    guard !PmapWorkers.isWorkerThread else {
+      for i in 0..<count { body(i) }
+      return
+    }
+
+    let group = DispatchGroup()
+    for i in 0..<count {
+      group.enter()
+      nodes[node(for: i, of: count)].add {
+        body(i)
+        group.leave()
+      }
     }
     group.wait()
   }
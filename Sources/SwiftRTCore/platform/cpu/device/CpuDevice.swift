@@ -105,7 +105,7 @@ public final class CpuDeviceMemory: DeviceMemory {
 
   @inlinable deinit {
     if !isReference {
-      buffer.deallocate()
+      CpuMemoryPool.shared.deallocate(buffer)
       #if DEBUG
         if let name = name, let msg = releaseMessage {
           diagnostic(.release, "\(name)\(msg)", categories: .dataAlloc)
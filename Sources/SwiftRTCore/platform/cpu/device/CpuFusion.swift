@@ -0,0 +1,581 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import Numerics
+
+//==============================================================================
+/// the number of elements computed at a time by a fused loop. The
+/// intermediate values of a block stay in the cpu cache.
+public var fusedBlockSize = 512
+
+//==============================================================================
+/// using(lazyEvaluation:_:
+/// selects whether the current cpu queue defers elementwise operations
+/// within the scope of the body. Deferred operations are fused into a
+/// single loop when a result is read, the queue is synchronized, or the
+/// scope ends. Results that are released before then are never computed
+/// or allocated. Other queues run the body unchanged.
+/// - Parameters:
+///  - isLazy: `true` to defer elementwise operations
+///  - body: a closure where the evaluation mode will be used
+@inlinable public func using<R>(
+  lazyEvaluation isLazy: Bool,
+  _ body: () throws -> R
+) rethrows -> R {
+  guard let queue = (currentQueue as AnyObject) as? CpuQueue else {
+    return try body()
+  }
+  let previous = queue.isLazy
+  queue.isLazy = isLazy
+  defer { queue.isLazy = previous }
+  return try body()
+}
+
+//==============================================================================
+/// FusedOp
+/// the elementwise operations that a lazy cpu queue can defer
+public enum FusedOp {
+  case add, subtract, multiply, divide, min, max
+  case neg, abs, sqrt, squared, exp, log, tanh, sigmoid
+}
+
+/// LazyOperand
+/// an argument of a deferred operation
+public enum LazyOperand<S: TensorShape, E: StorageElement> {
+  case tensor(Tensor<S, E>)
+  case value(E.Value)
+}
+
+//==============================================================================
+/// LazyFusion
+/// the pending fusion graphs of a cpu queue for each element type
+public final class LazyFusion {
+  @usableFromInline var floatGraph: FusionGraph<Float>?
+  @usableFromInline var doubleGraph: FusionGraph<Double>?
+
+  @inlinable public init() {}
+
+  /// evaluate
+  /// computes the pending results of every graph
+  @inlinable public func evaluate() {
+    floatGraph?.evaluate()
+    doubleGraph?.evaluate()
+  }
+}
+
+//==============================================================================
+// CpuQueue lazy evaluation
+extension CpuQueue {
+  //--------------------------------------------------------------------------
+  /// deferred(_:_:into:
+  /// records an elementwise operation in the fusion graph when the queue
+  /// is lazy. Only dense row ordered `Float` and `Double` results are
+  /// deferred.
+  /// - Parameters:
+  ///  - op: the operation
+  ///  - operands: the arguments of the operation
+  ///  - out: the result tensor
+  /// - Returns: `true` if the operation was deferred, otherwise the
+  ///   caller performs it
+  @inlinable func deferred<S, E>(
+    _ op: FusedOp,
+    _ operands: LazyOperand<S, E>...,
+    into out: Tensor<S, E>
+  ) -> Bool {
+    guard isLazy, let queue = (self as AnyObject) as? Platform.Device.Queue
+    else { return false }
+
+    if E.Value.self == Float.self {
+      if fusion.floatGraph == nil { fusion.floatGraph = FusionGraph() }
+      return fusion.floatGraph!.record(op, operands, out, on: queue)
+    } else if E.Value.self == Double.self {
+      if fusion.doubleGraph == nil { fusion.doubleGraph = FusionGraph() }
+      return fusion.doubleGraph!.record(op, operands, out, on: queue)
+    }
+    return false
+  }
+}
+
+//==============================================================================
+/// FusionGraph
+/// A DAG of deferred elementwise operations on tensors of the same shape.
+/// Each node writes a result storage that is only weakly referenced, so
+/// intermediate results that the application has released are evaluated
+/// block by block in scratch memory and never allocated. The results that
+/// are still in use are computed together by one parallel loop.
+public final class FusionGraph<Value>: LazyEvaluation, Logging
+where Value: BinaryFloatingPoint & Real & StorageElement {
+  //--------------------------------------------------------------------------
+  @usableFromInline enum Operand {
+    case node(Int)
+    case leaf(Int)
+    case constant(Value)
+  }
+
+  @usableFromInline struct Node {
+    @usableFromInline let op: FusedOp
+    @usableFromInline let operands: [Operand]
+    @usableFromInline weak var output: Platform.Storage?
+    @usableFromInline let base: Int
+
+    @inlinable init(
+      _ op: FusedOp,
+      _ operands: [Operand],
+      _ output: Platform.Storage,
+      _ base: Int
+    ) {
+      self.op = op
+      self.operands = operands
+      self.output = output
+      self.base = base
+    }
+  }
+
+  /// a tensor read by the graph
+  @usableFromInline struct Leaf {
+    @usableFromInline let storage: Platform.Storage
+    @usableFromInline let base: Int
+    @usableFromInline let spanCount: Int
+    @usableFromInline let strides: [Int]
+    @usableFromInline let isContiguous: Bool
+
+    @inlinable init<S, E>(_ tensor: Tensor<S, E>) {
+      storage = tensor.storage
+      base = tensor.storageBase
+      spanCount = tensor.spanCount
+      strides = tensor.strides.array
+      // a transposed view is contiguous, but not in row order
+      isContiguous = tensor.isContiguous
+        && tensor.strides == tensor.shape.strides(for: .row)
+    }
+  }
+
+  /// the maximum number of nodes before the graph is evaluated
+  public static var maxNodes: Int { 64 }
+
+  /// the queue that evaluates the graph. It is only held while operations
+  /// are pending, so the queue outlives its deferred work.
+  @usableFromInline var queue: Platform.Device.Queue?
+  @usableFromInline var nodes: [Node] = []
+  @usableFromInline var leaves: [Leaf] = []
+  /// the shape of every node and leaf
+  @usableFromInline var shape: [Int] = []
+  /// the node index of each pending result storage
+  @usableFromInline var outputs: [ObjectIdentifier: Int] = [:]
+
+  //--------------------------------------------------------------------------
+  @inlinable public init() {}
+
+  //--------------------------------------------------------------------------
+  /// record(_:_:_:on:
+  /// adds a node to the graph
+  /// - Returns: `false` if the operation can't be deferred
+  @inlinable func record<S, E>(
+    _ op: FusedOp,
+    _ operands: [LazyOperand<S, E>],
+    _ out: Tensor<S, E>,
+    on queue: Platform.Device.Queue
+  ) -> Bool {
+    assert(E.Value.self == Value.self)
+    var tensors = [Tensor<S, E>]()
+    for case let .tensor(t) in operands { tensors.append(t) }
+
+    // the graph indexes every tensor by its row major element position
+    guard
+      out.isValueAddressable && out.isContiguous && out.order == .row
+        && out.strides == out.shape.strides(for: .row)
+        && out.storage.pendingWriter == nil && out.storage.pendingReader == nil
+        && tensors.allSatisfy({
+          $0.isValueAddressable && $0.count == out.count && $0.order == .row
+        })
+    else { return false }
+
+    // complete the other deferred computations that share the operands,
+    // so this graph can't be evaluated while the node is built
+    for t in tensors {
+      if let writer = t.storage.pendingWriter, writer !== self { writer.evaluate() }
+      if let reader = t.storage.pendingReader, reader !== self { reader.evaluate() }
+    }
+
+    let shape = out.shape.array
+    if !nodes.isEmpty
+      && (shape != self.shape || nodes.count == Self.maxNodes
+        || !tensors.allSatisfy({ isFusable($0) }))
+    {
+      evaluate()
+    }
+    self.shape = shape
+    self.queue = queue
+
+    let sources = operands.map { operand -> Operand in
+      switch operand {
+      case let .tensor(t): return source(t)
+      case let .value(v): return .constant(unsafeBitCast(v, to: Value.self))
+      }
+    }
+    outputs[ObjectIdentifier(out.storage)] = nodes.count
+    nodes.append(Node(op, sources, out.storage, out.storageBase))
+    out.storage.pendingWriter = self
+
+    diagnostic(
+      .queueCpu, "\(op)(\(tensors.map { $0.name })) deferred on \(queue.name)",
+      categories: .queueCpu)
+    return true
+  }
+
+  //--------------------------------------------------------------------------
+  /// `true` if the tensor is not a pending result, or is a whole
+  /// pending result of this graph
+  @inlinable func isFusable<S, E>(_ t: Tensor<S, E>) -> Bool {
+    guard t.storage.pendingWriter === self else { return true }
+    guard let index = outputs[ObjectIdentifier(t.storage)] else { return false }
+    return t.isContiguous && t.storageBase == nodes[index].base
+  }
+
+  /// the operand that reads `t`
+  @inlinable func source<S, E>(_ t: Tensor<S, E>) -> Operand {
+    if t.storage.pendingWriter === self,
+      let index = outputs[ObjectIdentifier(t.storage)]
+    {
+      return .node(index)
+    }
+    t.storage.pendingReader = self
+    leaves.append(Leaf(t))
+    return .leaf(leaves.count - 1)
+  }
+
+  //==========================================================================
+  // compiled form
+  /// where an instruction reads its elements
+  @usableFromInline enum Source {
+    /// a dense buffer indexed by element position
+    case dense(UnsafePointer<Value>)
+    /// a scratch block
+    case scratch(Int)
+    /// a repeated value
+    case repeated(UnsafePointer<Value>)
+    case constant(Value)
+  }
+
+  /// an argument resolved for a block
+  @usableFromInline enum Argument {
+    case elements(UnsafePointer<Value>)
+    case value(Value)
+  }
+
+  @usableFromInline struct Instruction {
+    @usableFromInline let op: FusedOp
+    @usableFromInline let a: Source
+    @usableFromInline let b: Source
+    /// the result buffer indexed by element position, or a scratch block
+    @usableFromInline let result: UnsafeMutablePointer<Value>?
+    @usableFromInline let scratch: Int
+
+    @inlinable init(
+      _ op: FusedOp, _ a: Source, _ b: Source,
+      _ result: UnsafeMutablePointer<Value>?, _ scratch: Int
+    ) {
+      (self.op, self.a, self.b) = (op, a, b)
+      (self.result, self.scratch) = (result, scratch)
+    }
+  }
+
+  /// a strided leaf copied to a scratch block
+  @usableFromInline struct Gather {
+    @usableFromInline let elements: UnsafePointer<Value>
+    @usableFromInline let loops: StridedLoops
+    @usableFromInline let scratch: Int
+
+    @inlinable init(
+      _ elements: UnsafePointer<Value>, _ loops: StridedLoops, _ scratch: Int
+    ) {
+      (self.elements, self.loops, self.scratch) = (elements, loops, scratch)
+    }
+
+    @inlinable func copy(_ start: Int, _ count: Int, to out: UnsafeMutablePointer<Value>) {
+      let (rowLength, stride) = (loops.rowLength, loops.strides[0].last!)
+      var i = start
+      while i < start + count {
+        let (row, col) = i.quotientAndRemainder(dividingBy: rowLength)
+        let n = Swift.min(rowLength - col, start + count - i)
+        let src = elements + loops.offset(row: row, operand: 0) + col * stride
+        let dst = out + (i - start)
+        for j in 0..<n { dst[j] = src[j * stride] }
+        i += n
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// release(_:
+  /// removes a released result from the graph. The graph is discarded
+  /// without being evaluated when none of its results are referenced.
+  public func release(_ buffer: StorageBuffer) {
+    outputs[ObjectIdentifier(buffer)] = nil
+    guard let queue = queue, nodes.allSatisfy({ $0.output == nil })
+    else { return }
+    diagnostic(
+      .queueCpu, "discarded \(nodes.count) unused ops on \(queue.name)",
+      categories: .queueCpu)
+    let leaves = self.leaves
+    reset()
+    for leaf in leaves where leaf.storage.pendingReader === self {
+      leaf.storage.pendingReader = nil
+    }
+  }
+
+  /// removes the pending operations and releases the queue
+  @inlinable func reset() {
+    nodes = []
+    leaves = []
+    outputs = [:]
+    queue = nil
+  }
+
+  //--------------------------------------------------------------------------
+  /// evaluate
+  /// computes the results that are still referenced with a single
+  /// parallel loop over blocks of `fusedBlockSize` elements
+  public func evaluate() {
+    guard !nodes.isEmpty, let queue = queue else { return }
+    let (nodes, leaves, shape) = (self.nodes, self.leaves, self.shape)
+    reset()
+    for leaf in leaves where leaf.storage.pendingReader === self {
+      leaf.storage.pendingReader = nil
+    }
+
+    // hold the live results until they are written
+    let results = nodes.map { $0.output }
+    for case let storage? in results where storage.pendingWriter === self {
+      storage.pendingWriter = nil
+    }
+
+    // find the nodes that contribute to a live result
+    var isNeeded = results.map { $0 != nil }
+    for i in nodes.indices.reversed() where isNeeded[i] {
+      for case let .node(j) in nodes[i].operands { isNeeded[j] = true }
+    }
+    let liveCount = results.reduce(0) { $0 + ($1 == nil ? 0 : 1) }
+    guard liveCount > 0 else {
+      diagnostic(
+        .queueCpu, "discarded \(nodes.count) unused ops on \(queue.name)",
+        categories: .queueCpu)
+      return
+    }
+
+    //----------------------------------
+    // compile the needed nodes into instructions. Intermediate values
+    // use scratch blocks, which are reused after their last use.
+    let count = shape.reduce(1, *)
+    var lastUse = Array(nodes.indices)
+    for i in nodes.indices where isNeeded[i] {
+      for case let .node(j) in nodes[i].operands { lastUse[j] = i }
+    }
+
+    var scratchCount = 0
+    var freeScratch = [Int]()
+    func allocateScratch() -> Int {
+      if let index = freeScratch.popLast() { return index }
+      scratchCount += 1
+      return scratchCount - 1
+    }
+
+    var gathers = [Gather]()
+    let leafSources = leaves.map { leaf -> Source in
+      let elements = leaf.storage.read(
+        type: Value.self, at: leaf.base, count: leaf.spanCount,
+        using: queue
+      ).baseAddress!
+      if leaf.spanCount == 1 { return .repeated(elements) }
+      if leaf.isContiguous { return .dense(elements) }
+      let loops = StridedLoops(shape: shape, strides: [leaf.strides])
+      gathers.append(Gather(elements, loops, allocateScratch()))
+      return .scratch(gathers.last!.scratch)
+    }
+
+    var program = [Instruction]()
+    var nodeSources = [Source?](repeating: nil, count: nodes.count)
+    for (i, node) in nodes.enumerated() where isNeeded[i] {
+      let sources = node.operands.map { operand -> Source in
+        switch operand {
+        case let .node(j): return nodeSources[j]!
+        case let .leaf(j): return leafSources[j]
+        case let .constant(v): return .constant(v)
+        }
+      }
+      // release operand scratch blocks, which can hold the result
+      for case let .node(j) in node.operands where lastUse[j] == i {
+        if case let .scratch(index)? = nodeSources[j],
+          !freeScratch.contains(index)
+        {
+          freeScratch.append(index)
+        }
+      }
+
+      let a = sources[0]
+      let b = sources.count > 1 ? sources[1] : .constant(0)
+      if let storage = results[i] {
+        let result = storage.readWrite(
+          type: Value.self, at: node.base, count: count, using: queue
+        ).baseAddress!
+        program.append(Instruction(node.op, a, b, result, 0))
+        nodeSources[i] = .dense(UnsafePointer(result))
+      } else {
+        let index = allocateScratch()
+        program.append(Instruction(node.op, a, b, nil, index))
+        nodeSources[i] = .scratch(index)
+      }
+    }
+
+    diagnostic(
+      .queueCpu,
+      "fused \(program.count) ops into \(liveCount) results "
+        + "\(Value.self)[\(count)] on \(queue.name)",
+      categories: .queueCpu)
+
+    //----------------------------------
+    // execute the program a block at a time
+    let blockSize = Swift.max(1, fusedBlockSize)
+    let blockCount = (count + blockSize - 1) / blockSize
+    let grainSize = Swift.max(1, 16384 / blockSize)
+    let scratchSize = scratchCount * blockSize
+
+    func run() {
+      CpuThreadPool.shared.parallelFor(blockCount, grainSize: grainSize) {
+        let scratch = UnsafeMutablePointer<Value>.allocate(
+          capacity: Swift.max(1, scratchSize))
+        defer { scratch.deallocate() }
+
+        for block in $0 {
+          let start = block * blockSize
+          let n = Swift.min(blockSize, count - start)
+          for gather in gathers {
+            gather.copy(start, n, to: scratch + gather.scratch * blockSize)
+          }
+
+          func argument(_ source: Source) -> Argument {
+            switch source {
+            case let .dense(p): return .elements(p + start)
+            case let .scratch(i): return .elements(scratch + i * blockSize)
+            case let .repeated(p): return .value(p[0])
+            case let .constant(v): return .value(v)
+            }
+          }
+
+          for instruction in program {
+            let out = instruction.result.map { $0 + start }
+              ?? scratch + instruction.scratch * blockSize
+            Self.execute(
+              instruction.op, argument(instruction.a),
+              argument(instruction.b), out, n)
+          }
+        }
+      }
+    }
+
+    queue.cpu_execute(run)
+  }
+
+  //==========================================================================
+  // block kernels
+  @inlinable static func execute(
+    _ op: FusedOp,
+    _ a: Argument,
+    _ b: Argument,
+    _ out: UnsafeMutablePointer<Value>,
+    _ count: Int
+  ) {
+    switch op {
+    case .add: map(a, b, out, count) { $0 + $1 }
+    case .subtract: map(a, b, out, count) { $0 - $1 }
+    case .multiply: map(a, b, out, count) { $0 * $1 }
+    case .divide: map(a, b, out, count) { $0 / $1 }
+    case .min: map(a, b, out, count) { $0 < $1 ? $0 : $1 }
+    case .max: map(a, b, out, count) { $0 >= $1 ? $0 : $1 }
+    case .neg: map(a, out, count) { -$0 }
+    case .abs: map(a, out, count) { Swift.abs($0) }
+    case .sqrt: map(a, out, count) { $0.squareRoot() }
+    case .squared: map(a, out, count) { $0 * $0 }
+    case .exp:
+      map(a, out, count, VectorMath.exp, VectorMath.exp) { .exp($0) }
+    case .log:
+      map(a, out, count, VectorMath.log, VectorMath.log) { .log($0) }
+    case .tanh:
+      map(a, out, count, VectorMath.tanh, VectorMath.tanh) { .tanh($0) }
+    case .sigmoid:
+      map(a, out, count, VectorMath.sigmoid, VectorMath.sigmoid) {
+        1 / (1 + .exp(-$0))
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable static func map(
+    _ a: Argument,
+    _ b: Argument,
+    _ out: UnsafeMutablePointer<Value>,
+    _ count: Int,
+    _ op: (Value, Value) -> Value
+  ) {
+    switch (a, b) {
+    case let (.elements(a), .elements(b)):
+      for i in 0..<count { out[i] = op(a[i], b[i]) }
+    case let (.elements(a), .value(b)):
+      for i in 0..<count { out[i] = op(a[i], b) }
+    case let (.value(a), .elements(b)):
+      for i in 0..<count { out[i] = op(a, b[i]) }
+    case let (.value(a), .value(b)):
+      let v = op(a, b)
+      for i in 0..<count { out[i] = v }
+    }
+  }
+
+  @inlinable static func map(
+    _ a: Argument,
+    _ out: UnsafeMutablePointer<Value>,
+    _ count: Int,
+    _ op: (Value) -> Value
+  ) {
+    map(a, .value(0), out, count) { x, _ in op(x) }
+  }
+
+  /// uses the `VectorMath` kernels for elements when they are enabled
+  @inlinable static func map(
+    _ a: Argument,
+    _ out: UnsafeMutablePointer<Value>,
+    _ count: Int,
+    _ float: (SIMD16<Float>) -> SIMD16<Float>,
+    _ double: (SIMD8<Double>) -> SIMD8<Double>,
+    _ op: (Value) -> Value
+  ) {
+    if useVectorMath, case let .elements(x) = a {
+      let (x, out) = (UnsafeRawPointer(x), UnsafeMutableRawPointer(out))
+      if Value.self == Float.self {
+        VectorMath.map(
+          x.assumingMemoryBound(to: Float.self),
+          out.assumingMemoryBound(to: Float.self), count: count, float)
+        return
+      } else if Value.self == Double.self {
+        VectorMath.map(
+          x.assumingMemoryBound(to: Double.self),
+          out.assumingMemoryBound(to: Double.self), count: count, double)
+        return
+      }
+    }
+    map(a, out, count, op)
+  }
+}
@@ -0,0 +1,369 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+#if os(macOS) || os(iOS) || os(watchOS) || os(tvOS)
+  import Darwin
+#elseif os(Windows)
+  import ucrt
+#else
+  import Glibc
+#endif
+
+//==============================================================================
+/// CpuMemoryPool
+/// A caching allocator for host memory buffers. Freed buffers are kept in
+/// free lists by size class and handed out again, so a loop that creates
+/// the same temporaries every step stops calling the system allocator
+/// after the first step.
+///
+/// Every buffer is aligned to a cache line. Requests of a huge page or
+/// more are rounded up to whole huge pages, aligned to the huge page size
+/// and, on Linux, advised to use transparent huge pages.
+///
+/// Small buffers are returned to a cache owned by the freeing thread,
+/// which only that thread locks, except while statistics are collected.
+/// The cache is found through a pthread thread local key, so the fast path
+/// is an uncontended lock and no dictionary lookup. Buffers that don't fit
+/// there go to the free lists shared by all threads.
+public final class CpuMemoryPool {
+  /// the alignment of every buffer, which is a cache line
+  public static let alignment = 64
+  /// the size class granularity and alignment of large buffers
+  public static let hugePageSize = 2 * 1024 * 1024
+  /// the number of size classes between consecutive powers of two
+  public static let classesPerDoubling = 4
+
+  /// the pool used by cpu storage and queues. The cpu devices all address
+  /// the same host memory, so they share one pool.
+  public static let shared = CpuMemoryPool()
+
+  /// `true` to cache freed buffers. When `false`, buffers are allocated
+  /// from and released to the system.
+  public var isEnabled = true
+  /// the maximum number of bytes kept in the shared free lists
+  public var maxBytesCached: Int
+  /// the largest buffer kept in a thread cache
+  public let threadCacheBlockLimit: Int
+  /// the maximum number of bytes kept in each thread cache
+  public let threadCacheCapacity: Int
+
+  let mutex = Mutex()
+  var freeLists: [Int: [UnsafeMutableRawPointer]] = [:]
+  var threadCaches: [WeakThreadCache] = []
+  var counters = Statistics()
+  /// the thread local key of each thread's cache, which holds a retained
+  /// reference that is released when the thread exits
+  let threadCacheKey: pthread_key_t
+
+  //--------------------------------------------------------------------------
+  /// Statistics
+  /// a snapshot of the pool counters
+  public struct Statistics: Equatable, CustomStringConvertible {
+    /// the number of allocations served from a free list
+    public var hits = 0
+    /// the number of allocations served by the system
+    public var misses = 0
+    /// the number of bytes held in free lists
+    public var bytesCached = 0
+    /// the number of bytes allocated from the system and not released
+    public var bytesReserved = 0
+    /// the largest value of `bytesReserved`
+    public var peakBytesReserved = 0
+
+    /// the number of bytes held by clients of the pool
+    public var bytesInUse: Int { bytesReserved - bytesCached }
+
+    /// the fraction of allocations served from a free list
+    public var hitRate: Double {
+      hits + misses == 0 ? 0 : Double(hits) / Double(hits + misses)
+    }
+
+    public var description: String {
+      "hits: \(hits) misses: \(misses) cached: \(bytesCached) "
+        + "in use: \(bytesInUse) peak: \(peakBytesReserved)"
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// - Parameters:
+  ///  - maxBytesCached: the maximum number of bytes kept in the shared
+  ///    free lists. The default is a quarter of the physical memory.
+  ///  - threadCacheBlockLimit: the largest buffer kept in a thread cache
+  ///  - threadCacheCapacity: the maximum number of bytes kept in each
+  ///    thread cache
+  public init(
+    maxBytesCached: Int = Int(ProcessInfo.processInfo.physicalMemory / 4),
+    threadCacheBlockLimit: Int = 256 * 1024,
+    threadCacheCapacity: Int = 4 * 1024 * 1024
+  ) {
+    self.maxBytesCached = maxBytesCached
+    self.threadCacheBlockLimit = threadCacheBlockLimit
+    self.threadCacheCapacity = threadCacheCapacity
+
+    var key = pthread_key_t()
+    #if os(Linux)
+      let status = pthread_key_create(&key) {
+        if let cache = $0 {
+          Unmanaged<CpuThreadCache>.fromOpaque(cache).release()
+        }
+      }
+    #else
+      let status = pthread_key_create(&key) {
+        Unmanaged<CpuThreadCache>.fromOpaque($0).release()
+      }
+    #endif
+    precondition(status == 0, "failed to create the thread cache key")
+    threadCacheKey = key
+  }
+
+  deinit {
+    // thread caches keep their pool alive, so only the shared lists remain
+    for (size, blocks) in freeLists {
+      blocks.forEach { CpuMemoryPool.systemDeallocate($0, size) }
+    }
+    pthread_key_delete(threadCacheKey)
+  }
+
+  //--------------------------------------------------------------------------
+  /// blockSize(for:
+  /// - Parameter byteCount: the number of bytes requested
+  /// - Returns: the size of the size class that holds `byteCount` bytes.
+  ///   Each power of two is divided into `classesPerDoubling` classes in
+  ///   multiples of `alignment`, and huge page requests are rounded up to
+  ///   whole huge pages.
+  public static func blockSize(for byteCount: Int) -> Int {
+    if byteCount >= hugePageSize {
+      return (byteCount + hugePageSize - 1) / hugePageSize * hugePageSize
+    }
+    guard byteCount > alignment else { return alignment }
+    let lower = 1 << (Int.bitWidth - 1 - (byteCount - 1).leadingZeroBitCount)
+    let step = Swift.max(alignment, lower / classesPerDoubling)
+    return (byteCount + step - 1) / step * step
+  }
+
+  //--------------------------------------------------------------------------
+  /// allocate(byteCount:
+  /// - Parameter byteCount: the number of bytes to allocate
+  /// - Returns: an uninitialized buffer of `byteCount` bytes, which must
+  ///   be returned with `deallocate`
+  public func allocate(byteCount: Int) -> UnsafeMutableRawBufferPointer {
+    let size = CpuMemoryPool.blockSize(for: byteCount)
+    if isEnabled {
+      if size <= threadCacheBlockLimit, let block = threadCache.take(size) {
+        return UnsafeMutableRawBufferPointer(start: block, count: byteCount)
+      }
+      let cached = mutex.access { () -> UnsafeMutableRawPointer? in
+        guard let block = freeLists[size]?.popLast() else { return nil }
+        counters.hits += 1
+        counters.bytesCached -= size
+        return block
+      }
+      if let block = cached {
+        return UnsafeMutableRawBufferPointer(start: block, count: byteCount)
+      }
+    }
+
+    let block = CpuMemoryPool.systemAllocate(size)
+    mutex.access {
+      counters.misses += 1
+      counters.bytesReserved += size
+      counters.peakBytesReserved = Swift.max(
+        counters.peakBytesReserved, counters.bytesReserved)
+    }
+    return UnsafeMutableRawBufferPointer(start: block, count: byteCount)
+  }
+
+  //--------------------------------------------------------------------------
+  /// deallocate(_:
+  /// returns a buffer obtained from `allocate` to the pool
+  public func deallocate(_ buffer: UnsafeMutableRawBufferPointer) {
+    guard let block = buffer.baseAddress else { return }
+    let size = CpuMemoryPool.blockSize(for: buffer.count)
+    if isEnabled {
+      if size <= threadCacheBlockLimit && threadCache.put(block, size) {
+        return
+      }
+      let isCached = mutex.access { () -> Bool in
+        guard counters.bytesCached + size <= maxBytesCached else { return false }
+        freeLists[size, default: []].append(block)
+        counters.bytesCached += size
+        return true
+      }
+      if isCached { return }
+    }
+    release([block], size)
+  }
+
+  //--------------------------------------------------------------------------
+  /// trim
+  /// releases the buffers cached in the shared free lists and in the
+  /// calling thread's cache to the system
+  public func trim() {
+    if let cache = pthread_getspecific(threadCacheKey) {
+      let cache = Unmanaged<CpuThreadCache>.fromOpaque(cache)
+        .takeUnretainedValue()
+      for (size, blocks) in cache.removeAll() { release(blocks, size) }
+    }
+    let lists = mutex.access { () -> [Int: [UnsafeMutableRawPointer]] in
+      defer { freeLists = [:] }
+      counters.bytesCached = 0
+      return freeLists
+    }
+    for (size, blocks) in lists { release(blocks, size) }
+  }
+
+  //--------------------------------------------------------------------------
+  /// statistics
+  /// the counters of the shared free lists combined with those of the
+  /// thread caches
+  public var statistics: Statistics {
+    // the caches are collected under the pool lock but read outside it,
+    // because releasing the last reference to a cache locks the pool
+    let (caches, shared) = mutex.access {
+      (threadCaches.compactMap { $0.cache }, counters)
+    }
+    var stats = shared
+    for cache in caches {
+      cache.mutex.access {
+        stats.hits += cache.hits
+        stats.bytesCached += cache.bytesCached
+      }
+    }
+    return stats
+  }
+
+  //--------------------------------------------------------------------------
+  /// the cache of the calling thread, which is created on first use
+  var threadCache: CpuThreadCache {
+    if let cache = pthread_getspecific(threadCacheKey) {
+      return Unmanaged<CpuThreadCache>.fromOpaque(cache).takeUnretainedValue()
+    }
+    let cache = CpuThreadCache(pool: self, capacity: threadCacheCapacity)
+    pthread_setspecific(
+      threadCacheKey, Unmanaged.passRetained(cache).toOpaque())
+    mutex.access {
+      threadCaches.removeAll { $0.cache == nil }
+      threadCaches.append(WeakThreadCache(cache))
+    }
+    return cache
+  }
+
+  //--------------------------------------------------------------------------
+  /// reclaim
+  /// moves the contents of a thread cache that is being released to the
+  /// shared free lists
+  func reclaim(_ blocks: [Int: [UnsafeMutableRawPointer]], hits: Int) {
+    var overflow: [(Int, UnsafeMutableRawPointer)] = []
+    mutex.access {
+      counters.hits += hits
+      for (size, list) in blocks {
+        for block in list {
+          if counters.bytesCached + size <= maxBytesCached {
+            freeLists[size, default: []].append(block)
+            counters.bytesCached += size
+          } else {
+            overflow.append((size, block))
+          }
+        }
+      }
+    }
+    for (size, block) in overflow { release([block], size) }
+  }
+
+  //--------------------------------------------------------------------------
+  /// release
+  /// returns blocks of the same size class to the system
+  func release(_ blocks: [UnsafeMutableRawPointer], _ size: Int) {
+    guard !blocks.isEmpty else { return }
+    blocks.forEach { CpuMemoryPool.systemDeallocate($0, size) }
+    mutex.access { counters.bytesReserved -= size * blocks.count }
+  }
+
+  //--------------------------------------------------------------------------
+  static func systemAllocate(_ size: Int) -> UnsafeMutableRawPointer {
+    let isHuge = size >= hugePageSize
+    let block = UnsafeMutableRawPointer.allocate(
+      byteCount: size, alignment: isHuge ? hugePageSize : alignment)
+    #if os(Linux)
+      // a hint only, which fails harmlessly when huge pages are disabled
+      if isHuge { _ = madvise(block, size, MADV_HUGEPAGE) }
+    #endif
+    return block
+  }
+
+  static func systemDeallocate(_ block: UnsafeMutableRawPointer, _ size: Int) {
+    block.deallocate()
+  }
+}
+
+//==============================================================================
+/// CpuThreadCache
+/// The free lists of small buffers freed by one thread. The cache is held
+/// by a thread local key, so its contents move to the shared free lists
+/// when the thread exits.
+final class CpuThreadCache {
+  let pool: CpuMemoryPool
+  let capacity: Int
+  let mutex = Mutex()
+  var blocks: [Int: [UnsafeMutableRawPointer]] = [:]
+  var bytesCached = 0
+  var hits = 0
+
+  init(pool: CpuMemoryPool, capacity: Int) {
+    self.pool = pool
+    self.capacity = capacity
+  }
+
+  deinit {
+    pool.reclaim(blocks, hits: hits)
+  }
+
+  func take(_ size: Int) -> UnsafeMutableRawPointer? {
+    mutex.access {
+      guard let block = blocks[size]?.popLast() else { return nil }
+      bytesCached -= size
+      hits += 1
+      return block
+    }
+  }
+
+  func put(_ block: UnsafeMutableRawPointer, _ size: Int) -> Bool {
+    mutex.access {
+      guard bytesCached + size <= capacity else { return false }
+      blocks[size, default: []].append(block)
+      bytesCached += size
+      return true
+    }
+  }
+
+  func removeAll() -> [Int: [UnsafeMutableRawPointer]] {
+    mutex.access {
+      defer {
+        blocks = [:]
+        bytesCached = 0
+      }
+      return blocks
+    }
+  }
+}
+
+/// a weak reference to a thread cache held by its pool
+struct WeakThreadCache {
+  weak var cache: CpuThreadCache?
+  init(_ cache: CpuThreadCache) { self.cache = cache }
+}
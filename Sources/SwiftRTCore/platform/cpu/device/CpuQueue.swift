@@ -37,6 +37,14 @@ public final class CpuQueue: DeviceQueue, CpuFunctions {
   public let queueLimit: DispatchSemaphore
   public let usesCpu: Bool
 
+  /// the pending fusion graphs of lazy evaluation
+  public let fusion = LazyFusion()
+  /// `true` if elementwise operations are deferred and fused. Pending
+  /// results are computed when lazy evaluation ends.
+  public var isLazy = false {
+    didSet { if !isLazy { fusion.evaluate() } }
+  }
+
   //--------------------------------------------------------------------------
   // initializers
   @inlinable public init(
@@ -60,8 +68,10 @@ public final class CpuQueue: DeviceQueue, CpuFunctions {
   }
 
   deinit {
-    // make sure all scheduled work is complete before exiting
-    waitForCompletion()
+    // make sure all scheduled work is complete before exiting. A fusion
+    // graph holds its queue while it has pending operations, so there
+    // are none left to evaluate here.
+    if mode == .async { group.wait() }
     diagnostic(.release, "queue: \(name)", categories: .queueAlloc)
   }
 
@@ -71,12 +81,8 @@ public final class CpuQueue: DeviceQueue, CpuFunctions {
     byteCount: Int,
     heapIndex: Int = 0
   ) -> DeviceMemory {
-    // allocate a host memory buffer suitably aligned for any type
-    let buffer =
-      UnsafeMutableRawBufferPointer
-      .allocate(
-        byteCount: byteCount,
-        alignment: MemoryLayout<Int>.alignment)
+    // allocate a cache line aligned host buffer from the memory pool
+    let buffer = CpuMemoryPool.shared.allocate(byteCount: byteCount)
     return CpuDeviceMemory(deviceIndex, buffer, memoryType)
   }
 
@@ -98,22 +104,57 @@ public final class CpuQueue: DeviceQueue, CpuFunctions {
     diagnostic(
       .wait, "\(name) will wait for event(\(event.id))",
       categories: .queueSync)
-    if mode == .async {
-      queue.async(group: group) {
-        event.wait()
-      }
-    } else {
-      event.wait()
-    }
+    cpu_execute(.sync) { event.wait() }
   }
 
   //--------------------------------------------------------------------------
   // waitForCompletion
   // the synchronous queue completes work as it is queued,
-  // so it is always complete
+  // so it is always complete once deferred operations are evaluated
   @inlinable public func waitForCompletion() {
+    fusion.evaluate()
     if mode == .async {
       group.wait()
     }
   }
 }
+
+//==============================================================================
+/// parallelFor(_:grainSize:_:
+/// divides `0..<count` into contiguous ranges of at least `grainSize`
+/// elements and invokes `body` for each range concurrently on the shared
+/// `CpuThreadPool`. It returns when all ranges have been processed.
+/// - Parameters:
+///  - count: the number of items to process
+///  - grainSize: the minimum number of items in a range. This should be
+///    large enough to amortize the cost of dispatching a range.
+///  - body: the function to process a range of items
+@inlinable public func parallelFor(
+  _ count: Int,
+  grainSize: Int = 1,
+  _ body: (Range<Int>) -> Void
+) {
+  CpuThreadPool.shared.parallelFor(count, grainSize: grainSize, body)
+}
+
+//==============================================================================
+/// parallelPartitions(_:grainSize:
+/// - Parameters:
+///  - count: the number of items to process
+///  - grainSize: the minimum number of items in a range
+/// - Returns: contiguous ranges covering `0..<count`, at most one per
+///   active processor. This is used by kernels that need a per range
+///   index, for example to accumulate into private partial buffers.
+@inlinable public func parallelPartitions(
+  _ count: Int,
+  grainSize: Int = 1
+) -> [Range<Int>] {
+  guard count > 0 else { return [] }
+  let processors = ProcessInfo.processInfo.activeProcessorCount
+  let rangeCount = Swift.max(
+    1, Swift.min(processors, count / Swift.max(1, grainSize)))
+  let size = (count + rangeCount - 1) / rangeCount
+  return stride(from: 0, to: count, by: size).map {
+    $0..<Swift.min($0 + size, count)
+  }
+}
@@ -27,6 +27,11 @@ public final class CpuStorage: StorageBuffer {
   public let isReadOnly: Bool
   public let isReference: Bool
   public var isZero: Bool
+  public var pendingWriter: LazyEvaluation?
+  public var pendingReader: LazyEvaluation?
+  public var writeVersion: Int = 0
+  /// the mapped file that holds the elements of a mapped buffer
+  public var mappedFile: MappedFile?
 
   /// the last queue used to write storage
   public var lastQueue: Platform.Device.Queue?
@@ -36,11 +41,51 @@ public final class CpuStorage: StorageBuffer {
     get {
       _name != defaultTensorName ? _name : "\(defaultTensorName)(\(id))"
     }
-    set { _name = newValue }
+    set {
+      _name = newValue
+      if let allocation = _allocation {
+        MemoryAccounting.shared.rename(allocation, to: newValue)
+      }
+    }
   }
 
   // implementation properties
-  public let hostBuffer: UnsafeMutableRawBufferPointer
+  @usableFromInline var _hostBuffer: UnsafeMutableRawBufferPointer?
+  /// the accounting record of the host buffer
+  @usableFromInline var _allocation: MemoryAccounting.Allocation?
+
+  /// serializes the allocation of the host buffer
+  @usableFromInline let hostBufferMutex = Mutex()
+
+  /// the host memory buffer. It is allocated from the memory pool on
+  /// first access, so a buffer that is never read or written, such as a
+  /// discarded lazy result, uses no memory.
+  @inlinable public var hostBuffer: UnsafeMutableRawBufferPointer {
+    hostBuffer(using: Platform.syncQueue)
+  }
+
+  /// hostBuffer(using:
+  /// - Parameter queue: the queue accessing the buffer, which the
+  ///   allocation is attributed to
+  /// - Returns: the host memory buffer, allocated on first access
+  @inlinable public func hostBuffer(
+    using queue: Platform.Device.Queue
+  ) -> UnsafeMutableRawBufferPointer {
+    hostBufferMutex.access {
+      if let buffer = _hostBuffer { return buffer }
+      let buffer = CpuMemoryPool.shared.allocate(byteCount: byteCount)
+      _hostBuffer = buffer
+      _allocation = MemoryAccounting.shared.allocated(
+        byteCount, name: _name, deviceIndex: queue.deviceIndex,
+        queueId: queue.id)
+
+      #if DEBUG
+        diagnostic(
+          .alloc, "\(name) [\(byteCount) bytes]", categories: .dataAlloc)
+      #endif
+      return buffer
+    }
+  }
 
   //--------------------------------------------------------------------------
   // init(type:count:name:
@@ -53,20 +98,14 @@ public final class CpuStorage: StorageBuffer {
       MemoryLayout<Element>.size != 0,
       "type: \(Element.self) is size 0")
     _name = name
-    alignment = MemoryLayout<Element>.alignment
+    // the buffer is allocated from the pool
+    alignment = Swift.max(
+      MemoryLayout<Element>.alignment, CpuMemoryPool.alignment)
     byteCount = MemoryLayout<Element>.size * count
     id = Platform.objectId.next
     isReadOnly = false
     isReference = false
     isZero = false
-
-    hostBuffer = UnsafeMutableRawBufferPointer.allocate(
-      byteCount: byteCount,
-      alignment: alignment)
-
-    #if DEBUG
-      diagnostic(.alloc, "\(self.name) " + "\(Element.self)[\(count)]", categories: .dataAlloc)
-    #endif
   }
 
   //--------------------------------------------------------------------------
@@ -96,20 +135,30 @@ public final class CpuStorage: StorageBuffer {
     copying other: CpuStorage,
     using queue: Platform.Device.Queue
   ) {
-    alignment = other.alignment
+    // a copy of a read only reference, such as a read only mapped
+    // file, is made to be written, so it owns its buffer
+    let isReference = other.isReference && !other.isReadOnly
+    alignment = isReference
+      ? other.alignment
+      : Swift.max(other.alignment, CpuMemoryPool.alignment)
     byteCount = other.byteCount
     id = Platform.objectId.next
-    isReadOnly = other.isReadOnly
-    isReference = other.isReference
+    isReadOnly = false
+    self.isReference = isReference
     isZero = other.isZero
     _name = other._name
+    other.evaluatePending(willMutate: false)
     if isReference {
-      hostBuffer = other.hostBuffer
+      _hostBuffer = other.hostBuffer(using: queue)
+      mappedFile = other.mappedFile
     } else {
-      hostBuffer = UnsafeMutableRawBufferPointer.allocate(
-        byteCount: other.byteCount,
-        alignment: other.alignment)
-      hostBuffer.copyMemory(from: UnsafeRawBufferPointer(other.hostBuffer))
+      let buffer = CpuMemoryPool.shared.allocate(byteCount: other.byteCount)
+      buffer.copyMemory(
+        from: UnsafeRawBufferPointer(other.hostBuffer(using: queue)))
+      _hostBuffer = buffer
+      _allocation = MemoryAccounting.shared.allocated(
+        byteCount, name: _name, deviceIndex: queue.deviceIndex,
+        queueId: queue.id)
     }
   }
 
@@ -123,7 +172,7 @@ public final class CpuStorage: StorageBuffer {
     alignment = MemoryLayout<Element>.alignment
     byteCount = MemoryLayout<Element>.size * buffer.count
     let buff = UnsafeMutableBufferPointer(mutating: buffer)
-    hostBuffer = UnsafeMutableRawBufferPointer(buff)
+    _hostBuffer = UnsafeMutableRawBufferPointer(buff)
     id = Platform.objectId.next
     isReadOnly = true
     isReference = true
@@ -142,7 +191,7 @@ public final class CpuStorage: StorageBuffer {
     _name = name
     alignment = MemoryLayout<Element>.alignment
     byteCount = MemoryLayout<Element>.size * buffer.count
-    hostBuffer = UnsafeMutableRawBufferPointer(buffer)
+    _hostBuffer = UnsafeMutableRawBufferPointer(buffer)
     id = Platform.objectId.next
     isReadOnly = false
     isReference = true
@@ -163,11 +212,17 @@ public final class CpuStorage: StorageBuffer {
   //--------------------------------------------------------------------------
   // deinit
   @inlinable deinit {
-    // wait for any pending writes to complete
-    lastQueue?.waitForCompletion()
+    // a pending result that is released is removed from its deferred
+    // computation without evaluating it, so it is never computed
+    pendingWriter?.release(self)
+    // wait for the writes that are already scheduled to complete
+    lastQueue?.waitForScheduledWork()
 
-    if !isReference {
-      hostBuffer.deallocate()
+    if !isReference, let hostBuffer = _hostBuffer {
+      CpuMemoryPool.shared.deallocate(hostBuffer)
+      if let allocation = _allocation {
+        MemoryAccounting.shared.released(allocation)
+      }
       diagnostic(.release, self.name, categories: .dataAlloc)
     }
   }
@@ -202,9 +257,10 @@ public final class CpuStorage: StorageBuffer {
     count: Int,
     using queue: Platform.Device.Queue
   ) -> UnsafeBufferPointer<Element> {
+    evaluatePending(willMutate: false)
     synchronize(queue, willWrite: false)
     // advance to typed starting position
-    let start = hostBuffer.baseAddress!
+    let start = hostBuffer(using: queue).baseAddress!
       .bindMemory(to: Element.self, capacity: count)
       .advanced(by: index)
     // return read only buffer pointer
@@ -219,9 +275,11 @@ public final class CpuStorage: StorageBuffer {
     count: Int,
     using queue: Platform.Device.Queue
   ) -> UnsafeMutableBufferPointer<Element> {
+    evaluatePending(willMutate: true)
     synchronize(queue, willWrite: true)
+    writeVersion += 1
     // advance to typed starting position
-    let start = hostBuffer.baseAddress!
+    let start = hostBuffer(using: queue).baseAddress!
       .bindMemory(to: Element.self, capacity: count)
       .advanced(by: index)
     // return read/write buffer pointer
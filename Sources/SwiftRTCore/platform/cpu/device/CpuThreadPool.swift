@@ -0,0 +1,273 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+//==============================================================================
+/// CpuThreadPool
+/// A work stealing pool of persistent worker threads used to split the
+/// index range of a single queued operation across the cpu cores.
+///
+/// A parallel loop is divided into chunks, and the chunks are divided
+/// evenly into one slot per participant. Each participant takes chunks
+/// from the front of its own slot and, when that is empty, steals from
+/// the back of the other slots. The calling thread always participates,
+/// so a loop completes even if every worker is busy, and it returns only
+/// after all chunks have run. This keeps the ordering of operations on a
+/// serial `CpuQueue` unchanged.
+public final class CpuThreadPool {
+  /// the number of worker threads, excluding the calling thread
+  public let workerCount: Int
+  /// the estimated run time below which a loop runs inline
+  public var inlineNanoseconds: UInt64 = 30_000
+  /// the target run time of a single chunk
+  public var chunkNanoseconds: UInt64 = 50_000
+  /// the number of elements timed to estimate the cost of an operation
+  public var probeCount = 1024
+
+  @usableFromInline let mutex = Mutex()
+  @usableFromInline var jobs: [ParallelJob] = []
+  @usableFromInline let workAvailable = DispatchSemaphore(value: 0)
+
+  /// the pool shared by all cpu queues
+  public static let shared = CpuThreadPool()
+
+  /// the thread dictionary key that marks pool worker threads
+  @usableFromInline static let workerKey = "SwiftRT.CpuThreadPool.worker"
+
+  //--------------------------------------------------------------------------
+  /// - Parameter workerCount: the number of worker threads to create. The
+  ///   default leaves one core for the calling thread.
+  @inlinable public init(
+    workerCount: Int = ProcessInfo.processInfo.activeProcessorCount - 1
+  ) {
+    self.workerCount = Swift.max(0, workerCount)
+    for i in 0..<self.workerCount {
+      let thread = Thread { [unowned self] in self.workerLoop() }
+      thread.name = "CpuThreadPool.worker\(i)"
+      thread.start()
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// `true` if the current thread is a pool worker
+  @inlinable public static var isWorkerThread: Bool {
+    Thread.current.threadDictionary[workerKey] != nil
+  }
+
+  //--------------------------------------------------------------------------
+  @usableFromInline func workerLoop() {
+    Thread.current.threadDictionary[CpuThreadPool.workerKey] = true
+    while true {
+      workAvailable.wait()
+      while let job = mutex.access({ jobs.first { !$0.isDrained } }) {
+        job.participate()
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// parallelFor(_:grainSize:_:
+  /// invokes `body` with chunks of `0..<count` on the pool threads and
+  /// returns when all chunks have been processed.
+  /// - Parameters:
+  ///  - count: the number of items to process
+  ///  - grainSize: the minimum number of items in a chunk
+  ///  - body: the function to process a range of items
+  @inlinable public func parallelFor(
+    _ count: Int,
+    grainSize: Int = 1,
+    _ body: (Range<Int>) -> Void
+  ) {
+    guard count > 0 else { return }
+    let participants = workerCount + 1
+
+    // nested loops on a worker run inline, because the outer loop
+    // already occupies the pool
+    guard participants > 1, count > grainSize, !CpuThreadPool.isWorkerThread
+    else {
+      body(0..<count)
+      return
+    }
+
+    // a few chunks per participant leaves room to balance by stealing
+    let chunkSize = Swift.max(grainSize, count / (participants * 4), 1)
+    let chunkCount = (count + chunkSize - 1) / chunkSize
+    guard chunkCount > 1 else {
+      body(0..<count)
+      return
+    }
+
+    withoutActuallyEscaping(body) { body in
+      let job = ParallelJob(
+        count: count, chunkSize: chunkSize, chunkCount: chunkCount,
+        slotCount: Swift.min(participants, chunkCount), body: body)
+      mutex.access { jobs.append(job) }
+      for _ in 0..<Swift.min(workerCount, job.slots.count - 1) {
+        workAvailable.signal()
+      }
+
+      // participate, then wait for the workers to leave the job before
+      // releasing the body, which must not outlive this call
+      job.participate()
+      job.complete.wait()
+      mutex.access { jobs.removeAll { $0 === job } }
+      job.mutex.access { job.body = nil }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// adaptiveFor(_:_:
+  /// Times `body` on a small probe range to estimate the cost per item,
+  /// then runs the rest inline if it is cheap, or in chunks sized to
+  /// `chunkNanoseconds` on the pool threads.
+  /// - Parameters:
+  ///  - count: the number of items to process
+  ///  - body: the function to process a range of items
+  @inlinable public func adaptiveFor(
+    _ count: Int,
+    _ body: (Range<Int>) -> Void
+  ) {
+    let probe = Swift.min(count, probeCount)
+    guard probe > 0 else { return }
+    let start = DispatchTime.now().uptimeNanoseconds
+    body(0..<probe)
+    let remaining = count - probe
+    guard remaining > 0 else { return }
+
+    let elapsed = DispatchTime.now().uptimeNanoseconds - start
+    let nanosPerItem = Swift.max(1, elapsed / UInt64(probe))
+    if nanosPerItem * UInt64(remaining) < inlineNanoseconds {
+      body(probe..<count)
+    } else {
+      let grain = Swift.max(1, Int(chunkNanoseconds / nanosPerItem))
+      parallelFor(remaining, grainSize: grain) {
+        body(($0.lowerBound + probe)..<($0.upperBound + probe))
+      }
+    }
+  }
+}
+
+//==============================================================================
+/// ParallelJob
+/// The chunks of one parallel loop divided into stealable slots
+@usableFromInline final class ParallelJob {
+  @usableFromInline final class Slot {
+    @usableFromInline let mutex = Mutex()
+    @usableFromInline var lower: Int
+    @usableFromInline var upper: Int
+    @inlinable init(_ lower: Int, _ upper: Int) {
+      self.lower = lower
+      self.upper = upper
+    }
+
+    /// takes the next chunk from the front for the owner
+    @inlinable func takeFront() -> Int? {
+      mutex.access {
+        guard lower < upper else { return nil }
+        lower += 1
+        return lower - 1
+      }
+    }
+
+    /// steals a chunk from the back for another participant
+    @inlinable func takeBack() -> Int? {
+      mutex.access {
+        guard lower < upper else { return nil }
+        upper -= 1
+        return upper
+      }
+    }
+  }
+
+  @usableFromInline let count: Int
+  @usableFromInline let chunkSize: Int
+  @usableFromInline let chunkCount: Int
+  @usableFromInline let slots: [Slot]
+  @usableFromInline var body: ((Range<Int>) -> Void)?
+  @usableFromInline let mutex = Mutex()
+  @usableFromInline var nextParticipant = 0
+  @usableFromInline var activeParticipants = 0
+  @usableFromInline var finishedChunks = 0
+  @usableFromInline var isComplete = false
+  /// signaled when every chunk has run and all participants have left
+  @usableFromInline let complete = DispatchSemaphore(value: 0)
+
+  //--------------------------------------------------------------------------
+  @inlinable init(
+    count: Int,
+    chunkSize: Int,
+    chunkCount: Int,
+    slotCount: Int,
+    body: @escaping (Range<Int>) -> Void
+  ) {
+    self.count = count
+    self.chunkSize = chunkSize
+    self.chunkCount = chunkCount
+    self.body = body
+    let perSlot = (chunkCount + slotCount - 1) / slotCount
+    slots = stride(from: 0, to: chunkCount, by: perSlot).map {
+      Slot($0, Swift.min($0 + perSlot, chunkCount))
+    }
+  }
+
+  /// `true` when every chunk has been taken
+  @inlinable var isDrained: Bool {
+    slots.allSatisfy { slot in slot.mutex.access { slot.lower >= slot.upper } }
+  }
+
+  //--------------------------------------------------------------------------
+  /// participate
+  /// runs chunks from this participant's slot, then steals from the
+  /// others until every chunk has been taken
+  @inlinable func participate() {
+    let home = mutex.access { () -> Int in
+      activeParticipants += 1
+      nextParticipant += 1
+      return (nextParticipant - 1) % slots.count
+    }
+    var finished = 0
+    while let chunk = slots[home].takeFront() {
+      run(chunk)
+      finished += 1
+    }
+    for i in 1..<Swift.max(1, slots.count) {
+      let victim = slots[(home + i) % slots.count]
+      while let chunk = victim.takeBack() {
+        run(chunk)
+        finished += 1
+      }
+    }
+
+    // the last participant to leave after all chunks have run
+    // releases the caller. Participants arriving after that find no
+    // chunks and don't touch the body.
+    let isLast = mutex.access { () -> Bool in
+      finishedChunks += finished
+      activeParticipants -= 1
+      guard !isComplete && activeParticipants == 0
+        && finishedChunks == chunkCount else { return false }
+      isComplete = true
+      return true
+    }
+    if isLast { complete.signal() }
+  }
+
+  @inlinable func run(_ chunk: Int) {
+    let lower = chunk * chunkSize
+    body!(lower..<Swift.min(lower + chunkSize, count))
+  }
+}
@@ -0,0 +1,103 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+#if os(macOS) || os(iOS) || os(watchOS) || os(tvOS)
+  import Darwin
+#elseif os(Windows)
+  import ucrt
+#else
+  import Glibc
+#endif
+
+//==============================================================================
+/// CpuTopology
+/// The logical cpus of the host grouped by NUMA node. On Linux the nodes
+/// are read from sysfs. Other platforms, and hosts where the node
+/// information is unavailable, are described as a single node.
+public struct CpuTopology: Equatable {
+  /// the logical cpu numbers of each NUMA node
+  public let nodes: [[Int]]
+
+  /// the total number of logical cpus
+  @inlinable public var cpuCount: Int { nodes.reduce(0) { $0 + $1.count } }
+
+  //--------------------------------------------------------------------------
+  @inlinable public init(nodes: [[Int]]) {
+    assert(!nodes.isEmpty && nodes.allSatisfy { !$0.isEmpty })
+    self.nodes = nodes
+  }
+
+  //--------------------------------------------------------------------------
+  /// the topology of the current host
+  public static let current: CpuTopology = {
+    let cpuCount = ProcessInfo.processInfo.activeProcessorCount
+    let single = CpuTopology(nodes: [Array(0..<cpuCount)])
+    #if os(Linux)
+      let root = "/sys/devices/system/node"
+      guard let entries = try? FileManager.default.contentsOfDirectory(atPath: root)
+      else { return single }
+      let nodes = entries
+        .filter { $0.hasPrefix("node") && Int($0.dropFirst(4)) != nil }
+        .sorted { Int($0.dropFirst(4))! < Int($1.dropFirst(4))! }
+        .compactMap { try? String(contentsOfFile: "\(root)/\($0)/cpulist") }
+        .map { parseCpuList($0) }
+        .filter { !$0.isEmpty }
+      return nodes.isEmpty ? single : CpuTopology(nodes: nodes)
+    #else
+      return single
+    #endif
+  }()
+
+  //--------------------------------------------------------------------------
+  /// parseCpuList(_:
+  /// - Parameter list: a Linux cpu list such as "0-3,8-11"
+  /// - Returns: the listed cpu numbers
+  @inlinable public static func parseCpuList(_ list: String) -> [Int] {
+    list.trimmingCharacters(in: .whitespacesAndNewlines)
+      .split(separator: ",")
+      .flatMap { range -> [Int] in
+        let bounds = range.split(separator: "-").compactMap { Int($0) }
+        switch bounds.count {
+        case 1: return bounds
+        case 2 where bounds[0] <= bounds[1]: return Array(bounds[0]...bounds[1])
+        default: return []
+        }
+      }
+  }
+
+  //--------------------------------------------------------------------------
+  /// bindCurrentThread(to:
+  /// restricts the current thread to the listed cpus. This is a no-op on
+  /// platforms without thread affinity.
+  /// - Returns: `true` if the affinity was set
+  @discardableResult
+  public static func bindCurrentThread(to cpus: [Int]) -> Bool {
+    #if os(Linux)
+      var set = cpu_set_t()
+      let capacity = MemoryLayout<cpu_set_t>.size * 8
+      withUnsafeMutableBytes(of: &set) { bytes in
+        for cpu in cpus where cpu < capacity {
+          bytes[cpu / 8] |= UInt8(1 << (cpu % 8))
+        }
+      }
+      return sched_setaffinity(0, MemoryLayout<cpu_set_t>.size, &set) == 0
+    #else
+      return false
+    #endif
+  }
+}
@@ -0,0 +1,366 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Dispatch
+import Foundation
+import Numerics
+
+//==============================================================================
+/// CpuAutotuner
+/// Chooses the gemm blocking and the forward convolution algorithm by
+/// timing a small set of candidates on the machine the kernels run on,
+/// because the choice that is fastest on one cpu can be much slower on
+/// another.
+///
+/// When tuning is enabled, the first matmul or convolution of a new shape
+/// class is tuned, and the winner is stored in `ExecutionPlans.shared`, so
+/// later calls reuse it, and in its database when `SWIFTRT_PLAN_DATABASE`
+/// is set, so later processes reuse it. Tuning can also be run offline
+/// over a list of problems with `tune(_:output:)`, which writes a plan
+/// database that can be shipped with a model and selected the same way.
+public final class CpuAutotuner {
+  /// the tuner used by the cpu functions
+  public static let shared = CpuAutotuner()
+
+  /// `true` to tune problems that don't have a stored plan. The default
+  /// is `true` if the `SWIFTRT_AUTOTUNE` environment variable is set to
+  /// a value other than `0`.
+  public var isEnabled: Bool
+  /// the maximum time in seconds spent tuning one problem. Each candidate
+  /// is timed at least once, and the candidates that haven't been timed
+  /// when the budget runs out are skipped.
+  public var timeBudget: TimeInterval = 0.1
+  /// the fraction by which a candidate must be faster than the best one
+  /// timed before it, so timing noise doesn't change the choice between
+  /// nearly equal candidates and tuning the same problem again gives the
+  /// same result
+  public var margin = 0.05
+  /// the gemm blockings that are timed. The first is the default, and
+  /// is kept unless another is faster.
+  public var gemmCandidates: [CpuGemmBlocking]
+  /// the maximum number of lhs rows a gemm is timed with. The blocking
+  /// doesn't depend on the number of rows once there are enough to fill
+  /// the caches, so large problems are timed on their leading rows.
+  public var maximumGemmRows = 256
+  /// the maximum number of images a convolution is timed with. The
+  /// algorithm choice depends on the image and filter geometry, so large
+  /// batches are timed on their leading images.
+  public var maximumConvolutionBatch = 4
+
+  //--------------------------------------------------------------------------
+  public init() {
+    let setting = ProcessInfo.processInfo.environment["SWIFTRT_AUTOTUNE"]
+    isEnabled = setting != nil && setting != "0"
+
+    let current = CpuGemmBlocking.current
+    var candidates = [current]
+    for rows in [2, 4, 8] {
+      for panelWidth in [4, 8, 16] {
+        let blocking = CpuGemmBlocking(rows: rows, panelWidth: panelWidth)
+        if blocking != current { candidates.append(blocking) }
+      }
+    }
+    gemmCandidates = candidates
+  }
+
+  //--------------------------------------------------------------------------
+  /// fastest(_:_:_:
+  /// times candidates within `timeBudget`. Each candidate is run once to
+  /// warm the caches, and then repeatedly for its share of the budget.
+  /// - Parameters:
+  ///  - count: the number of candidates
+  ///  - problem: the problem description used in diagnostics
+  ///  - run: runs the candidate with the given index
+  /// - Returns: the index of the fastest candidate
+  public func fastest(
+    _ count: Int,
+    _ problem: @autoclosure () -> String,
+    _ run: (Int) -> Void
+  ) -> Int {
+    assert(count > 0)
+    let start = DispatchTime.now().uptimeNanoseconds
+    let budget = UInt64(Swift.max(0, timeBudget) * 1e9)
+    let deadline = start + budget
+    let slice = budget / UInt64(count)
+    var times: [UInt64] = []
+
+    for candidate in 0..<count {
+      run(candidate)
+      var time = UInt64.max
+      let sliceEnd = DispatchTime.now().uptimeNanoseconds + slice
+      var end: UInt64
+      repeat {
+        let begin = DispatchTime.now().uptimeNanoseconds
+        run(candidate)
+        end = DispatchTime.now().uptimeNanoseconds
+        time = Swift.min(time, end - begin)
+      } while end < sliceEnd
+      times.append(time)
+
+      if end >= deadline && candidate < count - 1 {
+        diagnostic(
+          .setup, "tuning \(problem()) skipped \(count - candidate - 1) "
+            + "candidates after the time budget", categories: .setup)
+        break
+      }
+    }
+    return Self.fastest(times, margin: margin)
+  }
+
+  //--------------------------------------------------------------------------
+  /// fastest(_:margin:
+  /// - Parameters:
+  ///  - times: the times of the candidates in the order they were timed
+  ///  - margin: the fraction by which a candidate must be faster than the
+  ///    best one before it to be chosen
+  /// - Returns: the index of the chosen candidate. Ties and differences
+  ///   within the margin keep the earlier candidate.
+  public static func fastest(_ times: [UInt64], margin: Double) -> Int {
+    var best = 0
+    for (candidate, time) in times.enumerated()
+    where Double(time) < Double(times[best]) * (1 - margin) {
+      best = candidate
+    }
+    return best
+  }
+
+  //--------------------------------------------------------------------------
+  /// tuneGemm(_:m:k:n:plans:
+  /// times the gemm blocking candidates for the product of an `m` by `k`
+  /// and a `k` by `n` matrix, and stores the fastest in `plans`
+  /// - Returns: the fastest blocking
+  @inlinable public func tuneGemm<E>(
+    _ type: E.Type,
+    m: Int, k: Int, n: Int,
+    plans: ExecutionPlans = ExecutionPlans.shared
+  ) -> CpuGemmBlocking where E: StorageElement, E.Value: Numeric {
+    let candidates = gemmCandidates
+    let rows = Swift.min(m, maximumGemmRows)
+    let one = E.Value(exactly: 1)!
+    let lhs = [E.Value](repeating: one, count: rows * k)
+    var out = [E.Value](repeating: 0, count: rows * n)
+
+    // the values don't change the time, so the panels are filled
+    // instead of packed from a tensor
+    let source = TensorR2<E>(shape: Shape2(k, n)).version
+    let packed = candidates.map { blocking -> PackedMatrix<E> in
+      let width = blocking.panelWidth
+      let panelCount = (n + width - 1) / width
+      return PackedMatrix(
+        rows: k, cols: n, panelWidth: width,
+        panels: [E.Value](repeating: one, count: panelCount * k * width),
+        isTransposed: false, source: source)
+    }
+
+    let problem = "gemm \(E.self) [\(m), \(k)] x [\(k), \(n)]"
+    let winner = lhs.withUnsafeBufferPointer { a in
+      out.withUnsafeMutableBufferPointer { c in
+        fastest(candidates.count, problem) {
+          packed[$0].multiply(
+            a, lhsRows: rows, into: c, blockRows: candidates[$0].rows)
+        }
+      }
+    }
+
+    let blocking = candidates[winner]
+    diagnostic(
+      .setup, "tuned \(problem): rows \(blocking.rows) "
+        + "panelWidth \(blocking.panelWidth)", categories: .setup)
+    plans.add(
+      plan: blocking, CpuGemmBlocking.self,
+      key: CpuGemmBlocking.planKey(for: type, m: m, k: k, n: n))
+    return blocking
+  }
+
+  //--------------------------------------------------------------------------
+  /// tuneConvolution(_:_:_:plans:
+  /// times the forward convolution algorithms for a problem, and stores
+  /// the fastest in `plans`
+  /// - Returns: the fastest plan
+  @inlinable public func tuneConvolution<S, E>(
+    _ problem: ConvolutionProblem,
+    _ shape: S.Type,
+    _ type: E.Type,
+    plans: ExecutionPlans = ExecutionPlans.shared
+  ) -> CpuConvolutionPlan
+  where S: TensorShape, E: StorageElement & Numeric,
+    E.Value: Real & BinaryFloatingPoint
+  {
+    func makeShape(_ values: [Int], default value: Int) -> S {
+      var shape = S(repeating: value)
+      for i in 0..<Swift.min(values.count, S.rank) { shape[i] = values[i] }
+      return shape
+    }
+
+    let convolution = CpuConvolution<S, E, E>(
+      activation: .identity,
+      strides: makeShape(problem.strides ?? [], default: 1),
+      padding: problem.padding == "same" ? .same : .valid,
+      dilations: makeShape(problem.dilations ?? [], default: 1),
+      properties: ConvolutionProperties(),
+      deviceId: 0,
+      filterBiasBackpropQueueIndex: 0)
+
+    // the values don't change the time
+    let x = Tensor<S, E>(repeating: 1, to: makeShape(problem.data, default: 1))
+    let filter = Tensor<S, E>(
+      repeating: 1, to: makeShape(problem.filter, default: 1))
+    let bias = TensorR1<E>(repeating: 0, to: Shape1(problem.filter.last ?? 1))
+    return convolution.tuneForward(
+      x, filter, bias, tuner: self, plans: plans)
+  }
+
+  //==========================================================================
+  /// GemmProblem
+  /// the product of an `m` by `k` and a `k` by `n` matrix
+  public struct GemmProblem: Codable {
+    public var m: Int
+    public var k: Int
+    public var n: Int
+    /// the element type, `Float` or `Double`. The default is `Float`.
+    public var type: String?
+
+    public init(m: Int, k: Int, n: Int, type: String? = nil) {
+      self.m = m
+      self.k = k
+      self.n = n
+      self.type = type
+    }
+  }
+
+  //==========================================================================
+  /// ConvolutionProblem
+  /// a forward convolution of NWC, NHWC, or NDHWC data
+  public struct ConvolutionProblem: Codable {
+    /// the data shape, such as `[batch, height, width, channels]`
+    public var data: [Int]
+    /// the filter shape, such as `[height, width, in, out]`
+    public var filter: [Int]
+    /// the spatial strides. The default is 1.
+    public var strides: [Int]?
+    /// the spatial dilations. The default is 1.
+    public var dilations: [Int]?
+    /// `same` or `valid`. The default is `valid`.
+    public var padding: String?
+    /// the element type, `Float` or `Double`. The default is `Float`.
+    public var type: String?
+
+    public init(
+      data: [Int],
+      filter: [Int],
+      strides: [Int]? = nil,
+      dilations: [Int]? = nil,
+      padding: String? = nil,
+      type: String? = nil
+    ) {
+      self.data = data
+      self.filter = filter
+      self.strides = strides
+      self.dilations = dilations
+      self.padding = padding
+      self.type = type
+    }
+  }
+
+  //==========================================================================
+  /// Problems
+  /// the list of problems tuned by `tune(_:output:)`, which is read from
+  /// a json file such as
+  /// `{"gemm": [{"m": 128, "k": 512, "n": 512}],
+  ///   "convolution": [{"data": [8, 32, 32, 16], "filter": [3, 3, 16, 32],
+  ///                    "padding": "same"}]}`
+  public struct Problems: Codable {
+    public var gemm: [GemmProblem]
+    public var convolution: [ConvolutionProblem]
+
+    public init(
+      gemm: [GemmProblem] = [],
+      convolution: [ConvolutionProblem] = []
+    ) {
+      self.gemm = gemm
+      self.convolution = convolution
+    }
+
+    public init(from decoder: Decoder) throws {
+      let container = try decoder.container(keyedBy: CodingKeys.self)
+      gemm = try container.decodeIfPresent(
+        [GemmProblem].self, forKey: .gemm) ?? []
+      convolution = try container.decodeIfPresent(
+        [ConvolutionProblem].self, forKey: .convolution) ?? []
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// tune(_:output:
+  /// tunes each problem and writes the winners to a new plan database at
+  /// `path`. The keys and plans are written in a canonical order, so the
+  /// file is the same for the same set of winners. Timing noise can still
+  /// choose different winners on another run.
+  public func tune(_ problems: Problems, output path: String) throws {
+    let database = ExecutionPlanDatabase(path: path)
+    database.removeAll()
+    database.savesOnStore = false
+    let plans = ExecutionPlans(
+      capacity: problems.gemm.count + problems.convolution.count,
+      database: database)
+
+    func failure(_ message: String) -> PlatformError {
+      PlatformError.functionFailure(location: "CpuAutotuner", message: message)
+    }
+
+    for problem in problems.gemm {
+      let (m, k, n) = (problem.m, problem.k, problem.n)
+      switch problem.type ?? "Float" {
+      case "Float": _ = tuneGemm(Float.self, m: m, k: k, n: n, plans: plans)
+      case "Double": _ = tuneGemm(Double.self, m: m, k: k, n: n, plans: plans)
+      case let type: throw failure("unsupported gemm type \(type)")
+      }
+    }
+
+    func tune<S: TensorShape>(
+      _ problem: ConvolutionProblem,
+      _ shape: S.Type
+    ) throws {
+      switch problem.type ?? "Float" {
+      case "Float": _ = tuneConvolution(problem, shape, Float.self, plans: plans)
+      case "Double": _ = tuneConvolution(problem, shape, Double.self, plans: plans)
+      case let type: throw failure("unsupported convolution type \(type)")
+      }
+    }
+
+    for problem in problems.convolution {
+      guard problem.filter.count == problem.data.count else {
+        throw failure(
+          "filter \(problem.filter) doesn't match data \(problem.data)")
+      }
+      switch problem.data.count {
+      case 3: try tune(problem, Shape3.self)
+      case 4: try tune(problem, Shape4.self)
+      case 5: try tune(problem, Shape5.self)
+      default: throw failure("convolution data must be NWC, NHWC, or NDHWC")
+      }
+    }
+    try database.save()
+  }
+
+  //--------------------------------------------------------------------------
+  /// tune(problemsAt:output:
+  /// the tune command, which reads the problems from a json file
+  public func tune(problemsAt path: String, output: String) throws {
+    let data = try Data(contentsOf: URL(fileURLWithPath: path))
+    try tune(JSONDecoder().decode(Problems.self, from: data), output: output)
+  }
+}
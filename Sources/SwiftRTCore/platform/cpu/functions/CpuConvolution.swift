@@ -15,6 +15,7 @@
 //
 
 import Foundation
+import Numerics
 
 //==============================================================================
 // ConvolutionProperties
@@ -127,13 +128,863 @@ extension DeviceQueue where Self: CpuFunctions {
 
 //==============================================================================
 /// CpuConvolution
+/// The cpu kernels compute in the filter value type, so they are available
+/// when the data and filter values are the same floating point type.
+/// That can't be expressed in the `DeviceConvolution` constraints, so
+/// `CpuConvolutionKernels` is conditionally conformed and checked when
+/// the convolution is used.
 public final class CpuConvolution<Shape, Element, FilterElement>:
   DeviceConvolution<Shape, Element, FilterElement>
 where
   Shape: TensorShape,
   Element: StorageElement & Numeric,
   FilterElement: StorageElement & Numeric
-{}
+{
+  // properties
+  public let dataQueue: Platform.Device.Queue
+  /// the queue used to compute the filter and bias gradients, so they
+  /// can overlap the data gradient computed on `dataQueue`
+  public let filterBiasBackQueue: Platform.Device.Queue
+  public let filterBiasBackQueueIndex: Int
+  /// the filter packed as a gemm rhs matrix for the im2col algorithm
+  public var packedFilter: PackedMatrix<FilterElement>?
+  /// the filter transformed for the Winograd algorithm by output tile
+  /// size. The `WinogradFilter` element type depends on the kernel
+  /// constraints, so the transforms are stored type erased.
+  public var winogradFilters: [Int: AnyObject] = [:]
+  /// the forward algorithm chosen for the last geometry, so the stored
+  /// plans are only searched when the geometry changes
+  public var cachedForwardPlan:
+    (geometry: ConvolutionGeometry, plan: CpuConvolutionPlan)?
+
+  //--------------------------------------------------------------------------
+  @inlinable public override init(
+    activation: ActivationType,
+    strides: Shape,
+    padding: Padding,
+    dilations: Shape,
+    properties: ConvolutionProperties,
+    deviceId: Int,
+    filterBiasBackpropQueueIndex: Int
+  ) {
+    dataQueue = currentQueue
+    filterBiasBackQueueIndex = filterBiasBackpropQueueIndex
+    filterBiasBackQueue = platform.validQueue(
+      deviceId, filterBiasBackpropQueueIndex)
+    super.init(
+      activation: activation,
+      strides: strides,
+      padding: padding,
+      dilations: dilations,
+      properties: properties,
+      deviceId: deviceId,
+      filterBiasBackpropQueueIndex: filterBiasBackpropQueueIndex)
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public override func forward(
+    x: Data,
+    filter: Filter,
+    bias: Bias,
+    mode: EvaluationMode
+  ) -> Data {
+    guard let kernels = self as? CpuConvolutionKernels else {
+      fatalError(
+        "cpu convolution is not supported for Element: \(Element.self) "
+          + "FilterElement: \(FilterElement.self)")
+    }
+    return kernels.forward(x, filter, bias) as! Data
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public override func backward(
+    y: Data,
+    yDiff: Data,
+    filter: Filter,
+    filterDiff: inout Filter,
+    bias: Bias,
+    biasDiff: inout Bias,
+    x: Data,
+    xDiff: inout Data,
+    mode: EvaluationMode
+  ) {
+    guard let kernels = self as? CpuConvolutionKernels else {
+      fatalError(
+        "cpu convolution is not supported for Element: \(Element.self) "
+          + "FilterElement: \(FilterElement.self)")
+    }
+    let (fd, bd, xd) = kernels.backward(y, yDiff, filter, x)
+    filterDiff = fd as! Filter
+    biasDiff = bd as! Bias
+    xDiff = xd as! Data
+  }
+}
+
+//==============================================================================
+/// CpuConvolutionKernels
+/// type erased entry points to the cpu convolution kernels
+public protocol CpuConvolutionKernels {
+  func forward(_ x: Any, _ filter: Any, _ bias: Any) -> Any
+  func backward(_ y: Any, _ yDiff: Any, _ filter: Any, _ x: Any)
+    -> (filterDiff: Any, biasDiff: Any, xDiff: Any)
+}
+
+//==============================================================================
+/// ConvolutionGeometry
+/// The dimensions of a convolution normalized to three spatial dimensions
+/// ordered depth, height, width. Missing leading spatial dimensions are
+/// given an extent of 1, so the same kernels handle NWC, NHWC, and NDHWC.
+public struct ConvolutionGeometry: Equatable {
+  public let batch: Int
+  public let inChannels: Int
+  public let outChannels: Int
+  public let input: [Int]
+  public let output: [Int]
+  public let filter: [Int]
+  public let strides: [Int]
+  public let dilations: [Int]
+  /// the padding before the first input position. The padding after the
+  /// last position is implied by `output`, and taps that fall in either
+  /// are skipped by the kernels.
+  public let padding: [Int]
+  /// `true` to flip the filter for true convolution
+  public let isFlipped: Bool
+
+  /// the number of filter values contributing to one output value
+  @inlinable public var filterCount: Int {
+    filter[0] * filter[1] * filter[2] * inChannels
+  }
+
+  /// the number of output rows, where a row is all output positions
+  /// along the width dimension
+  @inlinable public var outputRows: Int { batch * output[0] * output[1] }
+
+  //--------------------------------------------------------------------------
+  @inlinable public init<Shape: TensorShape>(
+    x: Shape,
+    filter: Shape,
+    strides: Shape,
+    dilations: Shape,
+    padding: Padding,
+    mode: ConvolutionMode
+  ) {
+    let spatial = Shape.rank - 2
+    assert(
+      spatial >= 1 && spatial <= 3,
+      "convolution data must be NWC, NHWC, or NDHWC")
+    assert(
+      filter[Shape.rank - 2] == x[Shape.rank - 1],
+      "filter input channels must equal data channels")
+
+    func normalized(_ shape: Shape, _ start: Int) -> [Int] {
+      [Int](repeating: 1, count: 3 - spatial)
+        + (0..<spatial).map { shape[start + $0] }
+    }
+
+    batch = x[0]
+    inChannels = x[Shape.rank - 1]
+    outChannels = filter[Shape.rank - 1]
+    input = normalized(x, 1)
+    self.filter = normalized(filter, 0)
+    self.strides = normalized(strides, 0)
+    self.dilations = normalized(dilations, 0)
+    isFlipped = mode == .convolution
+
+    // same padding gives `ceil(input / stride)` outputs. The total padding
+    // is split with the extra element after, so an even filter extent
+    // is padded asymmetrically.
+    var pad = [Int](repeating: 0, count: 3)
+    var out = [Int](repeating: 0, count: 3)
+    for i in 0..<3 {
+      let extent = (self.filter[i] - 1) * self.dilations[i] + 1
+      if padding == .same {
+        out[i] = (input[i] + self.strides[i] - 1) / self.strides[i]
+        let total = Swift.max(
+          (out[i] - 1) * self.strides[i] + extent - input[i], 0)
+        pad[i] = total / 2
+      } else {
+        out[i] = (input[i] - extent) / self.strides[i] + 1
+      }
+      assert(out[i] > 0, "convolution filter extent exceeds the padded input")
+    }
+    self.padding = pad
+    self.output = out
+  }
+
+  //--------------------------------------------------------------------------
+  /// outputShape(like:
+  /// - Returns: the shape of the convolution output for data shaped `x`
+  @inlinable public func outputShape<Shape: TensorShape>(like x: Shape) -> Shape {
+    let spatial = Shape.rank - 2
+    var shape = x
+    for i in 0..<spatial { shape[i + 1] = output[3 - spatial + i] }
+    shape[Shape.rank - 1] = outChannels
+    return shape
+  }
+}
+
+//==============================================================================
+/// CpuConvolutionPlan
+/// the forward algorithm chosen for a convolution problem, which is
+/// stored in `ExecutionPlans.shared`
+public struct CpuConvolutionPlan: Codable, Equatable {
+  /// the Winograd output tile size, or `nil` to not use Winograd
+  public var winogradTile: Int?
+  /// `true` to use the im2col gemm when Winograd isn't used
+  public var useGemm: Bool
+
+  @inlinable public init(winogradTile: Int? = nil, useGemm: Bool) {
+    self.winogradTile = winogradTile
+    self.useGemm = useGemm
+  }
+}
+
+//==============================================================================
+// CpuConvolution kernels
+extension CpuConvolution: CpuConvolutionKernels
+where
+  Element.Value == FilterElement.Value,
+  FilterElement.Value: Real & BinaryFloatingPoint
+{
+  public typealias Value = FilterElement.Value
+
+  //--------------------------------------------------------------------------
+  @inlinable public func forward(_ x: Any, _ filter: Any, _ bias: Any) -> Any {
+    forward(x as! Data, filter as! Filter, bias as! Bias)
+  }
+
+  //--------------------------------------------------------------------------
+  /// forward
+  /// computes `activation(convolution(x, filter) + bias)`
+  @inlinable public func forward(
+    _ x: Data,
+    _ filter: Filter,
+    _ bias: Bias
+  ) -> Data {
+    let g = ConvolutionGeometry(
+      x: x.shape, filter: filter.shape, strides: strides,
+      dilations: dilations, padding: padding, mode: properties.mode)
+    assert(bias.count == g.outChannels, "bias count must equal output channels")
+    inputShape = x.shape
+    var y = Data(shape: g.outputShape(like: x.shape), order: x.order)
+
+    // select the algorithm
+    let useGemm: Bool
+    var winogradTile: Int?
+    switch properties.forwardAlgorithm {
+    case .direct: useGemm = false
+    case .gemm, .implicitGEMM, .implicitPrecompGEMM: useGemm = true
+    case .winograd, .winogradNonFused:
+      winogradTile = Self.winogradTileSize(g, requested: true)
+      useGemm = winogradTile == nil && Self.preferGemm(g)
+    default:
+      let plan = forwardPlan(x, filter, bias, g)
+      winogradTile = plan.winogradTile
+      useGemm = plan.useGemm
+    }
+    let algorithm = winogradTile.map { "winograd F(\($0)x\($0), 3x3)" }
+      ?? (useGemm ? "im2col gemm" : "direct")
+    diagnostic(
+      .queueCpu,
+      "convolution(\(x.name), filter: \(filter.name)) "
+        + "\(algorithm) on \(dataQueue.name)",
+      categories: .queueCpu)
+
+    // Winograd reuses the filter transformed into the Winograd domain
+    let winograd = winogradTile.map { winogradFilter(filter, g, m: $0) }
+
+    // the im2col algorithm reuses the filter packed as a gemm matrix
+    var packed: PackedMatrix<FilterElement>?
+    if useGemm {
+      let matrix = TensorR2<FilterElement>(
+        reshaping: filter, to: Shape2(g.filterCount, g.outChannels))
+      if let cached = packedFilter, cached.isPacking(of: matrix, transposed: false) {
+        packed = cached
+      } else {
+        packed = PackedMatrix(matrix)
+        packedFilter = packed
+      }
+    }
+
+    let epilogue = activationFunction()
+    let workspaceLimit = properties.forwardWorkspaceLimit
+    let xs = x.elements, fs = filter.elements, bs = bias.elements
+
+    func execute<O: MutableCollection>(_ out: O) where O.Element == Value {
+      var out = out
+      let x = [Value](xs), b = [Value](bs)
+      var y = [Value](repeating: 0, count: out.count)
+      x.withUnsafeBufferPointer { x in
+        b.withUnsafeBufferPointer { b in
+          y.withUnsafeMutableBufferPointer { y in
+            if let winograd = winograd {
+              Self.forwardWinograd(g, x, winograd, b, epilogue, y)
+            } else if let packed = packed {
+              Self.forwardGemm(g, x, packed, b, epilogue, workspaceLimit, y)
+            } else {
+              let w = [Value](fs)
+              w.withUnsafeBufferPointer {
+                Self.forwardDirect(g, x, $0, b, epilogue, y)
+              }
+            }
+          }
+        }
+      }
+      zip(out.indices, y).forEach { out[$0] = $1 }
+    }
+
+    if y.order == .row {
+      let out = y.mutableBuffer
+      dataQueue.cpu_execute { execute(out) }
+    } else {
+      let out = y.mutableElements
+      dataQueue.cpu_execute { execute(out) }
+    }
+    return y
+  }
+
+  //--------------------------------------------------------------------------
+  /// activationFunction
+  /// - Returns: the activation as an epilogue function, or `nil` for identity
+  @inlinable public func activationFunction() -> ((Value) -> Value)? {
+    guard activation != .identity else { return nil }
+    let ceiling = properties.activationReluCeiling
+    return ceiling > 0
+      ? activation.function(Value.self, reluCeiling: Value(ceiling))
+      : activation.function(Value.self)
+  }
+
+  //--------------------------------------------------------------------------
+  /// forwardPlan(_:_:_:_:
+  /// - Returns: the stored or tuned plan of the geometry, or the heuristic
+  ///   choice if there isn't one. The choice is kept for the next call
+  ///   with the same geometry.
+  @inlinable public func forwardPlan(
+    _ x: Data,
+    _ filter: Filter,
+    _ bias: Bias,
+    _ g: ConvolutionGeometry
+  ) -> CpuConvolutionPlan {
+    if let cached = cachedForwardPlan, cached.geometry == g {
+      return cached.plan
+    }
+
+    var choice: CpuConvolutionPlan
+    let stored = ExecutionPlans.shared.query(
+      CpuConvolutionPlan.self, key: Self.forwardPlanKey(g))
+    if let plan = stored ?? (CpuAutotuner.shared.isEnabled
+      ? tuneForward(x, filter, bias) : nil)
+    {
+      // a stored Winograd tile is only used if it fits the geometry
+      choice = plan
+      if Self.winogradTileSize(g, requested: true) == nil {
+        choice.winogradTile = nil
+      }
+      choice.useGemm = choice.winogradTile == nil && plan.useGemm
+    } else {
+      let tile = Self.winogradTileSize(g, requested: false)
+      choice = CpuConvolutionPlan(
+        winogradTile: tile, useGemm: tile == nil && Self.preferGemm(g))
+    }
+    cachedForwardPlan = (g, choice)
+    return choice
+  }
+
+  //--------------------------------------------------------------------------
+  /// forwardPlanKey
+  /// - Returns: the execution plan key of the forward algorithm choice
+  @inlinable public static func forwardPlanKey(
+    _ g: ConvolutionGeometry
+  ) -> ExecutionPlanKey {
+    ExecutionPlanKey(
+      op: "convolution.forward",
+      shapes: [
+        [ExecutionPlanKey.shapeClass(g.batch)] + g.input + [g.inChannels],
+        g.filter, [g.outChannels],
+      ],
+      types: [Element.self, FilterElement.self],
+      strides: [g.strides, g.dilations, g.padding])
+  }
+
+  //--------------------------------------------------------------------------
+  /// tuneForward(_:_:_:tuner:plans:
+  /// times the forward algorithms that apply to a problem with `tuner`,
+  /// and stores the fastest in `plans`. The heuristic choice is timed
+  /// first, so it is kept unless another algorithm is faster. At most
+  /// `tuner.maximumConvolutionBatch` images are timed.
+  /// - Returns: the fastest plan
+  @inlinable public func tuneForward(
+    _ x: Data,
+    _ filter: Filter,
+    _ bias: Bias,
+    tuner: CpuAutotuner = CpuAutotuner.shared,
+    plans cache: ExecutionPlans = ExecutionPlans.shared
+  ) -> CpuConvolutionPlan {
+    let g = ConvolutionGeometry(
+      x: x.shape, filter: filter.shape, strides: strides,
+      dilations: dilations, padding: padding, mode: properties.mode)
+    var timedShape = x.shape
+    timedShape[0] = Swift.min(x.shape[0], Swift.max(1, tuner.maximumConvolutionBatch))
+    let timed = ConvolutionGeometry(
+      x: timedShape, filter: filter.shape, strides: strides,
+      dilations: dilations, padding: padding, mode: properties.mode)
+
+    let tile = Self.winogradTileSize(g, requested: false)
+    var plans = [
+      CpuConvolutionPlan(
+        winogradTile: tile, useGemm: tile == nil && Self.preferGemm(g)),
+      CpuConvolutionPlan(useGemm: false),
+      CpuConvolutionPlan(useGemm: true),
+    ]
+    if let largest = Self.winogradTileSize(g, requested: true) {
+      for m in [2, 4] where m <= largest {
+        plans.append(CpuConvolutionPlan(winogradTile: m, useGemm: false))
+      }
+    }
+    var candidates: [CpuConvolutionPlan] = []
+    for plan in plans where !candidates.contains(plan) {
+      candidates.append(plan)
+    }
+
+    // the filter is transformed and packed before timing, as it is
+    // reused by the forward calls
+    var winograd: [Int: WinogradPlan] = [:]
+    for m in candidates.compactMap({ $0.winogradTile }) {
+      winograd[m] = winogradFilter(filter, g, m: m)
+    }
+    let packed = PackedMatrix(
+      TensorR2<FilterElement>(
+        reshaping: filter, to: Shape2(g.filterCount, g.outChannels)))
+
+    let epilogue = activationFunction()
+    let workspaceLimit = properties.forwardWorkspaceLimit
+    let (xs, ws, bs) = usingSyncQueue {
+      ([Value](x.elements.prefix(timedShape.elementCount())),
+       [Value](filter.elements), [Value](bias.elements))
+    }
+    var ys = [Value](
+      repeating: 0, count: timed.outputRows * timed.output[2] * timed.outChannels)
+
+    let problem = "convolution \(Value.self) data \(x.shape.array) "
+      + "filter \(filter.shape.array)"
+    let winner = xs.withUnsafeBufferPointer { x in
+      ws.withUnsafeBufferPointer { w in
+        bs.withUnsafeBufferPointer { b in
+          ys.withUnsafeMutableBufferPointer { y in
+            tuner.fastest(candidates.count, problem) {
+              let plan = candidates[$0]
+              if let m = plan.winogradTile {
+                Self.forwardWinograd(timed, x, winograd[m]!, b, epilogue, y)
+              } else if plan.useGemm {
+                Self.forwardGemm(
+                  timed, x, packed, b, epilogue, workspaceLimit, y)
+              } else {
+                Self.forwardDirect(timed, x, w, b, epilogue, y)
+              }
+            }
+          }
+        }
+      }
+    }
+
+    let plan = candidates[winner]
+    diagnostic(
+      .setup, "tuned \(problem): "
+        + (plan.winogradTile.map { "winograd F(\($0)x\($0), 3x3)" }
+          ?? (plan.useGemm ? "im2col gemm" : "direct")),
+      categories: .setup)
+    cache.add(plan: plan, CpuConvolutionPlan.self, key: Self.forwardPlanKey(g))
+    return plan
+  }
+
+  //--------------------------------------------------------------------------
+  /// preferGemm
+  /// im2col copies each input value once per filter tap, which pays off
+  /// when the gemm has a long reduction and enough output channels to fill
+  /// a packed panel. Small filters and channel counts run faster directly.
+  @inlinable public static func preferGemm(_ g: ConvolutionGeometry) -> Bool {
+    g.filterCount >= 64
+      && g.outChannels >= CpuGemmBlocking.current.panelWidth
+  }
+
+  //--------------------------------------------------------------------------
+  /// forwardDirect
+  /// accumulates each output position across the filter window with the
+  /// output channels innermost, so the inner loop runs over contiguous
+  /// filter and output values. Rows of output positions are distributed
+  /// across the cpu cores.
+  @inlinable public static func forwardDirect(
+    _ g: ConvolutionGeometry,
+    _ x: UnsafeBufferPointer<Value>,
+    _ w: UnsafeBufferPointer<Value>,
+    _ bias: UnsafeBufferPointer<Value>,
+    _ epilogue: ((Value) -> Value)?,
+    _ y: UnsafeMutableBufferPointer<Value>
+  ) {
+    let (ci, co) = (g.inChannels, g.outChannels)
+    let (id, ih, iw) = (g.input[0], g.input[1], g.input[2])
+    let (od, oh, ow) = (g.output[0], g.output[1], g.output[2])
+    let (fd, fh, fw) = (g.filter[0], g.filter[1], g.filter[2])
+
+    parallelFor(g.outputRows) { rows in
+      var acc = [Value](repeating: 0, count: co)
+      acc.withUnsafeMutableBufferPointer { acc in
+        for row in rows {
+          let n = row / (od * oh)
+          let z = (row / oh) % od
+          let r = row % oh
+          for c in 0..<ow {
+            for o in 0..<co { acc[o] = bias[o] }
+
+            for kd in 0..<fd {
+              let xd = g.inputIndex(z, kd, 0)
+              guard xd >= 0 && xd < id else { continue }
+              for kh in 0..<fh {
+                let xh = g.inputIndex(r, kh, 1)
+                guard xh >= 0 && xh < ih else { continue }
+                for kw in 0..<fw {
+                  let xw = g.inputIndex(c, kw, 2)
+                  guard xw >= 0 && xw < iw else { continue }
+                  let xi = (((n * id + xd) * ih + xh) * iw + xw) * ci
+                  var wi = ((kd * fh + kh) * fw + kw) * ci * co
+                  for i in 0..<ci {
+                    let xv = x[xi + i]
+                    for o in 0..<co { acc[o] += xv * w[wi + o] }
+                    wi += co
+                  }
+                }
+              }
+            }
+
+            let yi = (row * ow + c) * co
+            if let epilogue = epilogue {
+              for o in 0..<co { y[yi + o] = epilogue(acc[o]) }
+            } else {
+              for o in 0..<co { y[yi + o] = acc[o] }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// forwardGemm
+  /// Copies the input windows for a tile of output rows into a matrix
+  /// (im2col) and multiplies it by the packed filter with the bias and
+  /// activation fused into the gemm epilogue. Tiles are sized so the
+  /// im2col workspaces of all cores stay within `workspaceLimit`.
+  @inlinable public static func forwardGemm(
+    _ g: ConvolutionGeometry,
+    _ x: UnsafeBufferPointer<Value>,
+    _ packed: PackedMatrix<FilterElement>,
+    _ bias: UnsafeBufferPointer<Value>,
+    _ epilogue: ((Value) -> Value)?,
+    _ workspaceLimit: Int,
+    _ y: UnsafeMutableBufferPointer<Value>
+  ) {
+    let (ci, co, k) = (g.inChannels, g.outChannels, g.filterCount)
+    let (id, ih, iw) = (g.input[0], g.input[1], g.input[2])
+    let (od, oh, ow) = (g.output[0], g.output[1], g.output[2])
+    let (fd, fh, fw) = (g.filter[0], g.filter[1], g.filter[2])
+    let processors = ProcessInfo.processInfo.activeProcessorCount
+    let rowBytes = ow * k * MemoryLayout<Value>.stride
+    let tileRows = Swift.max(1, workspaceLimit / processors / rowBytes)
+
+    parallelFor(g.outputRows) { rows in
+      var cols = [Value](repeating: 0, count: Swift.min(tileRows, rows.count) * ow * k)
+      cols.withUnsafeMutableBufferPointer { cols in
+        for tile in stride(from: rows.lowerBound, to: rows.upperBound, by: tileRows) {
+          let tileEnd = Swift.min(tile + tileRows, rows.upperBound)
+
+          // im2col
+          var p = 0
+          for row in tile..<tileEnd {
+            let n = row / (od * oh)
+            let z = (row / oh) % od
+            let r = row % oh
+            for c in 0..<ow {
+              for kd in 0..<fd {
+                let xd = g.inputIndex(z, kd, 0)
+                for kh in 0..<fh {
+                  let xh = g.inputIndex(r, kh, 1)
+                  for kw in 0..<fw {
+                    let xw = g.inputIndex(c, kw, 2)
+                    if xd >= 0 && xd < id && xh >= 0 && xh < ih && xw >= 0 && xw < iw {
+                      let xi = (((n * id + xd) * ih + xh) * iw + xw) * ci
+                      for i in 0..<ci { cols[p + i] = x[xi + i] }
+                    } else {
+                      for i in 0..<ci { cols[p + i] = 0 }
+                    }
+                    p += ci
+                  }
+                }
+              }
+            }
+          }
+
+          // gemm
+          let m = (tileEnd - tile) * ow
+          let out = UnsafeMutableBufferPointer(
+            rebasing: y[(tile * ow * co)..<(tileEnd * ow * co)])
+          packed.multiply(
+            UnsafeBufferPointer(rebasing: cols[0..<(m * k)]),
+            lhsRows: m, into: out, bias: bias, epilogue: epilogue)
+        }
+      }
+    }
+  }
+}
+
+//==============================================================================
+// CpuConvolution backward kernels
+extension CpuConvolution
+where
+  Element.Value == FilterElement.Value,
+  FilterElement.Value: Real & BinaryFloatingPoint
+{
+  //--------------------------------------------------------------------------
+  @inlinable public func backward(
+    _ y: Any, _ yDiff: Any, _ filter: Any, _ x: Any
+  ) -> (filterDiff: Any, biasDiff: Any, xDiff: Any) {
+    backward(y as! Data, yDiff as! Data, filter as! Filter, x as! Data)
+  }
+
+  //--------------------------------------------------------------------------
+  /// backward
+  /// The data gradient is computed on `dataQueue`, while the filter and
+  /// bias gradients are computed on `filterBiasBackQueue`, so the two
+  /// can overlap when the queues are asynchronous.
+  /// - Returns: the filter, bias, and data gradients
+  @inlinable public func backward(
+    _ y: Data, _ yDiff: Data, _ filter: Filter, _ x: Data
+  ) -> (filterDiff: Filter, biasDiff: Bias, xDiff: Data) {
+    let g = ConvolutionGeometry(
+      x: x.shape, filter: filter.shape, strides: strides,
+      dilations: dilations, padding: padding, mode: properties.mode)
+    assert(y.shape == g.outputShape(like: x.shape) && yDiff.shape == y.shape)
+    diagnostic(
+      .queueCpu,
+      "convolution backward(\(x.name), filter: \(filter.name)) "
+        + "data on \(dataQueue.name) filter/bias on \(filterBiasBackQueue.name)",
+      categories: .queueCpu)
+
+    //----------------------------------
+    // backpropagate through the activation using the forward output
+    var dy = yDiff
+    if activation != .identity {
+      let ceiling = properties.activationReluCeiling
+      let derivative = ceiling > 0
+        ? activation.derivative(Value.self, reluCeiling: Value(ceiling))
+        : activation.derivative(Value.self)
+      dy = Data(like: yDiff)
+      dataQueue.mapOp(y, yDiff, &dy) { $1 * derivative($0) }
+    }
+
+    //----------------------------------
+    // data gradient
+    var xDiff = Data(like: x)
+    do {
+      let dys = dy.elements, fs = filter.elements
+      func execute<O: MutableCollection>(_ out: O) where O.Element == Value {
+        var out = out
+        let dy = [Value](dys), w = [Value](fs)
+        var dx = [Value](repeating: 0, count: out.count)
+        dy.withUnsafeBufferPointer { dy in
+          w.withUnsafeBufferPointer { w in
+            dx.withUnsafeMutableBufferPointer {
+              Self.backwardData(g, dy, w, $0)
+            }
+          }
+        }
+        zip(out.indices, dx).forEach { out[$0] = $1 }
+      }
+      let out = xDiff.mutableElements
+      dataQueue.cpu_execute { execute(out) }
+    }
+
+    //----------------------------------
+    // filter and bias gradients
+    var filterDiff = Filter(like: filter)
+    var biasDiff = Bias(shape: Shape1(g.outChannels), order: filter.order)
+    using(device: filterBiasBackQueue.deviceIndex,
+          queue: filterBiasBackQueueIndex) {
+      let queue = currentQueue
+      let xs = x.elements, dys = dy.elements
+      let fOut = filterDiff.mutableElements
+      let bOut = biasDiff.mutableElements
+
+      func execute<F: MutableCollection, B: MutableCollection>(
+        _ fOut: F, _ bOut: B
+      ) where F.Element == Value, B.Element == Value {
+        var fOut = fOut, bOut = bOut
+        let x = [Value](xs), dy = [Value](dys)
+        var dw = [Value](repeating: 0, count: fOut.count)
+        var db = [Value](repeating: 0, count: bOut.count)
+        x.withUnsafeBufferPointer { x in
+          dy.withUnsafeBufferPointer { dy in
+            dw.withUnsafeMutableBufferPointer { dw in
+              db.withUnsafeMutableBufferPointer {
+                Self.backwardFilterBias(g, x, dy, dw, $0)
+              }
+            }
+          }
+        }
+        zip(fOut.indices, dw).forEach { fOut[$0] = $1 }
+        zip(bOut.indices, db).forEach { bOut[$0] = $1 }
+      }
+
+      queue.cpu_execute { execute(fOut, bOut) }
+    }
+    return (filterDiff, biasDiff, xDiff)
+  }
+
+  //--------------------------------------------------------------------------
+  /// backwardData
+  /// Computes the data gradient, which is the transposed convolution of
+  /// the output gradient. Each input position gathers the output
+  /// positions that read it, so rows of `dx` are written independently
+  /// and distributed across the cpu cores.
+  @inlinable public static func backwardData(
+    _ g: ConvolutionGeometry,
+    _ dy: UnsafeBufferPointer<Value>,
+    _ w: UnsafeBufferPointer<Value>,
+    _ dx: UnsafeMutableBufferPointer<Value>
+  ) {
+    let (ci, co) = (g.inChannels, g.outChannels)
+    let (id, ih, iw) = (g.input[0], g.input[1], g.input[2])
+    let (od, oh, ow) = (g.output[0], g.output[1], g.output[2])
+    let (fd, fh, fw) = (g.filter[0], g.filter[1], g.filter[2])
+
+    parallelFor(g.batch * id * ih) { rows in
+      for row in rows {
+        let n = row / (id * ih)
+        let z = (row / ih) % id
+        let r = row % ih
+        for c in 0..<iw {
+          let xi = (row * iw + c) * ci
+          for kd in 0..<fd {
+            guard let yd = g.outputIndex(z, kd, 0), yd < od else { continue }
+            for kh in 0..<fh {
+              guard let yh = g.outputIndex(r, kh, 1), yh < oh else { continue }
+              for kw in 0..<fw {
+                guard let yw = g.outputIndex(c, kw, 2), yw < ow else { continue }
+                let yi = (((n * od + yd) * oh + yh) * ow + yw) * co
+                var wi = ((kd * fh + kh) * fw + kw) * ci * co
+                for i in 0..<ci {
+                  var sum = Value.zero
+                  for o in 0..<co { sum += dy[yi + o] * w[wi + o] }
+                  dx[xi + i] += sum
+                  wi += co
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// backwardFilterBias
+  /// Computes the filter and bias gradients. Each core accumulates the
+  /// rows it is given into a private partial buffer, and the partials
+  /// are then summed in a fixed order, so no atomics are needed and the
+  /// result doesn't depend on thread timing.
+  @inlinable public static func backwardFilterBias(
+    _ g: ConvolutionGeometry,
+    _ x: UnsafeBufferPointer<Value>,
+    _ dy: UnsafeBufferPointer<Value>,
+    _ dw: UnsafeMutableBufferPointer<Value>,
+    _ db: UnsafeMutableBufferPointer<Value>
+  ) {
+    let (ci, co) = (g.inChannels, g.outChannels)
+    let (id, ih, iw) = (g.input[0], g.input[1], g.input[2])
+    let (od, oh, ow) = (g.output[0], g.output[1], g.output[2])
+    let (fd, fh, fw) = (g.filter[0], g.filter[1], g.filter[2])
+    let partialCount = dw.count + db.count
+    let ranges = parallelPartitions(g.outputRows)
+    let partials = UnsafeMutableBufferPointer<Value>.allocate(
+      capacity: ranges.count * partialCount)
+    partials.initialize(repeating: 0)
+    defer { partials.deallocate() }
+
+    parallelFor(ranges.count, grainSize: 1) { parts in
+      for part in parts {
+        let base = part * partialCount
+        let biasBase = base + dw.count
+        for row in ranges[part] {
+          let n = row / (od * oh)
+          let z = (row / oh) % od
+          let r = row % oh
+          for c in 0..<ow {
+            let yi = (row * ow + c) * co
+            for o in 0..<co { partials[biasBase + o] += dy[yi + o] }
+
+            for kd in 0..<fd {
+              let xd = g.inputIndex(z, kd, 0)
+              guard xd >= 0 && xd < id else { continue }
+              for kh in 0..<fh {
+                let xh = g.inputIndex(r, kh, 1)
+                guard xh >= 0 && xh < ih else { continue }
+                for kw in 0..<fw {
+                  let xw = g.inputIndex(c, kw, 2)
+                  guard xw >= 0 && xw < iw else { continue }
+                  let xi = (((n * id + xd) * ih + xh) * iw + xw) * ci
+                  var wi = base + ((kd * fh + kh) * fw + kw) * ci * co
+                  for i in 0..<ci {
+                    let xv = x[xi + i]
+                    for o in 0..<co { partials[wi + o] += xv * dy[yi + o] }
+                    wi += co
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // reduce the partials
+    parallelFor(partialCount, grainSize: 1024) { elements in
+      for i in elements {
+        var sum = Value.zero
+        for part in 0..<ranges.count { sum += partials[part * partialCount + i] }
+        if i < dw.count { dw[i] = sum } else { db[i - dw.count] = sum }
+      }
+    }
+  }
+}
+
+extension ConvolutionGeometry {
+  //--------------------------------------------------------------------------
+  /// outputIndex(_:_:_:
+  /// - Parameters:
+  ///  - position: the input position along `dim`
+  ///  - tap: the filter tap along `dim`
+  ///  - dim: the normalized spatial dimension
+  /// - Returns: the output position whose filter tap reads `position`,
+  ///   or `nil` if there is none. The caller checks the upper bound.
+  @inlinable public func outputIndex(_ position: Int, _ tap: Int, _ dim: Int) -> Int? {
+    let t = isFlipped ? filter[dim] - 1 - tap : tap
+    let offset = position + padding[dim] - t * dilations[dim]
+    guard offset >= 0 && offset % strides[dim] == 0 else { return nil }
+    return offset / strides[dim]
+  }
+
+  //--------------------------------------------------------------------------
+  /// inputIndex(_:_:_:
+  /// - Parameters:
+  ///  - position: the output position along `dim`
+  ///  - tap: the filter tap along `dim`
+  ///  - dim: the normalized spatial dimension
+  /// - Returns: the input position read by the filter tap, which is out of
+  ///   range when it falls in the padding
+  @inlinable public func inputIndex(_ position: Int, _ tap: Int, _ dim: Int) -> Int {
+    let t = isFlipped ? filter[dim] - 1 - tap : tap
+    return position * strides[dim] - padding[dim] + t * dilations[dim]
+  }
+}
 
 //==============================================================================
 /// DeviceConvolution
@@ -156,6 +1007,7 @@ where
   public typealias Bias = TensorR1<FilterElement>
 
   // properties
+  public let activation: ActivationType
   public let properties: ConvolutionProperties
   public let padding: Padding
   public let strides: Shape
@@ -184,6 +1036,7 @@ where
   ) {
     //----------------------------------
     // save properties
+    self.activation = activation
     self.properties = properties
     self.padding = padding
     self.strides = strides
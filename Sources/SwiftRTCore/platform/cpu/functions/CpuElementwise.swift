@@ -0,0 +1,302 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import Numerics
+
+//==============================================================================
+/// BinaryElementOp
+/// An elementwise binary operation selected at compile time. The kernels
+/// below are specialized on the op type, so `apply` is inlined into a
+/// loop over raw pointers that the compiler can vectorize, instead of
+/// being called through a closure for each element.
+public protocol BinaryElementOp {
+  associatedtype Value
+  static func apply(_ a: Value, _ b: Value) -> Value
+}
+
+public enum AddOp<Value: AdditiveArithmetic>: BinaryElementOp {
+  @inlinable public static func apply(_ a: Value, _ b: Value) -> Value { a + b }
+}
+
+public enum SubtractOp<Value: AdditiveArithmetic>: BinaryElementOp {
+  @inlinable public static func apply(_ a: Value, _ b: Value) -> Value { a - b }
+}
+
+public enum MultiplyOp<Value: Numeric>: BinaryElementOp {
+  @inlinable public static func apply(_ a: Value, _ b: Value) -> Value { a * b }
+}
+
+public enum DivideOp<Value: AlgebraicField>: BinaryElementOp {
+  @inlinable public static func apply(_ a: Value, _ b: Value) -> Value { a / b }
+}
+
+public enum MinOp<Value: Comparable>: BinaryElementOp {
+  @inlinable public static func apply(_ a: Value, _ b: Value) -> Value {
+    a < b ? a : b
+  }
+}
+
+public enum MaxOp<Value: Comparable>: BinaryElementOp {
+  @inlinable public static func apply(_ a: Value, _ b: Value) -> Value {
+    a >= b ? a : b
+  }
+}
+
+//==============================================================================
+/// StridedLoops
+/// The loop nest of an elementwise op over row ordered operands of the
+/// same shape. Dimensions of extent 1 are dropped and adjacent dimensions
+/// that are contiguous in every operand are merged, so the innermost loop
+/// runs over the last axis and is as long as the operands allow.
+/// A repeated operand has a zero stride, so it merges with any dimension.
+public struct StridedLoops {
+  /// the extent of each loop, outermost first
+  public let extents: [Int]
+  /// the stride of each loop for each operand
+  public let strides: [[Int]]
+
+  /// the number of rows, which is the product of the outer extents
+  @inlinable public var rowCount: Int { extents.dropLast().reduce(1, *) }
+  /// the number of elements in a row
+  @inlinable public var rowLength: Int { extents.last! }
+  /// the total number of elements
+  @inlinable public var elementCount: Int { extents.reduce(1, *) }
+
+  //--------------------------------------------------------------------------
+  /// init(shape:strides:
+  /// - Parameters:
+  ///  - shape: the common shape of the operands
+  ///  - operandStrides: the strides of each operand
+  @inlinable public init(shape: [Int], strides operandStrides: [[Int]]) {
+    var extents = [Int]()
+    var strides = [[Int]](repeating: [], count: operandStrides.count)
+
+    for d in 0..<shape.count where shape[d] != 1 {
+      let last = extents.count - 1
+      if last >= 0 && strides.indices.allSatisfy({
+        strides[$0][last] == operandStrides[$0][d] * shape[d]
+      }) {
+        extents[last] *= shape[d]
+        for k in strides.indices { strides[k][last] = operandStrides[k][d] }
+      } else {
+        extents.append(shape[d])
+        for k in strides.indices { strides[k].append(operandStrides[k][d]) }
+      }
+    }
+
+    // a single element
+    if extents.isEmpty {
+      extents = [1]
+      strides = strides.map { _ in [0] }
+    }
+    self.extents = extents
+    self.strides = strides
+  }
+
+  //--------------------------------------------------------------------------
+  /// offset(row:operand:
+  /// - Returns: the storage offset of the first element of `row`
+  ///   for the specified operand
+  @inlinable public func offset(row: Int, operand k: Int) -> Int {
+    var row = row
+    var offset = 0
+    var d = extents.count - 2
+    while d >= 0 {
+      offset += (row % extents[d]) * strides[k][d]
+      row /= extents[d]
+      d -= 1
+    }
+    return offset
+  }
+
+  /// offset(element:operand:
+  /// - Returns: the storage offset of the element at the row major
+  ///   `element` position for the specified operand
+  @inlinable public func offset(element: Int, operand k: Int) -> Int {
+    let (row, j) = element.quotientAndRemainder(dividingBy: rowLength)
+    return offset(row: row, operand: k) + j * strides[k].last!
+  }
+}
+
+//==============================================================================
+// Devirtualized elementwise kernels
+// These apply when every operand is row ordered and its elements are stored
+// as `E.Value`, which excludes packed types like `Int4` and converted types
+// like `Float16`. The output must be dense. Everything else falls back to
+// the closure based `mapOp`.
+extension Tensor {
+  /// `true` if the stored elements can be addressed directly as values
+  @inlinable public var isValueAddressable: Bool {
+    TensorElement.Stored.self == TensorElement.Value.self && order == .row
+  }
+
+  /// a pointer to the first element for reading by the cpu
+  @inlinable func valuePointer(
+    using queue: Platform.Device.Queue
+  ) -> UnsafePointer<TensorElement.Value> {
+    UnsafeRawPointer(read(using: queue).baseAddress!)
+      .assumingMemoryBound(to: TensorElement.Value.self)
+  }
+
+  /// a pointer to the first element for writing by the cpu
+  @inlinable mutating func mutableValuePointer(
+    using queue: Platform.Device.Queue
+  ) -> UnsafeMutablePointer<TensorElement.Value> {
+    UnsafeMutableRawPointer(readWrite(using: queue).baseAddress!)
+      .assumingMemoryBound(to: TensorElement.Value.self)
+  }
+}
+
+extension DeviceQueue {
+  //==========================================================================
+  // mapOp tensor tensor
+  @inlinable func mapOp<S, E, Op: BinaryElementOp>(
+    _ a: Tensor<S, E>,
+    _ b: Tensor<S, E>,
+    _ output: inout Tensor<S, E>,
+    _ op: Op.Type
+  ) where Op.Value == E.Value {
+    guard
+      output.count > 0 && a.isValueAddressable && b.isValueAddressable
+        && output.isValueAddressable && output.isContiguous
+    else {
+      mapOp(a, b, &output, Op.apply)
+      return
+    }
+    assert(a.shape == output.shape && b.shape == output.shape)
+    let pa = a.valuePointer(using: currentQueue)
+    let pb = b.valuePointer(using: currentQueue)
+    let po = output.mutableValuePointer(using: currentQueue)
+
+    if a.isContiguous && b.isContiguous {
+      cpu_parallel(output.count, writing: E.self) {
+        for i in $0 { po[i] = Op.apply(pa[i], pb[i]) }
+      }
+    } else {
+      let loops = StridedLoops(
+        shape: output.shape.array,
+        strides: [a.strides.array, b.strides.array, output.strides.array])
+      let n = loops.rowLength
+      let (sa, sb) = (loops.strides[0].last!, loops.strides[1].last!)
+
+      cpu_parallel(loops.rowCount, writing: E.self) {
+        for row in $0 {
+          let a = pa + loops.offset(row: row, operand: 0)
+          let b = pb + loops.offset(row: row, operand: 1)
+          let o = po + loops.offset(row: row, operand: 2)
+          // keep the common unit stride and broadcast rows on
+          // simple loops the compiler can vectorize
+          if sa == 1 && sb == 1 {
+            for j in 0..<n { o[j] = Op.apply(a[j], b[j]) }
+          } else if sa == 1 && sb == 0 {
+            let b = b[0]
+            for j in 0..<n { o[j] = Op.apply(a[j], b) }
+          } else if sa == 0 && sb == 1 {
+            let a = a[0]
+            for j in 0..<n { o[j] = Op.apply(a, b[j]) }
+          } else {
+            for j in 0..<n { o[j] = Op.apply(a[j * sa], b[j * sb]) }
+          }
+        }
+      }
+    }
+  }
+
+  //==========================================================================
+  // mapOp tensor element
+  @inlinable func mapOp<S, E, Op: BinaryElementOp>(
+    _ a: Tensor<S, E>,
+    _ element: E.Value,
+    _ output: inout Tensor<S, E>,
+    _ op: Op.Type
+  ) where Op.Value == E.Value {
+    guard
+      output.count > 0 && a.isValueAddressable
+        && output.isValueAddressable && output.isContiguous
+    else {
+      mapOp(a, element, &output, Op.apply)
+      return
+    }
+    let pa = a.valuePointer(using: currentQueue)
+    let po = output.mutableValuePointer(using: currentQueue)
+
+    if a.isContiguous {
+      cpu_parallel(output.count, writing: E.self) {
+        for i in $0 { po[i] = Op.apply(pa[i], element) }
+      }
+    } else {
+      let loops = StridedLoops(
+        shape: output.shape.array,
+        strides: [a.strides.array, output.strides.array])
+      let (n, sa) = (loops.rowLength, loops.strides[0].last!)
+
+      cpu_parallel(loops.rowCount, writing: E.self) {
+        for row in $0 {
+          let a = pa + loops.offset(row: row, operand: 0)
+          let o = po + loops.offset(row: row, operand: 1)
+          if sa == 1 {
+            for j in 0..<n { o[j] = Op.apply(a[j], element) }
+          } else {
+            for j in 0..<n { o[j] = Op.apply(a[j * sa], element) }
+          }
+        }
+      }
+    }
+  }
+
+  //==========================================================================
+  // mapOp element tensor
+  @inlinable func mapOp<S, E, Op: BinaryElementOp>(
+    _ element: E.Value,
+    _ a: Tensor<S, E>,
+    _ output: inout Tensor<S, E>,
+    _ op: Op.Type
+  ) where Op.Value == E.Value {
+    guard
+      output.count > 0 && a.isValueAddressable
+        && output.isValueAddressable && output.isContiguous
+    else {
+      mapOp(element, a, &output, Op.apply)
+      return
+    }
+    let pa = a.valuePointer(using: currentQueue)
+    let po = output.mutableValuePointer(using: currentQueue)
+
+    if a.isContiguous {
+      cpu_parallel(output.count, writing: E.self) {
+        for i in $0 { po[i] = Op.apply(element, pa[i]) }
+      }
+    } else {
+      let loops = StridedLoops(
+        shape: output.shape.array,
+        strides: [a.strides.array, output.strides.array])
+      let (n, sa) = (loops.rowLength, loops.strides[0].last!)
+
+      cpu_parallel(loops.rowCount, writing: E.self) {
+        for row in $0 {
+          let a = pa + loops.offset(row: row, operand: 0)
+          let o = po + loops.offset(row: row, operand: 1)
+          if sa == 1 {
+            for j in 0..<n { o[j] = Op.apply(element, a[j]) }
+          } else {
+            for j in 0..<n { o[j] = Op.apply(element, a[j * sa]) }
+          }
+        }
+      }
+    }
+  }
+}
@@ -15,6 +15,7 @@
 //
 
 import Foundation
+import Numerics
 
 //==============================================================================
 // DeviceQueue functions with default cpu delegation
@@ -147,11 +148,7 @@ extension CpuFunctions where Self: DeviceQueue {
       "fill(randomUniform: \(out.name), lower: "
         + "\(lower), upper: \(upper), seed: \(seed)) on \(name)",
       categories: .queueCpu)
-    let scale = Double(upper - lower) / Double(UInt64.max)
-    var generator = Platform.createRandomNumberGenerator(using: seed)
-    mapOp(&out) {
-      E.Value(Double(generator.next()) * scale) + lower
-    }
+    cpu_fill(random: &out, .uniform, upper - lower, lower, seed)
   }
 
   //--------------------------------------------------------------------------
@@ -165,11 +162,7 @@ extension CpuFunctions where Self: DeviceQueue {
       .queueCpu,
       "fill(randomNormal: \(out.name), mean: " + "\(mean), std: \(std), seed: \(seed)) on \(name)",
       categories: .queueCpu)
-    let scale = Double(std) / Double(UInt64.max)
-    var generator = Platform.createRandomNumberGenerator(using: seed)
-    mapOp(&out) {
-      E.Value(Double(generator.next()) * scale) + mean
-    }
+    cpu_fill(random: &out, .normal, std, mean, seed)
   }
 
   //--------------------------------------------------------------------------
@@ -187,11 +180,7 @@ extension CpuFunctions where Self: DeviceQueue {
       "fill(randomNormal: \(out.name), mean: "
         + "\(mean.name), std: \(std.name), seed: \(seed)) on \(name)",
       categories: .queueCpu)
-    let scale = Double(std.element) / Double(UInt64.max)
-    var generator = Platform.createRandomNumberGenerator(using: seed)
-    mapOp(&out) {
-      E.Value(Double(generator.next()) * scale) + mean.element
-    }
+    cpu_fill(random: &out, .normal, std.element, mean.element, seed)
   }
 
   //--------------------------------------------------------------------------
@@ -206,13 +195,7 @@ extension CpuFunctions where Self: DeviceQueue {
       "fill(randomTruncatedNormal: \(out.name), mean: "
         + "\(mean), std: \(std), seed: \(seed)) on \(name)",
       categories: .queueCpu)
-    let std2x = std * 2
-    let scale = Double(std) / Double(UInt64.max)
-    var generator = Platform.createRandomNumberGenerator(using: seed)
-    mapOp(&out) {
-      let a = Double(generator.next()) * scale
-      return E.Value(a).clamped(to: -std2x...std2x) + mean
-    }
+    cpu_fill(random: &out, .truncatedNormal, std, mean, seed)
   }
 
   //--------------------------------------------------------------------------
@@ -228,12 +211,79 @@ extension CpuFunctions where Self: DeviceQueue {
       "fill(randomTruncatedNormal: \(out.name), "
         + "mean: \(mean.name), std: \(std.name), seed: \(seed)) on \(name)",
       categories: .queueCpu)
-    let std2x = std.element * 2
-    let scale = Double(std.element) / Double(UInt64.max)
-    var generator = Platform.createRandomNumberGenerator(using: seed)
-    mapOp(&out) {
-      let a = Double(generator.next()) * scale
-      return E.Value(a).clamped(to: -std2x...std2x) + mean.element
+    cpu_fill(random: &out, .truncatedNormal, std.element, mean.element, seed)
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_fill(random:_:_:_:_:
+  /// fills `out` with `distribution * scale + offset`. Elements `4c..<4c+4`
+  /// are generated from Philox counter `c`, so each worker jumps directly
+  /// to the counters of its range, and the values don't depend on the
+  /// number of workers. Double tensors are generated in double precision
+  /// and all others in single precision. Normal values are generated four
+  /// counters at a time, so the Box-Muller transform runs on whole
+  /// vectors.
+  @inlinable func cpu_fill<S, E>(
+    random out: inout Tensor<S, E>,
+    _ distribution: RandomFillDistribution,
+    _ scale: E.Value,
+    _ offset: E.Value,
+    _ seed: RandomSeed
+  ) where E.Value: BinaryFloatingPoint {
+    let philox = Philox4x32(seed: seed)
+
+    func fill<T: Real & BinaryFloatingPoint & SIMDScalar>(_ type: T.Type) {
+      let (scale, offset) = (T(scale), T(offset))
+      switch distribution {
+      case .uniform:
+        cpu_fill(random: &out) {
+          philox.uniform($0) * scale + offset as SIMD4<T>
+        }
+      case .normal:
+        cpu_fill(random: &out) {
+          philox.normals($0 * 4) * scale + offset as SIMD16<T>
+        }
+      case .truncatedNormal:
+        cpu_fill(random: &out) {
+          philox.truncatedNormals($0 * 4) * scale + offset as SIMD16<T>
+        }
+      }
+    }
+
+    if E.Value.self == Double.self {
+      fill(Double.self)
+    } else {
+      fill(Float.self)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_fill(random:_:
+  /// fills `out` with consecutive blocks of `values`, where block `b`
+  /// holds elements `b * V.scalarCount..<(b + 1) * V.scalarCount`
+  @inlinable func cpu_fill<S, E, V>(
+    random out: inout Tensor<S, E>,
+    _ values: @escaping (UInt64) -> V
+  ) where E.Value: BinaryFloatingPoint, V: SIMD, V.Scalar: BinaryFloatingPoint {
+    let out = out.mutableBuffer
+    let count = out.count
+    let lanes = V.scalarCount
+    cpu_parallel((count + lanes - 1) / lanes, writing: E.self) {
+      var o = out
+      for block in $0 {
+        let v = values(UInt64(block))
+        let start = block * lanes
+        for i in 0..<Swift.min(lanes, count - start) {
+          o[o.startIndex + start + i] = E.Value(v[i])
+        }
+      }
     }
   }
 }
+
+//==============================================================================
+/// RandomFillDistribution
+/// the distributions generated by the cpu random fill
+@usableFromInline enum RandomFillDistribution {
+  case uniform, normal, truncatedNormal
+}
@@ -0,0 +1,388 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+//==============================================================================
+// DeviceQueue functions with default cpu delegation
+extension CpuQueue {
+  //--------------------------------------------------------------------------
+  @inlinable public func gather<S, E>(
+    from a: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) {
+    cpu_gather(from: a, indices: indices, axis: axis, into: &out)
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func scatterAdd<S, E>(
+    _ updates: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    cpu_scatterAdd(updates, indices: indices, axis: axis, into: &out)
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func segmentSum<S, E>(
+    _ updates: Tensor<S, E>,
+    segments: ScatterSegments,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    cpu_segmentSum(updates, segments: segments, into: &out)
+  }
+}
+
+//==============================================================================
+/// ScatterSegments
+/// The positions of a list of indices grouped by index value. Scattering
+/// by segment lets each destination row be summed by one thread, so
+/// duplicate indices are reduced before the row is written and threads
+/// never write the same row.
+public struct ScatterSegments {
+  /// the distinct index values in ascending order
+  public let rows: [Int]
+  /// the positions in the index list ordered by index value. Positions
+  /// with the same value are in increasing order, so sums are always
+  /// accumulated in the same order.
+  public let order: [Int]
+  /// the start of each segment in `order`, followed by `order.count`
+  public let starts: [Int]
+
+  /// the number of indices
+  @inlinable public var count: Int { order.count }
+
+  //--------------------------------------------------------------------------
+  /// init(_:
+  /// sorts the positions of `indices` by value
+  @inlinable public init<C>(_ indices: C)
+  where C: Collection, C.Element == DeviceIndex {
+    let values = indices.map { Int($0) }
+    let order = values.indices.sorted { (values[$0], $0) < (values[$1], $1) }
+    var rows: [Int] = []
+    var starts: [Int] = []
+    for (i, position) in order.enumerated()
+    where rows.last != values[position] {
+      rows.append(values[position])
+      starts.append(i)
+    }
+    starts.append(order.count)
+    self.rows = rows
+    self.order = order
+    self.starts = starts
+  }
+}
+
+//==============================================================================
+/// the number of indices ahead of the row being copied whose source row
+/// is brought into cache
+@usableFromInline let gatherPrefetchDistance = 8
+
+/// the number of bytes copied by each parallel chunk of a gather
+@usableFromInline let gatherChunkBytes = 64 * 1024
+
+/// cpu_retain(_:
+/// Swift has no prefetch intrinsic, so upcoming rows are brought into
+/// cache by loading their first byte. The loaded bytes are passed here so
+/// the loads aren't removed as unused.
+@usableFromInline @inline(never) func cpu_retain(_ value: UInt8) {}
+
+//==============================================================================
+// Cpu device queue function implementations
+extension DeviceQueue {
+  //--------------------------------------------------------------------------
+  /// cpu_gather(from:indices:axis:into:
+  /// Copies the slices of `a` selected by `indices` along `axis`. For
+  /// dense row major tensors each selected slice is a set of contiguous
+  /// rows of the elements after `axis`, so whole rows are copied with
+  /// `assign` instead of through tensor views. When gathering along the
+  /// last axis the rows are single elements, so the copy is strided.
+  ///
+  /// The rows are split across the cpu cores, and the source row several
+  /// indices ahead is loaded into cache while the current row is copied,
+  /// since embedding indices are usually random. Other layouts and packed
+  /// elements are copied a slice at a time through views.
+  @inlinable public func cpu_gather<S, E>(
+    from a: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) {
+    diagnostic(
+      .queueCpu, "gather(\(a.name), indices: \(indices.name), "
+        + "axis: \(axis)) on \(name)", categories: .queueCpu)
+    assert(out.shape[axis] == indices.count, "out extent must equal indices")
+
+    // a transposed view spans its storage contiguously, so the strides
+    // are compared to find rows that are dense in row order
+    guard a.isContiguous && out.isContiguous && a.order == .row
+      && out.order == .row && E.storedCount(64) == 64
+      && a.strides == a.shape.strides(for: .row)
+      && out.strides == out.shape.strides(for: .row)
+    else {
+      cpu_gatherSlices(from: a, indices: indices, axis: axis, into: &out)
+      return
+    }
+
+    let extent = a.shape[axis]
+    let outer = (0..<axis).reduce(1) { $0 * a.shape[$1] }
+    let inner = ((axis + 1)..<S.rank).reduce(1) { $0 * a.shape[$1] }
+    let count = indices.count
+    let rowBytes = inner * MemoryLayout<E.Stored>.stride
+    let prefetch = rowBytes >= 64
+    let grain = Swift.max(1, gatherChunkBytes / Swift.max(1, rowBytes))
+    let ix = indices.elements
+    let (src, dst) = (a.buffer, out.mutableBuffer)
+
+    cpu_execute(bytes: 2 * outer * count * rowBytes) {
+      let rows = [DeviceIndex](ix)
+      let s = UnsafePointer(src.hostBuffer.baseAddress!)
+      let d = dst.hostBuffer.baseAddress!
+
+      // item `i` copies source row `rows[i % count]` of outer slice
+      // `i / count` to destination row `i`, so each chunk writes
+      // consecutive destination rows
+      func source(_ item: Int) -> UnsafePointer<E.Stored> {
+        let (o, r) = item.quotientAndRemainder(dividingBy: count)
+        let row = Int(rows[r])
+        precondition(row >= 0 && row < extent, "gather index out of range")
+        return s + (o * extent + row) * inner
+      }
+
+      parallelFor(outer * count, grainSize: grain) { items in
+        var touched: UInt8 = 0
+        for item in items {
+          let ahead = item + gatherPrefetchDistance
+          if prefetch && ahead < items.upperBound {
+            touched &+= UnsafeRawPointer(source(ahead)).load(as: UInt8.self)
+          }
+          let to = d + item * inner
+          if inner == 1 {
+            to.pointee = source(item).pointee
+          } else {
+            to.assign(from: source(item), count: inner)
+          }
+        }
+        cpu_retain(touched)
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_gatherSlices(from:indices:axis:into:
+  /// copies each selected slice through tensor views, which handles any
+  /// layout and element type
+  @inlinable public func cpu_gatherSlices<S, E>(
+    from a: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) {
+    var rlower = S.zero
+    var alower = S.zero
+    var rupper = out.shape
+    var aupper = a.shape
+
+    for (ri, ai) in indices.enumerated() {
+      rlower[axis] = ri
+      rupper[axis] = ri + 1
+      alower[axis] = Int(ai)
+      aupper[axis] = alower[axis] + 1
+      out[rlower, rupper] = a[alower, aupper]
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_scatterAdd(_:indices:axis:into:
+  /// Adds each slice of `updates` along `axis` to the slice of `out`
+  /// selected by the corresponding index. The indices are grouped into
+  /// segments, and the destination rows are split across the cpu cores,
+  /// so each row is summed in a scratch row by one thread and written
+  /// once without atomics.
+  @inlinable public func cpu_scatterAdd<S, E>(
+    _ updates: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    diagnostic(
+      .queueCpu, "scatterAdd(\(updates.name), indices: \(indices.name), "
+        + "axis: \(axis), into: \(out.name)) on \(name)",
+      categories: .queueCpu)
+    assert(
+      updates.shape[axis] == indices.count,
+      "updates extent must equal indices")
+
+    guard updates.isContiguous && out.isContiguous && updates.order == .row
+      && out.order == .row && E.storedCount(64) == 64
+      && updates.strides == updates.shape.strides(for: .row)
+      && out.strides == out.shape.strides(for: .row)
+    else {
+      cpu_scatterAddSlices(updates, indices: indices, axis: axis, into: &out)
+      return
+    }
+
+    let extent = out.shape[axis]
+    let outer = (0..<axis).reduce(1) { $0 * out.shape[$1] }
+    let inner = ((axis + 1)..<S.rank).reduce(1) { $0 * out.shape[$1] }
+    let ix = indices.elements
+    let (src, dst) = (updates.buffer, out.mutableBuffer)
+
+    cpu_execute {
+      let segments = ScatterSegments(ix)
+      if let first = segments.rows.first, let last = segments.rows.last {
+        precondition(first >= 0 && last < extent, "scatter index out of range")
+      }
+      cpu_reduceSegments(
+        E.self, segments, outer: outer, inner: inner,
+        from: UnsafePointer(src.hostBuffer.baseAddress!),
+        to: dst.hostBuffer.baseAddress!, accumulate: true
+      ) { o, segment in o * extent + segments.rows[segment] }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_segmentSum(_:segments:into:
+  /// Sums the rows of `updates` along axis 0 that belong to each segment
+  /// into row `s` of `out`, which has one row per segment. Together with
+  /// `segments.rows` this is a sparse representation of the scatter, so
+  /// the table sized result is never allocated.
+  @inlinable public func cpu_segmentSum<S, E>(
+    _ updates: Tensor<S, E>,
+    segments: ScatterSegments,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    diagnostic(
+      .queueCpu, "segmentSum(\(updates.name), segments: "
+        + "\(segments.rows.count)) on \(name)", categories: .queueCpu)
+    assert(
+      updates.shape[0] == segments.count,
+      "updates extent must equal indices")
+    assert(
+      out.shape[0] == segments.rows.count,
+      "out extent must equal segments")
+
+    guard updates.isContiguous && out.isContiguous && updates.order == .row
+      && out.order == .row && E.storedCount(64) == 64
+      && updates.strides == updates.shape.strides(for: .row)
+      && out.strides == out.shape.strides(for: .row)
+    else {
+      // add each update row to the row of its segment through views
+      var segmentOf = [DeviceIndex](repeating: 0, count: segments.count)
+      for segment in 0..<segments.rows.count {
+        for p in segments.starts[segment]..<segments.starts[segment + 1] {
+          segmentOf[segments.order[p]] = DeviceIndex(segment)
+        }
+      }
+      out = Tensor(zeros: out.shape, order: out.order)
+      cpu_scatterAddSlices(
+        updates, indices: TensorR1(segmentOf, shape: Shape1(segments.count)),
+        axis: 0, into: &out)
+      return
+    }
+
+    let inner = updates.count / Swift.max(1, segments.count)
+    let (src, dst) = (updates.buffer, out.mutableBuffer)
+
+    cpu_execute {
+      cpu_reduceSegments(
+        E.self, segments, outer: 1, inner: inner,
+        from: UnsafePointer(src.hostBuffer.baseAddress!),
+        to: dst.hostBuffer.baseAddress!, accumulate: false
+      ) { _, segment in segment }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_scatterAddSlices(_:indices:axis:into:
+  /// adds each slice through tensor views, which handles any layout and
+  /// element type
+  @inlinable public func cpu_scatterAddSlices<S, E>(
+    _ updates: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    var ulower = S.zero
+    var olower = S.zero
+    var uupper = updates.shape
+    var oupper = out.shape
+
+    for (ui, oi) in indices.enumerated() {
+      ulower[axis] = ui
+      uupper[axis] = ui + 1
+      olower[axis] = Int(oi)
+      oupper[axis] = olower[axis] + 1
+      out[olower, oupper] = out[olower, oupper] + updates[ulower, uupper]
+    }
+  }
+}
+
+//==============================================================================
+/// cpu_reduceSegments
+/// For each outer slice and segment, sums the update rows of the
+/// segment in a scratch row, then adds it to or stores it in the
+/// destination row. Each destination row belongs to one work item, so
+/// the rows can be written in parallel.
+/// - Parameters:
+///  - type: the element type
+///  - segments: the update positions grouped by destination
+///  - outer: the number of slices before the scatter axis
+///  - inner: the number of elements in a row
+///  - updates: the update rows, `outer * segments.count` rows
+///  - out: the destination rows
+///  - accumulate: `true` to add to the destination rows
+///  - row: the destination row of an outer slice and segment
+@inlinable func cpu_reduceSegments<E>(
+  _ type: E.Type,
+  _ segments: ScatterSegments,
+  outer: Int,
+  inner: Int,
+  from updates: UnsafePointer<E.Stored>,
+  to out: UnsafeMutablePointer<E.Stored>,
+  accumulate: Bool,
+  _ row: (Int, Int) -> Int
+) where E: StorageElement, E.Value: Numeric {
+  let (count, segmentCount) = (segments.count, segments.rows.count)
+  let rowBytes = inner * MemoryLayout<E.Stored>.stride
+  let grain = Swift.max(1, gatherChunkBytes / Swift.max(1, rowBytes))
+
+  parallelFor(outer * segmentCount, grainSize: grain) { items in
+    var sum = [E.Value](repeating: 0, count: inner)
+    sum.withUnsafeMutableBufferPointer { sum in
+      for item in items {
+        let (o, segment) = item.quotientAndRemainder(dividingBy: segmentCount)
+        for j in 0..<inner { sum[j] = 0 }
+        for p in segments.starts[segment]..<segments.starts[segment + 1] {
+          let u = updates + (o * count + segments.order[p]) * inner
+          for j in 0..<inner { sum[j] += E.value(at: j, from: u[j]) }
+        }
+
+        let d = out + row(o, segment) * inner
+        if accumulate {
+          for j in 0..<inner {
+            d[j] = E.stored(value: E.value(at: j, from: d[j]) + sum[j])
+          }
+        } else {
+          for j in 0..<inner { d[j] = E.stored(value: sum[j]) }
+        }
+      }
+    }
+  }
+}
@@ -17,6 +17,12 @@
 import Foundation
 import Numerics
 
+//==============================================================================
+/// the number of converted elements, such as `Float16`, that the cpu
+/// map ops convert to values and back at a time. A chunk of each operand
+/// stays in the L1 cache between the conversions and the op.
+public var convertedChunkSize = 1024
+
 //==============================================================================
 // The map operations invoke an `execute` function with suitable storage
 // element iterators. The iterators are non reference counted unsafe buffer
@@ -24,6 +30,77 @@ import Numerics
 // capturing for asynchrnous execution. The async operations are safe,
 // because tensor storage lifetime is gauranteed by the queue.
 extension DeviceQueue {
+  //==========================================================================
+  /// cpu_parallel(_:writing:_:
+  /// runs `body` over `0..<count` on this queue. The shared `CpuThreadPool`
+  /// splits the range across the cpu cores when the op is costly enough,
+  /// and async ops stay in stream order, because each one completes before
+  /// the serial queue runs the next.
+  /// Packed elements such as `Int4` share stored values, so they are
+  /// not split.
+  @inlinable public func cpu_parallel<E: StorageElement>(
+    _ count: Int,
+    writing type: E.Type,
+    _ body: @escaping (Range<Int>) -> Void
+  ) {
+    let isPacked = E.storedCount(64) != 64
+    func execute() {
+      if isPacked {
+        body(0..<count)
+      } else {
+        CpuThreadPool.shared.adaptiveFor(count, body)
+      }
+    }
+
+    cpu_execute(execute)
+  }
+
+  //==========================================================================
+  /// cpu_convertedChunks(_:_:_:
+  /// runs `body` over `0..<count` in chunks of at most
+  /// `convertedChunkSize` elements. Each participating thread allocates
+  /// one set of scratch value buffers for its range, so converted
+  /// elements like `Float16` are computed a chunk at a time, and a full
+  /// copy of the values never exists in memory.
+  /// - Parameters:
+  ///  - count: the number of elements
+  ///  - type: the output element type
+  ///  - body: called with the chunk range and a scratch buffer for each
+  ///    operand. Buffers are uninitialized trivial values.
+  @inlinable func cpu_convertedChunks<A, B, RE: StorageElement>(
+    _ count: Int,
+    writing type: RE.Type,
+    _ a: A.Type,
+    _ b: B.Type,
+    _ body: @escaping (
+      Range<Int>,
+      UnsafeMutableBufferPointer<A>,
+      UnsafeMutableBufferPointer<B>,
+      UnsafeMutableBufferPointer<RE.Value>
+    ) -> Void
+  ) {
+    cpu_parallel(count, writing: RE.self) { range in
+      let chunkSize = Swift.min(convertedChunkSize, range.count)
+      let av = UnsafeMutableBufferPointer<A>.allocate(capacity: chunkSize)
+      let bv = UnsafeMutableBufferPointer<B>.allocate(capacity: chunkSize)
+      let ov = UnsafeMutableBufferPointer<RE.Value>.allocate(capacity: chunkSize)
+      defer {
+        av.deallocate()
+        bv.deallocate()
+        ov.deallocate()
+      }
+
+      for start in stride(from: range.lowerBound, to: range.upperBound, by: chunkSize) {
+        let n = Swift.min(chunkSize, range.upperBound - start)
+        body(
+          start..<(start + n),
+          UnsafeMutableBufferPointer(rebasing: av[0..<n]),
+          UnsafeMutableBufferPointer(rebasing: bv[0..<n]),
+          UnsafeMutableBufferPointer(rebasing: ov[0..<n]))
+      }
+    }
+  }
+
   //==========================================================================
   // caller defined generator
   @inlinable func mapOp<S, E>(
@@ -32,12 +109,8 @@ extension DeviceQueue {
   ) {
     var out = output.mutableBuffer
 
-    if mode == .sync {
+    cpu_execute {
       out.indices.forEach { out[$0] = op() }
-    } else {
-      queue.async(group: group) {
-        out.indices.forEach { out[$0] = op() }
-      }
     }
   }
 
@@ -54,22 +127,13 @@ extension DeviceQueue {
       _ out: O
     ) where O.Element == E.Value {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         var io = out.indices.startIndex
         for i in 0..<(out.count - 1) {
           out[io] = first + O.Element(exactly: i)! * step
           io = out.index(after: io)
         }
         out[io] = last
-      } else {
-        queue.async(group: group) {
-          var io = out.indices.startIndex
-          for i in 0..<(out.count - 1) {
-            out[io] = first + O.Element(exactly: i)! * step
-            io = out.index(after: io)
-          }
-          out[io] = last
-        }
       }
     }
 
@@ -86,13 +150,21 @@ extension DeviceQueue {
     _ output: inout Tensor<S, E>,
     _ op: @escaping (E.Value) -> E.Value
   ) {
-    var out = output.mutableBuffer
-
-    if mode == .sync {
-      out.indices.forEach { out[$0] = op(out[$0]) }
+    let out = output.mutableBuffer
+    if E.isConverted {
+      let buffer = UnsafeBufferPointer(out.hostBuffer)
+      cpu_convertedChunks(out.count, writing: E.self, E.Value.self, Void.self) {
+        range, av, _, ov in
+        E.getValues(from: buffer, at: out.startIndex + range.lowerBound, into: av)
+        for i in 0..<av.count { ov[i] = op(av[i]) }
+        E.set(
+          values: UnsafeBufferPointer(ov), in: out.hostBuffer,
+          at: out.startIndex + range.lowerBound)
+      }
     } else {
-      queue.async(group: group) {
-        out.indices.forEach { out[$0] = op(out[$0]) }
+      cpu_parallel(out.count, writing: E.self) {
+        var o = out
+        for i in $0 { o[o.startIndex + i] = op(o[o.startIndex + i]) }
       }
     }
   }
@@ -110,12 +182,8 @@ extension DeviceQueue {
       _ op: @escaping (A.Element, O.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, a).forEach { out[$0] = op($1, out[$0]) }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, a).forEach { out[$0] = op($1, out[$0]) }
-        }
       }
     }
 
@@ -123,7 +191,26 @@ extension DeviceQueue {
     if a.order == output.order {
       if a.isContiguous {
         if output.isContiguous {
-          execute(a.buffer, output.mutableBuffer, op)
+          let (a, out) = (a.buffer, output.mutableBuffer)
+          if E.isConverted || RE.isConverted {
+            let (ab, ob) = (UnsafeBufferPointer(a.hostBuffer), UnsafeBufferPointer(out.hostBuffer))
+            cpu_convertedChunks(out.count, writing: RE.self, E.Value.self, Void.self) {
+              range, av, _, ov in
+              E.getValues(from: ab, at: a.startIndex + range.lowerBound, into: av)
+              RE.getValues(from: ob, at: out.startIndex + range.lowerBound, into: ov)
+              for i in 0..<av.count { ov[i] = op(av[i], ov[i]) }
+              RE.set(
+                values: UnsafeBufferPointer(ov), in: out.hostBuffer,
+                at: out.startIndex + range.lowerBound)
+            }
+          } else {
+            cpu_parallel(out.count, writing: RE.self) {
+              var o = out
+              for i in $0 {
+                o[o.startIndex + i] = op(a[a.startIndex + i], o[o.startIndex + i])
+              }
+            }
+          }
         } else {
           execute(a.buffer, output.mutableElements, op)
         }
@@ -152,12 +239,8 @@ extension DeviceQueue {
       _ op: @escaping (A.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, a).forEach { out[$0] = op($1) }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, a).forEach { out[$0] = op($1) }
-        }
       }
     }
 
@@ -165,7 +248,23 @@ extension DeviceQueue {
     if a.order == output.order {
       if a.isContiguous {
         if output.isContiguous {
-          execute(a.buffer, output.mutableBuffer, op)
+          let (a, out) = (a.buffer, output.mutableBuffer)
+          if E.isConverted || RE.isConverted {
+            let ab = UnsafeBufferPointer(a.hostBuffer)
+            cpu_convertedChunks(out.count, writing: RE.self, E.Value.self, Void.self) {
+              range, av, _, ov in
+              E.getValues(from: ab, at: a.startIndex + range.lowerBound, into: av)
+              for i in 0..<av.count { ov[i] = op(av[i]) }
+              RE.set(
+                values: UnsafeBufferPointer(ov), in: out.hostBuffer,
+                at: out.startIndex + range.lowerBound)
+            }
+          } else {
+            cpu_parallel(out.count, writing: RE.self) {
+              var o = out
+              for i in $0 { o[o.startIndex + i] = op(a[a.startIndex + i]) }
+            }
+          }
         } else {
           execute(a.buffer, output.mutableElements, op)
         }
@@ -200,12 +299,8 @@ extension DeviceQueue {
       var out = out
       let io = out.startIndex
       
-      if mode == .sync {
+      cpu_execute {
         out[io] = a.reduce(into: initialValue, op)
-      } else {
-        queue.async(group: group) {
-          out[io] = a.reduce(into: initialValue, op)
-        }
       }
     }
     
@@ -232,23 +327,36 @@ extension DeviceQueue {
       _ op: @escaping (A.Element, B.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, zip(a, b)).forEach {
           out[$0] = op($1.0, $1.1)
         }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, zip(a, b)).forEach {
-            out[$0] = op($1.0, $1.1)
-          }
-        }
       }
     }
 
     let out = output.mutableBuffer
     if a.isContiguous {
       if b.isContiguous {
-        execute(a.buffer, b.buffer, out, op)
+        let (a, b) = (a.buffer, b.buffer)
+        if AE.isConverted || BE.isConverted || RE.isConverted {
+          let (ab, bb) = (UnsafeBufferPointer(a.hostBuffer), UnsafeBufferPointer(b.hostBuffer))
+          cpu_convertedChunks(out.count, writing: RE.self, AE.Value.self, BE.Value.self) {
+            range, av, bv, ov in
+            AE.getValues(from: ab, at: a.startIndex + range.lowerBound, into: av)
+            BE.getValues(from: bb, at: b.startIndex + range.lowerBound, into: bv)
+            for i in 0..<av.count { ov[i] = op(av[i], bv[i]) }
+            RE.set(
+              values: UnsafeBufferPointer(ov), in: out.hostBuffer,
+              at: out.startIndex + range.lowerBound)
+          }
+        } else {
+          cpu_parallel(out.count, writing: RE.self) {
+            var o = out
+            for i in $0 {
+              o[o.startIndex + i] = op(a[a.startIndex + i], b[b.startIndex + i])
+            }
+          }
+        }
       } else {
         execute(a.buffer, b.elements, out, op)
       }
@@ -278,23 +386,23 @@ extension DeviceQueue {
       _ op: @escaping (A.Element, B.Element, A.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, zip(a, b)).forEach {
           out[$0] = op($1.0, $1.1, c)
         }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, zip(a, b)).forEach {
-            out[$0] = op($1.0, $1.1, c)
-          }
-        }
       }
     }
 
     let out = output.mutableBuffer
     if a.isContiguous {
       if b.isContiguous {
-        execute(a.buffer, b.buffer, c, out, op)
+        let (a, b) = (a.buffer, b.buffer)
+        cpu_parallel(out.count, writing: RE.self) {
+          var o = out
+          for i in $0 {
+            o[o.startIndex + i] = op(a[a.startIndex + i], b[b.startIndex + i], c)
+          }
+        }
       } else {
         execute(a.buffer, b.elements, c, out, op)
       }
@@ -320,17 +428,17 @@ extension DeviceQueue {
       _ op: @escaping (A.Element, A.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, a).forEach { out[$0] = op($1, elt) }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, a).forEach { out[$0] = op($1, elt) }
-        }
       }
     }
 
     if a.isContiguous {
-      execute(a.buffer, element, output.mutableBuffer, op)
+      let (a, out) = (a.buffer, output.mutableBuffer)
+      cpu_parallel(out.count, writing: OE.self) {
+        var o = out
+        for i in $0 { o[o.startIndex + i] = op(a[a.startIndex + i], element) }
+      }
     } else {
       execute(a.elements, element, output.mutableBuffer, op)
     }
@@ -349,17 +457,17 @@ extension DeviceQueue {
       _ op: @escaping (A.Element, A.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, a).forEach { out[$0] = op(elt, $1) }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, a).forEach { out[$0] = op(elt, $1) }
-        }
       }
     }
 
     if a.isContiguous {
-      execute(element, a.buffer, output.mutableBuffer, op)
+      let (a, out) = (a.buffer, output.mutableBuffer)
+      cpu_parallel(out.count, writing: OE.self) {
+        var o = out
+        for i in $0 { o[o.startIndex + i] = op(element, a[a.startIndex + i]) }
+      }
     } else {
       execute(element, a.elements, output.mutableBuffer, op)
     }
@@ -384,16 +492,10 @@ extension DeviceQueue {
       _ op: @escaping (A.Element, B.Element, C.Element) -> O.Element
     ) {
       var out = out
-      if mode == .sync {
+      cpu_execute {
         zip(out.indices, zip(a, zip(b, c))).forEach {
           out[$0] = op($1.0, $1.1.0, $1.1.1)
         }
-      } else {
-        queue.async(group: group) {
-          zip(out.indices, zip(a, zip(b, c))).forEach {
-            out[$0] = op($1.0, $1.1.0, $1.1.1)
-          }
-        }
       }
     }
 
@@ -401,7 +503,15 @@ extension DeviceQueue {
       if b.isContiguous {
         if c.isContiguous {
           if output.isContiguous {
-            execute(a.buffer, b.buffer, c.buffer, output.mutableBuffer, op)
+            let (a, b, c) = (a.buffer, b.buffer, c.buffer)
+            let out = output.mutableBuffer
+            cpu_parallel(out.count, writing: OE.self) {
+              var o = out
+              for i in $0 {
+                o[o.startIndex + i] = op(
+                  a[a.startIndex + i], b[b.startIndex + i], c[c.startIndex + i])
+              }
+            }
           } else {
             execute(a.buffer, b.buffer, c.buffer, output.mutableElements, op)
           }
@@ -484,20 +594,12 @@ extension DeviceQueue {
     ) {
       var o1 = o1
       var o2 = o2
-      if mode == .sync {
+      cpu_execute {
         zip(zip(o1.indices, o2.indices), zip(a, zip(b, c))).forEach {
           let (o1v, o2v) = op($1.0, $1.1.0, $1.1.1)
           o1[$0.0] = o1v
           o2[$0.1] = o2v
         }
-      } else {
-        queue.async(group: group) {
-          zip(zip(o1.indices, o2.indices), zip(a, zip(b, c))).forEach {
-            let (o1v, o2v) = op($1.0, $1.1.0, $1.1.1)
-            o1[$0.0] = o1v
-            o2[$0.1] = o2v
-          }
-        }
       }
     }
 
@@ -527,20 +629,12 @@ extension DeviceQueue {
     ) {
       var o1 = o1
       var o2 = o2
-      if mode == .sync {
+      cpu_execute {
         zip(zip(o1.indices, o2.indices), zip(a, b)).forEach {
           let (o1v, o2v) = op($1.0, $1.1, c)
           o1[$0.0] = o1v
           o2[$0.1] = o2v
         }
-      } else {
-        queue.async(group: group) {
-          zip(zip(o1.indices, o2.indices), zip(a, b)).forEach {
-            let (o1v, o2v) = op($1.0, $1.1, c)
-            o1[$0.0] = o1v
-            o2[$0.1] = o2v
-          }
-        }
       }
     }
 
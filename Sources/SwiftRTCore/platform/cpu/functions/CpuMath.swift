@@ -34,6 +34,7 @@ extension CpuQueue {
     _ x: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: Comparable & SignedNumeric {
+    if deferred(.abs, .tensor(x), into: out) { return }
     cpu_abs(x, &out)
   }
 
@@ -67,6 +68,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
+    if deferred(.add, .tensor(lhs), .tensor(rhs), into: out) { return }
     cpu_add(lhs, rhs, &out)
   }
   //--------------------------------------------------------------------------
@@ -75,6 +77,7 @@ extension CpuQueue {
     _ rhs: E.Value,
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
+    if deferred(.add, .tensor(lhs), .value(rhs), into: out) { return }
     cpu_add(lhs, rhs, &out)
   }
   //--------------------------------------------------------------------------
@@ -116,6 +119,13 @@ extension CpuQueue {
     cpu_cast(from: a, to: &out)
   }
 
+  @inlinable public func cast<S, E, OE>(
+    from a: Tensor<S, E>,
+    to out: inout Tensor<S, OE>
+  ) where E.Value: BinaryFloatingPoint, OE.Value: BinaryFloatingPoint {
+    cpu_cast(from: a, to: &out)
+  }
+
   @inlinable public func cast<S, E, OE>(
     from a: Tensor<S, E>,
     to out: inout Tensor<S, OE>
@@ -172,6 +182,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: AlgebraicField {
+    if deferred(.divide, .tensor(lhs), .tensor(rhs), into: out) { return }
     cpu_div(lhs, rhs, &out)
   }
 
@@ -180,6 +191,7 @@ extension CpuQueue {
     _ rhs: E.Value,
     _ out: inout Tensor<S, E>
   ) where E.Value: AlgebraicField {
+    if deferred(.divide, .tensor(lhs), .value(rhs), into: out) { return }
     cpu_div(lhs, rhs, &out)
   }
 
@@ -188,6 +200,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: AlgebraicField {
+    if deferred(.divide, .value(lhs), .tensor(rhs), into: out) { return }
     cpu_div(lhs, rhs, &out)
   }
 
@@ -259,7 +272,10 @@ extension CpuQueue {
   where E.Value: Real { cpu_erfc(x, &out) }
   //--------------------------------------------------------------------------
   @inlinable public func exp<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: Real { cpu_exp(x, &out) }
+  where E.Value: Real {
+    if deferred(.exp, .tensor(x), into: out) { return }
+    cpu_exp(x, &out)
+  }
   //--------------------------------------------------------------------------
   @inlinable public func exp2<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
   where E.Value: Real { cpu_exp2(x, &out) }
@@ -335,7 +351,10 @@ extension CpuQueue {
 
   //--------------------------------------------------------------------------
   @inlinable public func log<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: Real { cpu_log(x, &out) }
+  where E.Value: Real {
+    if deferred(.log, .tensor(x), into: out) { return }
+    cpu_log(x, &out)
+  }
   //--------------------------------------------------------------------------
   @inlinable public func log<S, E>(onePlus x: Tensor<S, E>, _ out: inout Tensor<S, E>)
   where E.Value: Real { cpu_log(onePlus: x, &out) }
@@ -360,6 +379,33 @@ extension CpuQueue {
     cpu_matmul(lhs, transposeLhs, rhs, transposeRhs, &out)
   }
   //--------------------------------------------------------------------------
+  @inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ out: inout TensorR2<E>
+  ) where E.Value: Numeric {
+    cpu_matmul(lhs, transposeLhs, rhs, &out)
+  }
+  //--------------------------------------------------------------------------
+  @inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ bias: TensorR1<E>,
+    _ out: inout TensorR2<E>
+  ) where E.Value: Numeric {
+    cpu_matmul(lhs, transposeLhs, rhs, bias, nil, &out)
+  }
+  //--------------------------------------------------------------------------
+  @inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ bias: TensorR1<E>?,
+    _ activation: ActivationType,
+    _ out: inout TensorR2<E>
+  ) where E.Value: Real {
+    cpu_matmul(lhs, transposeLhs, rhs, bias, activation, &out)
+  }
+  //--------------------------------------------------------------------------
   @inlinable public func matmul<E>(
     _ lhs: TensorR3<E>, _ transposeLhs: Bool,
     _ rhs: TensorR3<E>, _ transposeRhs: Bool,
@@ -373,6 +419,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: Comparable {
+    if deferred(.min, .tensor(lhs), .tensor(rhs), into: out) { return }
     cpu_min(lhs, rhs, &out)
   }
 
@@ -381,6 +428,7 @@ extension CpuQueue {
     _ rhs: E.Value,
     _ out: inout Tensor<S, E>
   ) where E.Value: Comparable {
+    if deferred(.min, .tensor(lhs), .value(rhs), into: out) { return }
     cpu_min(lhs, rhs, &out)
   }
 
@@ -390,6 +438,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: Comparable {
+    if deferred(.max, .tensor(lhs), .tensor(rhs), into: out) { return }
     cpu_max(lhs, rhs, &out)
   }
 
@@ -398,6 +447,7 @@ extension CpuQueue {
     _ rhs: E.Value,
     _ out: inout Tensor<S, E>
   ) where E.Value: Comparable {
+    if deferred(.max, .tensor(lhs), .value(rhs), into: out) { return }
     cpu_max(lhs, rhs, &out)
   }
 
@@ -407,6 +457,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: Numeric {
+    if deferred(.multiply, .tensor(lhs), .tensor(rhs), into: out) { return }
     cpu_mul(lhs, rhs, &out)
   }
 
@@ -415,6 +466,7 @@ extension CpuQueue {
     _ rhs: E.Value,
     _ out: inout Tensor<S, E>
   ) where E.Value: Numeric {
+    if deferred(.multiply, .tensor(lhs), .value(rhs), into: out) { return }
     cpu_mul(lhs, rhs, &out)
   }
 
@@ -440,7 +492,10 @@ extension CpuQueue {
 
   //--------------------------------------------------------------------------
   @inlinable public func neg<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: SignedNumeric { cpu_neg(x, &out) }
+  where E.Value: SignedNumeric {
+    if deferred(.neg, .tensor(x), into: out) { return }
+    cpu_neg(x, &out)
+  }
   //--------------------------------------------------------------------------
   @inlinable public func notEqual<S, E>(
     _ lhs: Tensor<S, E>, _ rhs: Tensor<S, E>,
@@ -480,7 +535,10 @@ extension CpuQueue {
   where E.Value: Real { cpu_root(x, n, &out) }
   //--------------------------------------------------------------------------
   @inlinable public func sigmoid<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: Real { cpu_sigmoid(x, &out) }
+  where E.Value: Real {
+    if deferred(.sigmoid, .tensor(x), into: out) { return }
+    cpu_sigmoid(x, &out)
+  }
   //--------------------------------------------------------------------------
   @inlinable public func sign<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
   where E.Value: Comparable & SignedNumeric {
@@ -498,6 +556,7 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
+    if deferred(.subtract, .tensor(lhs), .tensor(rhs), into: out) { return }
     cpu_subtract(lhs, rhs, &out)
   }
 
@@ -506,6 +565,7 @@ extension CpuQueue {
     _ rhs: E.Value,
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
+    if deferred(.subtract, .tensor(lhs), .value(rhs), into: out) { return }
     cpu_subtract(lhs, rhs, &out)
   }
 
@@ -514,21 +574,31 @@ extension CpuQueue {
     _ rhs: Tensor<S, E>,
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
+    if deferred(.subtract, .value(lhs), .tensor(rhs), into: out) { return }
     cpu_subtract(lhs, rhs, &out)
   }
 
   //--------------------------------------------------------------------------
   @inlinable public func sqrt<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: Real { cpu_sqrt(x, &out) }
+  where E.Value: Real {
+    if deferred(.sqrt, .tensor(x), into: out) { return }
+    cpu_sqrt(x, &out)
+  }
   //--------------------------------------------------------------------------
   @inlinable public func squared<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: Numeric { cpu_squared(x, &out) }
+  where E.Value: Numeric {
+    if deferred(.squared, .tensor(x), into: out) { return }
+    cpu_squared(x, &out)
+  }
   //--------------------------------------------------------------------------
   @inlinable public func tan<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
   where E.Value: Real { cpu_tan(x, &out) }
   //--------------------------------------------------------------------------
   @inlinable public func tanh<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
-  where E.Value: Real { cpu_tanh(x, &out) }
+  where E.Value: Real {
+    if deferred(.tanh, .tensor(x), into: out) { return }
+    cpu_tanh(x, &out)
+  }
 }
 
 //==============================================================================
@@ -649,7 +719,7 @@ extension DeviceQueue {
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
     diagnostic(.queueCpu, "add(\(lhs.name), \(rhs.name)) on \(name)", categories: .queueCpu)
-    mapOp(lhs, rhs, &out, +)
+    mapOp(lhs, rhs, &out, AddOp<E.Value>.self)
   }
 
   @inlinable public func cpu_add<S, E>(
@@ -658,7 +728,7 @@ extension DeviceQueue {
     _ out: inout Tensor<S, E>
   ) where E.Value: AdditiveArithmetic {
     diagnostic(.queueCpu, "add(\(lhs.name), \(rhs)) on \(name)", categories: .queueCpu)
-    mapOp(lhs, rhs, &out, +)
+    mapOp(lhs, rhs, &out, AddOp<E.Value>.self)
   }
 
   //--------------------------------------------------------------------------
@@ -735,6 +805,17 @@ extension DeviceQueue {
     mapOp(a, &out) { OE.Value($0) }
   }
 
+  // FloatingPoint -> FloatingPoint
+  // converted types like `Float16` and `BFloat16` are read and written
+  // in bulk by the chunked `mapOp` path
+  @inlinable public func cpu_cast<S, E, OE>(
+    from a: Tensor<S, E>,
+    to out: inout Tensor<S, OE>
+  ) where E.Value: BinaryFloatingPoint, OE.Value: BinaryFloatingPoint {
+    diagnostic(.queueCpu, "cast(\(a.name)) on \(name)", categories: .queueCpu)
+    mapOp(a, &out) { OE.Value($0) }
+  }
+
   @inlinable public func cpu_cast<S, E, OE>(
     from a: Tensor<S, E>,
     to out: inout Tensor<S, OE>
@@ -787,7 +868,20 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "copy(form: \(a.name), to: \(out.name) on \(name)",
       categories: .queueCpu)
-    mapOp(a, &out) { $0 }
+
+    // whole elements in the same layout are copied without converting
+    // them to values, which matters for types like `Float16`
+    if a.order == out.order && a.isContiguous && out.isContiguous
+      && E.storedCount(64) == 64
+    {
+      let (a, o) = (a.buffer, out.mutableBuffer)
+      cpu_parallel(o.count, writing: E.self) {
+        (o.hostBuffer.baseAddress! + $0.lowerBound).assign(
+          from: a.hostBuffer.baseAddress! + $0.lowerBound, count: $0.count)
+      }
+    } else {
+      mapOp(a, &out) { $0 }
+    }
   }
 
   //--------------------------------------------------------------------------
@@ -817,7 +911,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "div(\(lhs.name), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, /)
+    mapOp(lhs, rhs, &out, DivideOp<E.Value>.self)
   }
 
   @inlinable public func cpu_div<S, E>(
@@ -828,7 +922,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "div(\(lhs.name), \(rhs)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, /)
+    mapOp(lhs, rhs, &out, DivideOp<E.Value>.self)
   }
 
   @inlinable public func cpu_div<S, E>(
@@ -839,7 +933,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "div(\(lhs), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, /)
+    mapOp(lhs, rhs, &out, DivideOp<E.Value>.self)
   }
 
   //----------------------------------------------------------------------------
@@ -927,7 +1021,8 @@ extension DeviceQueue {
     _ out: inout Tensor<S, E>
   ) where E.Value: Real {
     diagnostic(.queueCpu, "erf(\(x.name)) on \(name)", categories: .queueCpu)
-    mapOp(x, &out) { .erf($0) }
+    vectorMapOp(
+      x, &out, float: VectorMath.erf, double: VectorMath.erf) { .erf($0) }
   }
 
   //--------------------------------------------------------------------------
@@ -945,7 +1040,8 @@ extension DeviceQueue {
     _ out: inout Tensor<S, E>
   ) where E.Value: Real {
     diagnostic(.queueCpu, "exp(\(x.name)) on \(name)", categories: .queueCpu)
-    mapOp(x, &out) { .exp($0) }
+    vectorMapOp(
+      x, &out, float: VectorMath.exp, double: VectorMath.exp) { .exp($0) }
   }
 
   //--------------------------------------------------------------------------
@@ -1096,7 +1192,8 @@ extension DeviceQueue {
     _ out: inout Tensor<S, E>
   ) where E.Value: Real {
     diagnostic(.queueCpu, "log(\(x.name)) on \(name)", categories: .queueCpu)
-    mapOp(x, &out) { .log($0) }
+    vectorMapOp(
+      x, &out, float: VectorMath.log, double: VectorMath.log) { .log($0) }
   }
 
   //--------------------------------------------------------------------------
@@ -1143,21 +1240,15 @@ extension DeviceQueue {
     _ rhs: TensorR2<E>, _ transposeRhs: Bool,
     _ out: inout TensorR2<E>
   ) where E.Value: Numeric {
-    diagnostic(.queueCpu, "matmul on \(name)", categories: .queueCpu)
-    let lhs = transposeLhs ? lhs.t : lhs
-    let rhs = transposeRhs ? rhs.t : rhs
-    assert(
-      out.shape[0] == lhs.shape[0] && out.shape[1] == rhs.shape[1],
-      "matmul inner dimensions must be equal")
-    //-------------------------------
-    // simple place holder
-    for r in 0..<out.shape[0] {
-      let row = lhs[r, ...]
-      for c in 0..<out.shape[1] {
-        let col = rhs[..., c]
-        out[r, c] = zip(row, col).reduce(into: 0) { $0 += $1.0 * $1.1 }
-      }
-    }
+    // the rhs is packed for each call. Callers that reuse the same
+    // rhs should pack it once with `PackedMatrix`
+    let (m, k) = transposeLhs
+      ? (lhs.shape[1], lhs.shape[0]) : (lhs.shape[0], lhs.shape[1])
+    let n = transposeRhs ? rhs.shape[0] : rhs.shape[1]
+    let blocking = CpuGemmBlocking.plan(for: E.self, m: m, k: k, n: n)
+    cpu_matmul(
+      lhs, transposeLhs,
+      PackedMatrix(rhs, transposed: transposeRhs, blocking: blocking), &out)
   }
 
   //--------------------------------------------------------------------------
@@ -1194,7 +1285,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "max(\(lhs.name), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out) { $0 >= $1 ? $0 : $1 }
+    mapOp(lhs, rhs, &out, MaxOp<E.Value>.self)
   }
 
   @inlinable public func cpu_max<S, E>(
@@ -1205,7 +1296,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "max(\(lhs.name), \(rhs)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out) { $0 >= $1 ? $0 : $1 }
+    mapOp(lhs, rhs, &out, MaxOp<E.Value>.self)
   }
 
   //--------------------------------------------------------------------------
@@ -1217,7 +1308,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "min(\(lhs.name), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out) { $0 < $1 ? $0 : $1 }
+    mapOp(lhs, rhs, &out, MinOp<E.Value>.self)
   }
 
   @inlinable public func cpu_min<S, E>(
@@ -1228,7 +1319,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "min(\(lhs.name), \(rhs)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out) { $0 < $1 ? $0 : $1 }
+    mapOp(lhs, rhs, &out, MinOp<E.Value>.self)
   }
 
   //--------------------------------------------------------------------------
@@ -1240,7 +1331,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "mul(\(lhs.name), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, *)
+    mapOp(lhs, rhs, &out, MultiplyOp<E.Value>.self)
   }
 
   @inlinable public func cpu_mul<S, E>(
@@ -1251,7 +1342,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "mul(\(lhs.name), \(rhs)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, *)
+    mapOp(lhs, rhs, &out, MultiplyOp<E.Value>.self)
   }
 
   //--------------------------------------------------------------------------
@@ -1373,7 +1464,20 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "sigmoid(\(x.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(x, &out) { 1 / (1 + .exp(-$0)) }
+    vectorMapOp(
+      x, &out, float: VectorMath.sigmoid, double: VectorMath.sigmoid
+    ) { 1 / (1 + .exp(-$0)) }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func cpu_gelu<S, E>(
+    _ x: Tensor<S, E>,
+    _ out: inout Tensor<S, E>
+  ) where E.Value: Real {
+    diagnostic(.queueCpu, "gelu(\(x.name)) on \(name)", categories: .queueCpu)
+    vectorMapOp(
+      x, &out, float: VectorMath.gelu, double: VectorMath.gelu
+    ) { $0 * (1 + .erf($0 / .sqrt(2))) / 2 }
   }
 
   //--------------------------------------------------------------------------
@@ -1413,7 +1517,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "subtract(\(lhs.name), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, -)
+    mapOp(lhs, rhs, &out, SubtractOp<E.Value>.self)
   }
 
   @inlinable public func cpu_subtract<S, E>(
@@ -1425,7 +1529,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "subtract(\(lhs.name), \(rhs)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, -)
+    mapOp(lhs, rhs, &out, SubtractOp<E.Value>.self)
   }
 
   @inlinable public func cpu_subtract<S, E>(
@@ -1436,7 +1540,7 @@ extension DeviceQueue {
     diagnostic(
       .queueCpu, "subtract(\(lhs), \(rhs.name)) on \(name)",
       categories: .queueCpu)
-    mapOp(lhs, rhs, &out, -)
+    mapOp(lhs, rhs, &out, SubtractOp<E.Value>.self)
   }
 
   //--------------------------------------------------------------------------
@@ -1471,7 +1575,8 @@ extension DeviceQueue {
     _ out: inout Tensor<S, E>
   ) where E.Value: Real {
     diagnostic(.queueCpu, "tanh(\(x.name)) on \(name)", categories: .queueCpu)
-    mapOp(x, &out) { .tanh($0) }
+    vectorMapOp(
+      x, &out, float: VectorMath.tanh, double: VectorMath.tanh) { .tanh($0) }
   }
 
   //==========================================================================
@@ -15,6 +15,7 @@
 //
 
 import Foundation
+import Numerics
 
 //==============================================================================
 /// CpuMatmul2
@@ -56,3 +57,440 @@ where E: StorageElement, E.Value: StorageElement & Numeric {
     fatalError("abstract not implemented")
   }
 }
+
+//==============================================================================
+/// CpuGemmBlocking
+/// the register block sizes used by the cpu gemm kernel
+public struct CpuGemmBlocking: Codable, Equatable {
+  /// the number of lhs rows accumulated together against a panel
+  public var rows: Int
+  /// the number of rhs columns in each packed panel
+  public var panelWidth: Int
+
+  @inlinable public init(rows: Int, panelWidth: Int) {
+    assert(rows > 0 && panelWidth > 0)
+    self.rows = rows
+    self.panelWidth = panelWidth
+  }
+
+  /// the blocking used when none is specified
+  public static var current = CpuGemmBlocking(rows: 4, panelWidth: 8)
+
+  //--------------------------------------------------------------------------
+  /// plan(for:m:k:n:
+  /// - Returns: the blocking stored in `ExecutionPlans.shared` for the
+  ///   product of an `m` by `k` and a `k` by `n` matrix. If there isn't
+  ///   one, the problem is tuned when `CpuAutotuner.shared` is enabled,
+  ///   and otherwise `current` is returned and the miss is recorded, so
+  ///   the database is only searched once for each problem.
+  @inlinable public static func plan<E>(
+    for type: E.Type,
+    m: Int, k: Int, n: Int
+  ) -> CpuGemmBlocking where E: StorageElement, E.Value: Numeric {
+    let key = planKeys.key(for: type, m: m, k: k, n: n)
+    if let plan = ExecutionPlans.shared.query(CpuGemmBlocking.self, key: key) {
+      return plan
+    }
+    guard CpuAutotuner.shared.isEnabled else {
+      ExecutionPlans.shared.addMissing(CpuGemmBlocking.self, key: key)
+      return current
+    }
+    return CpuAutotuner.shared.tuneGemm(type, m: m, k: k, n: n)
+  }
+
+  /// planKey(for:m:k:n:
+  /// - Returns: the execution plan key of a gemm problem. The number of
+  ///   lhs rows is the batch size of a layer, so it is rounded to its
+  ///   shape class.
+  @inlinable public static func planKey<E>(
+    for type: E.Type,
+    m: Int, k: Int, n: Int
+  ) -> ExecutionPlanKey {
+    let rows = ExecutionPlanKey.shapeClass(m)
+    return ExecutionPlanKey(
+      op: "gemm", shapes: [[rows, k], [k, n]], types: [type])
+  }
+
+  /// the plan keys of the problems `plan` has been called with
+  public static let planKeys = GemmPlanKeys()
+}
+
+//==============================================================================
+/// GemmPlanKeys
+/// The execution plan keys of gemm problems by geometry. Building a key
+/// formats and hashes the problem description, so it's built the first
+/// time a geometry is seen and looked up after that.
+public final class GemmPlanKeys {
+  @usableFromInline struct Problem: Hashable {
+    @usableFromInline let type: ObjectIdentifier
+    @usableFromInline let rows: Int
+    @usableFromInline let k: Int
+    @usableFromInline let n: Int
+
+    @inlinable init(_ type: ObjectIdentifier, _ rows: Int, _ k: Int, _ n: Int) {
+      (self.type, self.rows, self.k, self.n) = (type, rows, k, n)
+    }
+  }
+
+  /// the maximum number of keys kept. The keys are discarded when it's
+  /// reached, so a stream of new geometries can't grow the table.
+  public static let capacity = 4096
+
+  @usableFromInline let mutex = Mutex()
+  @usableFromInline var keys: [Problem: ExecutionPlanKey] = [:]
+
+  @inlinable public init() {}
+
+  //--------------------------------------------------------------------------
+  /// key(for:m:k:n:
+  /// - Returns: `CpuGemmBlocking.planKey(for:m:k:n:)`
+  @inlinable public func key<E>(
+    for type: E.Type,
+    m: Int, k: Int, n: Int
+  ) -> ExecutionPlanKey where E: StorageElement, E.Value: Numeric {
+    let problem = Problem(
+      ObjectIdentifier(type), ExecutionPlanKey.shapeClass(m), k, n)
+    if let key = mutex.access({ keys[problem] }) { return key }
+    let key = CpuGemmBlocking.planKey(for: type, m: m, k: k, n: n)
+    mutex.access {
+      if keys.count == Self.capacity { keys.removeAll() }
+      keys[problem] = key
+    }
+    return key
+  }
+}
+
+//==============================================================================
+/// PackedMatrix
+/// The right hand side of a matrix multiply stored in the column panel
+/// layout consumed by the cpu gemm kernel. Packing is a full pass over
+/// the matrix, so a matrix that is multiplied repeatedly, such as a layer
+/// weight during inference, can be packed once and reused.
+public final class PackedMatrix<E: StorageElement> {
+  /// the number of rows in the packed (possibly transposed) matrix
+  public let rows: Int
+  /// the number of columns in the packed matrix
+  public let cols: Int
+  /// the number of columns in each panel
+  public let panelWidth: Int
+  /// panels of `panelWidth` columns, each stored row major. The last
+  /// panel is zero padded to a full width.
+  public let panels: [E.Value]
+  /// `true` if `source` was transposed before packing
+  public let isTransposed: Bool
+  /// the version of the packed tensor. The tensor isn't retained, so an
+  /// in place update of a packed weight doesn't copy on write.
+  public let source: TensorVersion<Shape2>
+  /// the name used in diagnostic messages
+  public let name: String
+
+  @inlinable public init(
+    rows: Int,
+    cols: Int,
+    panelWidth: Int,
+    panels: [E.Value],
+    isTransposed: Bool,
+    source: TensorVersion<Shape2>,
+    name: String = defaultTensorName
+  ) {
+    assert(panels.count == (cols + panelWidth - 1) / panelWidth * rows * panelWidth)
+    self.rows = rows
+    self.cols = cols
+    self.panelWidth = panelWidth
+    self.panels = panels
+    self.isTransposed = isTransposed
+    self.source = source
+    self.name = name
+  }
+
+  //--------------------------------------------------------------------------
+  /// isPacking(of:transposed:
+  /// - Returns: `true` if this is a current packing of `tensor`
+  @inlinable public func isPacking(
+    of tensor: TensorR2<E>,
+    transposed: Bool
+  ) -> Bool {
+    transposed == isTransposed && tensor.version == source
+  }
+}
+
+extension PackedMatrix where E.Value: Numeric {
+  //--------------------------------------------------------------------------
+  /// init(matrix:transposed:blocking:
+  /// packs `matrix` into column panels
+  /// - Parameters:
+  ///  - matrix: the matrix to pack
+  ///  - transposed: `true` to pack the transpose of `matrix`
+  ///  - blocking: the kernel blocking the panels are packed for
+  @inlinable public convenience init(
+    _ matrix: TensorR2<E>,
+    transposed: Bool = false,
+    blocking: CpuGemmBlocking = CpuGemmBlocking.current
+  ) {
+    let logical = transposed ? matrix.t : matrix
+    let (k, n, nr) = (logical.shape[0], logical.shape[1], blocking.panelWidth)
+    let panelCount = (n + nr - 1) / nr
+    let values = usingSyncQueue { [E.Value](logical.elements) }
+    var panels = [E.Value](repeating: 0, count: panelCount * k * nr)
+
+    panels.withUnsafeMutableBufferPointer { p in
+      for panel in 0..<panelCount {
+        let col = panel * nr
+        let width = Swift.min(nr, n - col)
+        var pi = panel * k * nr
+        for row in 0..<k {
+          let vi = row * n + col
+          for j in 0..<width { p[pi + j] = values[vi + j] }
+          pi += nr
+        }
+      }
+    }
+
+    self.init(
+      rows: k, cols: n, panelWidth: nr, panels: panels,
+      isTransposed: transposed, source: matrix.version, name: matrix.name)
+  }
+
+  //--------------------------------------------------------------------------
+  /// multiply(_:lhsRows:into:bias:epilogue:blockRows:
+  /// computes `out = epilogue(lhs * self + bias)`
+  /// The bias and epilogue are applied to each accumulator block before
+  /// it is stored, so they don't cost another pass over `out`.
+  /// - Parameters:
+  ///  - lhs: a dense row major matrix of `lhsRows` by `rows` elements
+  ///  - lhsRows: the number of rows in `lhs` and `out`
+  ///  - out: a dense row major matrix of `lhsRows` by `cols` elements
+  ///  - bias: optional `cols` values added to each row
+  ///  - epilogue: optional function applied to each result element
+  ///  - blockRows: the number of lhs rows accumulated together
+  @inlinable public func multiply(
+    _ lhs: UnsafeBufferPointer<E.Value>,
+    lhsRows m: Int,
+    into out: UnsafeMutableBufferPointer<E.Value>,
+    bias: UnsafeBufferPointer<E.Value>? = nil,
+    epilogue: ((E.Value) -> E.Value)? = nil,
+    blockRows: Int = CpuGemmBlocking.current.rows
+  ) {
+    assert(bias == nil || bias!.count >= cols)
+    assert(lhs.count >= m * rows && out.count >= m * cols)
+    let (k, n, nr, mr) = (rows, cols, panelWidth, blockRows)
+    var accumulator = [E.Value](repeating: 0, count: mr * nr)
+
+    panels.withUnsafeBufferPointer { b in
+      accumulator.withUnsafeMutableBufferPointer { acc in
+        for panel in 0..<(n + nr - 1) / nr {
+          let col = panel * nr
+          let width = Swift.min(nr, n - col)
+
+          for row in stride(from: 0, to: m, by: mr) {
+            let height = Swift.min(mr, m - row)
+            for i in 0..<(height * nr) { acc[i] = 0 }
+
+            // each panel row is reused for every row in the block
+            var bi = panel * k * nr
+            for kk in 0..<k {
+              for r in 0..<height {
+                let a = lhs[(row + r) * k + kk]
+                let ai = r * nr
+                for j in 0..<nr { acc[ai + j] += a * b[bi + j] }
+              }
+              bi += nr
+            }
+
+            // apply the epilogue while the block is still in cache
+            // and store the valid part
+            for r in 0..<height {
+              let oi = (row + r) * n + col
+              let ai = r * nr
+              if let bias = bias {
+                for j in 0..<width { acc[ai + j] += bias[col + j] }
+              }
+              if let epilogue = epilogue {
+                for j in 0..<width { out[oi + j] = epilogue(acc[ai + j]) }
+              } else {
+                for j in 0..<width { out[oi + j] = acc[ai + j] }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+//==============================================================================
+/// PackedMatrixCache
+/// Holds the packing of a matrix that is multiplied repeatedly, such as a
+/// layer weight, and repacks it when the matrix is replaced or written.
+/// Only the version of the matrix is kept, so the owner of the matrix can
+/// update it in place without copying.
+public final class PackedMatrixCache<E: StorageElement> {
+  /// the current packing, or `nil` if nothing has been packed
+  public var packed: PackedMatrix<E>?
+  /// the number of times a matrix has been packed
+  public var packCount = 0
+
+  @inlinable public init() {}
+
+  /// releases the packing
+  @inlinable public func removeAll() { packed = nil }
+}
+
+extension PackedMatrixCache where E.Value: Numeric {
+  //--------------------------------------------------------------------------
+  /// packing(of:transposed:blocking:
+  /// - Returns: `matrix` packed as a matmul right hand side, which is the
+  ///   cached packing if `matrix` hasn't changed since it was packed and
+  ///   it was packed for the same panel width
+  @inlinable public func packing(
+    of matrix: TensorR2<E>,
+    transposed: Bool = false,
+    blocking: CpuGemmBlocking = CpuGemmBlocking.current
+  ) -> PackedMatrix<E> {
+    if let packed = packed, packed.isPacking(of: matrix, transposed: transposed),
+      packed.panelWidth == blocking.panelWidth
+    {
+      return packed
+    }
+    let packed = PackedMatrix(matrix, transposed: transposed, blocking: blocking)
+    self.packed = packed
+    packCount += 1
+    return packed
+  }
+}
+
+//==============================================================================
+// ActivationType cpu functions
+extension ActivationType {
+  /// function(type:reluCeiling:
+  /// - Parameters:
+  ///  - type: the element value type
+  ///  - reluCeiling: the upper bound used by `clippedRelu`
+  /// - Returns: the activation as a scalar function suitable for fusing
+  ///   into the epilogue of another operation
+  @inlinable public func function<T: Real>(
+    _ type: T.Type,
+    reluCeiling: T = 6
+  ) -> (T) -> T {
+    switch self {
+    case .sigmoid: return { 1 / (1 + .exp(-$0)) }
+    case .relu: return { $0 > 0 ? $0 : 0 }
+    case .tanh: return { .tanh($0) }
+    case .clippedRelu: return { Swift.min(Swift.max($0, 0), reluCeiling) }
+    case .elu: return { $0 > 0 ? $0 : .expMinusOne($0) }
+    case .identity: return { $0 }
+    }
+  }
+
+  /// derivative(type:reluCeiling:
+  /// - Parameters:
+  ///  - type: the element value type
+  ///  - reluCeiling: the upper bound used by `clippedRelu`
+  /// - Returns: the derivative of the activation expressed as a function
+  ///   of the activation output, so backpropagation does not need the
+  ///   activation input
+  @inlinable public func derivative<T: Real>(
+    _ type: T.Type,
+    reluCeiling: T = 6
+  ) -> (T) -> T {
+    switch self {
+    case .sigmoid: return { $0 * (1 - $0) }
+    case .relu: return { $0 > 0 ? 1 : 0 }
+    case .tanh: return { 1 - $0 * $0 }
+    case .clippedRelu: return { $0 > 0 && $0 < reluCeiling ? 1 : 0 }
+    case .elu: return { $0 > 0 ? 1 : $0 + 1 }
+    case .identity: return { _ in 1 }
+    }
+  }
+}
+
+//==============================================================================
+// Cpu device queue function implementations
+extension DeviceQueue {
+  //--------------------------------------------------------------------------
+  @inlinable public func cpu_matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ out: inout TensorR2<E>
+  ) where E.Value: Numeric {
+    cpu_matmul(lhs, transposeLhs, rhs, nil, nil, &out)
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func cpu_matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ bias: TensorR1<E>?,
+    _ activation: ActivationType,
+    _ out: inout TensorR2<E>
+  ) where E.Value: Real {
+    cpu_matmul(
+      lhs, transposeLhs, rhs, bias,
+      activation == .identity ? nil : activation.function(E.Value.self),
+      &out)
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_matmul
+  /// computes `out = epilogue(lhs * rhs + bias)` where `bias` is added
+  /// to each row of the result
+  @inlinable public func cpu_matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ bias: TensorR1<E>?,
+    _ epilogue: ((E.Value) -> E.Value)?,
+    _ out: inout TensorR2<E>
+  ) where E.Value: Numeric {
+    diagnostic(
+      .queueCpu, "matmul(\(lhs.name), packed: \(rhs.name)"
+        + "\(bias == nil ? "" : ", bias: \(bias!.name)")) on \(name)",
+      categories: .queueCpu)
+    let lhs = transposeLhs ? lhs.t : lhs
+    assert(
+      lhs.shape[1] == rhs.rows && out.shape[0] == lhs.shape[0]
+        && out.shape[1] == rhs.cols,
+      "matmul inner dimensions must be equal")
+    assert(bias == nil || bias!.count == rhs.cols, "bias count must equal rhs columns")
+    let m = lhs.shape[0]
+    let b = bias?.elements
+    // the rows are tuned together with the panel width, so a matrix
+    // packed for another width uses the default rows
+    let plan = CpuGemmBlocking.plan(for: E.self, m: m, k: rhs.rows, n: rhs.cols)
+    let blockRows = plan.panelWidth == rhs.panelWidth
+      ? plan.rows : CpuGemmBlocking.current.rows
+
+    func execute<A: Collection, O: MutableCollection>(
+      _ a: A,
+      _ out: O
+    ) where A.Element == E.Value, O.Element == E.Value {
+      var out = out
+      let a = [E.Value](a)
+      let bias = b.map { [E.Value]($0) }
+      var c = [E.Value](repeating: 0, count: out.count)
+      a.withUnsafeBufferPointer { a in
+        c.withUnsafeMutableBufferPointer { c in
+          if let bias = bias {
+            bias.withUnsafeBufferPointer {
+              rhs.multiply(
+                a, lhsRows: m, into: c, bias: $0, epilogue: epilogue,
+                blockRows: blockRows)
+            }
+          } else {
+            rhs.multiply(
+              a, lhsRows: m, into: c, epilogue: epilogue,
+              blockRows: blockRows)
+          }
+        }
+      }
+      zip(out.indices, c).forEach { out[$0] = $1 }
+    }
+
+    if out.isContiguous && out.order == .row {
+      let a = lhs.elements, c = out.mutableBuffer
+      cpu_execute { execute(a, c) }
+    } else {
+      let a = lhs.elements, c = out.mutableElements
+      cpu_execute { execute(a, c) }
+    }
+  }
+}
@@ -25,7 +25,7 @@ extension CpuQueue {
     _ config: PoolingConfig<S, E>,
     _ x: Tensor<S, E>,
     _ out: inout Tensor<S, E>
-  ) where E: Numeric {
+  ) where E.Value: Comparable & AlgebraicField {
     cpu_pool(config, x, &out)
   }
 
@@ -37,20 +37,56 @@ extension CpuQueue {
   ) where E: VectorElement, E.Scalar: Numeric {
     cpu_pool(config, x, &out)
   }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func poolBackward<S, E>(
+    _ config: PoolingConfig<S, E>,
+    _ x: Tensor<S, E>,
+    _ out: Tensor<S, E>,
+    _ outDiff: Tensor<S, E>,
+    _ xDiff: inout Tensor<S, E>
+  ) where E.Value: Comparable & AlgebraicField {
+    cpu_poolBackward(config, x, out, outDiff, &xDiff)
+  }
 }
 
 //==============================================================================
 // Cpu device queue function implementations
 extension DeviceQueue {
   //--------------------------------------------------------------------------
+  /// cpu_pool
+  /// Pools each dimension with a window in a separate pass, so the partial
+  /// results of overlapping windows are computed once and shared. Each
+  /// pass runs over the contiguous block of trailing dimensions, which for
+  /// NHWC data is the channel vector, and is distributed across the cpu
+  /// cores over the leading dimensions. Max pooling records the flat input
+  /// index of each maximum in `config.maxIndices` for the backward pass.
   @inlinable public func cpu_pool<S, E>(
     _ config: PoolingConfig<S, E>,
     _ x: Tensor<S, E>,
     _ out: inout Tensor<S, E>
-  ) where E: Numeric {
-    fatalError("cpu_pool not implemented yet")
-    // diagnostic(.queueCpu, "pool(\(x.name))", categories: .queueCpu)
+  ) where E.Value: Comparable & AlgebraicField {
+    diagnostic(.queueCpu, "pool(\(x.name)) \(config.geometry.op)",
+               categories: .queueCpu)
+    assert(out.shape == config.shape, "output shape must match the config")
+    let g = config.geometry
+    let xs = x.elements
+
+    func execute<O: MutableCollection>(_ out: O) where O.Element == E.Value {
+      var out = out
+      var indices: [Int32]?
+      let y = g.forward([E.Value](xs), &indices)
+      config.maxIndices = indices ?? []
+      zip(out.indices, y).forEach { out[$0] = $1 }
+    }
 
+    if out.order == .row {
+      let o = out.mutableBuffer
+      cpu_execute { execute(o) }
+    } else {
+      let o = out.mutableElements
+      cpu_execute { execute(o) }
+    }
   }
 
   //--------------------------------------------------------------------------
@@ -63,12 +99,267 @@ extension DeviceQueue {
     // diagnostic(.queueCpu, "pool(\(x.name))", categories: .queueCpu)
 
   }
+
+  //--------------------------------------------------------------------------
+  /// cpu_poolBackward
+  /// Max pooling scatters each output gradient to the input recorded in
+  /// `config.maxIndices` by the forward pass. Average pooling gathers the
+  /// gradient back through each pooling pass in reverse.
+  /// - Parameters:
+  ///  - config: the config used for the forward pass
+  ///  - x: the forward input
+  ///  - out: the forward output
+  ///  - outDiff: the output gradient
+  ///  - xDiff: the input gradient
+  @inlinable public func cpu_poolBackward<S, E>(
+    _ config: PoolingConfig<S, E>,
+    _ x: Tensor<S, E>,
+    _ out: Tensor<S, E>,
+    _ outDiff: Tensor<S, E>,
+    _ xDiff: inout Tensor<S, E>
+  ) where E.Value: Comparable & AlgebraicField {
+    diagnostic(.queueCpu, "poolBackward(\(x.name)) \(config.geometry.op)",
+               categories: .queueCpu)
+    assert(outDiff.shape == config.shape && xDiff.shape == x.shape)
+    let g = config.geometry
+    let dys = outDiff.elements
+
+    func execute<O: MutableCollection>(_ out: O) where O.Element == E.Value {
+      var out = out
+      let dx = g.isMax
+        ? g.backwardMax([E.Value](dys), config.maxIndices)
+        : g.backwardAverage([E.Value](dys))
+      zip(out.indices, dx).forEach { out[$0] = $1 }
+    }
+
+    if xDiff.order == .row {
+      let o = xDiff.mutableBuffer
+      cpu_execute { execute(o) }
+    } else {
+      let o = xDiff.mutableElements
+      cpu_execute { execute(o) }
+    }
+  }
+}
+
+//==============================================================================
+/// PoolingGeometry
+/// The pooling window parameters for each dimension of a row major tensor.
+/// Dimensions with a unit window and stride and no padding pass through
+/// unchanged, so for NHWC data the batch and channel dimensions cost
+/// nothing and each pass runs over contiguous channel vectors.
+public struct PoolingGeometry: Equatable {
+  public let input: [Int]
+  public let output: [Int]
+  public let window: [Int]
+  public let strides: [Int]
+  public let padding: [Int]
+  public let op: PoolingOp
+
+  /// `true` if this is a max pooling operation
+  @inlinable public var isMax: Bool { op == .max || op == .maxDeterministic }
+
+  /// the dimensions that are pooled
+  @inlinable public var pooledDims: [Int] {
+    (0..<input.count).filter {
+      !(window[$0] == 1 && strides[$0] == 1 && padding[$0] == 0)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public init<Shape: TensorShape>(
+    x: Shape,
+    windowSize: Shape,
+    strides: Shape,
+    padding: Shape,
+    op: PoolingOp
+  ) {
+    input = x.array
+    window = windowSize.array
+    self.strides = strides.array
+    self.padding = padding.array
+    self.op = op
+    output = (0..<Shape.rank).map {
+      1 + (x[$0] + 2 * padding[$0] - windowSize[$0]) / strides[$0]
+    }
+    assert(
+      (0..<Shape.rank).allSatisfy { padding[$0] < windowSize[$0] },
+      "padding must be less than the window size")
+  }
+
+  //--------------------------------------------------------------------------
+  /// taps(_:_:
+  /// - Returns: the input range covered by window `j` along `dim`,
+  ///   clipped to the input
+  @inlinable public func taps(_ j: Int, _ dim: Int) -> Range<Int> {
+    let lower = j * strides[dim] - padding[dim]
+    return Swift.max(0, lower)..<Swift.min(input[dim], lower + window[dim])
+  }
+
+  //--------------------------------------------------------------------------
+  /// passes
+  /// - Returns: the extents before and after each pooling pass, with the
+  ///   number of outer lines and the contiguous inner element count
+  @inlinable public var passes: [(dim: Int, outer: Int, inner: Int)] {
+    var extents = input
+    return pooledDims.map { dim in
+      let outer = extents[..<dim].reduce(1, *)
+      let inner = extents[(dim + 1)...].reduce(1, *)
+      extents[dim] = output[dim]
+      return (dim, outer, inner)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// forward
+  /// - Parameters:
+  ///  - x: the row major input values
+  ///  - indices: set to the flat input index of each maximum for max
+  ///    pooling, otherwise `nil`
+  /// - Returns: the row major pooled values
+  @inlinable public func forward<V: Comparable & AlgebraicField>(
+    _ x: [V],
+    _ indices: inout [Int32]?
+  ) -> [V] {
+    assert(!isMax || x.count <= Int(Int32.max), "max pooling index overflow")
+    var values = x
+    indices = nil
+
+    for (dim, outer, inner) in passes {
+      let (nIn, nOut, w) = (input[dim], output[dim], window[dim])
+      var next = [V](repeating: 0, count: outer * nOut * inner)
+      var nextIndices = isMax ? [Int32](repeating: 0, count: next.count) : []
+      let grain = Swift.max(1, 4096 / (w * inner))
+
+      values.withUnsafeBufferPointer { src in
+        next.withUnsafeMutableBufferPointer { dst in
+          nextIndices.withUnsafeMutableBufferPointer { dstIndex in
+            // indices are the flat input positions until the first pass
+            // has selected them
+            let srcIndex = indices
+            parallelFor(outer * nOut, grainSize: grain) { items in
+              for item in items {
+                let (o, j) = (item / nOut, item % nOut)
+                let d = item * inner
+                let taps = self.taps(j, dim)
+                var si = (o * nIn + taps.lowerBound) * inner
+
+                if isMax {
+                  for c in 0..<inner {
+                    dst[d + c] = src[si + c]
+                    dstIndex[d + c] = srcIndex?[si + c] ?? Int32(si + c)
+                  }
+                  for _ in taps.dropFirst() {
+                    si += inner
+                    for c in 0..<inner where src[si + c] > dst[d + c] {
+                      dst[d + c] = src[si + c]
+                      dstIndex[d + c] = srcIndex?[si + c] ?? Int32(si + c)
+                    }
+                  }
+                } else {
+                  for c in 0..<inner { dst[d + c] = src[si + c] }
+                  for _ in taps.dropFirst() {
+                    si += inner
+                    for c in 0..<inner { dst[d + c] += src[si + c] }
+                  }
+                  // the separable counts multiply to the window count
+                  let count = op == .averagePadding ? w : taps.count
+                  let scale = 1 / V(exactly: count)!
+                  for c in 0..<inner { dst[d + c] *= scale }
+                }
+              }
+            }
+          }
+        }
+      }
+      values = next
+      if isMax { indices = nextIndices }
+    }
+
+    // a max pool without pooled dimensions selects every input
+    if isMax && indices == nil {
+      indices = (0..<x.count).map { Int32($0) }
+    }
+    return values
+  }
+
+  //--------------------------------------------------------------------------
+  /// backwardMax
+  /// Each output gradient is added to the input that produced the maximum.
+  /// Windows only overlap within the leading dimensions that are not
+  /// pooled, so those are processed in parallel without conflicts.
+  @inlinable public func backwardMax<V: Comparable & AlgebraicField>(
+    _ dy: [V],
+    _ indices: [Int32]
+  ) -> [V] {
+    assert(indices.count == dy.count, "max pooling indices are missing")
+    let inputCount = input.reduce(1, *)
+    let groups = input.indices.prefix(while: { !pooledDims.contains($0) })
+      .reduce(1) { $0 * input[$1] }
+    let outputsPerGroup = dy.count / groups
+    var dx = [V](repeating: 0, count: inputCount)
+
+    dx.withUnsafeMutableBufferPointer { dx in
+      parallelFor(groups) { range in
+        for group in range {
+          let base = group * outputsPerGroup
+          for j in base..<(base + outputsPerGroup) {
+            dx[Int(indices[j])] += dy[j]
+          }
+        }
+      }
+    }
+    return dx
+  }
+
+  //--------------------------------------------------------------------------
+  /// backwardAverage
+  /// Gathers the gradient back through each pooling pass in reverse. Each
+  /// input element sums the windows that contain it, so every element is
+  /// written once and the work is distributed across the cpu cores.
+  @inlinable public func backwardAverage<V: Comparable & AlgebraicField>(
+    _ dy: [V]
+  ) -> [V] {
+    var grad = dy
+    for (dim, outer, inner) in passes.reversed() {
+      let (nIn, nOut, w, s, p) =
+        (input[dim], output[dim], window[dim], strides[dim], padding[dim])
+      var next = [V](repeating: 0, count: outer * nIn * inner)
+      let grain = Swift.max(1, 4096 / (w * inner))
+
+      grad.withUnsafeBufferPointer { src in
+        next.withUnsafeMutableBufferPointer { dst in
+          parallelFor(outer * nIn, grainSize: grain) { items in
+            for item in items {
+              let (o, i) = (item / nIn, item % nIn)
+              let d = item * inner
+              // the windows j with j * s - p <= i < j * s - p + w
+              let first = Swift.max(0, (i + p - w + s) / s)
+              let last = Swift.min(nOut - 1, (i + p) / s)
+              guard first <= last else { continue }
+              for j in first...last {
+                let count = op == .averagePadding ? w : taps(j, dim).count
+                let scale = 1 / V(exactly: count)!
+                let si = (o * nOut + j) * inner
+                for c in 0..<inner { dst[d + c] += src[si + c] * scale }
+              }
+            }
+          }
+        }
+      }
+      grad = next
+    }
+    return grad
+  }
 }
 
 //==============================================================================
 public final class CpuPoolingConfig<Shape: TensorShape, Element: StorageElement> {
   // properties
   public let shape: Shape
+  public let geometry: PoolingGeometry
+  /// the flat input index of each maximum recorded by max pooling
+  public var maxIndices: [Int32]
 
   //----------------------------------------------------------------------------
   /// init(x:windowSize:strides:padding:op:
@@ -79,6 +370,10 @@ public final class CpuPoolingConfig<Shape: TensorShape, Element: StorageElement>
     padding: Shape = Shape.zero,
     op: PoolingOp
   ) {
-    shape = tensor.shape
+    geometry = PoolingGeometry(
+      x: tensor.shape, windowSize: windowSize,
+      strides: strides, padding: padding, op: op)
+    shape = Shape(geometry.output)
+    maxIndices = []
   }
 }
@@ -14,12 +14,381 @@
 // limitations under the License.
 //
 
+import Foundation
+
 //==============================================================================
 //
 public typealias ReduceArg<E> = (index: Int, value: E.Value) where E: StorageElement
 
+//==============================================================================
+/// ReduceGeometry
+/// Describes a reduction of a strided tensor as three loop nests. `outer`
+/// visits the batch positions before the reduced axis, `axis` visits the
+/// elements reduced into each output element, and `inner` visits the
+/// positions after the axis. `outer` and `inner` carry the strides of
+/// both the input and the output, so sliced and column ordered tensors
+/// are addressed in place. A full reduction is a single batch item whose
+/// `axis` loops span every dimension.
+public struct ReduceGeometry {
+  /// the batch positions before the axis for the input and output
+  public let outer: StridedLoops
+  /// the positions reduced into one output element of the input
+  public let axis: StridedLoops
+  /// the positions after the axis for the input and output
+  public let inner: StridedLoops
+
+  /// the minimum number of elements reduced by one partition when a
+  /// long reduction is split across the cores
+  public static var partitionGrainSize = 65_536
+  /// the number of adjacent output elements accumulated by one work item
+  public static var columnBlockSize = 1024
+
+  //--------------------------------------------------------------------------
+  /// - Parameters:
+  ///  - shape: the input shape
+  ///  - strides: the input strides
+  ///  - outStrides: the output strides
+  ///  - axis: the axis to reduce, or `nil` to reduce all elements
+  @inlinable public init<S: TensorShape>(
+    shape: S,
+    strides: S,
+    outStrides: S,
+    axis: Int?
+  ) {
+    let (shape, a, o) = (shape.array, strides.array, outStrides.array)
+    if let axis = axis {
+      let before = 0..<axis
+      let after = (axis + 1)..<S.rank
+      outer = StridedLoops(
+        shape: Array(shape[before]),
+        strides: [Array(a[before]), Array(o[before])])
+      self.axis = StridedLoops(shape: [shape[axis]], strides: [[a[axis]]])
+      inner = StridedLoops(
+        shape: Array(shape[after]),
+        strides: [Array(a[after]), Array(o[after])])
+    } else {
+      outer = StridedLoops(shape: [], strides: [[], []])
+      self.axis = StridedLoops(shape: shape, strides: [a])
+      inner = StridedLoops(shape: [], strides: [[], []])
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// reduce(_:base:range:into:_:
+  /// reduces a range of the `axis` positions that start at `base`
+  @inlinable public func reduce<E: StorageElement>(
+    _ a: BufferElements<E>,
+    base: Int,
+    range: Range<Int>,
+    into result: inout E.Value,
+    _ op: (inout E.Value, E.Value) -> Void
+  ) {
+    forEachElement(a, base: base, range: range) { op(&result, $0) }
+  }
+
+  //--------------------------------------------------------------------------
+  /// forEachElement(_:base:range:_:
+  /// visits a range of the `axis` positions that start at `base` in order
+  @inlinable public func forEachElement<E: StorageElement>(
+    _ a: BufferElements<E>,
+    base: Int,
+    range: Range<Int>,
+    _ body: (E.Value) -> Void
+  ) {
+    let (n, stride) = (axis.rowLength, axis.strides[0].last!)
+    var i = range.lowerBound
+    while i < range.upperBound {
+      let (row, j) = i.quotientAndRemainder(dividingBy: n)
+      let end = Swift.min(n, j + range.upperBound - i)
+      var p = a.startIndex + base + axis.offset(row: row, operand: 0) + j * stride
+      for _ in j..<end {
+        body(a[p])
+        p += stride
+      }
+      i += end - j
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// reduceSegments
+  /// Used when each output element reduces a contiguous run of `axis`
+  /// positions, which is the case for the last axis and for a full
+  /// reduction. When there are fewer batch items than cores and they
+  /// are long, each one is split into one partition per core and the
+  /// partial results are combined with `op`.
+  @inlinable public func reduceSegments<E: StorageElement>(
+    _ a: BufferElements<E>,
+    _ out: BufferElements<E>,
+    _ initialValue: E.Value,
+    _ op: (inout E.Value, E.Value) -> Void
+  ) {
+    let segments = outer.elementCount
+    let length = axis.elementCount
+    let processors = ProcessInfo.processInfo.activeProcessorCount
+    var out = out
+
+    if segments < processors && length >= 2 * ReduceGeometry.partitionGrainSize {
+      let partitions = parallelPartitions(
+        length, grainSize: ReduceGeometry.partitionGrainSize)
+      var partials = [E.Value](repeating: initialValue, count: partitions.count)
+
+      for s in 0..<segments {
+        let base = outer.offset(element: s, operand: 0)
+        partials.withUnsafeMutableBufferPointer { buffer in
+          parallelFor(partitions.count) {
+            for i in $0 {
+              var partial = initialValue
+              reduce(a, base: base, range: partitions[i], into: &partial, op)
+              buffer[i] = partial
+            }
+          }
+        }
+        var result = partials[0]
+        for partial in partials.dropFirst() { op(&result, partial) }
+        out[out.startIndex + outer.offset(element: s, operand: 1)] = result
+      }
+    } else {
+      forEachItem(segments, writing: E.self) {
+        var out = out
+        for s in $0 {
+          var result = initialValue
+          reduce(a, base: outer.offset(element: s, operand: 0),
+                 range: 0..<length, into: &result, op)
+          out[out.startIndex + outer.offset(element: s, operand: 1)] = result
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// reduceColumns
+  /// Used when each axis position is followed by `inner` elements. The
+  /// work is split into blocks of adjacent output elements, and each
+  /// block accumulates the axis positions in order, so the reads of a
+  /// row ordered input are unit stride.
+  @inlinable public func reduceColumns<E: StorageElement>(
+    _ a: BufferElements<E>,
+    _ out: BufferElements<E>,
+    _ initialValue: E.Value,
+    _ op: (inout E.Value, E.Value) -> Void
+  ) {
+    let length = inner.rowLength
+    let (sa, so) = (inner.strides[0].last!, inner.strides[1].last!)
+    let blockSize = ReduceGeometry.columnBlockSize
+    let blocks = (length + blockSize - 1) / blockSize
+    let rows = inner.rowCount
+    let count = axis.elementCount
+
+    forEachItem(outer.elementCount * rows * blocks, writing: E.self) {
+      var out = out
+      for item in $0 {
+        let (batchRow, block) = item.quotientAndRemainder(dividingBy: blocks)
+        let (batch, row) = batchRow.quotientAndRemainder(dividingBy: rows)
+        let baseA = a.startIndex + outer.offset(element: batch, operand: 0)
+          + inner.offset(row: row, operand: 0)
+        let baseO = out.startIndex + outer.offset(element: batch, operand: 1)
+          + inner.offset(row: row, operand: 1)
+        let columns = (block * blockSize)..<Swift.min(length, (block + 1) * blockSize)
+
+        for j in columns { out[baseO + j * so] = initialValue }
+        for i in 0..<count {
+          let ai = baseA + axis.offset(element: i, operand: 0)
+          for j in columns { op(&out[baseO + j * so], a[ai + j * sa]) }
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// forEachItem(_:writing:_:
+  /// runs `body` over `0..<count` on the pool threads. Packed output
+  /// elements share stored values, so they are written serially.
+  @inlinable public func forEachItem<E: StorageElement>(
+    _ count: Int,
+    writing type: E.Type,
+    _ body: (Range<Int>) -> Void
+  ) {
+    if E.storedCount(64) != 64 {
+      body(0..<count)
+    } else {
+      CpuThreadPool.shared.adaptiveFor(count, body)
+    }
+  }
+}
+
+//==============================================================================
+// Reproducible reductions
+// The positions reduced into each output element are split into blocks of
+// `reproducibleBlockSize`, and the block results are combined by a fixed
+// pairwise tree. The association depends only on the shape of the input,
+// so the result has the same bits for any number of workers.
+extension ReduceGeometry {
+  /// the number of positions in a block of a reproducible reduction
+  public static var reproducibleBlockSize = 4096
+
+  //--------------------------------------------------------------------------
+  /// reduceBlocks
+  /// - Parameters:
+  ///  - a: the input elements
+  ///  - out: the output elements
+  ///  - initialValue: the initial value of each block result
+  ///  - carry: the initial value of the state carried with each block
+  ///    result, for example a compensation term
+  ///  - accumulate: adds an element to a block result and its carry
+  ///  - combine: combines two block results
+  @inlinable public func reduceBlocks<E: StorageElement>(
+    _ a: BufferElements<E>,
+    _ out: BufferElements<E>,
+    _ initialValue: E.Value,
+    _ carry: E.Value,
+    _ accumulate: (inout E.Value, inout E.Value, E.Value) -> Void,
+    _ combine: (inout E.Value, E.Value) -> Void
+  ) {
+    if inner.elementCount == 1 {
+      reduceSegmentBlocks(a, out, initialValue, carry, accumulate, combine)
+    } else {
+      reduceColumnBlocks(a, out, initialValue, carry, accumulate, combine)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func reduceSegmentBlocks<E: StorageElement>(
+    _ a: BufferElements<E>,
+    _ out: BufferElements<E>,
+    _ initialValue: E.Value,
+    _ carry: E.Value,
+    _ accumulate: (inout E.Value, inout E.Value, E.Value) -> Void,
+    _ combine: (inout E.Value, E.Value) -> Void
+  ) {
+    let segments = outer.elementCount
+    let length = axis.elementCount
+    let blockSize = ReduceGeometry.reproducibleBlockSize
+    let blocks = Swift.max(1, (length + blockSize - 1) / blockSize)
+    var partials = [E.Value](repeating: initialValue, count: segments * blocks)
+
+    partials.withUnsafeMutableBufferPointer { buffer in
+      // every block result is independent of how the blocks are
+      // divided between the workers
+      CpuThreadPool.shared.adaptiveFor(segments * blocks) {
+        for item in $0 {
+          let (segment, block) = item.quotientAndRemainder(dividingBy: blocks)
+          let range = (block * blockSize)..<Swift.min(length, (block + 1) * blockSize)
+          var (result, state) = (initialValue, carry)
+          forEachElement(
+            a, base: outer.offset(element: segment, operand: 0), range: range
+          ) {
+            accumulate(&result, &state, $0)
+          }
+          buffer[item] = result
+        }
+      }
+
+      forEachItem(segments, writing: E.self) {
+        var out = out
+        for segment in $0 {
+          let start = segment * blocks
+          let result = ReduceGeometry.pairwise(
+            UnsafeMutableBufferPointer(rebasing: buffer[start..<(start + blocks)]),
+            combine)
+          out[out.startIndex + outer.offset(element: segment, operand: 1)] = result
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // Each work item accumulates a block of adjacent output elements one
+  // axis block at a time. The axis block results are merged on a stack
+  // as soon as two of them cover subtrees of the same size, which forms
+  // the same tree as `pairwise` without keeping every block result.
+  @inlinable public func reduceColumnBlocks<E: StorageElement>(
+    _ a: BufferElements<E>,
+    _ out: BufferElements<E>,
+    _ initialValue: E.Value,
+    _ carry: E.Value,
+    _ accumulate: (inout E.Value, inout E.Value, E.Value) -> Void,
+    _ combine: (inout E.Value, E.Value) -> Void
+  ) {
+    let length = inner.rowLength
+    let (sa, so) = (inner.strides[0].last!, inner.strides[1].last!)
+    let columnBlockSize = ReduceGeometry.columnBlockSize
+    let columnBlocks = (length + columnBlockSize - 1) / columnBlockSize
+    let rows = inner.rowCount
+    let count = axis.elementCount
+    let blockSize = ReduceGeometry.reproducibleBlockSize
+
+    forEachItem(outer.elementCount * rows * columnBlocks, writing: E.self) {
+      var out = out
+      var levels: [(level: Int, results: [E.Value])] = []
+      for item in $0 {
+        let (batchRow, block) = item.quotientAndRemainder(dividingBy: columnBlocks)
+        let (batch, row) = batchRow.quotientAndRemainder(dividingBy: rows)
+        let baseA = a.startIndex + outer.offset(element: batch, operand: 0)
+          + inner.offset(row: row, operand: 0)
+        let baseO = out.startIndex + outer.offset(element: batch, operand: 1)
+          + inner.offset(row: row, operand: 1)
+        let first = block * columnBlockSize
+        let width = Swift.min(length, first + columnBlockSize) - first
+
+        levels.removeAll(keepingCapacity: true)
+        for start in stride(from: 0, to: Swift.max(1, count), by: blockSize) {
+          var results = [E.Value](repeating: initialValue, count: width)
+          var states = [E.Value](repeating: carry, count: width)
+          for i in start..<Swift.min(count, start + blockSize) {
+            let ai = baseA + axis.offset(element: i, operand: 0) + first * sa
+            for k in 0..<width {
+              accumulate(&results[k], &states[k], a[ai + k * sa])
+            }
+          }
+
+          // merge with the preceding subtrees of the same size
+          var node = (level: 0, results: results)
+          while let top = levels.last, top.level == node.level {
+            levels.removeLast()
+            var merged = top.results
+            for k in 0..<width { combine(&merged[k], node.results[k]) }
+            node = (node.level + 1, merged)
+          }
+          levels.append(node)
+        }
+
+        // combine the remaining subtrees from right to left
+        var results = levels.removeLast().results
+        while let left = levels.popLast() {
+          var merged = left.results
+          for k in 0..<width { combine(&merged[k], results[k]) }
+          results = merged
+        }
+        for k in 0..<width { out[baseO + (first + k) * so] = results[k] }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// pairwise(_:_:
+  /// combines `values` with a balanced tree in place
+  /// - Returns: the combined value
+  @inlinable public static func pairwise<T>(
+    _ values: UnsafeMutableBufferPointer<T>,
+    _ combine: (inout T, T) -> Void
+  ) -> T {
+    var width = 1
+    while width < values.count {
+      for i in stride(from: 0, to: values.count - width, by: 2 * width) {
+        combine(&values[i], values[i + width])
+      }
+      width *= 2
+    }
+    return values[0]
+  }
+}
+
 extension CpuFunctions where Self: DeviceQueue {
   //============================================================================
+  // Reduces strided inputs of row or column order in place. Batch items
+  // and blocks of output elements run in parallel, and a long single
+  // reduction is split into per core partitions whose partial results
+  // are combined with `op`, so `op` must also combine two partial results.
   @inlinable public func cpu_reduce<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
@@ -27,85 +396,63 @@ extension CpuFunctions where Self: DeviceQueue {
     _ initialValue: E.Value,
     _ op: @escaping (inout E.Value, E.Value) -> Void
   ) {
-    if axis == nil {
-      mapReduce(a, &out, initialValue, op)
-      return
-    }
-    let axis = axis ?? 0
-    assert(a.isContiguous, "input storage must be contiguous")
-    assert(a.order == .row && a.order == out.order, "only row order is implemented")
-    assert(axis >= 0 && axis < S.rank, "axis is out of range: \(axis)")
+    assert(axis == nil || (axis! >= 0 && axis! < S.rank), "axis is out of range")
+    assert(a.order == .row || a.order == .col, "only row and col order are implemented")
+    assert(out.order == .row || out.order == .col, "only row and col order are implemented")
 
     //-----------------------------------
-    // get buffers and iterators
-    let aBuffer = a.read(using: currentQueue)
-    let aStorageBase = a.storageBase
-    func getIterA(at: Int, count: Int) -> BufferElements<E> {
-      BufferElements<E>(
-        buffer: aBuffer, storageBase: aStorageBase,
-        startIndex: at, count: count)
-    }
+    // get buffers covering the strided spans
+    let geometry = ReduceGeometry(
+      shape: a.shape, strides: a.strides, outStrides: out.strides, axis: axis)
+    let iterA = BufferElements<E>(
+      buffer: a.read(using: currentQueue), storageBase: a.storageBase,
+      startIndex: 0, count: a.spanCount)
+    let iterO = BufferElements<E>(
+      buffer: out.readWrite(using: currentQueue), storageBase: out.storageBase,
+      startIndex: 0, count: out.spanCount)
 
-    let oBuffer = out.readWrite(using: currentQueue)
-    let oStorageBase = out.storageBase
-    func getIterO(at: Int, count: Int) -> BufferElements<E> {
-      BufferElements<E>(
-        buffer: oBuffer, storageBase: oStorageBase,
-        startIndex: at, count: count)
-    }
-    
-    //-----------------------------------
-    // batch shape
-    let bShape = Shape3(
-      // flatten the leading axes to form a batch
-      a.shape.reduce(range: 0..<axis, into: 1, &*=),
-      // the number of items per reduction set
-      a.shape[axis],
-      // the number of elements per reduction item
-      a.shape.reduce(range: (axis + 1)..<S.rank, into: 1, &*=))
-    let bStrides = bShape.strides(for: a.order)
-    var batchBaseA = 0, batchBaseO = 0
-    
     func execute() {
-      //-----------------------------------
-      for _ in 0..<bShape[0] {
-        // start the reduction at the batch base
-        var axisItem = batchBaseA
-        
-        // create the output batch item iterator
-        var iterO = getIterO(at: batchBaseO, count: bShape[2])
-        
-        // if the axis items form a column vector then
-        // perform a single reduction on all axis items
-        if bShape[2] == 1 {
-          let iterA = getIterA(at: axisItem, count: bShape[1])
-          iterO[iterO.startIndex] = iterA.reduce(into: initialValue, op)
-          
-        } else {
-          // initialize output
-          iterO.indices.forEach { iterO[$0] = initialValue }
-          
-          // reduce axis items using the specified op
-          for _ in 0..<bShape[1] {
-            let iterA = getIterA(at: axisItem, count: bShape[2])
-            zip(iterO.indices, iterA).forEach { op(&iterO[$0], $1) }
-            axisItem += bStrides[1]
-          }
-        }
-        
-        // move to next batch item
-        batchBaseA += bStrides[0]
-        batchBaseO += bStrides[1]
+      if geometry.inner.elementCount == 1 {
+        geometry.reduceSegments(iterA, iterO, initialValue, op)
+      } else {
+        geometry.reduceColumns(iterA, iterO, initialValue, op)
       }
     }
-    
-    if mode == .sync {
-      execute()
-    } else {
-      queue.async(group: group) {
-        execute()
-      }
+
+    cpu_execute(execute)
+  }
+
+  //============================================================================
+  // Reduces with an association that depends only on the input shape.
+  // `accumulate` adds an element to a block result and its carry, and
+  // `combine` joins two block results. See `ReduceGeometry.reduceBlocks`.
+  @inlinable public func cpu_reduce<S, E>(
+    reproducible a: Tensor<S, E>,
+    _ axis: Int?,
+    _ out: inout Tensor<S, E>,
+    _ initialValue: E.Value,
+    carry: E.Value,
+    _ accumulate: @escaping (inout E.Value, inout E.Value, E.Value) -> Void,
+    _ combine: @escaping (inout E.Value, E.Value) -> Void
+  ) {
+    assert(axis == nil || (axis! >= 0 && axis! < S.rank), "axis is out of range")
+    assert(a.order == .row || a.order == .col, "only row and col order are implemented")
+    assert(out.order == .row || out.order == .col, "only row and col order are implemented")
+
+    let geometry = ReduceGeometry(
+      shape: a.shape, strides: a.strides, outStrides: out.strides, axis: axis)
+    let iterA = BufferElements<E>(
+      buffer: a.read(using: currentQueue), storageBase: a.storageBase,
+      startIndex: 0, count: a.spanCount)
+    let iterO = BufferElements<E>(
+      buffer: out.readWrite(using: currentQueue), storageBase: out.storageBase,
+      startIndex: 0, count: out.spanCount)
+
+    func execute() {
+      geometry.reduceBlocks(iterA, iterO, initialValue, carry, accumulate, combine)
     }
+
+    cpu_execute(execute)
   }
 
   //============================================================================
@@ -118,9 +465,7 @@ extension CpuFunctions where Self: DeviceQueue {
     _ op: @escaping (inout ReduceArg<E>, ReduceArg<E>) -> Void
   ) {
     let axis = S.makePositive(axis: axis)
-    assert(a.isContiguous, "input storage must be contiguous")
-    assert(a.order == .row && a.order == out.order && a.order == arg.order,
-           "only row order is implemented")
+    assert(a.order == .row || a.order == .col, "only row and col order are implemented")
     assert(axis >= 0 && axis < S.rank, "axis is out of range: \(axis)")
     assert({
       var expected = a.shape
@@ -128,94 +473,58 @@ extension CpuFunctions where Self: DeviceQueue {
       return out.shape == expected
     }(), "invalid output shape")
     assert(arg.shape == out.shape, "arg and out must be the same shape")
+    assert(arg.strides == out.strides, "arg and out must have the same layout")
 
     //-----------------------------------
-    // get buffers and iterators
-    let aBuffer = a.read(using: currentQueue)
-    let aStorageBase = a.storageBase
-    func getIterA(at: Int, count: Int) -> BufferElements<E> {
-      BufferElements<E>(
-        buffer: aBuffer, storageBase: aStorageBase,
-        startIndex: at, count: count)
-    }
+    // get buffers covering the strided spans
+    let geometry = ReduceGeometry(
+      shape: a.shape, strides: a.strides, outStrides: out.strides, axis: axis)
+    let iterA = BufferElements<E>(
+      buffer: a.read(using: currentQueue), storageBase: a.storageBase,
+      startIndex: 0, count: a.spanCount)
+    let iterArg = BufferElements<Int32>(
+      buffer: arg.readWrite(using: currentQueue), storageBase: arg.storageBase,
+      startIndex: 0, count: arg.spanCount)
+    let iterOut = BufferElements<E>(
+      buffer: out.readWrite(using: currentQueue), storageBase: out.storageBase,
+      startIndex: 0, count: out.spanCount)
 
-    let argBuffer = arg.readWrite(using: currentQueue)
-    let argStorageBase = arg.storageBase
-    func getIterArg(at: Int, count: Int) -> BufferElements<Int32> {
-      BufferElements<Int32>(
-        buffer: argBuffer, storageBase: argStorageBase,
-        startIndex: at, count: count)
-    }
-
-    let outBuffer = out.readWrite(using: currentQueue)
-    let outStorageBase = out.storageBase
-    func getIterOut(at: Int, count: Int) -> BufferElements<E> {
-      BufferElements<E>(
-        buffer: outBuffer, storageBase: outStorageBase,
-        startIndex: at, count: count)
-    }
-    
-    //-----------------------------------
-    // batch shape
-    let bShape = Shape3(
-      // flatten the leading axes to form a batch
-      a.shape.reduce(range: 0..<axis, into: 1, &*=),
-      // the number of items per reduction set
-      a.shape[axis],
-      // the number of elements per reduction item
-      a.shape.reduce(range: (axis + 1)..<S.rank, into: 1, &*=))
-    let bStrides = bShape.strides(for: a.order)
-    var batchBaseA = 0, batchBaseO = 0
-    
     func execute() {
-      //-----------------------------------
-      for _ in 0..<bShape[0] {
-        // start the reduction at the batch base
-        var axisItem = batchBaseA
-        
-        // create the output batch item iterator
-        var iterArg = getIterArg(at: batchBaseO, count: bShape[2])
-        var iterOut = getIterOut(at: batchBaseO, count: bShape[2])
-
-        // if the axis items form a column vector then
-        // perform a single reduction on all axis items
-        if bShape[2] == 1 {
-          let iterA = getIterA(at: axisItem, count: bShape[1])
-          let result = iterA.enumerated().reduce(into: (0, initialValue), op)
-          iterArg[iterArg.startIndex] = Int32(result.index)
-          iterOut[iterOut.startIndex] = result.value
-          
-        } else {
-          // initialize output by copying first axis item elements
-          let iterA = getIterA(at: axisItem, count: bShape[2])
-          iterArg.indices.forEach { iterArg[$0] = 0 }
-          zip(iterOut.indices, iterA).forEach { iterOut[$0] = $1 }
-
-          // reduce additional axis items using the specified op
-          for i in 1..<bShape[1] {
-            axisItem += bStrides[1]
-            let iterA = getIterA(at: axisItem, count: bShape[2])
-            zip(iterOut.indices, iterA).forEach {
-              var result: ReduceArg<E> = (Int(iterArg[$0]), iterOut[$0])
-              op(&result, (i, $1))
-              iterArg[$0] = Int32(result.index)
-              iterOut[$0] = result.value
+      let (outer, inner) = (geometry.outer, geometry.inner)
+      let count = geometry.axis.elementCount
+      let (sa, so) = (inner.strides[0].last!, inner.strides[1].last!)
+
+      // each item is one inner row of one batch item
+      geometry.forEachItem(outer.elementCount * inner.rowCount, writing: E.self) {
+        var (iterArg, iterOut) = (iterArg, iterOut)
+        for item in $0 {
+          let (batch, row) = item.quotientAndRemainder(dividingBy: inner.rowCount)
+          let baseA = iterA.startIndex + outer.offset(element: batch, operand: 0)
+            + inner.offset(row: row, operand: 0)
+          let offsetO = outer.offset(element: batch, operand: 1)
+            + inner.offset(row: row, operand: 1)
+          let baseArg = iterArg.startIndex + offsetO
+          let baseOut = iterOut.startIndex + offsetO
+
+          // initialize with the first axis item, then reduce the others
+          for j in 0..<inner.rowLength {
+            iterArg[baseArg + j * so] = 0
+            iterOut[baseOut + j * so] = iterA[baseA + j * sa]
+          }
+          for i in 1..<Swift.max(1, count) {
+            let ai = baseA + geometry.axis.offset(element: i, operand: 0)
+            for j in 0..<inner.rowLength {
+              var result: ReduceArg<E> =
+                (Int(iterArg[baseArg + j * so]), iterOut[baseOut + j * so])
+              op(&result, (i, iterA[ai + j * sa]))
+              iterArg[baseArg + j * so] = Int32(result.index)
+              iterOut[baseOut + j * so] = result.value
             }
           }
         }
-        
-        // move to next batch item
-        batchBaseA += bStrides[0]
-        batchBaseO += bStrides[1]
-      }
-    }
-    
-    if mode == .sync {
-      execute()
-    } else {
-      queue.async(group: group) {
-        execute()
       }
     }
+
+    cpu_execute(execute)
   }
 }
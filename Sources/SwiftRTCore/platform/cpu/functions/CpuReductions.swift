@@ -24,10 +24,11 @@ extension CpuFunctions where Self: DeviceQueue {
   @inlinable public func cpu_abssum<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: SignedNumeric & Comparable {
     diagnostic(.queueCpu, "abssum(\(a.name), axis: \(axis ?? 0)) on \(name)", categories: .queueCpu)
-    cpu_reduce(a, axis, &out, E.Value.zero) { $0 += Swift.abs($1) }
+    cpu_sum(a, axis, &out, mode) { Swift.abs($0) }
   }
 
   //--------------------------------------------------------------------------
@@ -54,20 +55,55 @@ extension CpuFunctions where Self: DeviceQueue {
   @inlinable public func cpu_sum<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: AdditiveArithmetic {
     diagnostic(.queueCpu, "sum(\(a.name), axis: \(axis ?? 0)) on \(name)", categories: .queueCpu)
-    cpu_reduce(a, axis, &out, E.Value.zero) { $0 += $1 }
+    cpu_sum(a, axis, &out, mode) { $0 }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_sum(_:_:_:_:_:
+  /// sums `transform` of each element using the specified reduction mode
+  @inlinable public func cpu_sum<S, E>(
+    _ a: Tensor<S, E>,
+    _ axis: Int?,
+    _ out: inout Tensor<S, E>,
+    _ reduction: ReductionMode,
+    _ transform: @escaping (E.Value) -> E.Value
+  ) where E.Value: AdditiveArithmetic {
+    switch reduction {
+    case .fast:
+      cpu_reduce(a, axis, &out, E.Value.zero) { $0 += transform($1) }
+
+    case .reproducible:
+      cpu_reduce(
+        reproducible: a, axis, &out, E.Value.zero, carry: E.Value.zero,
+        { sum, _, x in sum += transform(x) }, { $0 += $1 })
+
+    case .compensated:
+      // Kahan summation, where `c` holds the low order part of
+      // the elements lost when they were added to `sum`
+      cpu_reduce(
+        reproducible: a, axis, &out, E.Value.zero, carry: E.Value.zero,
+        { sum, c, x in
+          let y = transform(x) - c
+          let t = sum + y
+          c = (t - sum) - y
+          sum = t
+        }, { $0 += $1 })
+    }
   }
 
   //--------------------------------------------------------------------------
   @inlinable public func cpu_mean<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: AlgebraicField {
     diagnostic(.queueCpu, "mean(\(a.name), axis: \(axis ?? 0)) on \(name)", categories: .queueCpu)
-    cpu_reduce(a, axis, &out, E.Value.zero) { $0 += $1 }
+    cpu_sum(a, axis, &out, mode) { $0 }
 
     // the reduction count is the product of the reduced dimensions
     var prod = a.count
@@ -125,10 +161,18 @@ extension CpuFunctions where Self: DeviceQueue {
   @inlinable public func cpu_prod<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: Numeric {
     diagnostic(.queueCpu, "prod(\(a.name), axis: \(axis ?? 0)) on \(name)", categories: .queueCpu)
-    cpu_reduce(a, axis, &out, E.Value.one) { $0 *= $1 }
+    if mode == .fast {
+      cpu_reduce(a, axis, &out, E.Value.one) { $0 *= $1 }
+    } else {
+      // products are not compensated
+      cpu_reduce(
+        reproducible: a, axis, &out, E.Value.one, carry: E.Value.zero,
+        { product, _, x in product *= x }, { $0 *= $1 })
+    }
   }
 
   //--------------------------------------------------------------------------
@@ -150,9 +194,10 @@ extension CpuQueue {
   @inlinable public func abssum<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: SignedNumeric & Comparable {
-    cpu_abssum(a, axis, &out)
+    cpu_abssum(a, axis, &out, mode)
   }
   //--------------------------------------------------------------------------
   @inlinable public func all<S>(
@@ -170,14 +215,16 @@ extension CpuQueue {
   @inlinable public func sum<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
-  ) where E.Value: AdditiveArithmetic { cpu_sum(a, axis, &out) }
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
+  ) where E.Value: AdditiveArithmetic { cpu_sum(a, axis, &out, mode) }
   //--------------------------------------------------------------------------
   @inlinable public func mean<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
-  ) where E.Value: AlgebraicField { cpu_mean(a, axis, &out) }
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
+  ) where E.Value: AlgebraicField { cpu_mean(a, axis, &out, mode) }
   //--------------------------------------------------------------------------
   @inlinable public func min<S, E>(
     _ a: Tensor<S, E>,
@@ -216,9 +263,10 @@ extension CpuQueue {
   @inlinable public func prod<S, E>(
     _ a: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: Numeric {
-    cpu_prod(a, axis, &out)
+    cpu_prod(a, axis, &out, mode)
   }
   //--------------------------------------------------------------------------
   @inlinable public func prodNonZeros<S, E>(
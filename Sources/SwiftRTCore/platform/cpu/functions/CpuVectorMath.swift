@@ -0,0 +1,573 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import Numerics
+
+//==============================================================================
+/// `true` to evaluate dense `Float` and `Double` transcendental functions
+/// on the cpu with the `VectorMath` kernels. Set it to `false` to use the
+/// scalar Numerics functions, for example to compare results.
+public var useVectorMath = true
+
+//==============================================================================
+/// VectorMath
+/// Branch free polynomial approximations of transcendental functions that
+/// evaluate 8 `Double` or 16 `Float` lanes at a time. Special cases are
+/// handled with lane selects, so the cpu kernels run whole vectors instead
+/// of calling the scalar Numerics functions element by element.
+///
+/// The largest errors of the `Double` functions, measured against 40
+/// digit references over their whole domain, are
+///
+///     exp 1 ulp, log 1 ulp, sigmoid 2 ulp, erf 2 ulp,
+///     tanh 3 ulp, gelu 5 ulp
+///
+/// Subnormal `gelu` results can lose a few more bits. The `Float` `exp`
+/// and `log` run in 16 `Float` lanes and are within 1 ulp. The other
+/// `Float` functions are evaluated in `Double` lanes and rounded once, so
+/// they are within 0.501 ulp and nearly always correctly rounded, at half
+/// the lane throughput.
+public enum VectorMath {
+  public typealias DoubleVector = SIMD8<Double>
+  public typealias FloatVector = SIMD16<Float>
+
+  //--------------------------------------------------------------------------
+  /// exp
+  /// the `Double` algorithm in `Float` lanes with a degree 7 polynomial
+  @inlinable public static func exp(_ x: FloatVector) -> FloatVector {
+    let isNaN = x .!= x
+    let xc = x.replacing(with: 0, where: isNaN).clamped(
+      lowerBound: FloatVector(repeating: -104),
+      upperBound: FloatVector(repeating: 89))
+    let n = (xc * log2eFloat).rounded(.toNearestOrEven)
+    let r = (xc - n * ln2HiFloat) - n * ln2LoFloat
+    let p = polynomial(r, expFloatCoefficients)
+
+    let k = SIMD16<Int32>(n, rounding: .towardZero)
+    let k1 = k &>> 1
+    return (p * pow2(k1) * pow2(k &- k1)).replacing(with: x, where: isNaN)
+  }
+
+  //--------------------------------------------------------------------------
+  /// log
+  /// the `Double` algorithm in `Float` lanes with the fdlibm single
+  /// precision polynomial
+  @inlinable public static func log(_ x: FloatVector) -> FloatVector {
+    let isSubnormal = x .< Float.leastNormalMagnitude
+    let xs = x.replacing(with: x * 0x1p25, where: isSubnormal)
+    let bits = unsafeBitCast(xs, to: SIMD16<Int32>.self)
+
+    var k = ((bits &>> 23) & 0xff) &- 127
+    k.replace(with: k &- 25, where: isSubnormal)
+    let mantissa = bits & 0x7f_ffff
+    let i = (mantissa &+ 0x4a_fb20) & 0x80_0000
+    let m = unsafeBitCast(mantissa | (i ^ 0x3f80_0000), to: FloatVector.self)
+    k &+= i &>> 23
+
+    let f = m - 1
+    let s = f / (2 + f)
+    let z = s * s
+    let w = z * z
+    let t1 = w * (lgFloat2 + w * lgFloat4)
+    let t2 = z * (lgFloat1 + w * lgFloat3)
+    let hfsq = 0.5 * f * f
+    let dk = FloatVector(k)
+    var result = dk * ln2HiLogFloat
+      - ((hfsq - (s * (hfsq + (t2 + t1)) + dk * ln2LoLogFloat)) - f)
+
+    result.replace(with: -.infinity, where: x .== 0)
+    result.replace(with: .nan, where: x .< 0)
+    result.replace(with: x, where: (x .== .infinity) .| (x .!= x))
+    return result
+  }
+
+  //--------------------------------------------------------------------------
+  // the other Float lanes are widened to Double lanes
+  @inlinable public static func tanh(_ x: FloatVector) -> FloatVector {
+    widened(x, tanh)
+  }
+
+  @inlinable public static func sigmoid(_ x: FloatVector) -> FloatVector {
+    widened(x, sigmoid)
+  }
+
+  @inlinable public static func erf(_ x: FloatVector) -> FloatVector {
+    widened(x, erf)
+  }
+
+  @inlinable public static func gelu(_ x: FloatVector) -> FloatVector {
+    widened(x, gelu)
+  }
+
+  //--------------------------------------------------------------------------
+  /// map(_:_:count:_:
+  /// applies `body` to `count` scalars a vector at a time. The last
+  /// vector is zero padded.
+  /// - Parameters:
+  ///  - x: the first argument scalar
+  ///  - out: the first result scalar, which may be `x`
+  ///  - count: the number of scalars
+  ///  - body: the vector function
+  @inlinable public static func map<V: SIMD>(
+    _ x: UnsafePointer<V.Scalar>,
+    _ out: UnsafeMutablePointer<V.Scalar>,
+    count: Int,
+    _ body: (V) -> V
+  ) {
+    let size = MemoryLayout<V.Scalar>.stride
+    for start in stride(from: 0, to: count, by: V.scalarCount) {
+      let bytes = Swift.min(V.scalarCount, count - start) * size
+      var v = V()
+      withUnsafeMutableBytes(of: &v) {
+        $0.baseAddress!.copyMemory(from: x + start, byteCount: bytes)
+      }
+      let r = body(v)
+      withUnsafeBytes(of: r) {
+        UnsafeMutableRawPointer(out + start)
+          .copyMemory(from: $0.baseAddress!, byteCount: bytes)
+      }
+    }
+  }
+
+  @inlinable static func widened(
+    _ x: FloatVector,
+    _ body: (DoubleVector) -> DoubleVector
+  ) -> FloatVector {
+    FloatVector(
+      lowHalf: SIMD8<Float>(body(DoubleVector(x.lowHalf))),
+      highHalf: SIMD8<Float>(body(DoubleVector(x.highHalf))))
+  }
+
+  //--------------------------------------------------------------------------
+  /// exp
+  /// `x` is reduced to `n * ln2 + r` with `|r| <= ln2 / 2`, and `exp(r)`
+  /// is a degree 13 Taylor polynomial. The scale `2^n` is applied in two
+  /// steps so overflow and subnormal results don't need special cases.
+  @inlinable public static func exp(_ x: DoubleVector) -> DoubleVector {
+    let isNaN = x .!= x
+    let xc = x.replacing(with: 0, where: isNaN).clamped(
+      lowerBound: DoubleVector(repeating: -746),
+      upperBound: DoubleVector(repeating: 710))
+    let n = (xc * log2e).rounded(.toNearestOrEven)
+    let r = (xc - n * ln2Hi) - n * ln2Lo
+    let p = polynomial(r, expCoefficients)
+
+    let k = SIMD8<Int64>(n, rounding: .towardZero)
+    let k1 = k &>> 1
+    return (p * pow2(k1) * pow2(k &- k1)).replacing(with: x, where: isNaN)
+  }
+
+  //--------------------------------------------------------------------------
+  /// log
+  /// `x` is split into `2^k * m` with `sqrt(2) / 2 <= m < sqrt(2)`, and
+  /// `log(m)` is computed from `s = (m - 1) / (m + 1)` with the fdlibm
+  /// minimax polynomial.
+  @inlinable public static func log(_ x: DoubleVector) -> DoubleVector {
+    let isSubnormal = x .< Double.leastNormalMagnitude
+    let xs = x.replacing(with: x * 0x1p54, where: isSubnormal)
+    let bits = unsafeBitCast(xs, to: SIMD8<Int64>.self)
+
+    var k = ((bits &>> 52) & 0x7ff) &- 1023
+    k.replace(with: k &- 54, where: isSubnormal)
+    let high = (bits &>> 32) & 0x000f_ffff
+    let i = (high &+ 0x95f64) & 0x10_0000
+    let m = unsafeBitCast(
+      ((high | (i ^ 0x3ff0_0000)) &<< 32) | (bits & 0xffff_ffff),
+      to: DoubleVector.self)
+    k &+= i &>> 20
+
+    let f = m - 1
+    let s = f / (2 + f)
+    let z = s * s
+    let w = z * z
+    let t1 = w * (lg2 + w * (lg4 + w * lg6))
+    let t2 = z * (lg1 + w * (lg3 + w * (lg5 + w * lg7)))
+    let hfsq = 0.5 * f * f
+    let dk = DoubleVector(k)
+    var result = dk * ln2Hi - ((hfsq - (s * (hfsq + t1 + t2) + dk * ln2Lo)) - f)
+
+    result.replace(with: -.infinity, where: x .== 0)
+    result.replace(with: .nan, where: x .< 0)
+    result.replace(with: x, where: (x .== .infinity) .| (x .!= x))
+    return result
+  }
+
+  //--------------------------------------------------------------------------
+  /// tanh
+  /// computed as `-e / (e + 2)` with `e = expm1(-2|x|)`, which keeps full
+  /// relative precision near zero
+  @inlinable public static func tanh(_ x: DoubleVector) -> DoubleVector {
+    let e = expMinusOne(-2 * magnitude(x))
+    let t = copySign(magnitude(-e / (e + 2)), from: x)
+    return t.replacing(with: x, where: x .!= x)
+  }
+
+  //--------------------------------------------------------------------------
+  /// sigmoid
+  /// the exponent is never positive, so `exp` can't overflow and tiny
+  /// results keep their precision
+  @inlinable public static func sigmoid(_ x: DoubleVector) -> DoubleVector {
+    let e = exp(-magnitude(x))
+    return (e / (1 + e)).replacing(with: 1 / (1 + e), where: x .>= 0)
+  }
+
+  //--------------------------------------------------------------------------
+  /// erf
+  /// `|x| < 1` uses an odd polynomial. Larger values use `1 - erfc(|x|)`.
+  @inlinable public static func erf(_ x: DoubleVector) -> DoubleVector {
+    let a = magnitude(x)
+    let small = a * polynomial(a * a, erfCoefficients)
+
+    // every lane evaluates the tail, so give it valid arguments
+    let ta = a.replacing(with: 0.5, where: .!(a .>= 0.5))
+      .replacing(with: 40, where: a .> 40)
+    let ta2 = ta * ta
+    let ta2Lo = (-ta2).addingProduct(ta, ta)
+    let r = small.replacing(with: 1 - erfc(ta, ta2, ta2Lo), where: a .>= 1)
+    return copySign(r, from: x).replacing(with: x, where: x .!= x)
+  }
+
+  //--------------------------------------------------------------------------
+  /// gelu
+  /// `x * Φ(x)`, computed as `x / 2 * erfc(-x / sqrt(2))`. The square of
+  /// the `erfc` argument is formed exactly from `x`, so large negative
+  /// inputs don't lose precision.
+  @inlinable public static func gelu(_ x: DoubleVector) -> DoubleVector {
+    let xc = x.replacing(with: -60, where: .!(x .>= -60))
+      .replacing(with: 60, where: x .> 60)
+    let a = magnitude(xc) * 0.7071067811865476
+    let a2 = xc * xc
+    let a2Lo = (-a2).addingProduct(xc, xc)
+    let e = a * polynomial(a * a, erfCoefficients)
+    let tail = erfc(a.replacing(with: 0.5, where: a .< 0.5), a2 * 0.5, a2Lo * 0.5)
+
+    // erfc(-x / sqrt(2)) without cancellation
+    let positive = (1 + e).replacing(with: 2 - tail, where: a .>= 1)
+    let negative = (1 - e).replacing(with: tail, where: a .>= 0.5)
+    let r = 0.5 * xc * negative.replacing(with: positive, where: xc .>= 0)
+    return r.replacing(with: x, where: (x .> 60) .| (x .!= x))
+  }
+
+  //--------------------------------------------------------------------------
+  /// sinCos(turns:
+  /// the sine and cosine of `2π x`. `x` is reduced exactly to the nearest
+  /// quarter turn, `x = q / 4 + f` with `|f| <= 1 / 8`, the sine and
+  /// cosine of `2π f` are Taylor polynomials, and the quarter `q` swaps
+  /// and negates them. `|x|` must be less than 2^50.
+  @inlinable public static func sinCos(
+    turns x: DoubleVector
+  ) -> (sin: DoubleVector, cos: DoubleVector) {
+    let q = (x * 4).rounded(.toNearestOrEven)
+    let a = (x - q * 0.25) * twoPi
+    let a2 = a * a
+    let s = a + a * a2 * polynomial(a2, sinCoefficients)
+    let c = 1 + a2 * polynomial(a2, cosCoefficients)
+
+    let quadrant = SIMD8<Int64>(q, rounding: .towardZero) & 3
+    let swap = (quadrant & 1) .== 1
+    var sin = s.replacing(with: c, where: swap)
+    var cos = c.replacing(with: s, where: swap)
+    sin.replace(with: -sin, where: (quadrant & 2) .== 2)
+    cos.replace(with: -cos, where: ((quadrant &+ 1) & 2) .== 2)
+    return (sin, cos)
+  }
+
+  //--------------------------------------------------------------------------
+  /// expMinusOne
+  /// `exp(x) - 1` for `x <= 0`
+  @inlinable static func expMinusOne(_ x: DoubleVector) -> DoubleVector {
+    let xc = x.replacing(with: -40, where: .!(x .>= -40))
+    let n = (xc * log2e).rounded(.toNearestOrEven)
+    let r = (xc - n * ln2Hi) - n * ln2Lo
+    let q = r + r * r * polynomial(r, expMinusOneCoefficients)
+    let scale = pow2(SIMD8<Int64>(n, rounding: .towardZero))
+    return (scale - 1) + scale * q
+  }
+
+  //--------------------------------------------------------------------------
+  /// erfc
+  /// `erfc(a)` for `0.5 <= a <= 40`, computed as `exp(-a^2) * g(a)`.
+  /// `g` is a polynomial on pieces of the range, selected per lane, and
+  /// `a^2 = a2 + a2Lo` is carried in two parts.
+  @inlinable static func erfc(
+    _ a: DoubleVector,
+    _ a2: DoubleVector,
+    _ a2Lo: DoubleVector
+  ) -> DoubleVector {
+    let f = a.rounded(.down)
+    let isAsymptotic = f .>= 6
+    let offset = f.replacing(with: 4, where: f .> 4).replacing(with: 0.5, where: f .== 0)
+    var piece = SIMD8<Int64>(offset, rounding: .towardZero)
+    piece.replace(with: 5, where: isAsymptotic)
+    let v = (a - offset).replacing(with: 1 / (a * a), where: isAsymptotic)
+
+    let degree = erfcDegree
+    var g = DoubleVector()
+    erfcCoefficients.withUnsafeBufferPointer { c in
+      let base = piece &* Int64(degree + 1)
+      let isUniform = base == SIMD8(repeating: base[0])
+      for j in 0...degree {
+        var coefficient = DoubleVector()
+        if isUniform {
+          coefficient = DoubleVector(repeating: c[Int(base[0]) + j])
+        } else {
+          for lane in 0..<coefficient.scalarCount {
+            coefficient[lane] = c[Int(base[lane]) + j]
+          }
+        }
+        g = j == 0 ? coefficient : g * v + coefficient
+      }
+    }
+    g.replace(with: g / a, where: isAsymptotic)
+    return exp(-a2) * (1 - a2Lo) * g
+  }
+
+  //--------------------------------------------------------------------------
+  // helpers
+  @inlinable static func polynomial(
+    _ x: DoubleVector,
+    _ coefficients: [Double]
+  ) -> DoubleVector {
+    var p = DoubleVector(repeating: coefficients[0])
+    for i in 1..<coefficients.count { p = p * x + coefficients[i] }
+    return p
+  }
+
+  @inlinable static func polynomial(
+    _ x: FloatVector,
+    _ coefficients: [Float]
+  ) -> FloatVector {
+    var p = FloatVector(repeating: coefficients[0])
+    for i in 1..<coefficients.count { p = p * x + coefficients[i] }
+    return p
+  }
+
+  /// 2^k for normal exponents
+  @inlinable static func pow2(_ k: SIMD8<Int64>) -> DoubleVector {
+    unsafeBitCast((k &+ 1023) &<< 52, to: DoubleVector.self)
+  }
+
+  @inlinable static func pow2(_ k: SIMD16<Int32>) -> FloatVector {
+    unsafeBitCast((k &+ 127) &<< 23, to: FloatVector.self)
+  }
+
+  @inlinable static func magnitude(_ x: DoubleVector) -> DoubleVector {
+    let bits = unsafeBitCast(x, to: SIMD8<UInt64>.self)
+    return unsafeBitCast(bits & 0x7fff_ffff_ffff_ffff, to: DoubleVector.self)
+  }
+
+  /// the magnitude of `x` with the sign of `y`
+  @inlinable static func copySign(
+    _ x: DoubleVector,
+    from y: DoubleVector
+  ) -> DoubleVector {
+    let sign = unsafeBitCast(y, to: SIMD8<UInt64>.self) & 0x8000_0000_0000_0000
+    let bits = unsafeBitCast(magnitude(x), to: SIMD8<UInt64>.self)
+    return unsafeBitCast(bits | sign, to: DoubleVector.self)
+  }
+
+  //--------------------------------------------------------------------------
+  // constants
+  @inlinable static var log2e: Double { 1.4426950408889634 }
+  @inlinable static var twoPi: Double { 6.283185307179586 }
+  // ln2Hi has enough trailing zeros that n * ln2Hi is exact
+  @inlinable static var ln2Hi: Double { 6.93147180369123816490e-01 }
+  @inlinable static var ln2Lo: Double { 1.90821492927058770002e-10 }
+
+  // fdlibm log coefficients
+  @inlinable static var lg1: Double { 6.666666666666735130e-01 }
+  @inlinable static var lg2: Double { 3.999999999940941908e-01 }
+  @inlinable static var lg3: Double { 2.857142874366239149e-01 }
+  @inlinable static var lg4: Double { 2.222219843214978396e-01 }
+  @inlinable static var lg5: Double { 1.818357216161805012e-01 }
+  @inlinable static var lg6: Double { 1.531383769920937332e-01 }
+  @inlinable static var lg7: Double { 1.479819860511658591e-01 }
+
+  // Float constants. ln2HiFloat has 9 significant bits, so n * ln2HiFloat
+  // is exact for every exponent of a finite result.
+  @inlinable static var log2eFloat: Float { 1.44269502 }
+  @inlinable static var ln2HiFloat: Float { 0.693359375 }
+  @inlinable static var ln2LoFloat: Float { -0x1.bd0106p-13 }
+  @inlinable static var ln2HiLogFloat: Float { 0x1.62e3p-1 }
+  @inlinable static var ln2LoLogFloat: Float { 0x1.2fefa2p-17 }
+
+  // fdlibm logf coefficients
+  @inlinable static var lgFloat1: Float { 0x1.555554p-1 }
+  @inlinable static var lgFloat2: Float { 0x1.999c26p-2 }
+  @inlinable static var lgFloat3: Float { 0x1.23d3dcp-2 }
+  @inlinable static var lgFloat4: Float { 0x1.f13c4cp-3 }
+
+  /// 1 / k! for k = 13...0
+  @usableFromInline static let expCoefficients: [Double] = [
+    1.6059043836821613e-10, 2.08767569878681e-09, 2.505210838544172e-08,
+    2.755731922398589e-07, 2.7557319223985893e-06, 2.48015873015873e-05,
+    0.0001984126984126984, 0.001388888888888889, 0.008333333333333333,
+    0.041666666666666664, 0.16666666666666666, 0.5, 1.0, 1.0,
+  ]
+
+  /// 1 / k! for k = 7...0 in single precision
+  @usableFromInline static let expFloatCoefficients: [Float] = [
+    0.00019841270113829523, 0.0013888889225199819, 0.008333333767950535,
+    0.0416666679084301, 0.1666666716337204, 0.5, 1.0, 1.0,
+  ]
+
+  /// 1 / k! for k = 14...2
+  @usableFromInline static let expMinusOneCoefficients: [Double] = [
+    1.1470745597729725e-11, 1.6059043836821613e-10, 2.08767569878681e-09,
+    2.505210838544172e-08, 2.755731922398589e-07, 2.7557319223985893e-06,
+    2.48015873015873e-05, 0.0001984126984126984, 0.001388888888888889,
+    0.008333333333333333, 0.041666666666666664, 0.16666666666666666, 0.5,
+  ]
+
+  /// (-1)^k / (2k + 1)! for k = 7...1
+  @usableFromInline static let sinCoefficients: [Double] = [
+    -7.647163731819816e-13, 1.6059043836821613e-10, -2.505210838544172e-08,
+    2.7557319223985893e-06, -0.0001984126984126984, 0.008333333333333333,
+    -0.16666666666666666,
+  ]
+
+  /// (-1)^k / (2k)! for k = 8...1
+  @usableFromInline static let cosCoefficients: [Double] = [
+    4.779477332387385e-14, -1.1470745597729725e-11, 2.08767569878681e-09,
+    -2.755731922398589e-07, 2.48015873015873e-05, -0.001388888888888889,
+    0.041666666666666664, -0.5,
+  ]
+
+  /// erf(x) / x as a polynomial in x^2 on [0, 1]
+  @usableFromInline static let erfCoefficients: [Double] = [
+    -7.795898827002142e-10, 1.3720064546777686e-08, -1.6208483801871705e-07,
+    1.6447424703317362e-06, -1.492473690741966e-05, 0.00012055294904839707,
+    -0.0008548325975389692, 0.0052239776071164225, -0.02686617064323777,
+    0.11283791670945006, -0.37612638903183543, 1.1283791670955126,
+  ]
+
+  /// the degree of each erfc piece
+  @inlinable static var erfcDegree: Int { 16 }
+
+  /// erfc(a) * exp(a^2) on each piece, in powers of the distance from the
+  /// start of the piece. The last piece is `a * erfc(a) * exp(a^2)` in
+  /// powers of `1 / a^2`.
+  @usableFromInline static let erfcCoefficients: [Double] = [
+    // [0.5, 1)
+    4.4454451280847605e-07, -3.2370323486118645e-06, 1.334741301665223e-05,
+    -4.344733053415434e-05, 0.0001275158005598149, -0.00035464597679849084,
+    0.0009466130650310006, -0.0024253879274193082, 0.005946173390117815,
+    -0.013887415827722425, 0.030728413890499393, -0.06397016368327069,
+    0.1241703236154352, -0.22201057102117816, 0.3593459327416325,
+    -0.5126888229025867, 0.6156903441929259,
+    // [1, 2)
+    1.3242541506849586e-08, -1.554861398936983e-07, 9.360127330165308e-07,
+    -3.992051976377373e-06, 1.4058049071592464e-05, -4.460991807631042e-05,
+    0.0001333520303273085, -0.00038181752460024563, 0.0010502240746120303,
+    -0.0027690536807181304, 0.006970140411868926, -0.016661868848093075,
+    0.03757229619550844, -0.07922696894034445, 0.1543715613718827,
+    -0.2732120147838983, 0.427583576155807,
+    // [2, 3)
+    2.1168892627144388e-10, -2.6263774242389477e-09, 1.7159013989071812e-08,
+    -8.213677225019913e-08, 3.359583487713109e-07, -1.2726085571280793e-06,
+    4.624117131250527e-06, -1.629192046102509e-05, 5.572771746300835e-05,
+    -0.00018477822032744403, 0.0005924699692825818, -0.0018316642725165835,
+    0.005440738537208833, -0.015460637764277908, 0.04180275260352621,
+    -0.1067964618534896, 0.25539567631050575,
+    // [3, 4)
+    6.170990997356177e-12, -8.107727459353776e-11, 5.769835640673163e-10,
+    -3.1100378881719404e-09, 1.4765201975868946e-08, -6.63002975525486e-08,
+    2.891682834245909e-07, -1.2333239123175283e-06, 5.146421949932267e-06,
+    -2.0989460861299693e-05, 8.355413898896688e-05, -0.0003241255444176044,
+    0.0012230390523703175, -0.004479431018372252, 0.01588437115987133,
+    -0.05437226000717287, 0.17900115118138996,
+    // [4, 6)
+    7.935106373004748e-14, -1.7729185737074144e-12, 1.9894006095527287e-11,
+    -1.542835384274239e-10, 9.653446866870636e-10, -5.371053634941204e-09,
+    2.8179899285350516e-08, -1.4346370568915954e-07, 7.159584627242148e-07,
+    -3.510324188376021e-06, 1.690563429424213e-05, -7.990887662304531e-05,
+    0.0003703524683957219, -0.001681182076686647, 0.007465433244972459,
+    -0.03238350609502139, 0.13699945762506138,
+    // [6, inf) in 1 / a^2
+    74359129556.65764, -23240102290.703213, 3696937195.036427,
+    -418065396.9724773, 40171658.39306354, -3717898.881526402,
+    359631.25400656223, -37958.704522268956, 4467.170192780333,
+    -595.6379340491659, 91.63672605716816, -16.661223625645032,
+    3.702494142001659, -1.057855469152001, 0.4231421876608172,
+    -0.28209479177387814, 0.5641895835477563,
+  ]
+}
+
+//==============================================================================
+// DeviceQueue vector math
+extension DeviceQueue {
+  //--------------------------------------------------------------------------
+  /// vectorMapOp(_:_:float:double:_:
+  /// maps dense `Float` and `Double` tensors through the `VectorMath`
+  /// kernels, and everything else through the scalar `op`
+  @inlinable func vectorMapOp<S, E>(
+    _ x: Tensor<S, E>,
+    _ out: inout Tensor<S, E>,
+    float: @escaping (SIMD16<Float>) -> SIMD16<Float>,
+    double: @escaping (SIMD8<Double>) -> SIMD8<Double>,
+    _ op: @escaping (E.Value) -> E.Value
+  ) {
+    guard
+      useVectorMath && out.count > 0
+        && x.isValueAddressable && x.isContiguous
+        && out.isValueAddressable && out.isContiguous
+    else {
+      mapOp(x, &out, op)
+      return
+    }
+
+    if E.Value.self == Float.self {
+      cpu_vectorMap(x, &out, Float.self, float)
+    } else if E.Value.self == Double.self {
+      cpu_vectorMap(x, &out, Double.self, double)
+    } else {
+      mapOp(x, &out, op)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// cpu_vectorMap(_:_:_:_:
+  /// applies `body` to whole vectors of the dense elements. The last
+  /// vector is zero padded.
+  @inlinable func cpu_vectorMap<S, E, V: SIMD>(
+    _ x: Tensor<S, E>,
+    _ out: inout Tensor<S, E>,
+    _ scalar: V.Scalar.Type,
+    _ body: @escaping (V) -> V
+  ) {
+    let px = UnsafeRawPointer(x.valuePointer(using: currentQueue))
+      .assumingMemoryBound(to: V.Scalar.self)
+    let po = UnsafeMutableRawPointer(out.mutableValuePointer(using: currentQueue))
+      .assumingMemoryBound(to: V.Scalar.self)
+    let count = out.count
+    let lanes = V.scalarCount
+
+    cpu_parallel((count + lanes - 1) / lanes, writing: E.self) {
+      let start = $0.lowerBound * lanes
+      let end = Swift.min($0.upperBound * lanes, count)
+      VectorMath.map(px + start, po + start, count: end - start, body)
+    }
+  }
+}
+
+//==============================================================================
+// Cpu device queue functions without a gpu kernel
+extension DeviceQueue where Self: CpuFunctions {
+  //--------------------------------------------------------------------------
+  @inlinable public func gelu<S, E>(_ x: Tensor<S, E>, _ out: inout Tensor<S, E>)
+  where E.Value: Real { cpu_gelu(x, &out) }
+}
@@ -0,0 +1,354 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import Numerics
+
+//==============================================================================
+/// WinogradTransform
+/// The transform matrices for the minimal filtering algorithm F(m x m, 3 x 3)
+/// - BT: input transform, alpha x alpha
+/// - G: filter transform, alpha x 3
+/// - AT: output transform, m x alpha
+/// where alpha = m + 2 is the input tile size
+public struct WinogradTransform<Value: BinaryFloatingPoint> {
+  /// the output tile size
+  public let m: Int
+  /// the input tile size
+  public let alpha: Int
+  public let BT: [Value]
+  public let G: [Value]
+  public let AT: [Value]
+
+  //--------------------------------------------------------------------------
+  /// - Parameter m: the output tile size, which must be 2 or 4
+  @inlinable public init(m: Int) {
+    self.m = m
+    alpha = m + 2
+    switch m {
+    case 2:
+      BT = [
+        1, 0, -1, 0,
+        0, 1, 1, 0,
+        0, -1, 1, 0,
+        0, 1, 0, -1,
+      ]
+      G = [
+        1, 0, 0,
+        0.5, 0.5, 0.5,
+        0.5, -0.5, 0.5,
+        0, 0, 1,
+      ]
+      AT = [
+        1, 1, 1, 0,
+        0, 1, -1, -1,
+      ]
+
+    case 4:
+      BT = [
+        4, 0, -5, 0, 1, 0,
+        0, -4, -4, 1, 1, 0,
+        0, 4, -4, -1, 1, 0,
+        0, -2, -1, 2, 1, 0,
+        0, 2, -1, -2, 1, 0,
+        0, 4, 0, -5, 0, 1,
+      ]
+      G = [
+        1 / 4, 0, 0,
+        -1 / 6, -1 / 6, -1 / 6,
+        -1 / 6, 1 / 6, -1 / 6,
+        1 / 24, 1 / 12, 1 / 6,
+        1 / 24, -1 / 12, 1 / 6,
+        0, 0, 1,
+      ]
+      AT = [
+        1, 1, 1, 1, 1, 0,
+        0, 1, -1, 2, -2, 0,
+        0, 1, 1, 4, 4, 0,
+        0, 1, -1, 8, -8, 1,
+      ]
+
+    default:
+      fatalError("Winograd F(\(m)x\(m), 3x3) is not supported")
+    }
+  }
+}
+
+//==============================================================================
+/// WinogradFilter
+/// A convolution filter transformed into the Winograd domain. The
+/// transformed values are laid out as `[alpha * alpha, Cin, Cout]`, so
+/// each tile position is a Cin x Cout matrix with output channels
+/// contiguous.
+///
+/// Only the version of the source filter is kept, so a filter that is
+/// updated in place by an optimizer isn't copied, and the update is
+/// detected as a stale transform.
+public final class WinogradFilter<Shape: TensorShape, Value: BinaryFloatingPoint> {
+  public let transform: WinogradTransform<Value>
+  public let transformed: [Value]
+  public let source: TensorVersion<Shape>
+
+  @inlinable public init(
+    _ transform: WinogradTransform<Value>,
+    _ transformed: [Value],
+    source: TensorVersion<Shape>
+  ) {
+    self.transform = transform
+    self.transformed = transformed
+    self.source = source
+  }
+}
+
+//==============================================================================
+// CpuConvolution Winograd kernels
+extension CpuConvolution
+where
+  Element.Value == FilterElement.Value,
+  FilterElement.Value: Real & BinaryFloatingPoint
+{
+  public typealias WinogradPlan = WinogradFilter<Shape, Value>
+
+  //--------------------------------------------------------------------------
+  /// winogradTileSize
+  /// Winograd applies to 3x3 filters with unit strides and dilations. The
+  /// larger F(4x4, 3x3) tile saves more multiplies, but its transform
+  /// constants amplify rounding error, so reduced precision elements are
+  /// limited to F(2x2, 3x3). When values are computed in half precision
+  /// the transforms are only used if requested explicitly.
+  /// - Parameters:
+  ///  - g: the convolution geometry
+  ///  - requested: `true` if the Winograd algorithm was requested
+  /// - Returns: the output tile size, or `nil` if Winograd doesn't apply
+  @inlinable public static func winogradTileSize(
+    _ g: ConvolutionGeometry,
+    requested: Bool
+  ) -> Int? {
+    guard g.filter == [1, 3, 3],
+      g.strides == [1, 1, 1],
+      g.dilations == [1, 1, 1]
+    else { return nil }
+
+    // the transforms only pay off when the channel gemms dominate
+    guard requested || g.inChannels * g.outChannels >= 64 else { return nil }
+
+    if Value.significandBitCount < Float.significandBitCount {
+      return requested ? 2 : nil
+    } else if MemoryLayout<Element.Stored>.size < MemoryLayout<Value>.size {
+      return 2
+    } else {
+      return g.output[1] >= 4 && g.output[2] >= 4 ? 4 : 2
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// winogradFilter
+  /// - Returns: the filter transformed into the Winograd domain. One
+  ///   transform is cached for each tile size in `winogradFilters`, and
+  ///   it is replaced when the filter is replaced or written.
+  @inlinable public func winogradFilter(
+    _ filter: Filter,
+    _ g: ConvolutionGeometry,
+    m: Int
+  ) -> WinogradPlan {
+    if let plan = winogradFilters[m] as? WinogradPlan,
+      plan.source == filter.version
+    {
+      return plan
+    }
+
+    diagnostic(
+      .queueCpu,
+      "transforming \(filter.name) for Winograd F(\(m)x\(m), 3x3)",
+      categories: .queueCpu)
+    let transform = WinogradTransform<Value>(m: m)
+    let w = usingSyncQueue { [Value](filter.elements) }
+    let transformed = Self.transformFilter(transform, g, w)
+    let plan = WinogradPlan(transform, transformed, source: filter.version)
+    winogradFilters[m] = plan
+    return plan
+  }
+
+  //--------------------------------------------------------------------------
+  /// transformFilter
+  /// computes `U = G g GT` for each input and output channel pair
+  @inlinable public static func transformFilter(
+    _ t: WinogradTransform<Value>,
+    _ g: ConvolutionGeometry,
+    _ w: [Value]
+  ) -> [Value] {
+    let (ci, co, alpha) = (g.inChannels, g.outChannels, t.alpha)
+    let channels = ci * co
+    var u = [Value](repeating: 0, count: alpha * alpha * channels)
+    var tmp = [Value](repeating: 0, count: alpha * 3)
+
+    for c in 0..<channels {
+      // tmp = G g, where true convolution flips the filter taps
+      for i in 0..<alpha {
+        for l in 0..<3 {
+          var sum = Value.zero
+          for k in 0..<3 {
+            let (kh, kw) = g.isFlipped ? (2 - k, 2 - l) : (k, l)
+            sum += t.G[i * 3 + k] * w[(kh * 3 + kw) * channels + c]
+          }
+          tmp[i * 3 + l] = sum
+        }
+      }
+      // U = tmp GT
+      for i in 0..<alpha {
+        for j in 0..<alpha {
+          var sum = Value.zero
+          for l in 0..<3 { sum += tmp[i * 3 + l] * t.G[j * 3 + l] }
+          u[(i * alpha + j) * channels + c] = sum
+        }
+      }
+    }
+    return u
+  }
+
+  //--------------------------------------------------------------------------
+  /// forwardWinograd
+  /// For each m x m output tile the input tile is transformed with
+  /// `V = BT d B`, multiplied by the transformed filter for each of the
+  /// alpha x alpha tile positions with the output channels innermost, and
+  /// transformed back with `Y = AT M A`. The bias and activation are
+  /// applied as each tile is stored. Rows of tiles are distributed across
+  /// the cpu cores.
+  @inlinable public static func forwardWinograd(
+    _ g: ConvolutionGeometry,
+    _ x: UnsafeBufferPointer<Value>,
+    _ plan: WinogradPlan,
+    _ bias: UnsafeBufferPointer<Value>,
+    _ epilogue: ((Value) -> Value)?,
+    _ y: UnsafeMutableBufferPointer<Value>
+  ) {
+    let t = plan.transform
+    let (m, alpha) = (t.m, t.alpha)
+    let (ci, co) = (g.inChannels, g.outChannels)
+    let (ih, iw) = (g.input[1], g.input[2])
+    let (oh, ow) = (g.output[1], g.output[2])
+    let (ph, pw) = (g.padding[1], g.padding[2])
+    let tilesH = (oh + m - 1) / m
+    let tilesW = (ow + m - 1) / m
+    let positions = alpha * alpha
+    // each image is one batch item and depth slice
+    let images = g.batch * g.input[0]
+
+    plan.transformed.withUnsafeBufferPointer { u in
+      parallelFor(images * tilesH) { tileRows in
+        var d = [Value](repeating: 0, count: positions * ci)
+        var v = [Value](repeating: 0, count: positions * ci)
+        var mt = [Value](repeating: 0, count: positions * co)
+        var tmp = [Value](repeating: 0, count: positions * Swift.max(ci, co))
+        var out = [Value](repeating: 0, count: m * m * co)
+
+        for tileRow in tileRows {
+          let image = tileRow / tilesH
+          let th = tileRow % tilesH
+          for tw in 0..<tilesW {
+            // gather the zero padded input tile d[alpha, alpha, Cin]
+            for a in 0..<alpha {
+              let r = th * m + a - ph
+              for b in 0..<alpha {
+                let c = tw * m + b - pw
+                let di = (a * alpha + b) * ci
+                if r >= 0 && r < ih && c >= 0 && c < iw {
+                  let xi = ((image * ih + r) * iw + c) * ci
+                  for i in 0..<ci { d[di + i] = x[xi + i] }
+                } else {
+                  for i in 0..<ci { d[di + i] = 0 }
+                }
+              }
+            }
+
+            // V = BT d B
+            transformTile(t.BT, alpha, alpha, d, &tmp, &v, ci)
+
+            // M[pos] = V[pos] U[pos]
+            for pos in 0..<positions {
+              let mi = pos * co
+              for o in 0..<co { mt[mi + o] = 0 }
+              var ui = pos * ci * co
+              for i in 0..<ci {
+                let vv = v[pos * ci + i]
+                for o in 0..<co { mt[mi + o] += vv * u[ui + o] }
+                ui += co
+              }
+            }
+
+            // Y = AT M A
+            transformTile(t.AT, m, alpha, mt, &tmp, &out, co)
+
+            // store with the bias and activation
+            for r in 0..<Swift.min(m, oh - th * m) {
+              for c in 0..<Swift.min(m, ow - tw * m) {
+                let yi = ((image * oh + th * m + r) * ow + tw * m + c) * co
+                let oi = (r * m + c) * co
+                if let epilogue = epilogue {
+                  for o in 0..<co { y[yi + o] = epilogue(out[oi + o] + bias[o]) }
+                } else {
+                  for o in 0..<co { y[yi + o] = out[oi + o] + bias[o] }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  /// transformTile
+  /// computes `result = T tile TT` for each channel, where `T` is a
+  /// `rows x cols` transform matrix and `tile` is `cols x cols x channels`.
+  /// Zero coefficients are skipped, since the transforms are sparse.
+  @inlinable public static func transformTile(
+    _ T: [Value],
+    _ rows: Int,
+    _ cols: Int,
+    _ tile: [Value],
+    _ tmp: inout [Value],
+    _ result: inout [Value],
+    _ channels: Int
+  ) {
+    // tmp[rows, cols] = T tile
+    for i in 0..<rows {
+      for l in 0..<cols {
+        let ti = (i * cols + l) * channels
+        for c in 0..<channels { tmp[ti + c] = 0 }
+        for k in 0..<cols {
+          let coef = T[i * cols + k]
+          if coef == 0 { continue }
+          let si = (k * cols + l) * channels
+          for c in 0..<channels { tmp[ti + c] += coef * tile[si + c] }
+        }
+      }
+    }
+    // result[rows, rows] = tmp TT
+    for i in 0..<rows {
+      for j in 0..<rows {
+        let ri = (i * rows + j) * channels
+        for c in 0..<channels { result[ri + c] = 0 }
+        for l in 0..<cols {
+          let coef = T[j * cols + l]
+          if coef == 0 { continue }
+          let ti = (i * cols + l) * channels
+          for c in 0..<channels { result[ri + c] += coef * tmp[ti + c] }
+        }
+      }
+    }
+  }
+}
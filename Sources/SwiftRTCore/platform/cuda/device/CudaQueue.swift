@@ -86,11 +86,7 @@ public final class CudaQueue: DeviceQueue, CpuFunctions {
     heapIndex: Int = 0
   ) -> DeviceMemory {
     if usesCpu {
-      let buffer =
-        UnsafeMutableRawBufferPointer
-        .allocate(
-          byteCount: byteCount,
-          alignment: MemoryLayout<Int>.alignment)
+      let buffer = CpuMemoryPool.shared.allocate(byteCount: byteCount)
       return CpuDeviceMemory(deviceIndex, buffer, memoryType)
     } else {
       return CudaDeviceMemory(deviceIndex, byteCount, stream)
@@ -152,6 +148,33 @@ public final class CudaQueue: DeviceQueue, CpuFunctions {
     }
   }
 
+  //--------------------------------------------------------------------------
+  // copyAsync range
+  @inlinable public func copyAsync(
+    from src: DeviceMemory,
+    to dst: DeviceMemory,
+    range: Range<Int>
+  ) {
+    assert(range.upperBound <= src.buffer.count && src.buffer.count == dst.buffer.count)
+    let kind: cudaMemcpyKind
+    switch (src.type, dst.type) {
+    // host --> host
+    case (.unified, .unified):
+      cpu_copyAsync(from: src, to: dst, range: range)
+      return
+    case (.unified, .discrete): kind = cudaMemcpyHostToDevice
+    case (.discrete, .unified): kind = cudaMemcpyDeviceToHost
+    case (.discrete, .discrete): kind = cudaMemcpyDeviceToDevice
+    }
+    cudaCheck(
+      cudaMemcpyAsync(
+        dst.mutablePointer + range.lowerBound,
+        src.pointer + range.lowerBound,
+        range.count,
+        kind,
+        stream))
+  }
+
   //--------------------------------------------------------------------------
   @inlinable public func recordEvent() -> CudaEvent {
     let event = CudaEvent(recordedOn: self)
@@ -174,13 +197,7 @@ public final class CudaQueue: DeviceQueue, CpuFunctions {
     if useGpu {
       cudaCheck(cudaStreamWaitEvent(stream, event.handle, 0))
     } else {
-      if mode == .sync {
-        event.wait()
-      } else {
-        queue.async(group: group) {
-          event.wait()
-        }
-      }
+      cpu_execute(.sync) { event.wait() }
     }
   }
 
@@ -55,6 +55,55 @@ extension CudaQueue {
     cpuFallback(status) { $0.copyElements(from: a, to: &out) }
   }
 
+  //--------------------------------------------------------------------------
+  @inlinable public func gather<S, E>(
+    from a: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) {
+    guard useGpu else {
+      cpu_gather(from: a, indices: indices, axis: axis, into: &out)
+      return
+    }
+    // there is no gpu gather kernel yet
+    cpuFallback(cudaErrorNotSupported) {
+      $0.gather(from: a, indices: indices, axis: axis, into: &out)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func scatterAdd<S, E>(
+    _ updates: Tensor<S, E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    guard useGpu else {
+      cpu_scatterAdd(updates, indices: indices, axis: axis, into: &out)
+      return
+    }
+    // there is no gpu scatter kernel yet
+    cpuFallback(cudaErrorNotSupported) {
+      $0.scatterAdd(updates, indices: indices, axis: axis, into: &out)
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func segmentSum<S, E>(
+    _ updates: Tensor<S, E>,
+    segments: ScatterSegments,
+    into out: inout Tensor<S, E>
+  ) where E.Value: Numeric {
+    guard useGpu else {
+      cpu_segmentSum(updates, segments: segments, into: &out)
+      return
+    }
+    cpuFallback(cudaErrorNotSupported) {
+      $0.segmentSum(updates, segments: segments, into: &out)
+    }
+  }
+
   //--------------------------------------------------------------------------
   @inlinable func fill<S, E: StorageElement>(
     _ out: inout Tensor<S, E>,
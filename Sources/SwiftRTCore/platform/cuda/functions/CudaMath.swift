@@ -578,6 +578,17 @@ extension CudaQueue {
     cpuFallback(gpuCast(a, &out)) { $0.cast(from: a, to: &out) }
   }
 
+  @inlinable public func cast<S, E, OE>(
+    from a: Tensor<S, E>,
+    to out: inout Tensor<S, OE>
+  ) where E.Value: BinaryFloatingPoint, OE.Value: BinaryFloatingPoint {
+    guard useGpu else {
+      cpu_cast(from: a, to: &out)
+      return
+    }
+    cpuFallback(gpuCast(a, &out)) { $0.cast(from: a, to: &out) }
+  }
+
   @inlinable public func cast<S, E, OE>(
     from a: Tensor<S, E>,
     to out: inout Tensor<S, OE>
@@ -14,6 +14,7 @@
 // limitations under the License.
 //
 
+import Numerics
 import SwiftRTCuda
 
 //==============================================================================
@@ -60,6 +61,35 @@ extension CudaQueue {
     }
   }
 
+  //--------------------------------------------------------------------------
+  // the packed panel layout is only consumed by the cpu gemm kernel
+  @inlinable func matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ result: inout TensorR2<E>
+  ) where E.Value: Numeric {
+    cpu_matmul(lhs, transposeLhs, rhs, &result)
+  }
+
+  @inlinable func matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ bias: TensorR1<E>,
+    _ result: inout TensorR2<E>
+  ) where E.Value: Numeric {
+    cpu_matmul(lhs, transposeLhs, rhs, bias, nil, &result)
+  }
+
+  @inlinable func matmul<E>(
+    _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+    _ rhs: PackedMatrix<E>,
+    _ bias: TensorR1<E>?,
+    _ activation: ActivationType,
+    _ result: inout TensorR2<E>
+  ) where E.Value: Real {
+    cpu_matmul(lhs, transposeLhs, rhs, bias, activation, &result)
+  }
+
   public func matmul2<E>(type: E.Type) -> DeviceMatmul2<E>
   where E: StorageElement, E.Value: StorageElement & Numeric {
     CudaMatmul2<E>(queue: self)
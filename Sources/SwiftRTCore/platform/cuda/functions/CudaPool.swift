@@ -14,6 +14,7 @@
 // limitations under the License.
 //
 
+import Numerics
 import SwiftRTCuda
 
 //==============================================================================
@@ -77,7 +78,7 @@ extension CudaQueue {
     _ config: PoolingConfig<Shape, E>,
     _ x: Tensor<Shape, E>,
     _ out: inout Tensor<Shape, E>
-  ) where E: Numeric {
+  ) where E.Value: Comparable & AlgebraicField {
     assert(out.isContiguous, _messageElementsMustBeContiguous)
     guard useGpu else {
       cpu_pool(config, x, &out)
@@ -140,6 +141,22 @@ extension CudaQueue {
     )
     cpuFallback(status) { $0.cpu_pool(config, x, &out) }
   }
+
+  //--------------------------------------------------------------------------
+  @inlinable public func poolBackward<Shape, E>(
+    _ config: PoolingConfig<Shape, E>,
+    _ x: Tensor<Shape, E>,
+    _ out: Tensor<Shape, E>,
+    _ outDiff: Tensor<Shape, E>,
+    _ xDiff: inout Tensor<Shape, E>
+  ) where E.Value: Comparable & AlgebraicField {
+    // cudnn forward doesn't record the cpu max indices
+    if config.geometry.isMax && config.maxIndices.count != outDiff.count {
+      var temp = Tensor<Shape, E>(like: out)
+      cpu_pool(config, x, &temp)
+    }
+    cpu_poolBackward(config, x, out, outDiff, &xDiff)
+  }
 }  // CudaQueue
 
 //==============================================================================
@@ -151,6 +168,9 @@ public final class CudaPoolingConfig<Shape: TensorShape, Element: StorageElement
   public let x: TensorDescriptor
   public let out: TensorDescriptor
   public let shape: Shape
+  public let geometry: PoolingGeometry
+  /// the flat input index of each maximum recorded by cpu max pooling
+  public var maxIndices: [Int32] = []
 
   //----------------------------------------------------------------------------
   /// init(x:windowSize:strides:padding:op:
@@ -178,6 +198,9 @@ public final class CudaPoolingConfig<Shape: TensorShape, Element: StorageElement
 
     // compute the output shape
     shape = 1 &+ (tensor.shape &+ 2 &* padding &- windowSize) / strides
+    geometry = PoolingGeometry(
+      x: tensor.shape, windowSize: windowSize,
+      strides: strides, padding: padding, op: op)
 
     // create the output descriptor
     out = TensorDescriptor(Tensor<Shape, Element>(shape: shape, order: tensor.order))
@@ -216,6 +239,12 @@ public final class CudaPoolingConfig<Shape: TensorShape, Element: StorageElement
       batchShape[i + 1] = outItemShape[i]
     }
     shape = batchShape
+    geometry = PoolingGeometry(
+      x: batch.shape,
+      windowSize: Shape([1] + windowSize.array),
+      strides: Shape([1] + strides.array),
+      padding: Shape([0] + padding.array),
+      op: op)
 
     // create output descriptor
     out = TensorDescriptor(batch: Tensor<Shape, Element>(shape: shape, order: batch.order))
@@ -24,16 +24,18 @@ extension CudaQueue {
   @inlinable public func abssum<S, E>(
     _ x: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: SignedNumeric & Comparable {
     var status: cudaError_t
     assert(out.isContiguous, _messageElementsMustBeContiguous)
     guard useGpu else {
-      cpu_abssum(x, axis, &out)
+      cpu_abssum(x, axis, &out, mode)
       return
     }
 
-    if out.count == 1 {
+    // the gpu kernels don't provide a reproducible association
+    if out.count == 1 && mode == .fast {
       diagnostic(.queueGpu, "abssum(\(x.name)) Flat", categories: .queueGpu)
       status = out.withMutableTensor(using: self) { o, oDesc in
         x.withTensor(using: self) { x, xDesc in
@@ -43,7 +45,7 @@ extension CudaQueue {
     } else {
       status = cudaErrorNotSupported
     }
-    cpuFallback(status) { $0.abssum(x, axis, &out) }
+    cpuFallback(status) { $0.abssum(x, axis, &out, mode) }
   }
 
   //--------------------------------------------------------------------------
@@ -102,16 +104,18 @@ extension CudaQueue {
   @inlinable public func sum<S, E>(
     _ x: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: AdditiveArithmetic {
     var status: cudaError_t
     assert(out.isContiguous, _messageElementsMustBeContiguous)
     guard useGpu else {
-      cpu_sum(x, axis, &out)
+      cpu_sum(x, axis, &out, mode)
       return
     }
 
-    if out.count == 1 {
+    // the gpu kernels don't provide a reproducible association
+    if out.count == 1 && mode == .fast {
       diagnostic(.queueGpu, "sum(\(x.name)) Flat", categories: .queueGpu)
       status = out.withMutableTensor(using: self) { o, oDesc in
         x.withTensor(using: self) { x, xDesc in
@@ -121,23 +125,24 @@ extension CudaQueue {
     } else {
       status = cudaErrorNotSupported
     }
-    cpuFallback(status) { $0.sum(x, axis, &out) }
+    cpuFallback(status) { $0.sum(x, axis, &out, mode) }
   }
 
   //--------------------------------------------------------------------------
   @inlinable public func mean<S, E>(
     _ x: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: AlgebraicField {
     assert(out.isContiguous, _messageElementsMustBeContiguous)
     guard useGpu else {
-      cpu_mean(x, axis, &out)
+      cpu_mean(x, axis, &out, mode)
       return
     }
     // diagnostic(.queueGpu, "mean(\(x.name)) Flat", categories: .queueGpu)
 
-    cpuFallback(cudaErrorNotSupported) { $0.mean(x, axis, &out) }
+    cpuFallback(cudaErrorNotSupported) { $0.mean(x, axis, &out, mode) }
   }
 
   //--------------------------------------------------------------------------
@@ -230,16 +235,17 @@ extension CudaQueue {
   @inlinable public func prod<S, E>(
     _ x: Tensor<S, E>,
     _ axis: Int?,
-    _ out: inout Tensor<S, E>
+    _ out: inout Tensor<S, E>,
+    _ mode: ReductionMode
   ) where E.Value: Numeric {
     assert(out.isContiguous, _messageElementsMustBeContiguous)
     guard useGpu else {
-      cpu_prod(x, axis, &out)
+      cpu_prod(x, axis, &out, mode)
       return
     }
     // diagnostic(.queueGpu, "prod(\(x.name)) Flat", categories: .queueGpu)
 
-    cpuFallback(cudaErrorNotSupported) { $0.prod(x, axis, &out) }
+    cpuFallback(cudaErrorNotSupported) { $0.prod(x, axis, &out, mode) }
   }
   //--------------------------------------------------------------------------
   @inlinable public func prodNonZeros<S, E>(
@@ -21,6 +21,8 @@
   import Glibc
 #endif
 
+import Numerics
+
 public typealias RandomSeed = (graph: Int32, op: Int32)
 
 //==============================================================================
@@ -432,6 +434,165 @@ public struct PhiloxRandomNumberGenerator: SeedableRandomNumberGenerator {
   }
 }
 
+//==============================================================================
+/// Philox4x32
+/// The counter based form of the 10 round Philox4x32 generator used by
+/// `PhiloxRandomNumberGenerator`. Each 64 bit counter maps to a block of
+/// four 32 bit values, so any part of the sequence can be generated
+/// directly by jumping to its counter. This lets a tensor fill be split
+/// across workers and still give the same values for any number of them.
+/// An optional `stream` selects an independent sequence for the same
+/// counters, which is used to redraw rejected samples.
+public struct Philox4x32 {
+  public let key: SIMD2<UInt32>
+
+  @usableFromInline static let multipliers = SIMD2<UInt64>(0xD251_1F53, 0xCD9E_8D57)
+  @usableFromInline static let bump = SIMD2<UInt32>(0x9E37_79B9, 0xBB67_AE85)
+
+  //--------------------------------------------------------------------------
+  @inlinable public init(seed: RandomSeed) {
+    key = SIMD2(UInt32(bitPattern: seed.op), UInt32(bitPattern: seed.graph))
+  }
+
+  //--------------------------------------------------------------------------
+  /// block(_:stream:
+  /// - Returns: the four values for `counter`. Stream 0 matches the
+  ///   values produced by `PhiloxRandomNumberGenerator` with the same seed.
+  @inlinable public func block(_ counter: UInt64, stream: UInt32 = 0) -> SIMD4<UInt32> {
+    var c = SIMD4<UInt32>(
+      stream, 0,
+      UInt32(truncatingIfNeeded: counter >> 32),
+      UInt32(truncatingIfNeeded: counter))
+    var k = key
+    for round in 0..<10 {
+      if round > 0 { k &+= Philox4x32.bump }
+      // both products of a round in SIMD lanes
+      let p = SIMD2<UInt64>(UInt64(c[0]), UInt64(c[2])) &* Philox4x32.multipliers
+      let hi = SIMD2<UInt32>(truncatingIfNeeded: p &>> 32)
+      let lo = SIMD2<UInt32>(truncatingIfNeeded: p)
+      c = SIMD4(hi[1] ^ c[1] ^ k[0], lo[1], hi[0] ^ c[3] ^ k[1], lo[0])
+    }
+    return c
+  }
+
+  //--------------------------------------------------------------------------
+  /// uniform(_:stream:
+  /// - Returns: four uniform values in the open interval (0, 1)
+  @inlinable public func uniform<T>(
+    _ counter: UInt64,
+    stream: UInt32 = 0
+  ) -> SIMD4<T> where T: BinaryFloatingPoint & SIMDScalar {
+    // keep the high bits that fit the fraction, and center them
+    // in their interval so that 0 and 1 are never produced
+    let shift = UInt32(Swift.max(0, 32 - T.significandBitCount))
+    let scale = 1 / T(UInt64(1) << (32 - shift))
+    let bits = block(counter, stream: stream) &>> shift
+    return SIMD4<T>(T(bits[0]), T(bits[1]), T(bits[2]), T(bits[3])) * scale
+      + scale / 2
+  }
+
+  //--------------------------------------------------------------------------
+  /// normal(_:stream:
+  /// - Returns: four standard normal values from the Box-Muller
+  ///   transform of the uniform pairs (0, 1) and (2, 3)
+  @inlinable public func normal<T>(
+    _ counter: UInt64,
+    stream: UInt32 = 0
+  ) -> SIMD4<T> where T: Real & BinaryFloatingPoint & SIMDScalar {
+    let u = SIMD4<Double>(uniform(counter, stream: stream) as SIMD4<T>)
+    // the unused lanes are given valid arguments
+    var radius = VectorMath.DoubleVector(repeating: 0.5)
+    var angle = VectorMath.DoubleVector(repeating: 0.5)
+    radius[0] = u[0]
+    angle[0] = u[1]
+    radius[1] = u[2]
+    angle[1] = u[3]
+    let (x, y) = Philox4x32.boxMuller(radius, angle)
+    return SIMD4<T>(T(x[0]), T(y[0]), T(x[1]), T(y[1]))
+  }
+
+  //--------------------------------------------------------------------------
+  /// normals(_:stream:
+  /// - Returns: the sixteen standard normal values of counters
+  ///   `counter..<counter + 4`, in counter order. Their eight uniform
+  ///   pairs are transformed as one vector, and the values equal those
+  ///   returned by `normal` for each counter.
+  @inlinable public func normals<T>(
+    _ counter: UInt64,
+    stream: UInt32 = 0
+  ) -> SIMD16<T> where T: Real & BinaryFloatingPoint & SIMDScalar {
+    var radius = VectorMath.DoubleVector()
+    var angle = VectorMath.DoubleVector()
+    for j in 0..<4 {
+      let u = SIMD4<Double>(
+        uniform(counter + UInt64(j), stream: stream) as SIMD4<T>)
+      radius[2 * j] = u[0]
+      angle[2 * j] = u[1]
+      radius[2 * j + 1] = u[2]
+      angle[2 * j + 1] = u[3]
+    }
+    let (x, y) = Philox4x32.boxMuller(radius, angle)
+    var z = SIMD16<T>()
+    for i in 0..<8 {
+      z[2 * i] = T(x[i])
+      z[2 * i + 1] = T(y[i])
+    }
+    return z
+  }
+
+  //--------------------------------------------------------------------------
+  /// boxMuller(_:_:
+  /// transforms the uniform pairs `(radius, angle)` into pairs of
+  /// independent standard normal values with the `VectorMath` kernels
+  @inlinable static func boxMuller(
+    _ radius: VectorMath.DoubleVector,
+    _ angle: VectorMath.DoubleVector
+  ) -> (VectorMath.DoubleVector, VectorMath.DoubleVector) {
+    let r = (-2 * VectorMath.log(radius)).squareRoot()
+    let (sin, cos) = VectorMath.sinCos(turns: angle)
+    return (r * cos, r * sin)
+  }
+
+  //--------------------------------------------------------------------------
+  /// truncatedNormal(_:
+  /// - Returns: four standard normal values within two standard
+  ///   deviations. A rejected value is redrawn from the next stream
+  ///   for the same counter, so it depends only on the counter.
+  @inlinable public func truncatedNormal<T>(
+    _ counter: UInt64
+  ) -> SIMD4<T> where T: Real & BinaryFloatingPoint & SIMDScalar {
+    redrawn(normal(counter), counter)
+  }
+
+  //--------------------------------------------------------------------------
+  /// truncatedNormals(_:
+  /// - Returns: the sixteen truncated normal values of counters
+  ///   `counter..<counter + 4`, which equal those returned by
+  ///   `truncatedNormal` for each counter
+  @inlinable public func truncatedNormals<T>(
+    _ counter: UInt64
+  ) -> SIMD16<T> where T: Real & BinaryFloatingPoint & SIMDScalar {
+    redrawn(normals(counter), counter)
+  }
+
+  /// redraws the values of `z` outside two standard deviations, where
+  /// lane `i` belongs to counter `counter + i / 4`
+  @inlinable func redrawn<V: SIMD>(_ z: V, _ counter: UInt64) -> V
+  where V.Scalar: Real & BinaryFloatingPoint {
+    var z = z
+    for i in 0..<V.scalarCount {
+      var stream: UInt32 = 0
+      while Swift.abs(z[i]) > 2 {
+        stream += 1
+        let values: SIMD4<V.Scalar> =
+          normal(counter + UInt64(i / 4), stream: stream)
+        z[i] = values[i % 4]
+      }
+    }
+    return z
+  }
+}
+
 /// Private helpers.
 extension UInt64 {
   fileprivate var vector2: UInt32x2 {
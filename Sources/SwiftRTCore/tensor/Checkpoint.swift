@@ -0,0 +1,448 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+
+#if os(macOS) || os(iOS) || os(watchOS) || os(tvOS)
+  import Darwin
+#elseif os(Windows)
+  import ucrt
+#else
+  import Glibc
+#endif
+
+//==============================================================================
+/// Checkpoint
+/// A binary file of named tensors. The file starts with a fixed header
+/// followed by an index that describes each tensor, and then the stored
+/// elements of each tensor in storage order. Element data starts on a
+/// 64 byte boundary, so a tensor can be memory mapped in place.
+///
+///     offset 0   magic "SRTCKPT\0", version, index byte count, data offset
+///     64         JSON encoded [CheckpointEntry]
+///     data       element data, each tensor 64 byte aligned
+///
+/// Element data is written and read in large chunks on the cpu thread
+/// pool with positioned I/O, and checksums are computed in parallel.
+public enum Checkpoint {
+  /// the file signature
+  public static let magic: [UInt8] = Array("SRTCKPT\0".utf8)
+  /// the format version
+  public static let version: UInt32 = 1
+  /// the size of the fixed header
+  public static let headerSize = 64
+  /// the alignment of the element data of each tensor
+  public static let alignment = 64
+  /// the number of bytes in each parallel I/O request
+  public static var ioChunkSize = 8 * 1024 * 1024
+  /// the number of bytes in each independently hashed checksum chunk
+  public static let checksumChunkSize = 1024 * 1024
+
+  //--------------------------------------------------------------------------
+  /// checksum(_:
+  /// a 64 bit checksum of `bytes`. Chunks are hashed in parallel and the
+  /// chunk hashes are combined in order, so the result doesn't depend on
+  /// the number of threads.
+  public static func checksum(_ bytes: UnsafeRawBufferPointer) -> UInt64 {
+    let chunkCount = (bytes.count + checksumChunkSize - 1) / checksumChunkSize
+    var hashes = [UInt64](repeating: 0, count: chunkCount)
+    hashes.withUnsafeMutableBufferPointer { hashes in
+      CpuThreadPool.shared.parallelFor(chunkCount) {
+        for chunk in $0 {
+          let lower = chunk * checksumChunkSize
+          let upper = Swift.min(lower + checksumChunkSize, bytes.count)
+          hashes[chunk] = hash(UnsafeRawBufferPointer(rebasing: bytes[lower..<upper]))
+        }
+      }
+    }
+    return hashes.reduce(UInt64(bytes.count)) { mix($0, $1) }
+  }
+
+  @inlinable static func mix(_ acc: UInt64, _ value: UInt64) -> UInt64 {
+    let x = acc &+ value &* 0xC2B2_AE3D_27D4_EB4F
+    return ((x << 31) | (x >> 33)) &* 0x9E37_79B1_85EB_CA87
+  }
+
+  @inlinable static func hash(_ bytes: UnsafeRawBufferPointer) -> UInt64 {
+    var acc: UInt64 = 0x2774_3B5F_5B2C_D1A9
+    var word: UInt64 = 0
+    let wordCount = bytes.count / 8
+    for i in 0..<wordCount {
+      memcpy(&word, bytes.baseAddress! + i * 8, 8)
+      acc = mix(acc, word)
+    }
+    for i in (wordCount * 8)..<bytes.count {
+      acc = mix(acc, UInt64(bytes[i]))
+    }
+    return acc
+  }
+
+  //--------------------------------------------------------------------------
+  /// the chunks of a parallel transfer of one contiguous byte range
+  static func chunks(
+    byteCount: Int,
+    fileOffset: Int
+  ) -> [(offset: Int, count: Int, fileOffset: Int)] {
+    stride(from: 0, to: byteCount, by: ioChunkSize).map {
+      ($0, Swift.min(ioChunkSize, byteCount - $0), fileOffset + $0)
+    }
+  }
+
+  static func failure(_ operation: String, _ path: String) -> PlatformError {
+    PlatformError.functionFailure(
+      location: "Checkpoint",
+      message: "\(operation) \(path): \(String(cString: strerror(errno)))")
+  }
+}
+
+//==============================================================================
+/// CheckpointEntry
+/// the description of one tensor in a checkpoint
+public struct CheckpointEntry: Codable, Equatable {
+  /// the name of the tensor
+  public let name: String
+  /// the tensor element type name
+  public let elementType: String
+  /// the size of a stored element
+  public let storedSize: Int
+  /// the tensor shape
+  public let shape: [Int]
+  /// the storage order of the elements
+  public let order: Order
+  /// the offset of the element data from the start of the data section
+  public let offset: Int
+  /// the number of element data bytes
+  public let byteCount: Int
+  /// the checksum of the element data, if it was computed
+  public let checksum: UInt64?
+}
+
+//==============================================================================
+/// CheckpointWriter
+/// Collects tensors and writes them to a checkpoint file
+public final class CheckpointWriter {
+  /// the path of the checkpoint file
+  public let path: String
+  /// `true` to store a checksum for each tensor
+  public let computesChecksums: Bool
+
+  // the tensors to write, and dense copies of strided tensors, which
+  // must stay alive until they are written
+  var pending: [(name: String, type: String, size: Int, shape: [Int],
+    order: Order, bytes: UnsafeRawBufferPointer, owner: Any)] = []
+
+  //--------------------------------------------------------------------------
+  /// - Parameters:
+  ///  - path: the path of the checkpoint file
+  ///  - computesChecksums: `true` to store a checksum for each tensor
+  public init(path: String, computesChecksums: Bool = true) {
+    self.path = path
+    self.computesChecksums = computesChecksums
+  }
+
+  //--------------------------------------------------------------------------
+  /// add(_:name:
+  /// adds a tensor to the checkpoint. Tensors whose strides aren't the
+  /// dense strides of their order, such as transposed or repeated views,
+  /// are copied to dense storage first.
+  /// - Parameters:
+  ///  - tensor: the tensor to add
+  ///  - name: the name of the entry. The default is the tensor name.
+  public func add<S, E>(_ tensor: Tensor<S, E>, name: String? = nil) {
+    var dense = tensor
+    if tensor.strides != tensor.shape.strides(for: tensor.order) {
+      dense = Tensor(like: tensor)
+      copyElements(from: tensor, to: &dense)
+    }
+    let stored = dense.read()
+    pending.append((
+      name ?? tensor.name, String(describing: E.self),
+      MemoryLayout<E.Stored>.size, tensor.shape.array, tensor.order,
+      UnsafeRawBufferPointer(stored), dense))
+  }
+
+  //--------------------------------------------------------------------------
+  /// write
+  /// writes the added tensors. The file is written under a temporary
+  /// name and renamed when it is complete, so an interrupted write never
+  /// replaces an existing checkpoint.
+  public func write() throws {
+    // lay out the element data
+    var entries: [CheckpointEntry] = []
+    var dataSize = 0
+    for tensor in pending {
+      let checksum = computesChecksums ? Checkpoint.checksum(tensor.bytes) : nil
+      entries.append(CheckpointEntry(
+        name: tensor.name, elementType: tensor.type, storedSize: tensor.size,
+        shape: tensor.shape, order: tensor.order, offset: dataSize,
+        byteCount: tensor.bytes.count, checksum: checksum))
+      dataSize = alignUp(dataSize + tensor.bytes.count)
+    }
+    let index = try JSONEncoder().encode(entries)
+    let dataOffset = alignUp(Checkpoint.headerSize + index.count)
+
+    // the fixed header
+    var header = [UInt8](repeating: 0, count: Checkpoint.headerSize)
+    header.replaceSubrange(0..<8, with: Checkpoint.magic)
+    header.withUnsafeMutableBytes {
+      $0.storeBytes(of: Checkpoint.version.littleEndian, toByteOffset: 8, as: UInt32.self)
+      $0.storeBytes(of: UInt64(index.count).littleEndian, toByteOffset: 16, as: UInt64.self)
+      $0.storeBytes(of: UInt64(dataOffset).littleEndian, toByteOffset: 24, as: UInt64.self)
+    }
+
+    let tempPath = path + ".partial"
+    let fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0o644)
+    guard fd >= 0 else { throw Checkpoint.failure("open", tempPath) }
+    var isClosed = false
+    defer {
+      if !isClosed {
+        close(fd)
+        unlink(tempPath)
+      }
+    }
+    guard ftruncate(fd, off_t(dataOffset + dataSize)) == 0 else {
+      throw Checkpoint.failure("truncate", tempPath)
+    }
+    try header.withUnsafeBytes { try writeAll(fd, $0, at: 0) }
+    try index.withUnsafeBytes { try writeAll(fd, $0, at: Checkpoint.headerSize) }
+
+    // the element data in parallel chunks
+    let requests = zip(pending, entries).flatMap { tensor, entry in
+      Checkpoint.chunks(
+        byteCount: entry.byteCount, fileOffset: dataOffset + entry.offset
+      ).map { (tensor.bytes.baseAddress! + $0.offset, $0.count, $0.fileOffset) }
+    }
+    var error: Error?
+    let mutex = Mutex()
+    CpuThreadPool.shared.parallelFor(requests.count) {
+      for i in $0 {
+        let (start, count, fileOffset) = requests[i]
+        do {
+          try writeAll(fd, UnsafeRawBufferPointer(start: start, count: count), at: fileOffset)
+        } catch let e {
+          mutex.access { error = e }
+        }
+      }
+    }
+    if let error = error { throw error }
+
+    guard fsync(fd) == 0 else { throw Checkpoint.failure("sync", tempPath) }
+    close(fd)
+    isClosed = true
+    guard rename(tempPath, path) == 0 else {
+      unlink(tempPath)
+      throw Checkpoint.failure("rename", path)
+    }
+    diagnostic(
+      .copy, "\(path) \(entries.count) tensors [\(dataOffset + dataSize) bytes]",
+      categories: .dataCopy)
+  }
+
+  func alignUp(_ offset: Int) -> Int {
+    (offset + Checkpoint.alignment - 1) / Checkpoint.alignment * Checkpoint.alignment
+  }
+
+  func writeAll(_ fd: Int32, _ bytes: UnsafeRawBufferPointer, at offset: Int) throws {
+    var done = 0
+    while done < bytes.count {
+      let n = pwrite(
+        fd, bytes.baseAddress! + done, bytes.count - done, off_t(offset + done))
+      guard n > 0 else { throw Checkpoint.failure("write", path) }
+      done += n
+    }
+  }
+}
+
+//==============================================================================
+/// CheckpointReader
+/// Reads tensors from a checkpoint file, either by copying them into new
+/// storage or by mapping them in place
+public final class CheckpointReader {
+  /// the path of the checkpoint file
+  public let path: String
+  /// the tensor entries in the order they were written
+  public let entries: [CheckpointEntry]
+  /// the file offset of the data section
+  public let dataOffset: Int
+  /// `true` to verify the checksums of tensors that are read
+  public var verifiesChecksums: Bool
+
+  @usableFromInline let fd: Int32
+  // the whole file mapped on first use by `map`
+  var mappedFile: MappedFile?
+
+  //--------------------------------------------------------------------------
+  /// - Parameters:
+  ///  - path: the path of the checkpoint file
+  ///  - verifiesChecksums: `true` to verify the checksums of tensors
+  ///    that are read
+  public init(path: String, verifiesChecksums: Bool = true) throws {
+    let fd = open(path, O_RDONLY)
+    guard fd >= 0 else { throw Checkpoint.failure("open", path) }
+    do {
+      var header = [UInt8](repeating: 0, count: Checkpoint.headerSize)
+      try header.withUnsafeMutableBytes {
+        try CheckpointReader.readAll(fd, $0, at: 0, path)
+      }
+      guard Array(header[0..<8]) == Checkpoint.magic else {
+        throw PlatformError.rangeError("\(path) is not a checkpoint")
+      }
+      let (version, indexCount, dataOffset) = header.withUnsafeBytes {
+        (UInt32(littleEndian: $0.load(fromByteOffset: 8, as: UInt32.self)),
+         Int(UInt64(littleEndian: $0.load(fromByteOffset: 16, as: UInt64.self))),
+         Int(UInt64(littleEndian: $0.load(fromByteOffset: 24, as: UInt64.self))))
+      }
+      guard version == Checkpoint.version else {
+        throw PlatformError.rangeError(
+          "\(path) checkpoint version \(version) is not supported")
+      }
+
+      var index = Data(count: indexCount)
+      try index.withUnsafeMutableBytes {
+        try CheckpointReader.readAll(fd, $0, at: Checkpoint.headerSize, path)
+      }
+      entries = try JSONDecoder().decode([CheckpointEntry].self, from: index)
+      self.dataOffset = dataOffset
+    } catch {
+      close(fd)
+      throw error
+    }
+    self.fd = fd
+    self.path = path
+    self.verifiesChecksums = verifiesChecksums
+  }
+
+  deinit {
+    close(fd)
+  }
+
+  //--------------------------------------------------------------------------
+  /// entry(_:
+  /// - Returns: the entry with the specified name
+  public func entry(_ name: String) -> CheckpointEntry? {
+    entries.first { $0.name == name }
+  }
+
+  //--------------------------------------------------------------------------
+  /// read(_:as:
+  /// reads a tensor into new storage
+  /// - Parameters:
+  ///  - name: the name of the tensor
+  ///  - type: the tensor type
+  /// - Returns: the tensor
+  public func read<S, E>(
+    _ name: String,
+    as type: Tensor<S, E>.Type = Tensor<S, E>.self
+  ) throws -> Tensor<S, E> {
+    let entry = try validate(name, type)
+    var tensor = Tensor<S, E>(
+      shape: S(entry.shape), order: entry.order, name: entry.name)
+    let buffer = UnsafeMutableRawBufferPointer(tensor.readWrite())
+
+    let requests = Checkpoint.chunks(
+      byteCount: entry.byteCount, fileOffset: dataOffset + entry.offset)
+    var error: Error?
+    let mutex = Mutex()
+    CpuThreadPool.shared.parallelFor(requests.count) {
+      for i in $0 {
+        let request = requests[i]
+        do {
+          try CheckpointReader.readAll(
+            fd, UnsafeMutableRawBufferPointer(
+              rebasing: buffer[request.offset..<(request.offset + request.count)]),
+            at: request.fileOffset, path)
+        } catch let e {
+          mutex.access { error = e }
+        }
+      }
+    }
+    if let error = error { throw error }
+    try verify(entry, UnsafeRawBufferPointer(buffer))
+    return tensor
+  }
+
+  //--------------------------------------------------------------------------
+  /// map(_:as:access:
+  /// creates a tensor over the element data of the memory mapped file,
+  /// without copying. The checksum is not verified, because that would
+  /// read every page.
+  /// - Parameters:
+  ///  - name: the name of the tensor
+  ///  - type: the tensor type
+  ///  - access: the access mode of the mapping
+  /// - Returns: the tensor
+  public func map<S, E>(
+    _ name: String,
+    as type: Tensor<S, E>.Type = Tensor<S, E>.self,
+    access: MappedFile.Access = .readOnly
+  ) throws -> Tensor<S, E> {
+    let entry = try validate(name, type)
+    let file: MappedFile
+    if let mapped = mappedFile, mapped.access == access {
+      file = mapped
+    } else {
+      file = try MappedFile(path: path, access: access)
+      mappedFile = file
+    }
+    return Tensor<S, E>(
+      mapping: file, at: dataOffset + entry.offset, shape: S(entry.shape),
+      order: entry.order, name: entry.name)
+  }
+
+  //--------------------------------------------------------------------------
+  func validate<S, E>(
+    _ name: String,
+    _ type: Tensor<S, E>.Type
+  ) throws -> CheckpointEntry {
+    guard let entry = entry(name) else {
+      throw PlatformError.rangeError("\(name) is not in \(path)")
+    }
+    guard entry.elementType == String(describing: E.self)
+      && entry.storedSize == MemoryLayout<E.Stored>.size
+      && entry.shape.count == S.rank
+    else {
+      throw PlatformError.rangeError(
+        "\(name) is \(entry.elementType)\(entry.shape) in \(path), "
+          + "not Tensor<\(S.self), \(E.self)>")
+    }
+    return entry
+  }
+
+  func verify(_ entry: CheckpointEntry, _ bytes: UnsafeRawBufferPointer) throws {
+    guard verifiesChecksums, let expected = entry.checksum else { return }
+    guard Checkpoint.checksum(bytes) == expected else {
+      throw PlatformError.rangeError("\(entry.name) in \(path) is corrupt")
+    }
+  }
+
+  static func readAll(
+    _ fd: Int32,
+    _ bytes: UnsafeMutableRawBufferPointer,
+    at offset: Int,
+    _ path: String
+  ) throws {
+    var done = 0
+    while done < bytes.count {
+      let n = pread(
+        fd, bytes.baseAddress! + done, bytes.count - done, off_t(offset + done))
+      guard n > 0 else {
+        if n == 0 { throw PlatformError.rangeError("\(path) is truncated") }
+        throw Checkpoint.failure("read", path)
+      }
+      done += n
+    }
+  }
+}
@@ -514,8 +514,11 @@ extension Tensor {
       copyElements(from: self, to: &expanded)
       self = expanded
 
-    } else if !(isKnownUniquelyReferenced(&storage) || isShared) {
-      // if not uniquely held then copy before creating the shared view
+    } else if !(isKnownUniquelyReferenced(&storage) || isShared)
+      || storage.isReadOnly
+    {
+      // if not uniquely held or read only, then copy before creating
+      // the shared view
       diagnostic(
         .mutate, "\(storage.name) \(Element.self)[\(count)] on \(queue.name)",
         categories: [.dataCopy, .dataMutation])
@@ -561,6 +564,7 @@ extension Tensor {
     let (i, storedCount) =
       TensorElement
       .storedRange(start: storageBase, count: spanCount)
+    if Tracer.shared.isEnabled { traceAccess(storedCount) }
 
     return storage.read(
       type: TensorElement.Stored.self,
@@ -609,6 +613,7 @@ extension Tensor {
     let (i, storedCount) =
       TensorElement
       .storedRange(start: storageBase, count: spanCount)
+    if Tracer.shared.isEnabled { traceAccess(storedCount) }
 
     return storage.readWrite(
       type: TensorElement.Stored.self,
@@ -628,6 +633,14 @@ extension Tensor {
   ) -> UnsafeMutableRawPointer {
     UnsafeMutableRawPointer(readWrite(using: queue).baseAddress!)
   }
+
+  //----------------------------------------------------------------------------
+  /// adds this tensor to the operands of the op being traced
+  @inlinable func traceAccess(_ storedCount: Int) {
+    Tracer.shared.operand(
+      "\(name)\(shape.array)",
+      bytes: storedCount * MemoryLayout<TensorElement.Stored>.size)
+  }
 }
 
 //==============================================================================
@@ -655,3 +668,38 @@ extension Tensor {
     }
   }
 }
+
+//==============================================================================
+/// TensorVersion
+/// Identifies the elements of a tensor at the time the version was taken,
+/// without retaining the tensor storage. A value derived from a tensor,
+/// such as a packed weight, keeps the version of its source so that a
+/// replaced or written source is detected without making the source
+/// storage non unique, which would copy it on the next in place update.
+public struct TensorVersion<Shape: TensorShape>: Equatable {
+  /// the id of the storage
+  public let storageId: Int
+  /// the storage `writeVersion`
+  public let writeVersion: Int
+  /// the storage index of the first element
+  public let storageBase: Int
+  /// the tensor shape
+  public let shape: Shape
+  /// the tensor strides
+  public let strides: Shape
+
+  @inlinable public init<E>(of tensor: Tensor<Shape, E>) {
+    storageId = tensor.storage.id
+    writeVersion = tensor.storage.writeVersion
+    storageBase = tensor.storageBase
+    shape = tensor.shape
+    strides = tensor.strides
+  }
+}
+
+extension Tensor {
+  /// the version of the tensor elements
+  @inlinable public var version: TensorVersion<Shape> {
+    TensorVersion(of: self)
+  }
+}
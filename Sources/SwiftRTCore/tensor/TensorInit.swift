@@ -81,6 +81,53 @@ extension Tensor {
       shared: false)
   }
 
+  //--------------------------------------------------------------------------
+  /// init(mapping:at:shape:order:name:
+  /// creates a dense tensor over elements stored in a memory mapped file.
+  /// The elements are not copied, and the tensor keeps the mapping alive.
+  /// - Parameters:
+  ///  - file: the mapped file
+  ///  - byteOffset: the offset of the first stored element in the mapping
+  ///  - shape: the n-dimensional shape of the tensor
+  ///  - order: the storage order of the elements
+  ///  - name: the name of the tensor
+  @inlinable public init(
+    mapping file: MappedFile,
+    at byteOffset: Int = 0,
+    shape: Shape,
+    order: Order = .defaultOrder,
+    name: String = defaultTensorName
+  ) {
+    let count = shape.elementCount()
+    let storage = Platform.Storage(
+      mapping: file,
+      type: TensorElement.Stored.self,
+      at: byteOffset,
+      count: TensorElement.storedCount(count),
+      name: name)
+    self.init(
+      shape: shape,
+      strides: shape.strides(for: order),
+      count: count,
+      storage: storage,
+      storageBase: 0,
+      spanCount: count,
+      order: order,
+      shared: false)
+  }
+
+  @inlinable public init(
+    mapping file: MappedFile,
+    at byteOffset: Int = 0,
+    shape: Shape.Tuple,
+    order: Order = .defaultOrder,
+    name: String = defaultTensorName
+  ) {
+    self.init(
+      mapping: file, at: byteOffset, shape: Shape(shape),
+      order: order, name: name)
+  }
+
   //--------------------------------------------------------------------------
   /// init(like:
   /// convenience initializer to initialize with the shape and type as `other`
@@ -89,7 +89,7 @@ where Shape: TensorShape,
         self.dilations = dilations
 
         self.bias = bias ??
-            TensorR1<FilterElement>(zeros: [filter.shape[1]],
+            TensorR1<FilterElement>(zeros: [filter.shape[Shape.rank - 1]],
                                     order: filter.order)
 
         // create the device op and save the output shape
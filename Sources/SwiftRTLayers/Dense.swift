@@ -13,6 +13,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
+import Numerics
 import SwiftRTCore
 #if canImport(TensorFlow)
 
@@ -21,7 +22,7 @@ import SwiftRTCore
 public struct Dense<S,E> : Layer
 where S: TensorShape,
       E: StorageElement,
-      E.Value: DifferentiableNumeric & BinaryFloatingPoint
+      E.Value: DifferentiableNumeric & BinaryFloatingPoint & Real
 {
     /// The element-wise activation function.
     @noDerivative public let activation: ActivationType
@@ -31,11 +32,67 @@ where S: TensorShape,
     public var weight: Tensor<S,E>
     /// The bias
     public var bias: Tensor<S,E>
+    /// caches `weight` packed into the gemm panel layout. It keeps only
+    /// the version of `weight`, so an optimizer can update `weight` in
+    /// place without copying it.
+    @noDerivative public let packedWeight: PackedMatrixCache<E>
     
     //--------------------------------------------------------------------------
+    /// Returns `activation(input * weight + bias)`. The weight is packed
+    /// on the first call and the packing is reused until `weight` changes,
+    /// and the bias and activation are fused into the gemm epilogue.
     @differentiable
     public func callAsFunction(_ input: Tensor<S,E>) -> Tensor<S,E> {
-        input
+        forward(input)
+    }
+}
+
+extension Dense {
+    /// Returns the rank 2 view of `tensor` whose columns are its last axis.
+    @inlinable func matrix(_ tensor: Tensor<S,E>) -> TensorR2<E> {
+        let cols = tensor.shape[S.rank - 1]
+        return TensorR2<E>(reshaping: tensor,
+                           to: Shape2(tensor.count / cols, cols))
+    }
+
+    /// Returns the layer output computed by the packed gemm kernel.
+    @inlinable func forward(_ input: Tensor<S,E>) -> Tensor<S,E> {
+        assert(S.rank == 2, "only rank 2 dense layers are supported")
+        let (x, w) = (matrix(input), matrix(weight))
+        // the weight is packed for the blocking the gemm runs with
+        let blocking = CpuGemmBlocking.plan(
+            for: E.self, m: x.shape[0], k: w.shape[0], n: w.shape[1])
+        let y = matmul(x, packedWeight.packing(of: w, blocking: blocking),
+                       bias: TensorR1<E>(reshaping: bias, to: Shape1(bias.count)),
+                       activation: activation)
+        var shape = input.shape
+        shape[S.rank - 1] = y.shape[1]
+        return Tensor<S,E>(reshaping: y, to: shape)
+    }
+
+    // the fused forward isn't differentiable, so the pullback is
+    // expressed with unfused ops
+    @derivative(of: callAsFunction)
+    @usableFromInline func _vjpCallAsFunction(_ input: Tensor<S,E>) -> (
+        value: Tensor<S,E>,
+        pullback: (Tensor<S,E>) -> (TangentVector, Tensor<S,E>)
+    ) {
+        let y = forward(input)
+        let derivative = activation.derivative(E.Value.self)
+        return (y, { [weight, bias] g in
+            // the activation derivative is a function of its output
+            var dy = Tensor<S,E>(like: g)
+            currentQueue.mapOp(y, g, &dy) { $1 * derivative($0) }
+            let dyMatrix = matrix(dy)
+            let dWeight = matmul(matrix(input), transposed: true, dyMatrix)
+            let dBias = dyMatrix.sum(axis: 0)
+            let dInput = matmul(dyMatrix, matrix(weight), transposed: true)
+            return (
+                TangentVector(
+                    weight: Tensor<S,E>(reshaping: dWeight, to: weight.shape),
+                    bias: Tensor<S,E>(reshaping: dBias, to: bias.shape)),
+                Tensor<S,E>(reshaping: dInput, to: input.shape))
+        })
     }
 }
 
@@ -49,24 +106,20 @@ public extension Dense where S == Shape2 {
                 bias.shape[0] == weight.shape[1])
         self.activation = activation
         self.weight = weight
-        self.bias = Tensor<S,E>(reshaping: bias, to: weight.shape,
+        self.packedWeight = PackedMatrixCache()
+        // the bias is a row vector added to each row of the product
+        self.bias = Tensor<S,E>(reshaping: bias,
+                                to: Shape2(1, bias.shape[0]),
                                 order: weight.order)
     }
 }
-public extension Dense where S == Shape3 {
 
-    @inlinable init(
-        weight: TensorR3<E>,
-        bias: TensorR2<E>,
-        activation: ActivationType
-    ) {
-        assert(weight.order == bias.order &&
-                bias.shape[0] == weight.shape[1] &&
-                bias.shape[1] == weight.shape[2])
-        self.activation = activation
-        self.weight = weight
-        self.bias = Tensor<S,E>(reshaping: bias, to: weight.shape,
-                                order: weight.order)
+public extension Dense where S == Shape2 {
+    /// Returns the inference output `activation(input * weight + bias)`.
+    @inlinable func callAsFunction(inferring input: TensorR2<E>)
+        -> TensorR2<E>
+    {
+        forward(input)
     }
 }
 
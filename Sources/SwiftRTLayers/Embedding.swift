@@ -62,6 +62,35 @@ where Element: StorageElement,
     public func callAsFunction(_ input: TensorR1<DeviceIndex>) -> TensorR2<Element> {
         embeddings.gathering(indices: input)
     }
+
+    /// Returns the gradient of the embeddings for a lookup as the summed
+    /// rows of the distinct indices, so a gradient the size of the table
+    /// is never allocated.
+    ///
+    /// - Parameters:
+    ///   - input: The indices that were mapped to their vector representations.
+    ///   - outputGradient: The gradient of the lookup output.
+    /// - Returns: The gradient rows and their indices in the embeddings table.
+    public func sparseGradient(
+        at input: TensorR1<DeviceIndex>,
+        outputGradient: TensorR2<Element>
+    ) -> SparseRows<Shape2, Element> {
+        segmentSum(outputGradient, indices: input, rows: embeddings.shape[0])
+    }
+
+    /// Adds a sparse gradient scaled by `scale` to the embeddings, for
+    /// example with a scale of `-learningRate` for gradient descent. Only
+    /// the rows of the gradient are written.
+    ///
+    /// - Parameters:
+    ///   - gradient: The gradient returned by `sparseGradient`.
+    ///   - scale: The factor applied to the gradient rows.
+    public mutating func update(
+        with gradient: SparseRows<Shape2, Element>,
+        scale: Element.Value
+    ) {
+        gradient.add(to: &embeddings, scale: scale)
+    }
 }
 
 #endif
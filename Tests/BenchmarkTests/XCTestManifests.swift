@@ -19,7 +19,10 @@ import XCTest
 #if !canImport(ObjectiveC)
   public func allTests() -> [XCTestCaseEntry] {
     return [
-      testCase(test_perfFractals.allTests)
+      testCase(test_perfFractals.allTests),
+      testCase(test_perfMemoryPool.allTests),
+      testCase(test_perfReductions.allTests),
+      testCase(test_perfVectorMath.allTests),
     ]
   }
 #endif
@@ -0,0 +1,59 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import SwiftRT
+import XCTest
+
+final class test_perfMemoryPool: XCTestCase {
+  //==========================================================================
+  // support terminal test run
+  static var allTests = [
+    ("test_poolSmall", test_poolSmall),
+    ("test_mallocSmall", test_mallocSmall),
+    ("test_poolLarge", test_poolLarge),
+    ("test_mallocLarge", test_mallocLarge),
+  ]
+
+  //--------------------------------------------------------------------------
+  // the pool is measured against the system allocator for the same
+  // sequence of allocate and free pairs
+  func allocate(pool: Bool, byteCount: Int) {
+    #if !DEBUG
+      let memoryPool = CpuMemoryPool()
+      let sizes = (0..<64).map { byteCount + $0 * 64 }
+      measure {
+        for _ in 0..<10_000 {
+          for size in sizes {
+            if pool {
+              memoryPool.deallocate(memoryPool.allocate(byteCount: size))
+            } else {
+              UnsafeMutableRawPointer.allocate(
+                byteCount: size, alignment: CpuMemoryPool.alignment
+              ).deallocate()
+            }
+          }
+        }
+      }
+      XCTAssert(!pool || memoryPool.statistics.hitRate > 0.99)
+    #endif
+  }
+
+  func test_poolSmall() { allocate(pool: true, byteCount: 256) }
+  func test_mallocSmall() { allocate(pool: false, byteCount: 256) }
+  func test_poolLarge() { allocate(pool: true, byteCount: 1 << 20) }
+  func test_mallocLarge() { allocate(pool: false, byteCount: 1 << 20) }
+}
@@ -0,0 +1,55 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import SwiftRT
+import XCTest
+
+final class test_perfReductions: XCTestCase {
+  //==========================================================================
+  // support terminal test run
+  static var allTests = [
+    ("test_sumFast", test_sumFast),
+    ("test_sumReproducible", test_sumReproducible),
+    ("test_sumCompensated", test_sumCompensated),
+    ("test_sumAxisReproducible", test_sumAxisReproducible),
+  ]
+
+  // 64M elements, 256MB
+  lazy var a = array(0..<(1 << 26), shape: (1 << 13, 1 << 13), type: Float.self)
+
+  //--------------------------------------------------------------------------
+  // the cost of each reduction mode is measured against `.fast`
+  func sum(_ mode: ReductionMode, axis: Int? = nil) {
+    #if !DEBUG
+      var result = empty(shape: (1, 1))
+      using(reductionMode: mode) {
+        measure {
+          for _ in 0..<10 {
+            result = a.sum(axis: axis)
+          }
+          currentQueue.waitForCompletion()
+        }
+      }
+      XCTAssert(result.count > 0)
+    #endif
+  }
+
+  func test_sumFast() { sum(.fast) }
+  func test_sumReproducible() { sum(.reproducible) }
+  func test_sumCompensated() { sum(.compensated) }
+  func test_sumAxisReproducible() { sum(.reproducible, axis: 0) }
+}
@@ -0,0 +1,68 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+import Foundation
+import SwiftRT
+import XCTest
+
+final class test_perfVectorMath: XCTestCase {
+  //==========================================================================
+  // support terminal test run
+  static var allTests = [
+    ("test_expVector", test_expVector),
+    ("test_expScalar", test_expScalar),
+    ("test_tanhVector", test_tanhVector),
+    ("test_tanhScalar", test_tanhScalar),
+    ("test_sigmoidVector", test_sigmoidVector),
+    ("test_sigmoidScalar", test_sigmoidScalar),
+    ("test_geluVector", test_geluVector),
+    ("test_geluScalar", test_geluScalar),
+  ]
+
+  // 16M elements, 64MB
+  lazy var a = array(0..<(1 << 24), shape: (1 << 12, 1 << 12), type: Float.self)
+    / Float(1 << 20) - 8
+
+  //--------------------------------------------------------------------------
+  // the vector kernels are measured against the scalar Numerics functions
+  func apply(
+    vector: Bool,
+    _ body: (Tensor2) -> Tensor2
+  ) {
+    #if !DEBUG
+      var result = empty(shape: (1, 1))
+      let saved = useVectorMath
+      useVectorMath = vector
+      defer { useVectorMath = saved }
+      measure {
+        for _ in 0..<10 {
+          result = body(a)
+        }
+        currentQueue.waitForCompletion()
+      }
+      XCTAssert(result.count > 0)
+    #endif
+  }
+
+  func test_expVector() { apply(vector: true) { exp($0) } }
+  func test_expScalar() { apply(vector: false) { exp($0) } }
+  func test_tanhVector() { apply(vector: true) { tanh($0) } }
+  func test_tanhScalar() { apply(vector: false) { tanh($0) } }
+  func test_sigmoidVector() { apply(vector: true) { sigmoid($0) } }
+  func test_sigmoidScalar() { apply(vector: false) { sigmoid($0) } }
+  func test_geluVector() { apply(vector: true) { gelu($0) } }
+  func test_geluScalar() { apply(vector: false) { gelu($0) } }
+}
@@ -34,6 +34,7 @@ class test_AlgebraicField: XCTestCase {
     ("test_add", test_add),
     ("test_addRanked", test_addRanked),
     ("test_addStrided", test_addStrided),
+    ("test_stridedBroadcastOps", test_stridedBroadcastOps),
     ("test_addFloat16", test_addFloat16),
     ("test_addBFloat16", test_addBFloat16),
     
@@ -61,6 +62,9 @@ class test_AlgebraicField: XCTestCase {
     
     ("test_queryMatmulProperties", test_queryMatmulProperties),
     ("test_matmul", test_matmul),
+    ("test_packedMatmul", test_packedMatmul),
+    ("test_packedMatrixCache", test_packedMatrixCache),
+    ("test_matmulBiasActivation", test_matmulBiasActivation),
     ("test_batchMatmul", test_batchMatmul),
     ("test_leftBatchMatmul", test_leftBatchMatmul),
     ("test_rightBatchMatmul", test_rightBatchMatmul),
@@ -73,6 +77,23 @@ class test_AlgebraicField: XCTestCase {
     XCTAssert(b == [[2], [5], [8]])
   }
   
+  //--------------------------------------------------------------------------
+  // exercises the strided row kernels, including repeated operands
+  // and views whose rows are not contiguous
+  func test_stridedBroadcastOps() {
+    let a = array(0..<12, shape: (3, 4), type: Float.self)
+    let rows = repeating(array([1, 2, 3, 4], shape: (1, 4)), shape: (3, 4))
+    let cols = repeating(array([10, 20, 30], shape: (3, 1)), shape: (3, 4))
+    let view = a[..., 1..<3]
+
+    XCTAssert(a + rows == [[1, 3, 5, 7], [5, 7, 9, 11], [9, 11, 13, 15]])
+    XCTAssert(cols - a == [[10, 9, 8, 7], [16, 15, 14, 13], [22, 21, 20, 19]])
+    XCTAssert(view * view == [[1, 4], [25, 36], [81, 100]])
+    XCTAssert(view / 2 == [[0.5, 1], [2.5, 3], [4.5, 5]])
+    XCTAssert(max(view, 5) == [[5, 5], [5, 6], [9, 10]])
+    XCTAssert(min(a, rows) == [[0, 1, 2, 3], [1, 2, 3, 4], [1, 2, 3, 4]])
+  }
+
   //--------------------------------------------------------------------------
   func test_minimalAdd() {
     let a = array([[0, 1], [2, 3], [4, 5]], name: "a")
@@ -568,6 +589,98 @@ class test_AlgebraicField: XCTestCase {
     //                  [9, 9, 9, 9]])
   }
   
+  //--------------------------------------------------------------------------
+  func test_packedMatmul() {
+    // the column count is not a multiple of the panel width, so the
+    // last panel is padded
+    let a = array(0..<12, shape: (4, 3), type: Float.self)
+    let b = array(0..<33, shape: (3, 11), type: Float.self)
+    let packed = PackedMatrix(b)
+    XCTAssert(packed.isPacking(of: b, transposed: false))
+    XCTAssert(
+      matmul(a, packed) == [
+        [55, 58, 61, 64, 67, 70, 73, 76, 79, 82, 85],
+        [154, 166, 178, 190, 202, 214, 226, 238, 250, 262, 274],
+        [253, 274, 295, 316, 337, 358, 379, 400, 421, 442, 463],
+        [352, 382, 412, 442, 472, 502, 532, 562, 592, 622, 652],
+      ])
+
+    // transposed packing
+    let bt = array(0..<33, shape: (11, 3), type: Float.self)
+    let packedT = PackedMatrix(bt, transposed: true)
+    XCTAssert(
+      matmul(a, packedT) == [
+        [5, 14, 23, 32, 41, 50, 59, 68, 77, 86, 95],
+        [14, 50, 86, 122, 158, 194, 230, 266, 302, 338, 374],
+        [23, 86, 149, 212, 275, 338, 401, 464, 527, 590, 653],
+        [32, 122, 212, 302, 392, 482, 572, 662, 752, 842, 932],
+      ])
+
+    // a copy of the source that is mutated is detected as stale
+    var c = b
+    c[0, 0] = 42
+    XCTAssert(!packed.isPacking(of: c, transposed: false))
+
+    // the packing doesn't retain its source, so the source is updated
+    // in place and the write is detected
+    var d = array(0..<33, shape: (3, 11), type: Float.self)
+    let packedD = PackedMatrix(d)
+    let id = d.id
+    d[0, 0] = 42
+    XCTAssertEqual(d.id, id)
+    XCTAssert(!packedD.isPacking(of: d, transposed: false))
+  }
+
+  //--------------------------------------------------------------------------
+  // a weight updated in place is repacked without being copied
+  func test_packedMatrixCache() {
+    let cache = PackedMatrixCache<Float>()
+    var w = array([0, 1, 2, 3, 4, 5], shape: (2, 3))
+    let x = array([1, 1], shape: (1, 2))
+    let id = w.id
+
+    XCTAssert(matmul(x, cache.packing(of: w)) == [[3, 5, 7]])
+    XCTAssert(matmul(x, cache.packing(of: w)) == [[3, 5, 7]])
+    XCTAssertEqual(cache.packCount, 1)
+
+    for step in 1...3 {
+      w[0, 0] = Float(step)
+      XCTAssertEqual(w.id, id)
+      XCTAssert(matmul(x, cache.packing(of: w)) == [[Float(3 + step), 5, 7]])
+      XCTAssertEqual(cache.packCount, 1 + step)
+    }
+
+    // a packing for another panel width is replaced
+    let blocking = CpuGemmBlocking(rows: 2, panelWidth: 4)
+    let packed = cache.packing(of: w, blocking: blocking)
+    XCTAssertEqual(packed.panelWidth, 4)
+    XCTAssertEqual(cache.packCount, 5)
+    XCTAssert(matmul(x, packed) == [[6, 5, 7]])
+    XCTAssert(cache.packing(of: w, blocking: blocking) === packed)
+  }
+
+  //--------------------------------------------------------------------------
+  func test_matmulBiasActivation() {
+    let a = array([0, 1, 2, 3, 4, 5], shape: (3, 2))
+    let b = array([0, 1, 2, 3, 4, 5, 6, 7], shape: (2, 4))
+    let bias = array([-10, -20, -30, -40])
+    let c = matmul(a, b, bias: bias)
+    XCTAssert(
+      c == [
+        [-6, -15, -24, -33],
+        [2, -3, -8, -13],
+        [10, 9, 8, 7],
+      ])
+
+    let r = matmul(a, PackedMatrix(b), bias: bias, activation: .relu)
+    XCTAssert(
+      r == [
+        [0, 0, 0, 0],
+        [2, 0, 0, 0],
+        [10, 9, 8, 7],
+      ])
+  }
+
   //--------------------------------------------------------------------------
   func test_batchMatmul() {
     //        let a = array(0..<12, (2, 3, 2))
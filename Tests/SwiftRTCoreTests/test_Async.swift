@@ -25,6 +25,15 @@ class test_Async: XCTestCase {
     // ("test_queueSync", test_queueSync),
     ("test_perfCurrentQueue", test_perfCurrentQueue),
     ("test_discreteMemoryReplication", test_discreteMemoryReplication),
+    ("test_partialReplication", test_partialReplication),
+    ("test_changedChunks", test_changedChunks),
+    ("test_threadPool", test_threadPool),
+    ("test_pmapWorkers", test_pmapWorkers),
+    ("test_memoryPool", test_memoryPool),
+    ("test_memoryAccounting", test_memoryAccounting),
+    ("test_parallelMapOrdering", test_parallelMapOrdering),
+    ("test_lazyEvaluation", test_lazyEvaluation),
+    ("test_tracing", test_tracing),
     // ("test_multiQueueDependency", test_multiQueueDependency),
   ]
 
@@ -89,6 +98,277 @@ class test_Async: XCTestCase {
     XCTAssert(expected == [[0, 2], [4, 6], [8, 10]])
   }
 
+  //--------------------------------------------------------------------------
+  func test_partialReplication() {
+    #if canImport(SwiftRTCuda)
+      var a = array(0..<(1024 * 256), shape: (1024, 256), name: "a")
+      let gpu = Platform.discreteMemoryDeviceId
+      _ = using(device: gpu) { a + 1 }
+      XCTAssert(a.storage._lastAccessCopiedBytes == a.storage.byteCount)
+
+      // writing one element only copies the chunk that holds it
+      a[5, 3] = 7
+      let b: Tensor2 = using(device: gpu) { a + 1 }
+      XCTAssert(a.storage._lastAccessCopiedBytes <= a.storage.chunkSize)
+      XCTAssert(b[5, 3] == 8)
+    #endif
+  }
+
+  //--------------------------------------------------------------------------
+  // test_changedChunks
+  // writes to discrete storage are tracked in chunks on the cpu, so the
+  // ranges a replica copies don't need a discrete device to test
+  func test_changedChunks() {
+    let minSize = DiscreteStorage.minChunkSize
+    let maxCount = DiscreteStorage.maxChunkCount
+
+    // small buffers have chunks of the minimum size, and large buffers
+    // have at most the maximum number of chunks
+    let (size0, versions0) = DiscreteStorage.chunks(for: 100)
+    XCTAssert(size0 == minSize && versions0 == [-1])
+    let (size1, versions1) = DiscreteStorage.chunks(for: 3 * minSize + 1)
+    XCTAssert(size1 == minSize && versions1.count == 4)
+    let (size2, versions2) = DiscreteStorage.chunks(for: 2 * minSize * maxCount)
+    XCTAssert(size2 == 2 * minSize && versions2.count == maxCount)
+    XCTAssert(DiscreteStorage.chunks(for: 0).1.isEmpty)
+
+    // the last chunk is partial
+    let perChunk = minSize / MemoryLayout<Float>.size
+    let count = 4 * perChunk - 4
+    let storage = DiscreteStorage(
+      storedType: Float.self, count: count, name: "chunks")
+    XCTAssert(storage.chunkVersions == [-1, -1, -1, -1])
+    let queue = Platform.syncQueue
+    func write(_ index: Int, _ n: Int) {
+      _ = storage.readWrite(type: Float.self, at: index, count: n, using: queue)
+    }
+
+    // version 0 writes every chunk
+    write(0, count)
+    XCTAssert(storage.changedRanges(since: -1) == [0..<storage.byteCount])
+    XCTAssert(storage.changedRanges(since: 0).isEmpty)
+
+    // version 1 writes within chunk 1, version 2 spans chunks 2 and 3
+    write(perChunk + 1, 2)
+    XCTAssert(storage.changedRanges(since: 0) == [minSize..<(2 * minSize)])
+    write(3 * perChunk - 1, 2)
+    XCTAssert(storage.chunkVersions == [0, 1, 2, 2])
+    XCTAssert(storage.changedRanges(since: 0) == [minSize..<storage.byteCount])
+    XCTAssert(
+      storage.changedRanges(since: 1) == [(2 * minSize)..<storage.byteCount])
+
+    // version 3 writes chunk 0, so the changes are two separate runs
+    write(0, 1)
+    XCTAssert(storage.changedRanges(since: 2) == [0..<minSize])
+    XCTAssert(
+      storage.changedRanges(since: 1)
+        == [0..<minSize, (2 * minSize)..<storage.byteCount])
+  }
+
+  //--------------------------------------------------------------------------
+  func test_threadPool() {
+    // every index is visited exactly once across the chunks
+    let count = 100_003
+    var visits = [Int32](repeating: 0, count: count)
+    visits.withUnsafeMutableBufferPointer { visits in
+      CpuThreadPool.shared.parallelFor(count, grainSize: 100) {
+        for i in $0 { visits[i] += 1 }
+      }
+    }
+    XCTAssert(visits.allSatisfy { $0 == 1 })
+
+    // nested loops complete without deadlocking the pool
+    var grid = [Int32](repeating: 0, count: 64 * 10)
+    grid.withUnsafeMutableBufferPointer { grid in
+      CpuThreadPool.shared.parallelFor(64) {
+        for i in $0 {
+          CpuThreadPool.shared.parallelFor(10) {
+            for j in $0 { grid[i * 10 + j] += 1 }
+          }
+        }
+      }
+    }
+    XCTAssert(grid.allSatisfy { $0 == 1 })
+  }
+
+  //--------------------------------------------------------------------------
+  func test_pmapWorkers() {
+    XCTAssertEqual(CpuTopology.parseCpuList("0-3,8-11\n"), [0, 1, 2, 3, 8, 9, 10, 11])
+    XCTAssertEqual(CpuTopology.parseCpuList("5"), [5])
+    XCTAssertEqual(CpuTopology.parseCpuList("0,2-2,7"), [0, 2, 7])
+    XCTAssertEqual(CpuTopology.parseCpuList("3-1,x"), [])
+    XCTAssertEqual(CpuTopology.parseCpuList(""), [])
+
+    // partitions are assigned to nodes in contiguous blocks
+    let workers = PmapWorkers(topology: CpuTopology(nodes: [[0], [0]]))
+    defer { workers.shutdown() }
+    XCTAssertEqual((0..<4).map { workers.node(for: $0, of: 4) }, [0, 0, 1, 1])
+
+    // nested runs complete without deadlocking the workers
+    let mutex = Mutex()
+    var visits = [Int](repeating: 0, count: 8 * 8)
+    workers.run(8) { i in
+      workers.run(8) { j in
+        mutex.access { visits[i * 8 + j] += 1 }
+      }
+    }
+    XCTAssert(visits.allSatisfy { $0 == 1 })
+  }
+
+  //--------------------------------------------------------------------------
+  func test_memoryPool() {
+    XCTAssertEqual(CpuMemoryPool.blockSize(for: 1), 64)
+    XCTAssertEqual(CpuMemoryPool.blockSize(for: 1000), 1024)
+    XCTAssertEqual(CpuMemoryPool.blockSize(for: 1025), 1280)
+    XCTAssertEqual(CpuMemoryPool.blockSize(for: 3 << 20), 4 << 20)
+
+    // a freed buffer is handed out again for the same size class
+    let pool = CpuMemoryPool()
+    let a = pool.allocate(byteCount: 1000)
+    XCTAssertEqual(Int(bitPattern: a.baseAddress!) % CpuMemoryPool.alignment, 0)
+    pool.deallocate(a)
+    let b = pool.allocate(byteCount: 900)
+    XCTAssertEqual(a.baseAddress, b.baseAddress)
+
+    // large buffers are aligned to whole huge pages
+    // storage that owns a pool buffer reports the pool alignment
+    let t = empty(shape: (3, 4))
+    XCTAssertEqual(t.storage.alignment, CpuMemoryPool.alignment)
+
+    let large = pool.allocate(byteCount: 3 << 20)
+    XCTAssertEqual(
+      Int(bitPattern: large.baseAddress!) % CpuMemoryPool.hugePageSize, 0)
+
+    var stats = pool.statistics
+    XCTAssertEqual(stats.hits, 1)
+    XCTAssertEqual(stats.misses, 2)
+    XCTAssertEqual(stats.bytesReserved, 1024 + (4 << 20))
+    XCTAssertEqual(stats.bytesInUse, stats.bytesReserved)
+
+    pool.deallocate(b)
+    pool.deallocate(large)
+    stats = pool.statistics
+    XCTAssertEqual(stats.bytesCached, stats.bytesReserved)
+    XCTAssertEqual(stats.bytesInUse, 0)
+
+    pool.trim()
+    stats = pool.statistics
+    XCTAssertEqual(stats.bytesReserved, 0)
+    XCTAssertEqual(stats.peakBytesReserved, 1024 + (4 << 20))
+  }
+
+  //--------------------------------------------------------------------------
+  func test_memoryAccounting() {
+    let accounting = MemoryAccounting.shared
+    accounting.isTrackingNames = true
+    defer { accounting.isTrackingNames = false }
+    accounting.resetPeaks()
+    let before = accounting.snapshot
+
+    do {
+      var a = array(0..<1024, name: "weights")
+      let b = a + 1
+      XCTAssertEqual(b.count, 1024)
+
+      // live bytes are attributed to the tensor name
+      let step = accounting.snapshot
+      XCTAssertEqual(step.names["weights"], 4096)
+      XCTAssert(step.top(step.names.count).contains { $0.name == "weights" })
+      XCTAssertGreaterThanOrEqual(step.total.peakBytes, before.total.bytes + 8192)
+      XCTAssertGreaterThanOrEqual(step.devices[0]?.bytes ?? 0, 8192)
+
+      let diff = step.difference(from: before)
+      XCTAssertEqual(diff.names["weights"], 4096)
+      XCTAssertGreaterThanOrEqual(diff.bytes, 8192)
+      XCTAssertGreaterThanOrEqual(diff.allocations, 2)
+
+      // renaming moves the attribution
+      a.name = "renamed"
+      let renamed = accounting.snapshot
+      XCTAssertNil(renamed.names["weights"])
+      XCTAssertEqual(renamed.names["renamed"], 4096)
+    }
+
+    // released storage is no longer counted
+    let after = accounting.snapshot.difference(from: before)
+    XCTAssertNil(after.names["renamed"])
+    XCTAssertNil(after.names["weights"])
+
+    // bytes are counted without names when names aren't tracked
+    accounting.isTrackingNames = false
+    do {
+      let start = accounting.snapshot
+      let c = array(0..<1024, name: "untracked") + 1
+      XCTAssertEqual(c.count, 1024)
+      let diff = accounting.snapshot.difference(from: start)
+      XCTAssertGreaterThanOrEqual(diff.bytes, 8192)
+      XCTAssertNil(diff.names["untracked"])
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  func test_parallelMapOrdering() {
+    // large dependent elementwise ops on an async queue keep stream order
+    let a = array(0..<1_000_000)
+    let c: Tensor1 = using(device: 0, queue: 1) {
+      var r = a + 1
+      for _ in 0..<4 { r = r * 2 }
+      return r - 16
+    }
+    let ca = c.flatArray
+    XCTAssert(ca.indices.allSatisfy { ca[$0] == Float($0) * 16 })
+  }
+
+  //--------------------------------------------------------------------------
+  func test_tracing() {
+    let tracer = Tracer.shared
+    tracer.clear()
+    tracer.isEnabled = true
+    let a = array(0..<6, shape: (2, 3), name: "a")
+    let b = a + 1
+    let c = using(device: 0, queue: 1) { b * 2 }
+    XCTAssertEqual(c.flatArray, [2, 4, 6, 8, 10, 12])
+
+    // reads outside of an op aren't added to the next op
+    _ = a.flatArray
+    let d = array([1, 2, 3], name: "d") + 1
+    XCTAssertEqual(d.flatArray, [2, 3, 4])
+    tracer.isEnabled = false
+
+    // ops are named by their queue diagnostic and list their operands
+    let events = tracer.events
+    let add = events.first { $0.name == "add" }
+    XCTAssertNotNil(add)
+    XCTAssert(add?.operands.contains("a[2, 3]") ?? false)
+    XCTAssertEqual(add?.bytes, 2 * 6 * MemoryLayout<Float>.size)
+    let lastAdd = events.last { $0.name == "add" }
+    XCTAssert(lastAdd?.operands.contains("d[3]") ?? false)
+    XCTAssertFalse(lastAdd?.operands.contains("a[2, 3]") ?? true)
+    let mul = events.first { $0.name == "mul" }
+    XCTAssertNotNil(mul)
+    XCTAssertNotEqual(add?.queueId, mul?.queueId)
+    XCTAssert(events.allSatisfy { $0.end >= $0.begin })
+
+    // disabled tracing records nothing
+    let count = tracer.events.count
+    _ = a + 1
+    XCTAssertEqual(tracer.events.count, count)
+
+    // the export is valid Chrome trace json
+    do {
+      let data = try tracer.chromeTrace()
+      let json = try JSONSerialization.jsonObject(with: data) as? [String: Any]
+      let traceEvents = json?["traceEvents"] as? [[String: Any]] ?? []
+      XCTAssert(traceEvents.contains {
+        $0["name"] as? String == "add" && $0["ph"] as? String == "X"
+      })
+    } catch {
+      XCTFail(String(describing: error))
+    }
+    tracer.clear()
+    XCTAssert(tracer.events.isEmpty)
+  }
+
   //--------------------------------------------------------------------------
   func test_multiQueueDependency() {
     let a = array([[0, 1], [2, 3], [4, 5]], name: "a")
@@ -107,4 +387,83 @@ class test_Async: XCTestCase {
     let da = d.array
     XCTAssert(da == [[0.0, 3.0], [6.0, 9.0], [12.0, 15.0]])
   }
+
+  //--------------------------------------------------------------------------
+  // deferred elementwise ops are fused and match the eager results
+  func test_lazyEvaluation() {
+    let x = array(0..<12, shape: (3, 4)) - 6
+    let w = array(0..<12, shape: (3, 4)) / 4
+    let b = repeating(array([1, 2, 3, 4], shape: (1, 4)), shape: (3, 4))
+    let expected = (max(x * w + b, 0) * 2).flatArray
+    let expectedProduct = (x * w).flatArray
+
+    var product = empty(shape: (3, 4))
+    var result = empty(shape: (3, 4))
+    using(lazyEvaluation: true) {
+      // the sum and max are released intermediates
+      product = x * w
+      result = max(product + b, 0) * 2
+
+      // reading the result evaluates the graph
+      XCTAssert(result.flatArray == expected)
+    }
+    XCTAssert(product.flatArray == expectedProduct)
+
+    // pending results are computed when lazy evaluation ends
+    var y = empty(shape: (3, 4))
+    using(lazyEvaluation: true) {
+      y = max(x * w + b, 0) * 2
+    }
+    XCTAssert(y.flatArray == expected)
+
+    // deferred ops don't allocate, and only the live result is allocated
+    // when the graph is evaluated
+    let accounting = MemoryAccounting.shared
+    using(lazyEvaluation: true) {
+      let start = accounting.snapshot
+      let z = max(x * w + b, 0) * 2
+      XCTAssert(z.storage.pendingWriter != nil)
+      XCTAssert(x.storage.pendingReader != nil)
+      XCTAssert(accounting.snapshot.difference(from: start).allocations == 0)
+
+      XCTAssert(z.flatArray == expected)
+      XCTAssert(z.storage.pendingWriter == nil)
+      XCTAssert(x.storage.pendingReader == nil)
+      XCTAssert(accounting.snapshot.difference(from: start).allocations == 1)
+    }
+
+    // a graph whose results are all released is discarded unevaluated
+    using(lazyEvaluation: true) {
+      let start = accounting.snapshot
+      _ = exp(x * w) + 1
+      XCTAssert(x.storage.pendingReader == nil)
+      XCTAssert(accounting.snapshot.difference(from: start).allocations == 0)
+    }
+
+    // scalar operands, transcendentals and Double elements
+    let d = array([-2.0, -1, 0, 1, 2], type: Double.self)
+    let expectedD = (1 - exp(sigmoid(d) / 2) * tanh(d)).flatArray
+    let lazyD = using(lazyEvaluation: true) {
+      1 - exp(sigmoid(d) / 2) * tanh(d)
+    }
+    XCTAssert(lazyD.flatArray == expectedD)
+
+    // an operand written after it is recorded keeps its recorded value
+    var a = array([1, 2, 3])
+    var c = empty(shape: 3)
+    using(lazyEvaluation: true) {
+      c = squared(a) + 1
+      a[0] = 10
+      XCTAssert(c.flatArray == [2, 5, 10])
+    }
+
+    // column ordered and transposed operands keep their logical order
+    let col = array([[0, 1, 2], [3, 4, 5]], order: .col)
+    let expectedCol = (col * 2 + x[0..<2, 0..<3]).flatArray
+    let expectedT = (x.t + 1).flatArray
+    using(lazyEvaluation: true) {
+      XCTAssert((col * 2 + x[0..<2, 0..<3]).flatArray == expectedCol)
+      XCTAssert((x.t + 1).flatArray == expectedT)
+    }
+  }
 }
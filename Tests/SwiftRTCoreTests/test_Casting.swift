@@ -31,6 +31,7 @@ class test_Casting: XCTestCase {
     ("test_cast2Float", test_cast2Float),
     ("test_cast2Bool", test_cast2Bool),
     ("test_cast2Complex", test_cast2Complex),
+    ("test_castHalf", test_castHalf),
   ]
   
   //--------------------------------------------------------------------------
@@ -75,4 +76,28 @@ class test_Casting: XCTestCase {
     XCTAssert(cast(cf16, elementsTo: CF.self) == cf)
     #endif
   }
+
+  //--------------------------------------------------------------------------
+  // the count spans several conversion chunks and a partial one
+  func test_castHalf() {
+    let count = 3 * convertedChunkSize + 7
+    let values = (0..<count).map { Float($0 - count / 2) * 0.37 }
+    let f = array(values)
+
+    let bf16 = cast(f, elementsTo: BFloat16.self)
+    XCTAssert(bf16.array == values.map { Float(BFloat16($0)) })
+    XCTAssert(cast(bf16, elementsTo: Float.self).array == bf16.array)
+    XCTAssert((bf16 + bf16).array == bf16.array.map { Float(BFloat16($0 + $0)) })
+
+    let f16 = cast(f, elementsTo: Float16.self)
+    let back = cast(f16, elementsTo: Float.self)
+    XCTAssert(back.array == values.map { Float(Float16($0)) })
+
+    // special values round trip through the bulk conversions
+    let special: [Float] = [.infinity, -.infinity, 65520, 1e-7, -0.0, 0.5]
+    let s16 = cast(array(special), elementsTo: Float16.self)
+    XCTAssert(cast(s16, elementsTo: Float.self).array == special.map { Float(Float16($0)) })
+    let sbf16 = cast(array(special), elementsTo: BFloat16.self)
+    XCTAssert(cast(sbf16, elementsTo: Float.self).array == special.map { Float(BFloat16($0)) })
+  }
 }
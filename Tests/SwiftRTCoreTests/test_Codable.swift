@@ -26,6 +26,9 @@ class test_Codable: XCTestCase {
     ("test_Tensor2", test_Tensor2),
     ("test_RGBImage", test_RGBImage),
     ("test_RGBAImage", test_RGBAImage),
+    ("test_checkpoint", test_checkpoint),
+    ("test_executionPlans", test_executionPlans),
+    ("test_autotuner", test_autotuner),
   ]
 
   //==========================================================================
@@ -115,4 +118,198 @@ class test_Codable: XCTestCase {
       XCTFail(String(describing: error))
     }
   }
+
+  //==========================================================================
+  // test_checkpoint
+  // writes tensors to a binary checkpoint, then reads and maps them
+  func test_checkpoint() {
+    let path = NSTemporaryDirectory()
+      + "test_checkpoint_\(ProcessInfo.processInfo.processIdentifier).ckpt"
+    defer { try? FileManager.default.removeItem(atPath: path) }
+    do {
+      try usingSyncQueue {
+        let a = array([[0, 1, 2], [3, 4, 5]], name: "a")
+        let b = array(1..<6, type: Int32.self, name: "b")
+        // a strided view is written densely
+        let c = a[..., 1...2]
+
+        let writer = CheckpointWriter(path: path)
+        writer.add(a)
+        writer.add(b)
+        writer.add(c, name: "c")
+        // a transposed view spans dense storage, but isn't in row order
+        writer.add(a.t, name: "at")
+        try writer.write()
+
+        let reader = try CheckpointReader(path: path)
+        XCTAssert(reader.entries.map { $0.name } == ["a", "b", "c", "at"])
+        XCTAssert(reader.entries.allSatisfy {
+          ($0.offset + reader.dataOffset) % Checkpoint.alignment == 0
+        })
+        let a2 = try reader.read("a", as: Tensor2.self)
+        XCTAssert(a2 == [[0, 1, 2], [3, 4, 5]])
+        let b2 = try reader.read("b", as: TensorR1<Int32>.self)
+        XCTAssert(b2 == [1, 2, 3, 4, 5])
+        let c2 = try reader.map("c", as: Tensor2.self)
+        XCTAssert(c2 == [[1, 2], [4, 5]])
+        let at2 = try reader.read("at", as: Tensor2.self)
+        XCTAssert(at2 == [[0, 3], [1, 4], [2, 5]])
+
+        // the element type must match
+        XCTAssertThrowsError(try reader.read("b", as: Tensor1.self))
+      }
+    } catch {
+      XCTFail(String(describing: error))
+    }
+  }
+
+  //==========================================================================
+  // test_executionPlans
+  // plans are cached by key and persisted for the same cpu and version
+  func test_executionPlans() {
+    let path = NSTemporaryDirectory()
+      + "test_plans_\(ProcessInfo.processInfo.processIdentifier).json"
+    defer { try? FileManager.default.removeItem(atPath: path) }
+
+    // keys are stable and distinguish shapes and types
+    let key = CpuGemmBlocking.planKey(for: Float.self, m: 64, k: 32, n: 16)
+    XCTAssertEqual(key, CpuGemmBlocking.planKey(for: Float.self, m: 64, k: 32, n: 16))
+    XCTAssertNotEqual(key, CpuGemmBlocking.planKey(for: Double.self, m: 64, k: 32, n: 16))
+    XCTAssertNotEqual(key, CpuGemmBlocking.planKey(for: Float.self, m: 64, k: 16, n: 32))
+    // geometries of the same shape class share the key
+    XCTAssertEqual(
+      CpuGemmBlocking.planKeys.key(for: Float.self, m: 40, k: 32, n: 16), key)
+
+    // the least recently used plan is evicted
+    let lru = ExecutionPlans(capacity: 2)
+    lru.add(plan: 1, Int.self, key: 1)
+    lru.add(plan: 2, Int.self, key: 2)
+    XCTAssertEqual(lru.query(Int.self, key: 1), 1)
+    lru.add(plan: 3, Int.self, key: 3)
+    XCTAssertEqual(lru.count, 2)
+    XCTAssertNil(lru.query(Int.self, key: 2))
+    XCTAssertEqual(lru.query(Int.self, key: 1), 1)
+    // replacing a plan makes it the most recently used
+    lru.add(plan: 30, Int.self, key: 3)
+    lru.add(plan: 4, Int.self, key: 4)
+    XCTAssertEqual(lru.count, 2)
+    XCTAssertNil(lru.query(Int.self, key: 1))
+    XCTAssertEqual(lru.query(Int.self, key: 3), 30)
+    XCTAssertEqual(lru.query(Int.self, key: 4), 4)
+    lru.removeAll()
+    XCTAssertEqual(lru.count, 0)
+    lru.add(plan: 5, Int.self, key: 5)
+    XCTAssertEqual(lru.query(Int.self, key: 5), 5)
+
+    // keys whose hashes collide are distinct problems
+    let collision = ExecutionPlanKey(op: "collision", shapes: [], types: [])
+    let keys = ExecutionPlans()
+    keys.add(plan: 6, Int.self, key: collision.value)
+    XCTAssertNil(keys.query(Int.self, key: collision))
+    keys.add(plan: 7, Int.self, key: collision)
+    XCTAssertEqual(keys.query(Int.self, key: collision.value), 6)
+    XCTAssertEqual(keys.query(Int.self, key: collision), 7)
+
+    // codable plans are stored and loaded by a new process
+    let blocking = CpuGemmBlocking(rows: 2, panelWidth: 4)
+    let plans = ExecutionPlans(database: ExecutionPlanDatabase(path: path))
+    plans.add(plan: blocking, CpuGemmBlocking.self, key: key)
+    let loaded = ExecutionPlans(database: ExecutionPlanDatabase(path: path))
+    XCTAssertEqual(loaded.query(CpuGemmBlocking.self, key: key), blocking)
+
+    // a recorded miss isn't stored, and is replaced by a plan
+    let other = CpuGemmBlocking.planKey(for: Float.self, m: 8, k: 8, n: 8)
+    plans.addMissing(CpuGemmBlocking.self, key: other)
+    XCTAssertNil(plans.query(CpuGemmBlocking.self, key: other))
+    XCTAssertEqual(ExecutionPlanDatabase(path: path).count, 1)
+    plans.add(plan: blocking, CpuGemmBlocking.self, key: other)
+    XCTAssertEqual(plans.query(CpuGemmBlocking.self, key: other), blocking)
+
+    // a database written for another cpu or version is ignored
+    let otherCpu = ExecutionPlanDatabase(path: path, cpuModel: "other")
+    XCTAssert(otherCpu.wasInvalidated)
+    XCTAssertEqual(otherCpu.count, 0)
+    let otherVersion = ExecutionPlanDatabase(path: path, libraryVersion: "0")
+    XCTAssert(otherVersion.wasInvalidated)
+
+    // matmul uses the stored blocking
+    let saved = ExecutionPlans.shared
+    ExecutionPlans.shared = loaded
+    defer { ExecutionPlans.shared = saved }
+    let a = array(0..<(64 * 32), shape: (64, 32))
+    let b = array(0..<(32 * 16), shape: (32, 16))
+    let c = matmul(a, b)
+    ExecutionPlans.shared = ExecutionPlans()
+    XCTAssert(c == matmul(a, b))
+  }
+
+  //==========================================================================
+  // test_autotuner
+  // tuned plans are reused by problems of the same shape class, and the
+  // offline tune command writes the same file for the same winners
+  func test_autotuner() {
+    let base = NSTemporaryDirectory()
+      + "test_tune_\(ProcessInfo.processInfo.processIdentifier)"
+    let (first, second) = (base + "_1.json", base + "_2.json")
+    defer {
+      try? FileManager.default.removeItem(atPath: first)
+      try? FileManager.default.removeItem(atPath: second)
+    }
+
+    let tuner = CpuAutotuner()
+    tuner.timeBudget = 0.01
+    let plans = ExecutionPlans()
+    let blocking = tuner.tuneGemm(Float.self, m: 16, k: 32, n: 24, plans: plans)
+    XCTAssert(tuner.gemmCandidates.contains(blocking))
+    let key = CpuGemmBlocking.planKey(for: Float.self, m: 12, k: 32, n: 24)
+    XCTAssertEqual(plans.query(CpuGemmBlocking.self, key: key), blocking)
+
+    // a candidate must beat the best earlier time by the margin, and
+    // ties keep the earlier candidate
+    XCTAssertEqual(CpuAutotuner.fastest([100, 100, 100], margin: 0.05), 0)
+    XCTAssertEqual(CpuAutotuner.fastest([100, 97, 120], margin: 0.05), 0)
+    XCTAssertEqual(CpuAutotuner.fastest([100, 94, 91], margin: 0.05), 1)
+    XCTAssertEqual(CpuAutotuner.fastest([100, 97, 94], margin: 0.05), 2)
+    XCTAssertEqual(CpuAutotuner.fastest([100, 90, 80], margin: 0), 2)
+    XCTAssertEqual(CpuAutotuner.fastest([100, 1], margin: 1), 0)
+
+    // the timed convolution algorithms compute the same output
+    typealias Conv = Convolution<Shape4, Float, Float>
+    let x = array((0..<256).map { Float($0 % 11) / 4 - 1 }, shape: (1, 8, 8, 4))
+    let filter = array(
+      (0..<288).map { Float($0 % 13) / 8 - 0.75 }, shape: (3, 3, 4, 8))
+    let bias = array((0..<8).map { Float($0) / 4 })
+    var properties = ConvolutionProperties()
+    var outputs: [[Float]] = []
+    for algorithm in [ConvolutionFwdAlgorithm.direct, .gemm, .winograd] {
+      properties.forwardAlgorithm = algorithm
+      let conv = Conv(
+        filter: filter, bias: bias, padding: .same, properties: properties)
+      outputs.append(conv(x).flatArray)
+    }
+    for output in outputs.dropFirst() {
+      XCTAssert(zip(output, outputs[0]).allSatisfy { abs($0 - $1) < 1e-3 })
+    }
+
+    // without a margin a candidate can't replace the default, so the
+    // result doesn't depend on timing
+    tuner.margin = 1
+    let problems = CpuAutotuner.Problems(
+      gemm: [CpuAutotuner.GemmProblem(m: 8, k: 16, n: 16)],
+      convolution: [
+        CpuAutotuner.ConvolutionProblem(
+          data: [1, 8, 8, 4], filter: [3, 3, 4, 8], padding: "same"),
+      ])
+    do {
+      try tuner.tune(problems, output: first)
+      try tuner.tune(problems, output: second)
+      let stored = ExecutionPlanDatabase(path: first)
+      XCTAssertEqual(stored.count, 2)
+      XCTAssertEqual(
+        FileManager.default.contents(atPath: first),
+        FileManager.default.contents(atPath: second))
+    } catch {
+      XCTFail(String(describing: error))
+    }
+  }
 }
@@ -31,6 +31,7 @@ class test_Initialize: XCTestCase {
     ("test_complexRange", test_complexRange),
     ("test_copy", test_copy),
     ("test_copyOnWrite", test_copyOnWrite),
+    ("test_mappedFile", test_mappedFile),
     ("test_columnMajorDataView", test_columnMajorDataView),
     ("test_indenting", test_indenting),
     ("test_perfCreateTensorR2", test_perfCreateTensorR2),
@@ -90,6 +91,39 @@ class test_Initialize: XCTestCase {
     XCTAssert(b[1, 1] == 7)
   }
 
+  //--------------------------------------------------------------------------
+  func test_mappedFile() {
+    // a 16 byte header followed by 6 Float elements
+    let path = NSTemporaryDirectory()
+      + "test_mappedFile_\(ProcessInfo.processInfo.processIdentifier).bin"
+    defer { try? FileManager.default.removeItem(atPath: path) }
+    var data = Data(count: 16)
+    (0..<6).map { Float($0) }.withUnsafeBytes { data.append(contentsOf: $0) }
+    XCTAssert(FileManager.default.createFile(atPath: path, contents: data))
+
+    do {
+      // a read only mapping is copied before it is written
+      let file = try MappedFile(path: path, advice: .sequential)
+      var a = Tensor2(mapping: file, at: 16, shape: (3, 2))
+      XCTAssert(a == [[0, 1], [2, 3], [4, 5]])
+      a[1, 1] = 7
+      XCTAssert(a == [[0, 1], [2, 7], [4, 5]])
+      let b = Tensor2(mapping: file, at: 16, shape: (3, 2))
+      XCTAssert(b == [[0, 1], [2, 3], [4, 5]])
+
+      // a copy on write mapping is written in place without
+      // changing the file
+      let copied = try MappedFile(path: path, offset: 16, access: .copyOnWrite)
+      var c = Tensor1(mapping: copied, shape: 6)
+      c[0] = 9
+      XCTAssert(c == [9, 1, 2, 3, 4, 5])
+      let unchanged = try MappedFile(path: path, offset: 16)
+      XCTAssert(Tensor1(mapping: unchanged, shape: 6) == [0, 1, 2, 3, 4, 5])
+    } catch {
+      XCTFail(String(describing: error))
+    }
+  }
+
   //--------------------------------------------------------------------------
   //   0, 1,
   //   2, 3,
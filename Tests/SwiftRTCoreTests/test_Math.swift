@@ -36,6 +36,7 @@ class test_Math: XCTestCase {
     ("test_neg", test_neg),
     ("test_sign", test_sign),
     ("test_squared", test_squared),
+    ("test_vectorMath", test_vectorMath),
   ]
 
   //--------------------------------------------------------------------------
@@ -261,4 +262,122 @@ class test_Math: XCTestCase {
     // XCTAssert(g == [2, -4, 6])
     // #endif
   }
+
+  //--------------------------------------------------------------------------
+  // test_vectorMath
+  // compares the vector kernels with the scalar functions
+  func test_vectorMath() {
+    func gelu(_ x: Double) -> Double { x / 2 * Foundation.erfc(-x / 2.0.squareRoot()) }
+    func sigmoid(_ x: Double) -> Double { 1 / (1 + Foundation.exp(-x)) }
+
+    typealias Function = (
+      name: String, range: ClosedRange<Double>, ulps: Double,
+      double: (SIMD8<Double>) -> SIMD8<Double>,
+      float: (SIMD16<Float>) -> SIMD16<Float>,
+      scalar: (Double) -> Double)
+
+    let functions: [Function] = [
+      ("exp", -700...700, 1, VectorMath.exp, VectorMath.exp, Foundation.exp),
+      ("log", 1e-300...1e300, 1, VectorMath.log, VectorMath.log, Foundation.log),
+      ("tanh", -20...20, 3, VectorMath.tanh, VectorMath.tanh, Foundation.tanh),
+      ("sigmoid", -700...700, 2, VectorMath.sigmoid, VectorMath.sigmoid, sigmoid),
+      ("erf", -6...6, 2, VectorMath.erf, VectorMath.erf, Foundation.erf),
+      ("gelu", -30...30, 5, VectorMath.gelu, VectorMath.gelu, gelu),
+    ]
+
+    // the scalar functions are not exact, so allow them 1 ulp
+    func ulps<T: BinaryFloatingPoint>(_ a: T, _ b: T) -> T {
+      a == b ? 0 : abs(a - b) / Swift.max(b.ulp, T.leastNormalMagnitude.ulp)
+    }
+
+    for f in functions {
+      let isLog = f.name == "log"
+      // a fixed seed makes a failure reproducible
+      var generator = PhiloxRandomNumberGenerator(uint64Seed: 0x5eed)
+      for _ in 0..<1000 {
+        var x = SIMD8<Double>()
+        for i in 0..<x.scalarCount {
+          x[i] = isLog
+            ? Foundation.exp(Double.random(in: Foundation.log(f.range.lowerBound)...Foundation.log(f.range.upperBound), using: &generator))
+            : Double.random(in: f.range, using: &generator)
+        }
+        let r = f.double(x)
+        for i in 0..<x.scalarCount {
+          let expected = f.scalar(x[i])
+          // gelu of large negative values is subnormal
+          guard expected.isNormal || expected == 0 else { continue }
+          XCTAssert(
+            ulps(r[i], expected) <= f.ulps + 1,
+            "\(f.name)(\(x[i])) = \(r[i]) expected \(expected)")
+        }
+
+        let xf = SIMD16<Float>(
+          lowHalf: SIMD8<Float>(x), highHalf: SIMD8<Float>(x / 2))
+        let rf = f.float(xf)
+        for i in 0..<xf.scalarCount {
+          let expected = Float(f.scalar(Double(xf[i])))
+          guard expected.isFinite && (expected.isNormal || expected == 0)
+          else { continue }
+          XCTAssert(
+            ulps(rf[i], expected) <= 1,
+            "\(f.name)(\(xf[i])) = \(rf[i]) expected \(expected)")
+        }
+      }
+    }
+
+    // the sine and cosine of whole turns
+    var generator = PhiloxRandomNumberGenerator(uint64Seed: 0x5eed)
+    for _ in 0..<1000 {
+      var x = SIMD8<Double>()
+      for i in 0..<x.scalarCount { x[i] = Double.random(in: -4...4, using: &generator) }
+      let (sin, cos) = VectorMath.sinCos(turns: x)
+      for i in 0..<x.scalarCount {
+        XCTAssert(abs(sin[i] - Foundation.sin(2 * .pi * x[i])) < 1e-14)
+        XCTAssert(abs(cos[i] - Foundation.cos(2 * .pi * x[i])) < 1e-14)
+      }
+    }
+    let quarters = VectorMath.sinCos(
+      turns: SIMD8<Double>(0, 0.25, 0.5, 0.75, 1, -0.25, -0.5, -0.75))
+    XCTAssert(quarters.sin == SIMD8<Double>(0, 1, 0, -1, 0, -1, 0, 1))
+    XCTAssert(quarters.cos == SIMD8<Double>(1, 0, -1, 0, 1, 0, -1, 0))
+
+    // special values
+    let special = SIMD8<Double>(0, -0.0, .infinity, -.infinity, .nan, 1, -1, 1e-310)
+    let e = VectorMath.exp(special)
+    XCTAssert(e[0] == 1 && e[2] == .infinity && e[3] == 0 && e[4].isNaN)
+    let l = VectorMath.log(special)
+    XCTAssert(l[0] == -.infinity && l[2] == .infinity && l[3].isNaN)
+    XCTAssert(l[5] == 0 && l[6].isNaN)
+    XCTAssert(ulps(l[7], Foundation.log(1e-310)) <= 1)
+    let t = VectorMath.tanh(special)
+    XCTAssert(t[1] == 0 && t[1].sign == .minus && t[2] == 1 && t[3] == -1)
+    let r = VectorMath.erf(special)
+    XCTAssert(r[1].sign == .minus && r[2] == 1 && r[3] == -1 && r[4].isNaN)
+    let g = VectorMath.gelu(special)
+    XCTAssert(g[0] == 0 && g[2] == .infinity && g[3] == 0 && g[4].isNaN)
+
+    // the Float lane exp and log
+    let specialFloat = SIMD16<Float>(
+      lowHalf: SIMD8<Float>(0, -0.0, .infinity, -.infinity, .nan, 1, -1, 1e-40),
+      highHalf: SIMD8<Float>(repeating: 100))
+    let ef = VectorMath.exp(specialFloat)
+    XCTAssert(ef[0] == 1 && ef[2] == .infinity && ef[3] == 0 && ef[4].isNaN)
+    XCTAssert(ef[8] == .infinity)
+    let lf = VectorMath.log(specialFloat)
+    XCTAssert(lf[0] == -.infinity && lf[2] == .infinity && lf[3].isNaN)
+    XCTAssert(lf[5] == 0 && lf[6].isNaN)
+    XCTAssert(ulps(lf[7], Float(Foundation.log(Double(Float(1e-40))))) <= 1)
+
+    // the tensor functions agree with and without the vector kernels
+    let a = array((0..<1000).map { Float($0 - 500) / 50 })
+    let vector = [exp(a), tanh(a), sigmoid(a), erf(a), gelu(a)]
+    useVectorMath = false
+    let scalar = [exp(a), tanh(a), sigmoid(a), erf(a), gelu(a)]
+    useVectorMath = true
+    for (v, s) in zip(vector, scalar) {
+      for (x, y) in zip(v.flatArray, s.flatArray) {
+        XCTAssert(ulps(x, y) <= 2, "\(x) expected \(y)")
+      }
+    }
+  }
 }
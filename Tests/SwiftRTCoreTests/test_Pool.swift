@@ -35,6 +35,7 @@ class test_Pool: XCTestCase {
     ("test_poolBatchAverage3D", test_poolBatchAverage3D),
     ("test_poolAveragePadding", test_poolAveragePadding),
     ("test_poolMax", test_poolMax),
+    ("test_poolBackwardNHWC", test_poolBackwardNHWC),
 
     // vector tests
     // ("test_pool1DPixelAverage", test_pool1DPixelAverage),
@@ -234,11 +235,9 @@ class test_Pool: XCTestCase {
 
   //--------------------------------------------------------------------------
   func test_poolAverage1D() {
-    #if canImport(SwiftRTCuda)
-      let a = array(0..<6)
-      let avg = pool(x: a, windowSize: 3, padding: 1, op: .average)
-      XCTAssert(avg == [0.5, 1.0, 2.0, 3.0, 4.0, 4.5])
-    #endif
+    let a = array(0..<6)
+    let avg = pool(x: a, windowSize: 3, padding: 1, op: .average)
+    XCTAssert(avg == [0.5, 1.0, 2.0, 3.0, 4.0, 4.5])
   }
 
   //--------------------------------------------------------------------------
@@ -257,88 +256,86 @@ class test_Pool: XCTestCase {
 
   //--------------------------------------------------------------------------
   func test_poolAverage3D() {
-    #if canImport(SwiftRTCuda)
-      let a = array(0..<27, shape: (3, 3, 3))
-      let avgrow = pool(x: a, windowSize: (1, 1, 3), padding: (0, 0, 1), op: .average)
-      XCTAssert(
-        avgrow == [
-          [
-            [0.5, 1.0, 1.5],
-            [3.5, 4.0, 4.5],
-            [6.5, 7.0, 7.5],
-          ],
-          [
-            [9.5, 10.0, 10.5],
-            [12.5, 13.0, 13.5],
-            [15.5, 16.0, 16.5],
-          ],
-          [
-            [18.5, 19.0, 19.5],
-            [21.5, 22.0, 22.5],
-            [24.5, 25.0, 25.5],
-          ],
-        ])
+    let a = array(0..<27, shape: (3, 3, 3))
+    let avgrow = pool(x: a, windowSize: (1, 1, 3), padding: (0, 0, 1), op: .average)
+    XCTAssert(
+      avgrow == [
+        [
+          [0.5, 1.0, 1.5],
+          [3.5, 4.0, 4.5],
+          [6.5, 7.0, 7.5],
+        ],
+        [
+          [9.5, 10.0, 10.5],
+          [12.5, 13.0, 13.5],
+          [15.5, 16.0, 16.5],
+        ],
+        [
+          [18.5, 19.0, 19.5],
+          [21.5, 22.0, 22.5],
+          [24.5, 25.0, 25.5],
+        ],
+      ])
 
-      let avgcol = pool(x: a, windowSize: (1, 3, 1), padding: (0, 1, 0), op: .average)
-      XCTAssert(
-        avgcol == [
-          [
-            [1.5, 2.5, 3.5],
-            [3.0, 4.0, 5.0],
-            [4.5, 5.5, 6.5],
-          ],
-          [
-            [10.5, 11.5, 12.5],
-            [12.0, 13.0, 14.0],
-            [13.5, 14.5, 15.5],
-          ],
-          [
-            [19.5, 20.5, 21.5],
-            [21.0, 22.0, 23.0],
-            [22.5, 23.5, 24.5],
-          ],
-        ])
+    let avgcol = pool(x: a, windowSize: (1, 3, 1), padding: (0, 1, 0), op: .average)
+    XCTAssert(
+      avgcol == [
+        [
+          [1.5, 2.5, 3.5],
+          [3.0, 4.0, 5.0],
+          [4.5, 5.5, 6.5],
+        ],
+        [
+          [10.5, 11.5, 12.5],
+          [12.0, 13.0, 14.0],
+          [13.5, 14.5, 15.5],
+        ],
+        [
+          [19.5, 20.5, 21.5],
+          [21.0, 22.0, 23.0],
+          [22.5, 23.5, 24.5],
+        ],
+      ])
 
-      let avgdepth = pool(x: a, windowSize: (1, 3, 3), padding: (0, 1, 1), op: .average)
-      XCTAssert(
-        avgdepth == [
-          [
-            [2.0, 2.5, 3.0],
-            [3.5, 4.0, 4.5],
-            [5.0, 5.5, 6.0],
-          ],
-          [
-            [11.0, 11.5, 12.0],
-            [12.5, 13.0, 13.5],
-            [14.0, 14.5, 15.0],
-          ],
-          [
-            [20.0, 20.5, 21.0],
-            [21.5, 22.0, 22.5],
-            [23.0, 23.5, 24.0],
-          ],
-        ])
+    let avgdepth = pool(x: a, windowSize: (1, 3, 3), padding: (0, 1, 1), op: .average)
+    XCTAssert(
+      avgdepth == [
+        [
+          [2.0, 2.5, 3.0],
+          [3.5, 4.0, 4.5],
+          [5.0, 5.5, 6.0],
+        ],
+        [
+          [11.0, 11.5, 12.0],
+          [12.5, 13.0, 13.5],
+          [14.0, 14.5, 15.0],
+        ],
+        [
+          [20.0, 20.5, 21.0],
+          [21.5, 22.0, 22.5],
+          [23.0, 23.5, 24.0],
+        ],
+      ])
 
-      let avgvolume = pool(x: a, windowSize: 3, padding: 1, op: .average)
-      XCTAssert(
-        avgvolume == [
-          [
-            [6.5, 7.0, 7.5],
-            [8.0, 8.5, 9.0],
-            [9.5, 10.0, 10.5],
-          ],
-          [
-            [11.0, 11.5, 12.0],
-            [12.5, 13.0, 13.5],
-            [14.0, 14.5, 15.0],
-          ],
-          [
-            [15.5, 16.0, 16.5],
-            [17.0, 17.5, 18.0],
-            [18.5, 19.0, 19.5],
-          ],
-        ])
-    #endif
+    let avgvolume = pool(x: a, windowSize: 3, padding: 1, op: .average)
+    XCTAssert(
+      avgvolume == [
+        [
+          [6.5, 7.0, 7.5],
+          [8.0, 8.5, 9.0],
+          [9.5, 10.0, 10.5],
+        ],
+        [
+          [11.0, 11.5, 12.0],
+          [12.5, 13.0, 13.5],
+          [14.0, 14.5, 15.0],
+        ],
+        [
+          [15.5, 16.0, 16.5],
+          [17.0, 17.5, 18.0],
+          [18.5, 19.0, 19.5],
+        ],
+      ])
   }
 
   //--------------------------------------------------------------------------
@@ -388,179 +385,116 @@ class test_Pool: XCTestCase {
 
   //--------------------------------------------------------------------------
   func test_poolAverage2D() {
-    #if canImport(SwiftRTCuda)
-      // average rows
-      do {
-        let a = array(0..<9, shape: (3, 3))
-        let avg = pool(x: a, windowSize: (1, 3), padding: (0, 1), op: .average)
-        XCTAssert(avg.shape == a.shape)
-        XCTAssert(
-          avg == [
-            [0.5, 1.0, 1.5],
-            [3.5, 4.0, 4.5],
-            [6.5, 7.0, 7.5],
-          ])
-      }
-
-      // average cols
-      do {
-        let a = array(0..<9, shape: (3, 3))
-        let avg = pool(x: a, windowSize: (3, 1), padding: (1, 0), op: .average)
-        XCTAssert(avg.shape == a.shape)
-        XCTAssert(
-          avg == [
-            [1.5, 2.5, 3.5],
-            [3.0, 4.0, 5.0],
-            [4.5, 5.5, 6.5],
-          ])
-      }
-
-      do {
-        let a = array([
-          [0, 1, 2],
-          [3, 4, 5],
-          [6, 7, 8],
+    // average rows
+    do {
+      let a = array(0..<9, shape: (3, 3))
+      let avg = pool(x: a, windowSize: (1, 3), padding: (0, 1), op: .average)
+      XCTAssert(avg.shape == a.shape)
+      XCTAssert(
+        avg == [
+          [0.5, 1.0, 1.5],
+          [3.5, 4.0, 4.5],
+          [6.5, 7.0, 7.5],
         ])
+    }
 
-        // same
-        let same = pool(x: a, windowSize: 3, padding: 1, op: .average)
-        XCTAssert(a.shape == same.shape)
-        XCTAssert(
-          same == [
-            [2.0, 2.5, 3.0],
-            [3.5, 4.0, 4.5],
-            [5.0, 5.5, 6.0],
-          ])
-
-        // default is strides 1 padding 0
-        let valid = pool(x: a, windowSize: 3, op: .average)
-        XCTAssert(valid == [[4.0]])
-
-        // using a configuration
-        let config = PoolingConfig(x: a, windowSize: Shape2(3, 3), op: .average)
-        var out = Tensor2(shape: config.shape, order: a.order)
-        currentQueue.pool(config, a, &out)
-        XCTAssert(out == [[4.0]])
-      }
-
-      do {
-        let a = array(0..<25, shape: (5, 5))
-
-        // same
-        let same = pool(x: a, windowSize: 5, padding: 2, op: .average)
-        XCTAssert(a.shape == same.shape)
-        let expsame = array([
-          [6.0, 6.5, 7.0, 7.5, 8.0],
-          [8.5, 9.0, 9.5, 10.0, 10.5],
-          [11.0, 11.5, 12.0, 12.5, 13.0],
-          [13.5, 14.0, 14.5, 15.0, 15.5],
-          [16.0, 16.5, 17.0, 17.5, 18.0],
+    // average cols
+    do {
+      let a = array(0..<9, shape: (3, 3))
+      let avg = pool(x: a, windowSize: (3, 1), padding: (1, 0), op: .average)
+      XCTAssert(avg.shape == a.shape)
+      XCTAssert(
+        avg == [
+          [1.5, 2.5, 3.5],
+          [3.0, 4.0, 5.0],
+          [4.5, 5.5, 6.5],
         ])
-        XCTAssert(almostEqual(same, expsame, tolerance: 0.001))
-
-        // valid
-        let valid = pool(x: a, windowSize: 5, op: .average)
-        XCTAssert(valid == [[12.0]])
-
-        // using a configuration
-        let config = PoolingConfig(x: a, windowSize: 5, op: .average)
-        var out = Tensor2(shape: config.shape, order: a.order)
-        currentQueue.pool(config, a, &out)
-        XCTAssert(out == [[12.0]])
-      }
-    #endif
+    }
+
+    do {
+      let a = array([
+        [0, 1, 2],
+        [3, 4, 5],
+        [6, 7, 8],
+      ])
+
+      // same
+      let same = pool(x: a, windowSize: 3, padding: 1, op: .average)
+      XCTAssert(a.shape == same.shape)
+      XCTAssert(
+        same == [
+          [2.0, 2.5, 3.0],
+          [3.5, 4.0, 4.5],
+          [5.0, 5.5, 6.0],
+        ])
+
+      // default is strides 1 padding 0
+      let valid = pool(x: a, windowSize: 3, op: .average)
+      XCTAssert(valid == [[4.0]])
+
+      // using a configuration
+      let config = PoolingConfig(x: a, windowSize: Shape2(3, 3), op: .average)
+      var out = Tensor2(shape: config.shape, order: a.order)
+      currentQueue.pool(config, a, &out)
+      XCTAssert(out == [[4.0]])
+    }
+
+    do {
+      let a = array(0..<25, shape: (5, 5))
+
+      // same
+      let same = pool(x: a, windowSize: 5, padding: 2, op: .average)
+      XCTAssert(a.shape == same.shape)
+      let expsame = array([
+        [6.0, 6.5, 7.0, 7.5, 8.0],
+        [8.5, 9.0, 9.5, 10.0, 10.5],
+        [11.0, 11.5, 12.0, 12.5, 13.0],
+        [13.5, 14.0, 14.5, 15.0, 15.5],
+        [16.0, 16.5, 17.0, 17.5, 18.0],
+      ])
+      XCTAssert(almostEqual(same, expsame, tolerance: 0.001))
+
+      // valid
+      let valid = pool(x: a, windowSize: 5, op: .average)
+      XCTAssert(valid == [[12.0]])
+
+      // using a configuration
+      let config = PoolingConfig(x: a, windowSize: 5, op: .average)
+      var out = Tensor2(shape: config.shape, order: a.order)
+      currentQueue.pool(config, a, &out)
+      XCTAssert(out == [[12.0]])
+    }
   }
 
   //--------------------------------------------------------------------------
   func test_poolAveragePadding() {
-    #if canImport(SwiftRTCuda)
-      // 3D
-      do {
-        let a = ones(shape: (3, 3, 3))
-        let avg = pool(x: a, windowSize: 3, padding: 1, op: .averagePadding)
-        let expavg = array(
+    // 3D
+    do {
+      let a = ones(shape: (3, 3, 3))
+      let avg = pool(x: a, windowSize: 3, padding: 1, op: .averagePadding)
+      let expavg = array(
+        [
           [
-            [
-              [0.2962963, 0.44444445, 0.2962963],
-              [0.44444445, 0.6666667, 0.44444445],
-              [0.2962963, 0.44444445, 0.2962963],
-            ],
-            [
-              [0.44444445, 0.6666667, 0.44444445],
-              [0.6666667, 1.0, 0.6666667],
-              [0.44444445, 0.6666667, 0.44444445],
-            ],
-            [
-              [0.2962963, 0.44444445, 0.2962963],
-              [0.44444445, 0.6666667, 0.44444445],
-              [0.2962963, 0.44444445, 0.2962963],
-            ],
-          ])
-        XCTAssert(almostEqual(avg, expavg, tolerance: 0.001))
-      }
-
-      // 2D
-      do {
-        let a = array([
-          [0, 1, 2],
-          [3, 4, 5],
-          [6, 7, 8],
-        ])
-
-        // same
-        let same = pool(x: a, windowSize: 3, padding: 1, op: .averagePadding)
-        XCTAssert(a.shape == same.shape)
-        XCTAssert(
-          almostEqual(
-            same,
-            array([
-              [0.8888889, 1.6666666, 1.3333334],
-              [2.3333333, 4.0, 3.0],
-              [2.2222223, 3.6666667, 2.6666667],
-            ]),
-            tolerance: 0.001))
-
-        // valid
-        let valid = pool(x: a, windowSize: 3, op: .averagePadding)
-        XCTAssert(valid == [[4.0]])
-
-        // using a configuration
-        let config = PoolingConfig(x: a, windowSize: 3, op: .averagePadding)
-        var out = Tensor2(shape: config.shape, order: a.order)
-        currentQueue.pool(config, a, &out)
-        XCTAssert(out == [[4.0]])
-      }
-
-      do {
-        let a = array(0..<25, shape: (5, 5))
-
-        // same
-        let same = pool(x: a, windowSize: 5, padding: 2, op: .averagePadding)
-        let expsame = array([
-          [2.1599998, 3.12, 4.2, 3.6, 2.8799999],
-          [4.08, 5.7599998, 7.6, 6.3999996, 5.04],
-          [6.6, 9.2, 12.0, 10.0, 7.7999997],
-          [6.48, 8.96, 11.599999, 9.599999, 7.44],
-          [5.7599998, 7.9199996, 10.2, 8.4, 6.48],
+            [0.2962963, 0.44444445, 0.2962963],
+            [0.44444445, 0.6666667, 0.44444445],
+            [0.2962963, 0.44444445, 0.2962963],
+          ],
+          [
+            [0.44444445, 0.6666667, 0.44444445],
+            [0.6666667, 1.0, 0.6666667],
+            [0.44444445, 0.6666667, 0.44444445],
+          ],
+          [
+            [0.2962963, 0.44444445, 0.2962963],
+            [0.44444445, 0.6666667, 0.44444445],
+            [0.2962963, 0.44444445, 0.2962963],
+          ],
         ])
-        XCTAssert(almostEqual(same, expsame, tolerance: 0.001))
-
-        // valid
-        let valid = pool(x: a, windowSize: 5, op: .averagePadding)
-        XCTAssert(valid == [[12.0]])
-
-        // using a configuration
-        let config = PoolingConfig(x: a, windowSize: 5, op: .averagePadding)
-        var out = Tensor2(shape: config.shape, order: a.order)
-        currentQueue.pool(config, a, &out)
-        XCTAssert(out == [[12.0]])
-      }
-    #endif
-  }
+      XCTAssert(almostEqual(avg, expavg, tolerance: 0.001))
+    }
 
-  //--------------------------------------------------------------------------
-  func test_poolMax() {
-    #if canImport(SwiftRTCuda)
+    // 2D
+    do {
       let a = array([
         [0, 1, 2],
         [3, 4, 5],
@@ -568,18 +502,100 @@ class test_Pool: XCTestCase {
       ])
 
       // same
-      let same = pool(x: a, windowSize: 3, padding: 1, op: .max)
+      let same = pool(x: a, windowSize: 3, padding: 1, op: .averagePadding)
       XCTAssert(a.shape == same.shape)
       XCTAssert(
-        same == [
-          [4.0, 5.0, 5.0],
-          [7.0, 8.0, 8.0],
-          [7.0, 8.0, 8.0],
-        ])
+        almostEqual(
+          same,
+          array([
+            [0.8888889, 1.6666666, 1.3333334],
+            [2.3333333, 4.0, 3.0],
+            [2.2222223, 3.6666667, 2.6666667],
+          ]),
+          tolerance: 0.001))
 
       // valid
-      let valid = pool(x: a, windowSize: 3, op: .max)
-      XCTAssert(valid == [[8.0]])
-    #endif
+      let valid = pool(x: a, windowSize: 3, op: .averagePadding)
+      XCTAssert(valid == [[4.0]])
+
+      // using a configuration
+      let config = PoolingConfig(x: a, windowSize: 3, op: .averagePadding)
+      var out = Tensor2(shape: config.shape, order: a.order)
+      currentQueue.pool(config, a, &out)
+      XCTAssert(out == [[4.0]])
+    }
+
+    do {
+      let a = array(0..<25, shape: (5, 5))
+
+      // same
+      let same = pool(x: a, windowSize: 5, padding: 2, op: .averagePadding)
+      let expsame = array([
+        [2.1599998, 3.12, 4.2, 3.6, 2.8799999],
+        [4.08, 5.7599998, 7.6, 6.3999996, 5.04],
+        [6.6, 9.2, 12.0, 10.0, 7.7999997],
+        [6.48, 8.96, 11.599999, 9.599999, 7.44],
+        [5.7599998, 7.9199996, 10.2, 8.4, 6.48],
+      ])
+      XCTAssert(almostEqual(same, expsame, tolerance: 0.001))
+
+      // valid
+      let valid = pool(x: a, windowSize: 5, op: .averagePadding)
+      XCTAssert(valid == [[12.0]])
+
+      // using a configuration
+      let config = PoolingConfig(x: a, windowSize: 5, op: .averagePadding)
+      var out = Tensor2(shape: config.shape, order: a.order)
+      currentQueue.pool(config, a, &out)
+      XCTAssert(out == [[12.0]])
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  func test_poolMax() {
+    let a = array([
+      [0, 1, 2],
+      [3, 4, 5],
+      [6, 7, 8],
+    ])
+
+    // same
+    let same = pool(x: a, windowSize: 3, padding: 1, op: .max)
+    XCTAssert(a.shape == same.shape)
+    XCTAssert(
+      same == [
+        [4.0, 5.0, 5.0],
+        [7.0, 8.0, 8.0],
+        [7.0, 8.0, 8.0],
+      ])
+
+    // valid
+    let valid = pool(x: a, windowSize: 3, op: .max)
+    XCTAssert(valid == [[8.0]])
+  }
+
+  //--------------------------------------------------------------------------
+  func test_poolBackwardNHWC() {
+    let x = array(0..<32, shape: (1, 4, 4, 2))
+    let window = Shape4(1, 2, 2, 1)
+
+    // max records the input index of each maximum for the backward pass
+    let maxConfig = PoolingConfig(x: x, windowSize: window, strides: window, op: .max)
+    var y = Tensor4(shape: maxConfig.shape, order: x.order)
+    currentQueue.pool(maxConfig, x, &y)
+    XCTAssert(y.shape == Shape4(1, 2, 2, 2))
+    XCTAssert(y.flatArray == [10, 11, 14, 15, 26, 27, 30, 31])
+
+    var dx = Tensor4(like: x)
+    currentQueue.poolBackward(maxConfig, x, y, ones(like: y), &dx)
+    let expected = (0..<32).map { [10, 11, 14, 15, 26, 27, 30, 31].contains($0) ? 1 : 0 }
+    XCTAssert(dx.flatArray == expected.map { Float($0) })
+
+    // average spreads the gradient evenly over each window
+    let avgConfig = PoolingConfig(x: x, windowSize: window, strides: window, op: .average)
+    currentQueue.pool(avgConfig, x, &y)
+    XCTAssert(y.flatArray == [5, 6, 9, 10, 21, 22, 25, 26])
+    currentQueue.poolBackward(avgConfig, x, y, ones(like: y), &dx)
+    XCTAssert(dx.flatArray == [Float](repeating: 0.25, count: 32))
   }
 }
@@ -25,6 +25,8 @@ class test_Random: XCTestCase {
     ("test_randomUniform", test_randomUniform),
     ("test_randomNormal", test_randomNormal),
     ("test_randomTruncatedNormal", test_randomTruncatedNormal),
+    ("test_philoxCounter", test_philoxCounter),
+    ("test_parallelFill", test_parallelFill),
   ]
 
   //--------------------------------------------------------------------------
@@ -53,4 +55,56 @@ class test_Random: XCTestCase {
     let _ = Tensor1(randomTruncatedNormal: 100)
     //        print(v.array)
   }
+
+  //--------------------------------------------------------------------------
+  // the counter based blocks match the sequential generator
+  func test_philoxCounter() {
+    let seed: RandomSeed = (graph: 7, op: 42)
+    let philox = Philox4x32(seed: seed)
+    var generator = PhiloxRandomNumberGenerator(
+      uint64Seed: UInt64(msb: UInt32(bitPattern: seed.op),
+                         lsb: UInt32(bitPattern: seed.graph)))
+    for counter in 0..<8 {
+      let block = philox.block(UInt64(counter))
+      XCTAssert(generator.next() == UInt64(block[0]) << 32 | UInt64(block[1]))
+      XCTAssert(generator.next() == UInt64(block[2]) << 32 | UInt64(block[3]))
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // a parallel fill produces each element from its own counter
+  func test_parallelFill() {
+    let seed: RandomSeed = (graph: 1, op: 2)
+    let philox = Philox4x32(seed: seed)
+    let count = 1 << 20
+
+    let u = Tensor1(randomUniform: count, lower: -1, upper: 1, seed: seed)
+    let expected: SIMD4<Float> = philox.uniform(12345) * 2 - 1
+    for i in 0..<4 { XCTAssert(u[12345 * 4 + i] == expected[i]) }
+    XCTAssert(u.min().element > -1 && u.max().element < 1)
+
+    let n = Tensor1(randomNormal: count, seed: seed)
+    let normal: SIMD4<Float> = philox.normal(12345)
+    for i in 0..<4 { XCTAssert(n[12345 * 4 + i] == normal[i]) }
+    XCTAssert(abs(n.mean().element) < 0.01)
+    XCTAssert(abs(sqrt(squared(n).mean().element) - 1) < 0.01)
+
+    let t = Tensor1(randomTruncatedNormal: count, mean: 1, std: 0.5, seed: seed)
+    XCTAssert(t.min().element >= 0 && t.max().element <= 2)
+
+    // the vector blocks equal the values of each counter
+    for counter in stride(from: UInt64(0), to: 64, by: 4) {
+      let block: SIMD16<Double> = philox.normals(counter)
+      let truncated: SIMD16<Double> = philox.truncatedNormals(counter)
+      for j in 0..<4 {
+        let z: SIMD4<Double> = philox.normal(counter + UInt64(j))
+        let tz: SIMD4<Double> = philox.truncatedNormal(counter + UInt64(j))
+        for i in 0..<4 {
+          XCTAssert(block[4 * j + i] == z[i])
+          XCTAssert(truncated[4 * j + i] == tz[i])
+          XCTAssert(abs(tz[i]) <= 2)
+        }
+      }
+    }
+  }
 }
@@ -30,10 +30,14 @@ class test_Reductions: XCTestCase {
     ("test_reduceAxis2D", test_reduceAxis2D),
     ("test_reduceAxis3D", test_reduceAxis3D),
     ("test_gather", test_gather),
+    ("test_gatherRows", test_gatherRows),
+    ("test_scatterAdd", test_scatterAdd),
     ("test_abssum", test_abssum),
     ("test_sumTensor1", test_sumTensor1),
     ("test_sumTensor2", test_sumTensor2),
     ("test_sumTensor3AlongAxes", test_sumTensor3AlongAxes),
+    ("test_sumStrided", test_sumStrided),
+    ("test_reproducibleSum", test_reproducibleSum),
     ("test_minTensor3AlongAxes", test_minTensor3AlongAxes),
     ("test_maxTensor3AlongAxes", test_maxTensor3AlongAxes),
     ("test_all", test_all),
@@ -209,6 +213,130 @@ class test_Reductions: XCTestCase {
     //   ])
     // #endif
   }
+
+  //--------------------------------------------------------------------------
+  // test_gatherRows
+  // rows are copied for each axis, with repeated indices and enough of
+  // them to split across threads, and views take the slice copy path
+  func test_gatherRows() {
+    let (d0, d1, d2) = (4, 300, 5)
+    let values = (0..<(d0 * d1 * d2)).map { Float($0) }
+    let a = array(values, shape: (d0, d1, d2))
+    func value(_ i: Int, _ j: Int, _ k: Int) -> Float {
+      values[(i * d1 + j) * d2 + k]
+    }
+
+    // axis 0
+    let i0: [DeviceIndex] = (0..<2000).map { DeviceIndex(($0 * 7) % d0) }
+    let g0 = gather(from: a, indices: array(i0))
+    XCTAssertEqual(g0.shape, Shape3(i0.count, d1, d2))
+    XCTAssertEqual(g0[1999, 17, 3], value(Int(i0[1999]), 17, 3))
+    XCTAssertEqual(g0[5, 299, 4], value(Int(i0[5]), 299, 4))
+
+    // a middle axis
+    let i1: [DeviceIndex] = [299, 0, 150, 150, 7]
+    let g1 = gather(from: a, indices: array(i1), axis: 1)
+    XCTAssertEqual(g1.shape, Shape3(d0, i1.count, d2))
+    for i in 0..<d0 {
+      for (j, index) in i1.enumerated() {
+        for k in 0..<d2 {
+          XCTAssertEqual(g1[i, j, k], value(i, Int(index), k))
+        }
+      }
+    }
+
+    // the last axis is a strided copy
+    let i2: [DeviceIndex] = [4, 0, 4]
+    let g2 = gather(from: a, indices: array(i2), axis: -1)
+    XCTAssertEqual(g2.shape, Shape3(d0, d1, i2.count))
+    XCTAssertEqual(g2[3, 200, 0], value(3, 200, 4))
+    XCTAssertEqual(g2[3, 200, 1], value(3, 200, 0))
+
+    // a strided view
+    let view = a[1..<4, 10..<20, 0..<5]
+    let g3 = gather(from: view, indices: array([2, 0] as [DeviceIndex]))
+    XCTAssertEqual(g3[0, 3, 2], value(3, 13, 2))
+    XCTAssertEqual(g3[1, 9, 4], value(1, 19, 4))
+
+    // a transposed view is contiguous, but its rows are columns of
+    // the storage
+    let m = array(0..<12, shape: (3, 4))
+    let g4 = gather(from: m.t, indices: array([3, 0] as [DeviceIndex]))
+    XCTAssert(g4 == [[3, 7, 11], [0, 4, 8]])
+  }
+
+  //--------------------------------------------------------------------------
+  // test_scatterAdd
+  // repeated indices accumulate, enough updates are added to split across
+  // threads, and the sparse sum matches the dense one
+  func test_scatterAdd() {
+    // axis 0 with repeated indices
+    let a = array([
+      [1, 2],
+      [3, 4],
+      [5, 6],
+      [7, 8],
+    ])
+    let indices = array([2, 0, 2, 2] as [DeviceIndex])
+    let s0 = scatterAdd(a, indices: indices, shape: Shape2(3, 2))
+    XCTAssert(s0.flatArray == [3, 4, 0, 0, 13, 16])
+
+    // into an existing tensor along the last axis
+    var t = array([
+      [1, 1, 1],
+      [1, 1, 1],
+    ])
+    let b = array([
+      [1, 2],
+      [3, 4],
+    ])
+    scatterAdd(b, indices: array([1, 1] as [DeviceIndex]), axis: 1, into: &t)
+    XCTAssert(t.flatArray == [1, 4, 1, 1, 8, 1])
+
+    // many updates into a few rows
+    let (rows, cols, count) = (7, 33, 5000)
+    let i1: [DeviceIndex] = (0..<count).map { DeviceIndex(($0 * 5) % rows) }
+    let u = ones(shape: (count, cols))
+    let s1 = scatterAdd(u, indices: array(i1), shape: Shape2(rows, cols))
+    for row in 0..<rows {
+      let expected = Float(i1.filter { Int($0) == row }.count)
+      XCTAssertEqual(s1[row, 0], expected)
+      XCTAssertEqual(s1[row, cols - 1], expected)
+    }
+
+    // the sparse sum has a row for each distinct index
+    let sparse = segmentSum(a, indices: indices, rows: 3)
+    XCTAssert(sparse.indices.flatArray == [0, 2])
+    XCTAssert(sparse.rows.flatArray == [3, 4, 13, 16])
+    XCTAssert(sparse.dense.flatArray == s0.flatArray)
+
+    // a strided view takes the slice path
+    let view = a[0..<4, 1..<2]
+    let s2 = scatterAdd(view, indices: indices, shape: Shape2(3, 1))
+    XCTAssert(s2.flatArray == [4, 0, 16])
+
+    // transposed updates are contiguous, but aren't in row order
+    let m = array([
+      [1, 3],
+      [2, 4],
+    ])
+    let s3 = scatterAdd(
+      m.t, indices: array([1, 1] as [DeviceIndex]), shape: Shape2(3, 2))
+    XCTAssert(s3.flatArray == [0, 0, 4, 6, 0, 0])
+    let sparseT = segmentSum(
+      m.t, indices: array([2, 0] as [DeviceIndex]), rows: 3)
+    XCTAssert(sparseT.indices.flatArray == [0, 2])
+    XCTAssert(sparseT.rows.flatArray == [3, 4, 1, 2])
+
+    // the scaled rows are added to only their rows of a table
+    var table = array([
+      [1, 1],
+      [1, 1],
+      [1, 1],
+    ])
+    sparseT.add(to: &table, scale: 2)
+    XCTAssert(table.flatArray == [7, 9, 1, 1, 3, 5])
+  }
   
   //--------------------------------------------------------------------------
   // test_sumTensor1
@@ -219,6 +347,77 @@ class test_Reductions: XCTestCase {
     XCTAssert(result.element == 10)
   }
   
+  //--------------------------------------------------------------------------
+  // test_sumStrided
+  // views and column ordered tensors are reduced in place, and long
+  // reductions are split into partitions
+  func test_sumStrided() {
+    let a = array(0..<12, shape: (3, 4))
+    let view = a[..., 1..<3]
+    XCTAssert(view.sum(axis: 0) == [[15, 18]])
+    XCTAssert(view.sum(axis: 1) == [[3], [11], [19]])
+    XCTAssert(view.sum().element == 33)
+    XCTAssert(view.max(axis: 1) == [[2], [6], [10]])
+
+    let c = array([[0, 1, 2], [3, 4, 5]], order: .col)
+    XCTAssert(c.sum(axis: 0) == [[3, 5, 7]])
+    XCTAssert(c.sum(axis: 1) == [[3], [12]])
+    XCTAssert(c.mean().element == 2.5)
+
+    let long = ones(shape: (2, 300_000))
+    XCTAssert(long.sum().element == 600_000)
+    XCTAssert(long.sum(axis: 1) == [[300_000], [300_000]])
+  }
+
+  //--------------------------------------------------------------------------
+  // the reproducible modes associate by shape alone, and the
+  // compensated mode recovers the low order bits of small elements
+  func test_reproducibleSum() {
+    let count = 100_000
+    let values = (0..<count).map { Float(($0 % 7) + 1) / 10 }
+    let expected = values.reduce(0) { $0 + Double($1) }
+    let a = array(values, shape: (count))
+
+    using(reductionMode: .reproducible) {
+      let sum = a.sum().element
+      let rows = array(values, shape: (1, count)).sum(axis: 1).element
+      XCTAssert(sum == rows)
+      XCTAssert(abs(Double(sum) - expected) < 1)
+    }
+
+    using(reductionMode: .compensated) {
+      XCTAssert(abs(Double(a.sum().element) - expected) < 1e-2)
+      XCTAssert(abs(Double(a.mean().element) - expected / Double(count)) < 1e-6)
+
+      let m = array(0..<6, shape: (3, 2))
+      XCTAssert(m.sum(axis: 0) == [[6, 9]])
+      XCTAssert(m.sum(axis: 1) == [[1], [5], [9]])
+    }
+    XCTAssert(reductionMode == .fast)
+
+    // a mode passed to the call overrides the thread's mode
+    XCTAssert(a.sum(mode: .compensated).element
+      == using(reductionMode: .compensated) { a.sum().element })
+    XCTAssert(abs(Double(a.sum(mode: .compensated).element) - expected) < 1e-2)
+
+    // the mode selected by another thread doesn't change this thread's
+    let selected = DispatchSemaphore(value: 0)
+    let checked = DispatchSemaphore(value: 0)
+    var otherMode = ReductionMode.fast
+    Thread {
+      reductionMode = .compensated
+      selected.signal()
+      checked.wait()
+      otherMode = reductionMode
+      selected.signal()
+    }.start()
+    selected.wait()
+    XCTAssert(reductionMode == .fast)
+    checked.signal()
+    selected.wait()
+    XCTAssert(otherMode == .compensated)
+  }
+
   //--------------------------------------------------------------------------
   // test_sumTensor2
   func test_sumTensor2() {
@@ -32,8 +32,120 @@ class test_Convolution: XCTestCase {
   static var allTests = [
     ("test_Tensor2", test_Tensor2),
     ("test_Image", test_Image),
+    ("test_cpuForward", test_cpuForward),
+    ("test_cpuBackward", test_cpuBackward),
+    ("test_cpuWinograd", test_cpuWinograd),
   ]
 
+  //--------------------------------------------------------------------------
+  func test_cpuForward() {
+    typealias Conv = Convolution<Shape4, Float, Float>
+    let x = array(0..<9, shape: (1, 3, 3, 1))
+    let filter = array([1, 1, 1, 1, 2, 2, 2, 2], shape: (2, 2, 1, 2))
+    let bias = array([0, -30])
+
+    // the direct kernel is selected for small filters
+    let direct = Conv(filter: filter, bias: bias, activation: .relu)
+    let a = direct(x)
+    XCTAssert(a.shape == Shape4(1, 2, 2, 2))
+    XCTAssert(a.flatArray == [15, 0, 21, 0, 33, 3, 39, 9])
+
+    // forcing the im2col gemm algorithm must give the same result
+    var properties = ConvolutionProperties()
+    properties.forwardAlgorithm = .gemm
+    let gemm = Conv(filter: filter, bias: bias, activation: .relu,
+                    properties: properties)
+    XCTAssert(gemm(x).flatArray == a.flatArray)
+
+    // same padding keeps the spatial size, and an even filter extent
+    // is padded after the input
+    let same = Conv(filter: filter, padding: .same)
+    let s = same(x)
+    XCTAssert(s.shape == Shape4(1, 3, 3, 2))
+    XCTAssert(
+      s.flatArray == [
+        15, 15, 21, 21, 12, 12,
+        33, 33, 39, 39, 21, 21,
+        13, 13, 15, 15, 8, 8,
+      ])
+
+    // a stride of 2 gives ceil(3 / 2) outputs
+    let strided = Conv(filter: filter, strides: Shape4(repeating: 2),
+                       padding: .same)
+    XCTAssert(strided(x).shape == Shape4(1, 2, 2, 2))
+  }
+
+  //--------------------------------------------------------------------------
+  func test_cpuBackward() {
+    typealias Conv = Convolution<Shape4, Float, Float>
+    let x = array(0..<9, shape: (1, 3, 3, 1))
+    let filter = array([1, 1, 1, 1], shape: (2, 2, 1, 1))
+    let conv = Conv(filter: filter)
+    let y = conv(x)
+    let yDiff = ones(like: y)
+
+    var filterDiff = Tensor4(like: filter)
+    var biasDiff = conv.bias
+    var xDiff = Tensor4(like: x)
+    conv.convolutionOp.backward(
+      y: y, yDiff: yDiff,
+      filter: conv.filter, filterDiff: &filterDiff,
+      bias: conv.bias, biasDiff: &biasDiff,
+      x: x, xDiff: &xDiff, mode: .inferring)
+
+    // each filter tap sees the 2x2 window of inputs it is applied to
+    XCTAssert(filterDiff.flatArray == [8, 12, 20, 24])
+    XCTAssert(biasDiff.flatArray == [4])
+    // each input receives one gradient per output window covering it
+    XCTAssert(xDiff.flatArray == [1, 2, 1, 2, 4, 2, 1, 2, 1])
+  }
+
+  //--------------------------------------------------------------------------
+  func test_cpuWinograd() {
+    typealias Conv = Convolution<Shape4, Float, Float>
+    let filter = array(
+      (0..<54).map { Float($0) / 10 - 2 }, shape: (3, 3, 2, 3))
+    let bias = array([0.5, -0.5, 1])
+    var properties = ConvolutionProperties()
+    properties.forwardAlgorithm = .direct
+    let direct = Conv(filter: filter, bias: bias, padding: .same,
+                      properties: properties)
+    properties.forwardAlgorithm = .winograd
+    let winograd = Conv(filter: filter, bias: bias, padding: .same,
+                        properties: properties)
+
+    // a 6x6 output uses F(4x4, 3x3) with a partial edge tile,
+    // a 3x3 output uses F(2x2, 3x3)
+    for size in [6, 3] {
+      let count = size * size * 2
+      let x = array((0..<count).map { Float($0 % 7) - 3 },
+                    shape: (1, size, size, 2))
+      let expected = direct(x).flatArray
+      let y = winograd(x)
+      XCTAssert(y.shape == Shape4(1, size, size, 3))
+      XCTAssert(zip(y.flatArray, expected).allSatisfy { abs($0 - $1) < 1e-3 })
+    }
+
+    // the transformed filter is cached between calls
+    let x = array((0..<72).map { Float($0 % 5) }, shape: (1, 6, 6, 2))
+    XCTAssert(winograd(x).flatArray == winograd(x).flatArray)
+
+    // a filter updated in place replaces its cached transform
+    var updated = Conv(filter: filter, bias: bias, padding: .same,
+                       properties: properties)
+    var reference = direct
+    let op = updated.convolutionOp as! CpuConvolution<Shape4, Float, Float>
+    for step in 1...4 {
+      updated.filter[1, 1, 0, 0] = Float(step)
+      reference.filter[1, 1, 0, 0] = Float(step)
+      let expected = reference(x).flatArray
+      XCTAssert(zip(updated(x).flatArray, expected).allSatisfy {
+        abs($0 - $1) < 1e-3
+      })
+      XCTAssertEqual(op.winogradFilters.count, 1)
+    }
+  }
+
   //--------------------------------------------------------------------------
   func test_Tensor2() {
     //        log.level = .diagnostic